@@ -343,10 +343,9 @@ TopicType detect_topic(const char* input) {
 }
 
 // Convert number word to digit
+// Returns a string literal, so concurrent callers never share a buffer
 const char* number_word_to_digit(const char* word) {
-    static char digit[10];
-    
-    struct {
+    static const struct {
         const char* word;
         const char* digit;
     } conversions[] = {
@@ -361,8 +360,7 @@ const char* number_word_to_digit(const char* word) {
     
     for (int i = 0; conversions[i].word; i++) {
         if (strcasecmp(word, conversions[i].word) == 0) {
-            strcpy(digit, conversions[i].digit);
-            return digit;
+            return conversions[i].digit;
         }
     }
     
@@ -379,7 +377,8 @@ int extract_entities(const char* input, Entity* entities, int max_entities) {
     
     // Tokenize input
     char* input_copy = strdup(input);
-    char* token = strtok(input_copy, " \t\n,.!?;:");
+    char* save;
+    char* token = strtok_r(input_copy, " \t\n,.!?;:", &save);
     
     while (token && entity_count < max_entities) {
         strcpy(word, token);
@@ -448,7 +447,7 @@ int extract_entities(const char* input, Entity* entities, int max_entities) {
         }
         
         position++;
-        token = strtok(NULL, " \t\n,.!?;:");
+        token = strtok_r(NULL, " \t\n,.!?;:", &save);
     }
     
     free(input_copy);
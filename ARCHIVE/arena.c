@@ -0,0 +1,163 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+// All allocations are aligned for pointers and 64-bit fields
+#define ARENA_ALIGNMENT 8
+
+static size_t align_up(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+Arena* arena_create(size_t block_size) {
+    Arena* arena = calloc(1, sizeof(Arena));
+    if (!arena) return NULL;
+    
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+    return arena;
+}
+
+static void free_blocks(Arena* arena) {
+    ArenaBlock* block = arena->blocks;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    
+    arena->blocks = NULL;
+    arena->num_blocks = 0;
+    arena->bytes_reserved = 0;
+    arena->bytes_used = 0;
+    memset(arena->free_slabs, 0, sizeof(arena->free_slabs));
+}
+
+void arena_destroy(Arena* arena) {
+    if (!arena) return;
+    free_blocks(arena);
+    free(arena);
+}
+
+// Release everything allocated so far; the arena stays usable
+void arena_reset(Arena* arena) {
+    if (!arena) return;
+    free_blocks(arena);
+}
+
+// Move src's blocks into dst, leaving src empty. Everything allocated from
+// src stays valid and is now released with dst.
+void arena_adopt(Arena* dst, Arena* src) {
+    if (!src->blocks) return;
+    
+    ArenaBlock* tail = src->blocks;
+    while (tail->next) {
+        tail = tail->next;
+    }
+    
+    // Keep dst's current block first so its free space is still used
+    if (dst->blocks) {
+        tail->next = dst->blocks->next;
+        dst->blocks->next = src->blocks;
+    } else {
+        dst->blocks = src->blocks;
+    }
+    
+    dst->num_blocks += src->num_blocks;
+    dst->bytes_reserved += src->bytes_reserved;
+    dst->bytes_used += src->bytes_used;
+    
+    src->blocks = NULL;
+    src->num_blocks = 0;
+    src->bytes_reserved = 0;
+    src->bytes_used = 0;
+    memset(src->free_slabs, 0, sizeof(src->free_slabs));
+}
+
+static ArenaBlock* add_block(Arena* arena, size_t min_size) {
+    size_t size = arena->block_size;
+    if (size < min_size) size = min_size;
+    
+    ArenaBlock* block = malloc(sizeof(ArenaBlock) + size);
+    if (!block) return NULL;
+    
+    block->size = size;
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->num_blocks++;
+    arena->bytes_reserved += size;
+    return block;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size = align_up(size ? size : 1);
+    
+    ArenaBlock* block = arena->blocks;
+    if (!block || block->size - block->used < size) {
+        // Oversized requests get their own block behind the current one so
+        // the remaining space in the current block is not abandoned
+        if (block && size > arena->block_size / 4) {
+            ArenaBlock* big = malloc(sizeof(ArenaBlock) + size);
+            if (!big) return NULL;
+            big->size = size;
+            big->used = size;
+            big->next = block->next;
+            block->next = big;
+            arena->num_blocks++;
+            arena->bytes_reserved += size;
+            arena->bytes_used += size;
+            return big->data;
+        }
+        
+        block = add_block(arena, size);
+        if (!block) return NULL;
+    }
+    
+    void* ptr = block->data + block->used;
+    block->used += size;
+    arena->bytes_used += size;
+    return ptr;
+}
+
+void* arena_calloc(Arena* arena, size_t size) {
+    void* ptr = arena_alloc(arena, size);
+    if (ptr) memset(ptr, 0, size);
+    return ptr;
+}
+
+char* arena_strdup(Arena* arena, const char* str) {
+    size_t len = strlen(str) + 1;
+    char* copy = arena_alloc(arena, len);
+    if (copy) memcpy(copy, str, len);
+    return copy;
+}
+
+// Size class holding allocations of size bytes
+static int slab_class(size_t size) {
+    int cls = 0;
+    while (((size_t)ARENA_ALIGNMENT << cls) < size) cls++;
+    return cls;
+}
+
+void* arena_alloc_slab(Arena* arena, size_t size) {
+    int cls = slab_class(size);
+    if (cls >= ARENA_NUM_CLASSES) return NULL;
+    
+    void* ptr = arena->free_slabs[cls];
+    if (ptr) {
+        arena->free_slabs[cls] = *(void**)ptr;
+        return ptr;
+    }
+    
+    return arena_alloc(arena, (size_t)ARENA_ALIGNMENT << cls);
+}
+
+void arena_free_slab(Arena* arena, void* ptr, size_t size) {
+    if (!ptr) return;
+    
+    int cls = slab_class(size);
+    if (cls >= ARENA_NUM_CLASSES) return;
+    
+    *(void**)ptr = arena->free_slabs[cls];
+    arena->free_slabs[cls] = ptr;
+}
@@ -0,0 +1,48 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Default size of each block requested from malloc
+#define ARENA_DEFAULT_BLOCK_SIZE (256 * 1024)
+
+// Power-of-two size classes available to slab allocations
+#define ARENA_NUM_CLASSES 32
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+    unsigned char data[];
+} ArenaBlock;
+
+// Region allocator. Objects are bump-allocated from large blocks and are
+// only released together, so freeing a whole model is one pass over the
+// block list instead of one free() per pattern. Slab allocations are
+// rounded up to a power of two and can be handed back for reuse, which
+// suits arrays that grow by doubling.
+typedef struct {
+    ArenaBlock* blocks;          // Most recent block first
+    size_t block_size;
+    size_t num_blocks;
+    size_t bytes_reserved;       // Bytes held in blocks
+    size_t bytes_used;           // Bytes handed out, including slab rounding
+    void* free_slabs[ARENA_NUM_CLASSES];
+} Arena;
+
+// Lifecycle
+Arena* arena_create(size_t block_size);
+void arena_destroy(Arena* arena);
+void arena_reset(Arena* arena);
+void arena_adopt(Arena* dst, Arena* src);
+
+// Allocation
+void* arena_alloc(Arena* arena, size_t size);
+void* arena_calloc(Arena* arena, size_t size);
+char* arena_strdup(Arena* arena, const char* str);
+
+// Recyclable power-of-two allocations
+void* arena_alloc_slab(Arena* arena, size_t size);
+void arena_free_slab(Arena* arena, void* ptr, size_t size);
+
+#endif // ARENA_H
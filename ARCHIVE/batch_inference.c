@@ -0,0 +1,129 @@
+#include "batch_inference.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+// State shared by the workers of one batch
+typedef struct {
+    const char* const* prompts;
+    size_t count;
+    const BatchConfig* config;
+    BatchResult* result;
+    size_t next;                 // Next prompt to hand out, taken atomically
+    int failed;
+} BatchQueue;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Answer prompts until the queue is empty. Each reply is written to its
+// own slot, so results come out in prompt order whatever the timing.
+static void* batch_worker(void* arg) {
+    BatchQueue* queue = arg;
+    const BatchConfig* config = queue->config;
+    char* output = malloc(config->output_size);
+    if (!output) {
+        __atomic_store_n(&queue->failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    
+    while (1) {
+        size_t i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+        if (i >= queue->count) break;
+        
+        double start = now_seconds();
+        output[0] = '\0';
+        config->answer(config->context, queue->prompts[i], output, config->output_size);
+        queue->result->latencies[i] = now_seconds() - start;
+        
+        queue->result->replies[i] = strdup(output);
+        if (!queue->result->replies[i]) __atomic_store_n(&queue->failed, 1, __ATOMIC_RELAXED);
+    }
+    
+    free(output);
+    return NULL;
+}
+
+int batch_run(const char* const* prompts, size_t count, const BatchConfig* config, BatchResult* result) {
+    memset(result, 0, sizeof(BatchResult));
+    if (!config->answer || config->output_size == 0) return 0;
+    
+    int num_threads = config->num_threads;
+    if (num_threads < 1) num_threads = 1;
+    if (num_threads > BATCH_MAX_THREADS) num_threads = BATCH_MAX_THREADS;
+    
+    result->replies = calloc(count ? count : 1, sizeof(char*));
+    result->latencies = calloc(count ? count : 1, sizeof(double));
+    result->count = count;
+    if (!result->replies || !result->latencies) {
+        batch_result_free(result);
+        return 0;
+    }
+    
+    BatchQueue queue = {
+        .prompts = prompts,
+        .count = count,
+        .config = config,
+        .result = result
+    };
+    
+    // The calling thread is worker 0; the pool shrinks if threads cannot
+    // be started, since the rest simply take more prompts
+    pthread_t threads[BATCH_MAX_THREADS];
+    int started[BATCH_MAX_THREADS];
+    double start = now_seconds();
+    
+    for (int i = 1; i < num_threads; i++) {
+        started[i] = pthread_create(&threads[i], NULL, batch_worker, &queue) == 0;
+    }
+    batch_worker(&queue);
+    for (int i = 1; i < num_threads; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+    
+    result->elapsed = now_seconds() - start;
+    return !queue.failed;
+}
+
+void batch_result_free(BatchResult* result) {
+    if (result->replies) {
+        for (size_t i = 0; i < result->count; i++) {
+            free(result->replies[i]);
+        }
+    }
+    free(result->replies);
+    free(result->latencies);
+    memset(result, 0, sizeof(BatchResult));
+}
+
+double batch_queries_per_second(const BatchResult* result) {
+    return result->elapsed > 0 ? result->count / result->elapsed : 0;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile over a sorted copy of the latencies
+double batch_latency_percentile(const BatchResult* result, double percentile) {
+    if (result->count == 0) return 0;
+    
+    double* sorted = malloc(result->count * sizeof(double));
+    if (!sorted) return 0;
+    memcpy(sorted, result->latencies, result->count * sizeof(double));
+    qsort(sorted, result->count, sizeof(double), compare_doubles);
+    
+    size_t rank = (size_t)(percentile / 100.0 * result->count + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > result->count) rank = result->count;
+    double value = sorted[rank - 1];
+    
+    free(sorted);
+    return value;
+}
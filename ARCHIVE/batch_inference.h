@@ -0,0 +1,37 @@
+#ifndef BATCH_INFERENCE_H
+#define BATCH_INFERENCE_H
+
+#include <stddef.h>
+
+#define BATCH_MAX_THREADS 256
+
+// Answers one prompt into output, returning the reply length. Called from
+// several workers at once with the same context, so it must only read it.
+typedef size_t (*BatchAnswer)(void* context, const char* prompt, char* output, size_t output_size);
+
+typedef struct {
+    int num_threads;
+    size_t output_size;          // Longest reply kept, including the NUL
+    BatchAnswer answer;
+    void* context;
+} BatchConfig;
+
+// Replies and per-prompt latencies, both in prompt order
+typedef struct {
+    char** replies;
+    double* latencies;           // Seconds from pickup to reply
+    size_t count;
+    double elapsed;              // Wall time of the whole batch
+} BatchResult;
+
+// Answer prompts with a fixed pool of config->num_threads workers. Workers
+// take the next unanswered prompt as they become free, so slow prompts do
+// not hold up a whole share of the batch.
+int batch_run(const char* const* prompts, size_t count, const BatchConfig* config, BatchResult* result);
+void batch_result_free(BatchResult* result);
+
+// Throughput and latency percentile (0-100) of a finished batch
+double batch_queries_per_second(const BatchResult* result);
+double batch_latency_percentile(const BatchResult* result, double percentile);
+
+#endif // BATCH_INFERENCE_H
@@ -0,0 +1,176 @@
+#include "beam_search.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static int allocate_beams(BeamHypothesis* beams, int count, int max_depth, int max_words) {
+    for (int i = 0; i < count; i++) {
+        beams[i].window = malloc(max_depth * sizeof(uint32_t));
+        beams[i].words = malloc(max_words * sizeof(uint32_t));
+        if (!beams[i].window || !beams[i].words) return 0;
+    }
+    return 1;
+}
+
+static void free_beams(BeamHypothesis* beams, int count) {
+    if (!beams) return;
+    for (int i = 0; i < count; i++) {
+        free(beams[i].window);
+        free(beams[i].words);
+    }
+    free(beams);
+}
+
+BeamSearch* beam_search_create(const BeamConfig* config, int max_depth) {
+    if (config->beam_width < 1 || config->beam_width > BEAM_MAX_WIDTH || config->max_words < 1) return NULL;
+    if (max_depth < 1 || max_depth > CONTEXT_TREE_MAX_DEPTH) return NULL;
+    
+    BeamSearch* search = calloc(1, sizeof(BeamSearch));
+    if (!search) return NULL;
+    
+    int width = config->beam_width;
+    search->config = *config;
+    search->max_depth = max_depth;
+    search->beams = calloc(width, sizeof(BeamHypothesis));
+    search->next = calloc(width, sizeof(BeamHypothesis));
+    search->candidates = malloc(width * width * sizeof(BeamCandidate));
+    search->contexts = malloc(width * sizeof(uint32_t*));
+    search->context_lengths = malloc(width * sizeof(int));
+    search->nodes = malloc(width * (max_depth + 1) * sizeof(ContextNode*));
+    search->depths = malloc(width * sizeof(int));
+    search->best_words = malloc(config->max_words * sizeof(uint32_t));
+    
+    if (!search->beams || !search->next || !search->candidates || !search->contexts ||
+        !search->context_lengths || !search->nodes || !search->depths || !search->best_words ||
+        !allocate_beams(search->beams, width, max_depth, config->max_words) ||
+        !allocate_beams(search->next, width, max_depth, config->max_words)) {
+        beam_search_destroy(search);
+        return NULL;
+    }
+    
+    return search;
+}
+
+void beam_search_destroy(BeamSearch* search) {
+    if (!search) return;
+    free_beams(search->beams, search->config.beam_width);
+    free_beams(search->next, search->config.beam_width);
+    free(search->candidates);
+    free(search->contexts);
+    free(search->context_lengths);
+    free(search->nodes);
+    free(search->depths);
+    free(search->best_words);
+    free(search);
+}
+
+// Best first; equal scores keep expansion order so results are stable
+static int compare_candidates(const void* a, const void* b) {
+    const BeamCandidate* x = a;
+    const BeamCandidate* y = b;
+    if (x->score != y->score) return x->score > y->score ? -1 : 1;
+    if (x->parent != y->parent) return x->parent < y->parent ? -1 : 1;
+    return x->word < y->word ? -1 : (x->word > y->word);
+}
+
+// Keep beam as the response if it beats the best so far per word
+static void offer_finished(BeamSearch* search, const BeamHypothesis* beam) {
+    if (beam->num_words == 0) return;
+    
+    double mean = beam->score / beam->num_words;
+    double best = search->best_length ? search->best_score / search->best_length : 0;
+    if (search->best_length == 0 || mean > best ||
+        (mean == best && beam->num_words > search->best_length)) {
+        memcpy(search->best_words, beam->words, beam->num_words * sizeof(uint32_t));
+        search->best_length = beam->num_words;
+        search->best_score = beam->score;
+    }
+}
+
+// Build a hypothesis for the next step from parent plus word
+static void extend(BeamSearch* search, BeamHypothesis* child, const BeamHypothesis* parent, uint32_t word,
+                   double score) {
+    int keep = parent->window_length < search->max_depth ? parent->window_length : search->max_depth - 1;
+    memcpy(child->window, parent->window + parent->window_length - keep, keep * sizeof(uint32_t));
+    child->window[keep] = word;
+    child->window_length = keep + 1;
+    
+    memcpy(child->words, parent->words, parent->num_words * sizeof(uint32_t));
+    child->words[parent->num_words] = word;
+    child->num_words = parent->num_words + 1;
+    child->score = score;
+}
+
+int beam_search_run(BeamSearch* search, ContextTree* tree, const uint32_t* context, int context_length,
+                    uint32_t* words) {
+    const BeamConfig* config = &search->config;
+    int width = config->beam_width;
+    int stride = tree->max_depth + 1;
+    if (tree->max_depth > search->max_depth) return 0;
+    
+    // One hypothesis holding the end of the prompt
+    BeamHypothesis* start = &search->beams[0];
+    int keep = context_length < search->max_depth ? context_length : search->max_depth;
+    memcpy(start->window, context + context_length - keep, keep * sizeof(uint32_t));
+    start->window_length = keep;
+    start->num_words = 0;
+    start->score = 0;
+    search->num_beams = 1;
+    search->best_length = 0;
+    
+    for (int step = 0; step < config->max_words && search->num_beams > 0; step++) {
+        // Match every hypothesis in one batched walk
+        for (int b = 0; b < search->num_beams; b++) {
+            search->contexts[b] = search->beams[b].window;
+            search->context_lengths[b] = search->beams[b].window_length;
+        }
+        context_tree_match_batch(tree, search->contexts, search->context_lengths, search->num_beams,
+                                 search->nodes, search->depths);
+        
+        // Each hypothesis proposes its context's width most frequent words
+        int num_candidates = 0;
+        for (int b = 0; b < search->num_beams; b++) {
+            const BeamHypothesis* beam = &search->beams[b];
+            int depth = search->depths[b];
+            if (depth < config->min_context) {
+                offer_finished(search, beam);
+                continue;
+            }
+            
+            const ContextNode* node = search->nodes[b * stride + depth];
+            const Continuation* ranked = context_tree_ranked(tree, node);
+            if (!ranked) ranked = node->continuations;
+            
+            uint32_t limit = node->num_continuations < (uint32_t)width ? node->num_continuations : (uint32_t)width;
+            for (uint32_t c = 0; c < limit; c++) {
+                BeamCandidate* candidate = &search->candidates[num_candidates++];
+                candidate->parent = b;
+                candidate->word = ranked[c].next;
+                candidate->score = beam->score + log((double)ranked[c].count / node->total_count);
+            }
+        }
+        
+        qsort(search->candidates, num_candidates, sizeof(BeamCandidate), compare_candidates);
+        
+        int survivors = num_candidates < width ? num_candidates : width;
+        for (int i = 0; i < survivors; i++) {
+            const BeamCandidate* candidate = &search->candidates[i];
+            extend(search, &search->next[i], &search->beams[candidate->parent], candidate->word,
+                   candidate->score);
+        }
+        search->expansions += survivors;
+        
+        BeamHypothesis* swap = search->beams;
+        search->beams = search->next;
+        search->next = swap;
+        search->num_beams = survivors;
+    }
+    
+    // Hypotheses still alive after max_words compete with the finished ones
+    for (int b = 0; b < search->num_beams; b++) {
+        offer_finished(search, &search->beams[b]);
+    }
+    
+    memcpy(words, search->best_words, search->best_length * sizeof(uint32_t));
+    return search->best_length;
+}
@@ -0,0 +1,70 @@
+#ifndef BEAM_SEARCH_H
+#define BEAM_SEARCH_H
+
+#include <stdint.h>
+#include "context_tree.h"
+
+// Widest beam a search can be configured with
+#define BEAM_MAX_WIDTH 64
+
+typedef struct {
+    int beam_width;              // Hypotheses kept after each step
+    int max_words;               // Longest response
+    int min_context;             // Shortest context a word is predicted from
+} BeamConfig;
+
+// One partial response. window holds the last max_depth tokens of prompt
+// plus response, which is all the tree can match.
+typedef struct {
+    uint32_t* window;
+    int window_length;
+    uint32_t* words;
+    int num_words;
+    double score;                // Sum of log probabilities of words
+} BeamHypothesis;
+
+// Expansion of a hypothesis by one word
+typedef struct {
+    int parent;
+    uint32_t word;
+    double score;
+} BeamCandidate;
+
+// Beam-search generator over a context tree. Each step extends every live
+// hypothesis by its context's most frequent next words, scored by log
+// probability at the deepest matching context, and keeps the beam_width
+// best. A hypothesis whose context predicts nothing is finished; the
+// response is the best finished or surviving hypothesis by mean log
+// probability per word. All buffers belong to the search, so one search
+// per thread is reentrant.
+typedef struct {
+    BeamConfig config;
+    int max_depth;
+    BeamHypothesis* beams;       // Live hypotheses
+    BeamHypothesis* next;        // Hypotheses being built for the next step
+    int num_beams;
+    BeamCandidate* candidates;   // beam_width * beam_width per step
+    
+    // Batched lookup buffers, one row per hypothesis
+    const uint32_t** contexts;
+    int* context_lengths;
+    const ContextNode** nodes;
+    int* depths;
+    
+    uint32_t* best_words;        // Best finished hypothesis so far
+    int best_length;
+    double best_score;
+    
+    size_t expansions;           // Hypotheses extended, for benchmarks
+} BeamSearch;
+
+// Lifecycle
+BeamSearch* beam_search_create(const BeamConfig* config, int max_depth);
+void beam_search_destroy(BeamSearch* search);
+
+// Generate a response to context into words (config.max_words entries);
+// returns the number of words
+int beam_search_run(BeamSearch* search, ContextTree* tree, const uint32_t* context, int context_length,
+                    uint32_t* words);
+
+#endif // BEAM_SEARCH_H
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "vocabulary.h"
+#include "tokenizer.h"
+#include "context_tree.h"
+#include "parallel_training.h"
+#include "beam_search.h"
+
+#define DEFAULT_DATASET_DIR "../datasets"
+#define BENCH_LINE_SIZE (1 << 20)
+#define BENCH_MAX_DEPTH 100
+#define BENCH_PROMPTS 400
+#define BENCH_PROMPT_WORDS 3
+#define BENCH_MAX_WORDS 50
+#define BENCH_PASSES 5
+
+static const int widths[] = {1, 2, 4, 8, 16, 32, 64};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void load_directory(const char* path, TrainCorpus* corpus) {
+    DIR* dir = opendir(path);
+    if (!dir) return;
+    
+    struct dirent* entry;
+    char full_path[512];
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
+        
+        struct stat st;
+        if (stat(full_path, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            load_directory(full_path, corpus);
+        } else if (strstr(entry->d_name, ".txt")) {
+            train_corpus_load_file(corpus, full_path, BENCH_LINE_SIZE);
+        }
+    }
+    closedir(dir);
+}
+
+static int split_words(const char* line, TokenSpan* spans, int max_tokens) {
+    return tokenize_spans(line, strlen(line), spans, max_tokens);
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = argc > 1 ? argv[1] : DEFAULT_DATASET_DIR;
+    
+    TrainCorpus corpus;
+    train_corpus_init(&corpus);
+    load_directory(path, &corpus);
+    if (corpus.num_lines == 0) {
+        printf("No .txt files under %s\n", path);
+        return 1;
+    }
+    
+    // Train as v5 does: contexts of 2 to 100 tokens
+    ContextTree* tree = context_tree_create(BENCH_MAX_DEPTH);
+    Vocabulary* vocab = vocab_create();
+    TrainConfig config = {1, 500, 0, 2, split_words};
+    TrainResult result = {0};
+    if (!tree || !vocab || !train_parallel(tree, vocab, &corpus, &config, &result)) {
+        printf("Training failed\n");
+        return 1;
+    }
+    context_tree_freeze(tree);
+    
+    // Prompts: the opening words of lines spread over the corpus
+    static uint32_t prompts[BENCH_PROMPTS][BENCH_PROMPT_WORDS];
+    int prompt_lengths[BENCH_PROMPTS];
+    int num_prompts = 0;
+    size_t step = corpus.num_lines > BENCH_PROMPTS ? corpus.num_lines / BENCH_PROMPTS : 1;
+    for (size_t l = 0; l < corpus.num_lines && num_prompts < BENCH_PROMPTS; l += step) {
+        const char* line = corpus.lines[l];
+        int length = tokenize_lookup(vocab, line, strlen(line), prompts[num_prompts], BENCH_PROMPT_WORDS);
+        if (length >= 2) prompt_lengths[num_prompts++] = length;
+    }
+    
+    printf("=== Beam Search Benchmark ===\n");
+    printf("Corpus: %s, %zu lines, %zu patterns; %d prompts of up to %d words, best of %d passes\n\n",
+           path, corpus.num_lines, tree->num_patterns, num_prompts, BENCH_PROMPT_WORDS, BENCH_PASSES);
+    printf("%6s %12s %12s %14s %14s\n", "width", "us/reply", "words/reply", "logprob/word", "expansions/s");
+    
+    uint32_t words[BENCH_MAX_WORDS];
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+        BeamConfig beam = {widths[w], BENCH_MAX_WORDS, 2};
+        BeamSearch* search = beam_search_create(&beam, BENCH_MAX_DEPTH);
+        if (!search) continue;
+        
+        double best = 0;
+        size_t total_words = 0;
+        double total_score = 0;
+        size_t expansions = 0;
+        
+        for (int pass = 0; pass < BENCH_PASSES; pass++) {
+            total_words = 0;
+            total_score = 0;
+            search->expansions = 0;
+            
+            double start = now_seconds();
+            for (int p = 0; p < num_prompts; p++) {
+                total_words += beam_search_run(search, tree, prompts[p], prompt_lengths[p], words);
+                total_score += search->best_score;
+            }
+            double elapsed = now_seconds() - start;
+            if (pass == 0 || elapsed < best) best = elapsed;
+            expansions = search->expansions;
+        }
+        
+        printf("%6d %12.1f %12.1f %14.3f %14.0f\n", widths[w], best * 1e6 / num_prompts,
+               (double)total_words / num_prompts, total_words ? total_score / total_words : 0.0,
+               expansions / best);
+        beam_search_destroy(search);
+    }
+    
+    context_tree_destroy(tree);
+    vocab_destroy(vocab);
+    train_corpus_free(&corpus);
+    return 0;
+}
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "gate_types.h"
+#include "vocabulary.h"
+#include "tokenizer.h"
+#include "pattern_store.h"
+#include "context_tree.h"
+#include "parallel_training.h"
+#include "benchmark_stores.h"
+
+#define DEFAULT_DATASET_DIR "../datasets"
+#define BENCH_LINE_SIZE (1 << 20)
+#define BENCH_MAX_TOKENS 500
+#define BENCH_MAX_CONTEXT 100    // CONTEXT_SIZE of gaia_chat_v5-v8
+#define BENCH_SYNTHETIC_COPIES 10
+#define BENCH_LOOKUPS 100000
+#define BENCH_LOOKUP_MIN_CONTEXT 2
+#define BENCH_LOOKUP_MAX_CONTEXT 5
+
+extern void register_basic_gates(void);
+extern void register_memory_gates(void);
+extern void register_adaptive_gates(void);
+
+// A training line as word IDs
+typedef struct {
+    uint32_t* ids;
+    int length;
+} BenchLine;
+
+// Part of the corpus the stores are trained on
+typedef struct {
+    const char* name;
+    BenchLine* lines;
+    size_t num_lines;
+    size_t num_words;
+} Slice;
+
+// A context of a slice line and the word after it
+typedef struct {
+    const uint32_t* context;
+    int length;
+    uint32_t next;
+} Probe;
+
+// One store trained on one slice
+typedef struct {
+    size_t occurrences;          // Patterns offered to the store
+    double insert_seconds;
+    double hit_seconds;
+    double miss_seconds;
+    size_t hits_found;
+    size_t misses_found;
+    StoreShape shape;
+} StoreResult;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void load_directory(const char* path, TrainCorpus* corpus) {
+    DIR* dir = opendir(path);
+    if (!dir) return;
+    
+    struct dirent* entry;
+    char full_path[512];
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
+        
+        struct stat st;
+        if (stat(full_path, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            load_directory(full_path, corpus);
+        } else if (strstr(entry->d_name, ".txt")) {
+            train_corpus_load_file(corpus, full_path, BENCH_LINE_SIZE);
+        }
+    }
+    closedir(dir);
+}
+
+static void slice_count_words(Slice* slice) {
+    slice->num_words = 0;
+    for (size_t i = 0; i < slice->num_lines; i++) slice->num_words += slice->lines[i].length;
+}
+
+// Ten copies of the corpus. Each later copy renames a different half of
+// the words, chosen by hash, so it adds new n-grams with the corpus's own
+// word frequencies instead of repeating the same ones.
+static BenchLine* synthesize(Vocabulary* vocab, const BenchLine* lines, size_t num_lines, int copies) {
+    uint32_t base_words = vocab_size(vocab);
+    BenchLine* out = calloc(num_lines * copies, sizeof(BenchLine));
+    uint32_t* rename = malloc(base_words * sizeof(uint32_t));
+    if (!out || !rename) {
+        free(out);
+        free(rename);
+        return NULL;
+    }
+    
+    char word[256];
+    for (int k = 0; k < copies; k++) {
+        for (uint32_t id = 0; id < base_words; id++) {
+            const char* base = vocab_word(vocab, id);
+            rename[id] = id;
+            if (k > 0 && ((vocab_hash(base) * (2u * k + 1)) >> 16) & 1) {
+                snprintf(word, sizeof(word), "%s~%d", base, k);
+                rename[id] = vocab_intern(vocab, word);
+            }
+        }
+        
+        for (size_t i = 0; i < num_lines; i++) {
+            BenchLine* line = &out[k * num_lines + i];
+            line->length = lines[i].length;
+            line->ids = malloc(line->length * sizeof(uint32_t));
+            if (!line->ids) line->length = 0;
+            for (int t = 0; t < line->length; t++) line->ids[t] = rename[lines[i].ids[t]];
+        }
+    }
+    
+    free(rename);
+    return out;
+}
+
+// Contexts spread over the slice by a fixed LCG, so every store answers
+// the same lookups
+static size_t make_probes(const Slice* slice, Probe* probes, size_t max_probes) {
+    uint64_t state = 88172645463325252ull;
+    size_t count = 0;
+    
+    for (size_t attempt = 0; count < max_probes && attempt < max_probes * 4; attempt++) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        const BenchLine* line = &slice->lines[(state >> 33) % slice->num_lines];
+        int length = BENCH_LOOKUP_MIN_CONTEXT +
+                     (int)((state >> 20) % (BENCH_LOOKUP_MAX_CONTEXT - BENCH_LOOKUP_MIN_CONTEXT + 1));
+        if (line->length <= length) continue;
+        
+        int start = (int)((state >> 8) % (line->length - length));
+        probes[count].context = line->ids + start;
+        probes[count].length = length;
+        probes[count].next = line->ids[start + length];
+        count++;
+    }
+    return count;
+}
+
+// gaia_chat_v6/v7: store_pattern over every context length of every line
+static void bench_pattern_store(const Slice* slice, const Probe* probes, size_t num_probes,
+                                uint32_t missing, StoreResult* result) {
+    PatternStore* store = pattern_store_create(PATTERN_STORE_DEFAULT_SLOTS);
+    if (!store) return;
+    
+    uint64_t states[BENCH_MAX_TOKENS];
+    double start = now_seconds();
+    for (size_t l = 0; l < slice->num_lines; l++) {
+        const BenchLine* line = &slice->lines[l];
+        for (int s = 0; s < line->length; s++) states[s] = PATTERN_HASH_SEED;
+        
+        for (int length = 1; length < line->length && length <= BENCH_MAX_CONTEXT; length++) {
+            for (int s = 0; s + length < line->length; s++) {
+                states[s] = pattern_hash_extend(states[s], line->ids[s + length - 1]);
+                uint32_t hash = pattern_hash_finish(states[s]);
+                uint32_t next = line->ids[s + length];
+                
+                Pattern* pattern = pattern_store_find_hashed(store, line->ids + s, length, hash, next);
+                if (!pattern) pattern = pattern_store_insert_hashed(store, line->ids + s, length, hash, next);
+                if (pattern) pattern->count++;
+                result->occurrences++;
+            }
+        }
+    }
+    result->insert_seconds = now_seconds() - start;
+    
+    start = now_seconds();
+    for (size_t i = 0; i < num_probes; i++) {
+        result->hits_found += pattern_store_find(store, probes[i].context, probes[i].length, probes[i].next) != NULL;
+    }
+    result->hit_seconds = now_seconds() - start;
+    
+    start = now_seconds();
+    for (size_t i = 0; i < num_probes; i++) {
+        result->misses_found += pattern_store_find(store, probes[i].context, probes[i].length, missing) != NULL;
+    }
+    result->miss_seconds = now_seconds() - start;
+    
+    // Chain length: groups probed from a pattern's home slot to its own
+    uint32_t mask = store->num_slots - 1;
+    size_t groups = 0;
+    uint32_t max_groups = 0;
+    for (uint32_t slot = 0; slot < store->num_slots; slot++) {
+        const Pattern* pattern = store->slots[slot];
+        if (!pattern) continue;
+        uint32_t probed = ((slot - pattern->hash) & mask) / PATTERN_GROUP_SIZE + 1;
+        groups += probed;
+        if (probed > max_groups) max_groups = probed;
+    }
+    
+    result->shape.patterns = store->num_patterns;
+    result->shape.bytes = pattern_store_memory_usage(store);
+    result->shape.avg_chain = store->num_patterns ? (double)groups / store->num_patterns : 0;
+    result->shape.max_chain = max_groups;
+    result->shape.load_factor = pattern_store_load_factor(store);
+    pattern_store_destroy(store);
+}
+
+// Depth of every pattern below node, summed, and the deepest holding one
+static void tree_depths(const ContextNode* node, uint32_t depth, size_t* depth_sum, uint32_t* max_depth) {
+    *depth_sum += (size_t)node->num_continuations * depth;
+    if (node->num_continuations > 0 && depth > *max_depth) *max_depth = depth;
+    for (uint32_t c = 0; c < node->num_children; c++) {
+        tree_depths(node->children[c], depth + 1, depth_sum, max_depth);
+    }
+}
+
+// gaia_chat_v5/v8: learn_pattern / store_pattern as context_tree_ingest
+static void bench_context_tree(const Slice* slice, const Probe* probes, size_t num_probes,
+                               uint32_t missing, StoreResult* result) {
+    ContextTree* tree = context_tree_create(BENCH_MAX_CONTEXT);
+    if (!tree) return;
+    
+    double start = now_seconds();
+    for (size_t l = 0; l < slice->num_lines; l++) {
+        context_tree_ingest(tree, slice->lines[l].ids, slice->lines[l].length, 1);
+    }
+    result->insert_seconds = now_seconds() - start;
+    result->occurrences = tree->total_words;
+    
+    const ContextNode* nodes[BENCH_LOOKUP_MAX_CONTEXT + 1];
+    start = now_seconds();
+    for (size_t i = 0; i < num_probes; i++) {
+        int depth = context_tree_match(tree, probes[i].context, probes[i].length, nodes);
+        result->hits_found += depth == probes[i].length && context_node_find(nodes[depth], probes[i].next);
+    }
+    result->hit_seconds = now_seconds() - start;
+    
+    start = now_seconds();
+    for (size_t i = 0; i < num_probes; i++) {
+        int depth = context_tree_match(tree, probes[i].context, probes[i].length, nodes);
+        result->misses_found += depth == probes[i].length && context_node_find(nodes[depth], missing);
+    }
+    result->miss_seconds = now_seconds() - start;
+    
+    // No hash table: the chain is the walk, one binary search per level,
+    // so report the depth of each pattern's context
+    size_t depth_sum = 0;
+    uint32_t max_depth = 0;
+    tree_depths(tree->root, 0, &depth_sum, &max_depth);
+    
+    result->shape.patterns = tree->num_patterns;
+    result->shape.bytes = context_tree_memory_usage(tree);
+    result->shape.avg_chain = tree->num_patterns ? (double)depth_sum / tree->num_patterns : 0;
+    result->shape.max_chain = max_depth;
+    result->shape.load_factor = -1;
+    context_tree_destroy(tree);
+}
+
+// text_training_system.c: learn_pattern_streaming over the slice as one
+// word stream
+static void bench_trigram_store(const Slice* slice, const Vocabulary* vocab, const Probe* probes,
+                                size_t num_probes, StoreResult* result) {
+    void* store = trigram_store_create();
+    if (!store) return;
+    
+    uint32_t w1 = VOCAB_NONE, w2 = VOCAB_NONE;
+    double start = now_seconds();
+    for (size_t l = 0; l < slice->num_lines; l++) {
+        const BenchLine* line = &slice->lines[l];
+        for (int t = 0; t < line->length; t++) {
+            if (w1 != VOCAB_NONE) {
+                trigram_store_learn(store, vocab_word(vocab, w1), vocab_word(vocab, w2),
+                                    vocab_word(vocab, line->ids[t]));
+                result->occurrences++;
+            }
+            w1 = w2;
+            w2 = line->ids[t];
+        }
+    }
+    result->insert_seconds = now_seconds() - start;
+    
+    // Trigram lookups use the last two words of each context
+    start = now_seconds();
+    for (size_t i = 0; i < num_probes; i++) {
+        const uint32_t* end = probes[i].context + probes[i].length;
+        result->hits_found += trigram_store_find(store, vocab_word(vocab, end[-2]), vocab_word(vocab, end[-1]),
+                                                 vocab_word(vocab, probes[i].next));
+    }
+    result->hit_seconds = now_seconds() - start;
+    
+    start = now_seconds();
+    for (size_t i = 0; i < num_probes; i++) {
+        const uint32_t* end = probes[i].context + probes[i].length;
+        result->misses_found += trigram_store_find(store, vocab_word(vocab, end[-2]), vocab_word(vocab, end[-1]),
+                                                   "\x01missing");
+    }
+    result->miss_seconds = now_seconds() - start;
+    
+    trigram_store_shape(store, &result->shape);
+    trigram_store_destroy(store);
+}
+
+static void print_result(const char* store, const Slice* slice, const StoreResult* result, size_t num_probes) {
+    char load[16] = "-";
+    if (result->shape.load_factor >= 0) snprintf(load, sizeof(load), "%.2f", result->shape.load_factor);
+    
+    printf("%-14s %-6s %10zu %9zu %10.2f %8.2f %8.2f %9.1f %7.2f %6u %6s",
+           store, slice->name, result->occurrences, result->shape.patterns,
+           result->insert_seconds > 0 ? result->occurrences / result->insert_seconds / 1e6 : 0,
+           result->hit_seconds > 0 ? num_probes / result->hit_seconds / 1e6 : 0,
+           result->miss_seconds > 0 ? num_probes / result->miss_seconds / 1e6 : 0,
+           result->shape.patterns ? (double)result->shape.bytes / result->shape.patterns : 0,
+           result->shape.avg_chain, result->shape.max_chain, load);
+    
+    // Every probe was trained on, and no store holds the missing word
+    if (result->hits_found != num_probes || result->misses_found != 0) {
+        printf("  (%zu/%zu hits, %zu false misses)", result->hits_found, num_probes, result->misses_found);
+    }
+    printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = argc > 1 ? argv[1] : DEFAULT_DATASET_DIR;
+    
+    TrainCorpus corpus;
+    train_corpus_init(&corpus);
+    load_directory(path, &corpus);
+    if (corpus.num_lines == 0) {
+        printf("No .txt files under %s\n", path);
+        return 1;
+    }
+    
+    // Word IDs of every line, shared by all stores
+    Vocabulary* vocab = vocab_create();
+    BenchLine* lines = calloc(corpus.num_lines, sizeof(BenchLine));
+    uint32_t ids[BENCH_MAX_TOKENS];
+    size_t num_lines = 0;
+    if (!vocab || !lines) return 1;
+    for (size_t l = 0; l < corpus.num_lines; l++) {
+        const char* text = corpus.lines[l];
+        int length = tokenize_intern(vocab, text, strlen(text), ids, BENCH_MAX_TOKENS);
+        if (length < 2) continue;
+        lines[num_lines].ids = malloc(length * sizeof(uint32_t));
+        if (!lines[num_lines].ids) continue;
+        memcpy(lines[num_lines].ids, ids, length * sizeof(uint32_t));
+        lines[num_lines++].length = length;
+    }
+    uint32_t corpus_words = vocab_size(vocab);
+    
+    BenchLine* synthetic = synthesize(vocab, lines, num_lines, BENCH_SYNTHETIC_COPIES);
+    if (!synthetic) return 1;
+    
+    Slice slices[] = {
+        {"1%", lines, num_lines / 100 ? num_lines / 100 : 1, 0},
+        {"10%", lines, num_lines / 10 ? num_lines / 10 : 1, 0},
+        {"100%", lines, num_lines, 0},
+        {"10x", synthetic, num_lines * BENCH_SYNTHETIC_COPIES, 0}
+    };
+    int num_slices = sizeof(slices) / sizeof(slices[0]);
+    for (int s = 0; s < num_slices; s++) slice_count_words(&slices[s]);
+    
+    // A word no slice contains, for lookups that must miss
+    uint32_t missing = vocab_intern(vocab, "\x01missing");
+    
+    gate_registry_init();
+    register_basic_gates();
+    register_memory_gates();
+    register_adaptive_gates();
+    
+    printf("=== Pattern Store Scaling Benchmark ===\n");
+    printf("Corpus: %s, %zu lines, %zu words, %u distinct (%u in the 10x corpus)\n",
+           path, num_lines, slices[2].num_words, corpus_words, vocab_size(vocab) - 1);
+    printf("Stores: pattern_store (v6/v7 store_pattern), context_tree (v5/v8 learn_pattern/store_pattern),\n"
+           "        trigram_chain (text_training_system learn_pattern_streaming)\n");
+    printf("Rates in millions per second; %d lookups of %d-%d word contexts per slice.\n",
+           BENCH_LOOKUPS, BENCH_LOOKUP_MIN_CONTEXT, BENCH_LOOKUP_MAX_CONTEXT);
+    printf("Chain: groups probed (pattern_store), context depth (context_tree), chain position (trigram_chain)\n\n");
+    printf("%-14s %-6s %10s %9s %10s %8s %8s %9s %7s %6s %6s\n", "store", "slice", "inserted", "patterns",
+           "insert M/s", "hit M/s", "miss M/s", "bytes/pat", "avg ch", "max ch", "load");
+    
+    Probe* probes = malloc(BENCH_LOOKUPS * sizeof(Probe));
+    if (!probes) return 1;
+    
+    for (int s = 0; s < num_slices; s++) {
+        size_t num_probes = make_probes(&slices[s], probes, BENCH_LOOKUPS);
+        StoreResult result;
+        
+        memset(&result, 0, sizeof(result));
+        bench_pattern_store(&slices[s], probes, num_probes, missing, &result);
+        print_result("pattern_store", &slices[s], &result, num_probes);
+        
+        memset(&result, 0, sizeof(result));
+        bench_context_tree(&slices[s], probes, num_probes, missing, &result);
+        print_result("context_tree", &slices[s], &result, num_probes);
+        
+        memset(&result, 0, sizeof(result));
+        bench_trigram_store(&slices[s], vocab, probes, num_probes, &result);
+        print_result("trigram_chain", &slices[s], &result, num_probes);
+        fflush(stdout);
+    }
+    
+    gate_registry_cleanup();
+    free(probes);
+    for (size_t l = 0; l < num_lines; l++) free(lines[l].ids);
+    for (size_t l = 0; l < num_lines * BENCH_SYNTHETIC_COPIES; l++) free(synthetic[l].ids);
+    free(lines);
+    free(synthetic);
+    vocab_destroy(vocab);
+    train_corpus_free(&corpus);
+    return 0;
+}
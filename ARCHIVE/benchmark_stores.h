@@ -0,0 +1,24 @@
+#ifndef BENCHMARK_STORES_H
+#define BENCHMARK_STORES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Shape of a pattern store after training on a benchmark slice
+typedef struct {
+    size_t patterns;             // Distinct patterns held
+    size_t bytes;
+    double avg_chain;            // Entries visited to reach a pattern
+    uint32_t max_chain;
+    double load_factor;          // Negative for stores without a hash table
+} StoreShape;
+
+// The trigram table of text_training_system.c. It is built in its own
+// translation unit, since its Pattern type clashes with pattern_store.h.
+void* trigram_store_create(void);
+void trigram_store_learn(void* store, const char* w1, const char* w2, const char* next);
+int trigram_store_find(void* store, const char* w1, const char* w2, const char* next);
+void trigram_store_shape(void* store, StoreShape* shape);
+void trigram_store_destroy(void* store);
+
+#endif // BENCHMARK_STORES_H
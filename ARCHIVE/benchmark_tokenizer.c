@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "vocabulary.h"
+#include "tokenizer.h"
+#include "parallel_training.h"
+
+#define DEFAULT_DATASET_DIR "../datasets"
+#define BENCH_LINE_SIZE (1 << 20)
+#define BENCH_PASSES 20
+#define MAX_TOKENS 100000
+
+// Buffer sizes of the tokenize_input copies this replaces
+#define LEGACY_INPUT_LENGTH 1024
+#define LEGACY_WORD_LENGTH 50
+#define LEGACY_MAX_TOKENS 100
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void load_directory(const char* path, TrainCorpus* corpus) {
+    DIR* dir = opendir(path);
+    if (!dir) return;
+    
+    struct dirent* entry;
+    char full_path[512];
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
+        
+        struct stat st;
+        if (stat(full_path, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            load_directory(full_path, corpus);
+        } else if (strstr(entry->d_name, ".txt")) {
+            train_corpus_load_file(corpus, full_path, BENCH_LINE_SIZE);
+        }
+    }
+    closedir(dir);
+}
+
+// The copy + strtok + tolower + strncpy tokenizer of v6-v8
+static int legacy_tokenize(const char* input, char tokens[][LEGACY_WORD_LENGTH], int max_tokens) {
+    int token_count = 0;
+    char temp[LEGACY_INPUT_LENGTH];
+    strncpy(temp, input, LEGACY_INPUT_LENGTH - 1);
+    temp[LEGACY_INPUT_LENGTH - 1] = '\0';
+    
+    char* token = strtok(temp, TOKEN_DELIMITERS);
+    while (token && token_count < max_tokens) {
+        for (int i = 0; token[i]; i++) {
+            token[i] = tolower(token[i]);
+        }
+        strncpy(tokens[token_count], token, LEGACY_WORD_LENGTH - 1);
+        tokens[token_count][LEGACY_WORD_LENGTH - 1] = '\0';
+        token_count++;
+        token = strtok(NULL, TOKEN_DELIMITERS);
+    }
+    
+    return token_count;
+}
+
+typedef enum {
+    MODE_LEGACY,
+    MODE_LEGACY_INTERN,
+    MODE_SPANS,
+    MODE_INTERN
+} BenchMode;
+
+static const char* mode_names[] = {
+    "strtok copy (1KB, 100 tokens)",
+    "strtok copy + vocab_intern",
+    "token spans",
+    "tokenize_intern"
+};
+
+// One pass over the corpus; returns the number of tokens seen
+static size_t run_pass(BenchMode mode, const TrainCorpus* corpus, Vocabulary* vocab, TokenSpan* spans, uint32_t* ids) {
+    static char legacy[LEGACY_MAX_TOKENS][LEGACY_WORD_LENGTH];
+    size_t tokens = 0;
+    
+    for (size_t l = 0; l < corpus->num_lines; l++) {
+        const char* line = corpus->lines[l];
+        int count = 0;
+        
+        switch (mode) {
+            case MODE_LEGACY:
+                count = legacy_tokenize(line, legacy, LEGACY_MAX_TOKENS);
+                break;
+            case MODE_LEGACY_INTERN:
+                count = legacy_tokenize(line, legacy, LEGACY_MAX_TOKENS);
+                for (int i = 0; i < count; i++) ids[i] = vocab_intern(vocab, legacy[i]);
+                break;
+            case MODE_SPANS:
+                count = tokenize_spans(line, strlen(line), spans, MAX_TOKENS);
+                break;
+            case MODE_INTERN:
+                count = tokenize_intern(vocab, line, strlen(line), ids, MAX_TOKENS);
+                break;
+        }
+        tokens += count;
+    }
+    
+    return tokens;
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = argc > 1 ? argv[1] : DEFAULT_DATASET_DIR;
+    
+    TrainCorpus corpus;
+    train_corpus_init(&corpus);
+    load_directory(path, &corpus);
+    
+    size_t bytes = 0;
+    for (size_t l = 0; l < corpus.num_lines; l++) bytes += strlen(corpus.lines[l]);
+    if (bytes == 0) {
+        printf("No .txt files under %s\n", path);
+        return 1;
+    }
+    
+    printf("=== Tokenizer Benchmark ===\n");
+    printf("Corpus: %s, %zu lines, %.2f MB, best of %d passes\n\n",
+           path, corpus.num_lines, bytes / (1024.0 * 1024.0), BENCH_PASSES);
+    
+    TokenSpan* spans = malloc(MAX_TOKENS * sizeof(TokenSpan));
+    uint32_t* ids = malloc(MAX_TOKENS * sizeof(uint32_t));
+    
+    for (int mode = MODE_LEGACY; mode <= MODE_INTERN; mode++) {
+        double best = 0;
+        size_t tokens = 0;
+        
+        for (int pass = 0; pass < BENCH_PASSES; pass++) {
+            // Interning modes start from a warm vocabulary after the first pass
+            Vocabulary* vocab = vocab_create();
+            run_pass((BenchMode)mode, &corpus, vocab, spans, ids);
+            
+            double start = now_seconds();
+            tokens = run_pass((BenchMode)mode, &corpus, vocab, spans, ids);
+            double elapsed = now_seconds() - start;
+            if (pass == 0 || elapsed < best) best = elapsed;
+            
+            vocab_destroy(vocab);
+        }
+        
+        printf("%-32s %9zu tokens  %8.1f MB/s  %7.1f M tokens/s\n", mode_names[mode], tokens,
+               bytes / (1024.0 * 1024.0) / best, tokens / best / 1e6);
+    }
+    
+    free(spans);
+    free(ids);
+    train_corpus_free(&corpus);
+    return 0;
+}
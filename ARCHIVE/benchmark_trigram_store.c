@@ -0,0 +1,68 @@
+// benchmark_stores.h adapter over the chained trigram table of
+// text_training_system.c
+#define TEXT_TRAINING_SYSTEM_NO_MAIN
+#include "text_training_system.c"
+#include "benchmark_stores.h"
+
+// Words longer than the table's fixed fields are cut, as the stream
+// tokenizer does
+static void clip_word(char* dst, const char* word) {
+    strncpy(dst, word, MAX_WORD_LENGTH - 1);
+    dst[MAX_WORD_LENGTH - 1] = '\0';
+}
+
+void* trigram_store_create(void) {
+    return create_training_system();
+}
+
+void trigram_store_learn(void* store, const char* w1, const char* w2, const char* next) {
+    char a[MAX_WORD_LENGTH], b[MAX_WORD_LENGTH], c[MAX_WORD_LENGTH];
+    clip_word(a, w1);
+    clip_word(b, w2);
+    clip_word(c, next);
+    learn_pattern_streaming(store, a, b, c);
+}
+
+// Same chain walk as learn_pattern_streaming, without inserting
+int trigram_store_find(void* store, const char* w1, const char* w2, const char* next) {
+    TrainingSystem* ts = store;
+    char a[MAX_WORD_LENGTH], b[MAX_WORD_LENGTH], c[MAX_WORD_LENGTH];
+    clip_word(a, w1);
+    clip_word(b, w2);
+    clip_word(c, next);
+    
+    for (Pattern* p = ts->patterns[compute_pattern_address(a, b)]; p; p = p->collision_next) {
+        if (strcmp(p->word1, a) == 0 && strcmp(p->word2, b) == 0 && strcmp(p->next, c) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Chain position of each pattern, averaged over patterns. Bytes count the
+// bucket array and the patterns.
+void trigram_store_shape(void* store, StoreShape* shape) {
+    TrainingSystem* ts = store;
+    size_t visits = 0;
+    uint32_t max_chain = 0;
+    size_t bytes = sizeof(TrainingSystem);
+    
+    for (int i = 0; i < HASH_SIZE; i++) {
+        uint32_t length = 0;
+        for (Pattern* p = ts->patterns[i]; p; p = p->collision_next) {
+            visits += ++length;
+            bytes += sizeof(Pattern);
+        }
+        if (length > max_chain) max_chain = length;
+    }
+    
+    shape->patterns = ts->total_patterns;
+    shape->bytes = bytes;
+    shape->avg_chain = ts->total_patterns ? (double)visits / ts->total_patterns : 0;
+    shape->max_chain = max_chain;
+    shape->load_factor = (double)ts->total_patterns / HASH_SIZE;
+}
+
+void trigram_store_destroy(void* store) {
+    destroy_training_system(store);
+}
@@ -0,0 +1,389 @@
+// In-process V8 benchmark: train once, then replay a query set against the
+// loaded model, timing each stage of every reply. Unlike test_v7_benchmark,
+// no process is started and nothing is retrained per query.
+//
+// The report is JSON on stdout; the engine's own messages go to stderr.
+#define GAIA_CHAT_V8_NO_MAIN
+#include "gaia_chat_v8.c"
+#include <sys/resource.h>
+
+#define BENCH_DEFAULT_PASSES 20
+#define BENCH_DEFAULT_TRAINING "conversational_flow.txt"
+#define BENCH_MAX_QUERIES 1024
+#define BENCH_SWAP_MODEL "benchmark_v8_swap.model"
+#define BENCH_SWAP_INTERVAL_MS 20
+
+// Queries of test_v7_benchmark
+static const char* default_queries[] = {
+    "What is 5 plus 3?",
+    "What is 10 minus 4?",
+    "What is 6 times 7?",
+    "What is 20 divided by 4?",
+    "What is 5 plus 3? What is 10 minus 2?",
+    "What is 15 plus 27? Also, explain addition.",
+    "What is 2 times 3? What is 12 divided by 4? What is 10 plus 5?",
+    "List three colors and explain why they are primary",
+    "Calculate factorial of 5 and explain what factorial means",
+    "",
+    "What is 1 plus 1 plus 1 plus 1 plus 1 plus 1 plus 1 plus 1 plus 1 plus 1?",
+    "What is 5 divided by 0?",
+    "What is factorial of 7?",
+    "Is 23 a prime number?",
+    "Hello there!",
+    "Goodbye!"
+};
+
+// Seconds per stage, summed over every reply
+typedef struct {
+    double tokenize;
+    double lookup;
+    double setup;
+    double workflow;
+    double attention;
+    double refinement;
+} StageTotals;
+
+// Read one query per line into queries; returns the count
+static int read_queries(const char* path, char** queries, int max_queries) {
+    FILE* file = fopen(path, "r");
+    if (!file) return -1;
+    
+    char line[MAX_INPUT_LENGTH];
+    int count = 0;
+    while (count < max_queries && fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = 0;
+        queries[count] = strdup(line);
+        if (queries[count]) count++;
+    }
+    fclose(file);
+    return count;
+}
+
+static void print_json_string(FILE* out, const char* text) {
+    fputc('"', out);
+    for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// Hot swap run: the main thread keeps replying while a swapper thread maps
+// the model again and publishes it every BENCH_SWAP_INTERVAL_MS
+typedef struct {
+    ModelSwap swap;
+    int swaps;
+    double* published;           // When each swap was published
+    double load;                 // Seconds mapping new versions, summed
+    double release;              // Seconds from publish to the old version freed, summed
+    int failed;
+    int done;
+} SwapRun;
+
+// Latencies of the replies in flight when a swap was published, of the
+// first reply started on each new version, and of all the others
+typedef struct {
+    double* in_flight;
+    double* first;
+    double* steady;
+    size_t num_in_flight, num_first, num_steady;
+} SwapLatencies;
+
+static void* swap_run_main(void* arg) {
+    SwapRun* run = arg;
+    for (int i = 0; i < run->swaps && !run->failed; i++) {
+        struct timespec pause = {0, BENCH_SWAP_INTERVAL_MS * 1000000L};
+        nanosleep(&pause, NULL);
+        
+        double start = now_seconds();
+        ChatSystem* version = load_chat_version(BENCH_SWAP_MODEL, 0);
+        if (!version) {
+            run->failed = 1;
+            break;
+        }
+        run->published[i] = now_seconds();
+        run->load += run->published[i] - start;
+        swap_publish(&run->swap, version);
+        
+        while (swap_reclaim(&run->swap) > 0) {
+            struct timespec poll = {0, 100000};
+            nanosleep(&poll, NULL);
+        }
+        run->release += now_seconds() - run->published[i];
+    }
+    __atomic_store_n(&run->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Reply through the swap until the swapper is done, then sort each reply
+// by where it fell relative to the swaps
+static int run_swaps(SwapRun* run, char** queries, int num_queries, V8Request* request,
+                     SwapLatencies* out) {
+    size_t capacity = 4096, count = 0;
+    double* starts = malloc(capacity * sizeof(double));
+    double* ends = malloc(capacity * sizeof(double));
+    pthread_t swapper;
+    if (!starts || !ends || pthread_create(&swapper, NULL, swap_run_main, run) != 0) {
+        free(starts);
+        free(ends);
+        return 0;
+    }
+    
+    while (!__atomic_load_n(&run->done, __ATOMIC_ACQUIRE)) {
+        if (count == capacity) {
+            capacity *= 2;
+            double* grown_starts = realloc(starts, capacity * sizeof(double));
+            if (grown_starts) starts = grown_starts;
+            double* grown_ends = realloc(ends, capacity * sizeof(double));
+            if (grown_ends) ends = grown_ends;
+            if (!grown_starts || !grown_ends) break;
+        }
+        
+        int slot;
+        starts[count] = now_seconds();
+        const ChatSystem* system = swap_enter(&run->swap, &slot);
+        generate_response_v8(system, request, queries[count % num_queries]);
+        swap_exit(&run->swap, slot);
+        ends[count++] = now_seconds();
+    }
+    pthread_join(swapper, NULL);
+    
+    out->in_flight = malloc(count * sizeof(double));
+    out->first = malloc(count * sizeof(double));
+    out->steady = malloc(count * sizeof(double));
+    out->num_in_flight = out->num_first = out->num_steady = 0;
+    int ok = !run->failed && out->in_flight && out->first && out->steady;
+    
+    // Publishes are in time order, as are replies
+    int next = 0;
+    int after_swap = 0;
+    for (size_t i = 0; ok && i < count; i++) {
+        while (next < run->swaps && run->published[next] <= starts[i]) {
+            next++;
+            after_swap = 1;
+        }
+        
+        double latency = ends[i] - starts[i];
+        if (next < run->swaps && run->published[next] < ends[i]) {
+            out->in_flight[out->num_in_flight++] = latency;
+        } else if (after_swap) {
+            out->first[out->num_first++] = latency;
+        } else {
+            out->steady[out->num_steady++] = latency;
+        }
+        after_swap = 0;
+    }
+    
+    free(starts);
+    free(ends);
+    return ok;
+}
+
+static void print_latency_json(FILE* out, const char* name, const double* latencies, size_t count,
+                               const char* suffix) {
+    BatchResult result = {.latencies = (double*)latencies, .count = count};
+    double mean = 0;
+    for (size_t i = 0; i < count; i++) mean += latencies[i];
+    if (count > 0) mean /= count;
+    fprintf(out, "    \"%s\": {\"replies\": %zu, \"mean_ms\": %.6f, \"p99_ms\": %.6f, \"max_ms\": %.6f}%s\n",
+            name, count, mean * 1000, batch_latency_percentile(&result, 99) * 1000,
+            batch_latency_percentile(&result, 100) * 1000, suffix);
+}
+
+// Peak resident set size in KB
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;   // Bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+int main(int argc, char* argv[]) {
+    const char* queries_path = NULL;
+    const char* training_path = BENCH_DEFAULT_TRAINING;
+    int passes = BENCH_DEFAULT_PASSES;
+    int swaps = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--queries") == 0 && i + 1 < argc) {
+            queries_path = argv[++i];
+        } else if (strcmp(argv[i], "--training") == 0 && i + 1 < argc) {
+            training_path = argv[++i];
+        } else if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc) {
+            passes = atoi(argv[++i]);
+            if (passes < 1) passes = 1;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            training_threads = atoi(argv[++i]);
+            if (training_threads < 1) training_threads = 1;
+            if (training_threads > TRAIN_MAX_THREADS) training_threads = TRAIN_MAX_THREADS;
+        } else if (strcmp(argv[i], "--swaps") == 0 && i + 1 < argc) {
+            swaps = atoi(argv[++i]);
+            if (swaps < 0) swaps = 0;
+        } else {
+            fprintf(stderr, "Usage: %s [--queries file] [--training file] [--passes n] [--threads n] [--swaps n]\n", argv[0]);
+            return 1;
+        }
+    }
+    
+    // Keep stdout for the report
+    FILE* report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!report || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) return 1;
+    
+    char* queries[BENCH_MAX_QUERIES];
+    int num_queries;
+    if (queries_path) {
+        num_queries = read_queries(queries_path, queries, BENCH_MAX_QUERIES);
+        if (num_queries <= 0) {
+            fprintf(stderr, "No queries in %s\n", queries_path);
+            return 1;
+        }
+    } else {
+        num_queries = sizeof(default_queries) / sizeof(default_queries[0]);
+        for (int q = 0; q < num_queries; q++) queries[q] = strdup(default_queries[q]);
+    }
+    
+    function_registry_init();
+    register_gaia_functions();
+    
+    double start = now_seconds();
+    ChatSystem* system = init_chat_system(0);
+    if (!system || !load_training_data(system, training_path)) {
+        fprintf(stderr, "Training on %s failed\n", training_path);
+        return 1;
+    }
+    double training = now_seconds() - start;
+    
+    // Replies as the chat loop gives them, minus the experiment log
+    V8Request request = V8_DEFAULT_REQUEST;
+    V8Timings timings;
+    char reply[MAX_RESPONSE_LENGTH];
+    request.log_experiments = 0;
+    request.output = reply;
+    request.output_size = sizeof(reply);
+    request.timings = &timings;
+    
+    size_t num_replies = (size_t)passes * num_queries;
+    double* latencies = malloc(num_replies * sizeof(double));
+    double* query_totals = calloc(num_queries, sizeof(double));
+    if (!latencies || !query_totals) return 1;
+    
+    StageTotals stages = {0};
+    uint32_t ids[CONTEXT_SIZE];
+    const ContextNode* nodes[CONTEXT_SIZE + 1];
+    size_t matched_words = 0;
+    size_t r = 0;
+    
+    start = now_seconds();
+    for (int pass = 0; pass < passes; pass++) {
+        for (int q = 0; q < num_queries; q++) {
+            const char* query = queries[q];
+            
+            // The model's view of the query: its word IDs and the longest
+            // context the tree holds for them
+            double stage_start = now_seconds();
+            int num_ids = tokenize_lookup(system->vocab, query, strlen(query), ids, CONTEXT_SIZE);
+            double tokenized = now_seconds();
+            matched_words += context_tree_match(system->tree, ids, num_ids, nodes);
+            double looked_up = now_seconds();
+            generate_response_v8(system, &request, query);
+            double replied = now_seconds();
+            
+            stages.tokenize += tokenized - stage_start;
+            stages.lookup += looked_up - tokenized;
+            stages.setup += timings.setup;
+            stages.workflow += timings.workflow;
+            stages.attention += timings.attention;
+            stages.refinement += timings.refinement;
+            
+            latencies[r++] = replied - stage_start;
+            query_totals[q] += replied - stage_start;
+        }
+    }
+    
+    BatchResult result = {
+        .latencies = latencies,
+        .count = num_replies,
+        .elapsed = now_seconds() - start
+    };
+    double mean = 0;
+    for (size_t i = 0; i < num_replies; i++) mean += latencies[i];
+    mean /= num_replies;
+    
+    // Swaps replace the trained model with the same patterns mapped from a
+    // snapshot, so any change in latency comes from the swap itself
+    SwapRun run = {.swaps = swaps};
+    SwapLatencies swap_latencies = {0};
+    if (swaps > 0) {
+        run.published = calloc(swaps, sizeof(double));
+        ChatSystem* initial = NULL;
+        if (run.published && snapshot_write(BENCH_SWAP_MODEL, system->vocab, system->tree, 1)) {
+            initial = load_chat_version(BENCH_SWAP_MODEL, 0);
+        }
+        if (!initial || !swap_init(&run.swap, initial, release_chat_version) ||
+            !run_swaps(&run, queries, num_queries, &request, &swap_latencies)) {
+            fprintf(stderr, "Hot swap run failed\n");
+            return 1;
+        }
+        swap_destroy(&run.swap);
+        remove(BENCH_SWAP_MODEL);
+    }
+    
+    fprintf(report, "{\n");
+    fprintf(report, "  \"benchmark\": \"gaia_chat_v8\",\n");
+    fprintf(report, "  \"queries\": %d,\n", num_queries);
+    fprintf(report, "  \"passes\": %d,\n", passes);
+    fprintf(report, "  \"replies\": %zu,\n", num_replies);
+    fprintf(report, "  \"training\": {\"file\": ");
+    print_json_string(report, training_path);
+    fprintf(report, ", \"threads\": %d, \"ms\": %.3f, \"patterns\": %zu, \"words\": %zu},\n",
+            training_threads, training * 1000, system->tree->num_patterns, system->tree->total_words);
+    fprintf(report, "  \"stage_ms_per_reply\": {\"tokenize\": %.6f, \"lookup\": %.6f, \"setup\": %.6f, "
+            "\"workflow\": %.6f, \"attention\": %.6f, \"refinement\": %.6f},\n",
+            stages.tokenize * 1000 / num_replies, stages.lookup * 1000 / num_replies,
+            stages.setup * 1000 / num_replies, stages.workflow * 1000 / num_replies,
+            stages.attention * 1000 / num_replies, stages.refinement * 1000 / num_replies);
+    fprintf(report, "  \"latency_ms\": {\"mean\": %.6f, \"p50\": %.6f, \"p95\": %.6f, \"p99\": %.6f, \"max\": %.6f},\n",
+            mean * 1000, batch_latency_percentile(&result, 50) * 1000,
+            batch_latency_percentile(&result, 95) * 1000, batch_latency_percentile(&result, 99) * 1000,
+            batch_latency_percentile(&result, 100) * 1000);
+    fprintf(report, "  \"throughput_qps\": %.1f,\n", batch_queries_per_second(&result));
+    fprintf(report, "  \"matched_words_per_reply\": %.3f,\n", (double)matched_words / num_replies);
+    if (swaps > 0) {
+        fprintf(report, "  \"hot_swap\": {\n");
+        fprintf(report, "    \"swaps\": %d, \"interval_ms\": %d, \"load_ms\": %.6f, \"release_ms\": %.6f,\n",
+                swaps, BENCH_SWAP_INTERVAL_MS, run.load * 1000 / swaps, run.release * 1000 / swaps);
+        print_latency_json(report, "in_flight", swap_latencies.in_flight, swap_latencies.num_in_flight, ",");
+        print_latency_json(report, "first_after_swap", swap_latencies.first, swap_latencies.num_first, ",");
+        print_latency_json(report, "steady", swap_latencies.steady, swap_latencies.num_steady, "");
+        fprintf(report, "  },\n");
+    }
+    fprintf(report, "  \"peak_rss_kb\": %ld,\n", peak_rss_kb());
+    fprintf(report, "  \"per_query_mean_ms\": [\n");
+    for (int q = 0; q < num_queries; q++) {
+        fprintf(report, "    {\"query\": ");
+        print_json_string(report, queries[q]);
+        fprintf(report, ", \"ms\": %.6f}%s\n", query_totals[q] * 1000 / passes, q + 1 < num_queries ? "," : "");
+    }
+    fprintf(report, "  ]\n");
+    fprintf(report, "}\n");
+    fclose(report);
+    
+    for (int q = 0; q < num_queries; q++) free(queries[q]);
+    free(latencies);
+    free(query_totals);
+    free(run.published);
+    free(swap_latencies.in_flight);
+    free(swap_latencies.first);
+    free(swap_latencies.steady);
+    function_registry_cleanup();
+    destroy_chat_system(system);
+    return 0;
+}
@@ -0,0 +1,547 @@
+#include "context_tree.h"
+#include <stdlib.h>
+#include <string.h>
+
+static ContextNode* create_node(ContextTree* tree, uint32_t token) {
+    ContextNode* node = arena_calloc(tree->arena, sizeof(ContextNode));
+    if (!node) return NULL;
+    
+    node->token = token;
+    tree->num_nodes++;
+    tree->node_bytes += sizeof(ContextNode);
+    return node;
+}
+
+ContextTree* context_tree_create(int max_depth) {
+    if (max_depth < 1 || max_depth > CONTEXT_TREE_MAX_DEPTH) return NULL;
+    
+    ContextTree* tree = calloc(1, sizeof(ContextTree));
+    if (!tree) return NULL;
+    
+    tree->max_depth = max_depth;
+    tree->arena = arena_create(ARENA_DEFAULT_BLOCK_SIZE);
+    tree->root = tree->arena ? create_node(tree, 0) : NULL;
+    if (!tree->root) {
+        arena_destroy(tree->arena);
+        free(tree);
+        return NULL;
+    }
+    
+    return tree;
+}
+
+void context_tree_destroy(ContextTree* tree) {
+    if (!tree) return;
+    arena_destroy(tree->arena);
+    free(tree);
+}
+
+// Move an array into a larger slab, returning the old one for reuse
+static void* grow_array(ContextTree* tree, void* old, uint32_t count, uint32_t old_capacity,
+                        uint32_t new_capacity, size_t elem_size) {
+    void* array = arena_alloc_slab(tree->arena, new_capacity * elem_size);
+    if (!array) return NULL;
+    
+    if (old) {
+        memcpy(array, old, count * elem_size);
+        arena_free_slab(tree->arena, old, old_capacity * elem_size);
+    }
+    return array;
+}
+
+// Binary search for token among sorted children; returns insert position
+static uint32_t child_position(const ContextNode* node, uint32_t token) {
+    uint32_t lo = 0, hi = node->num_children;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (node->children[mid]->token < token) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Binary search for next among sorted continuations; returns insert position
+static uint32_t continuation_position(const ContextNode* node, uint32_t next) {
+    uint32_t lo = 0, hi = node->num_continuations;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (node->continuations[mid].next < next) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+const ContextNode* context_node_child(const ContextNode* node, uint32_t token) {
+    uint32_t pos = child_position(node, token);
+    if (pos < node->num_children && node->children[pos]->token == token) {
+        return node->children[pos];
+    }
+    return NULL;
+}
+
+const Continuation* context_node_find(const ContextNode* node, uint32_t next) {
+    uint32_t pos = continuation_position(node, next);
+    if (pos < node->num_continuations && node->continuations[pos].next == next) {
+        return &node->continuations[pos];
+    }
+    return NULL;
+}
+
+// Find or create the child for token
+static ContextNode* get_child(ContextTree* tree, ContextNode* node, uint32_t token) {
+    uint32_t pos = child_position(node, token);
+    if (pos < node->num_children && node->children[pos]->token == token) {
+        return node->children[pos];
+    }
+    
+    if (node->num_children >= node->child_capacity) {
+        uint32_t new_capacity = node->child_capacity ? node->child_capacity * 2 : 2;
+        ContextNode** children = grow_array(tree, node->children, node->num_children,
+                                            node->child_capacity, new_capacity, sizeof(ContextNode*));
+        if (!children) return NULL;
+        tree->node_bytes += (new_capacity - node->child_capacity) * sizeof(ContextNode*);
+        node->children = children;
+        node->child_capacity = new_capacity;
+    }
+    
+    ContextNode* child = create_node(tree, token);
+    if (!child) return NULL;
+    
+    memmove(&node->children[pos + 1], &node->children[pos],
+            (node->num_children - pos) * sizeof(ContextNode*));
+    node->children[pos] = child;
+    node->num_children++;
+    return child;
+}
+
+// Drop a node's ranking before its counts change
+static void unrank(ContextTree* tree, ContextNode* node) {
+    if (!node->ranked) return;
+    
+    // Single continuations are ranked in place
+    if (node->ranked != node->continuations) {
+        size_t bytes = node->num_continuations * sizeof(Continuation);
+        arena_free_slab(tree->arena, node->ranked, bytes);
+        tree->node_bytes -= bytes;
+    }
+    node->ranked = NULL;
+    tree->num_ranked--;
+}
+
+// Add count to a continuation; returns 1 if it is new
+static int add_continuation(ContextTree* tree, ContextNode* node, uint32_t next, uint32_t count) {
+    unrank(tree, node);
+    uint32_t pos = continuation_position(node, next);
+    node->total_count += count;
+    
+    if (pos < node->num_continuations && node->continuations[pos].next == next) {
+        node->continuations[pos].count += count;
+        return 0;
+    }
+    
+    if (node->num_continuations >= node->continuation_capacity) {
+        uint32_t new_capacity = node->continuation_capacity ? node->continuation_capacity * 2 : 2;
+        Continuation* conts = grow_array(tree, node->continuations, node->num_continuations,
+                                         node->continuation_capacity, new_capacity, sizeof(Continuation));
+        if (!conts) {
+            node->total_count -= count;
+            return -1;
+        }
+        tree->node_bytes += (new_capacity - node->continuation_capacity) * sizeof(Continuation);
+        node->continuations = conts;
+        node->continuation_capacity = new_capacity;
+    }
+    
+    memmove(&node->continuations[pos + 1], &node->continuations[pos],
+            (node->num_continuations - pos) * sizeof(Continuation));
+    node->continuations[pos].next = next;
+    node->continuations[pos].count = count;
+    node->num_continuations++;
+    return 1;
+}
+
+int context_tree_add(ContextTree* tree, const uint32_t* context, int context_length, uint32_t next, uint32_t count) {
+    if (context_length < 0 || context_length > tree->max_depth) return -1;
+    
+    ContextNode* node = tree->root;
+    for (int d = 1; d <= context_length; d++) {
+        node = get_child(tree, node, context[context_length - d]);
+        if (!node) return -1;
+    }
+    
+    int added = add_continuation(tree, node, next, count);
+    if (added == 1) {
+        tree->num_patterns++;
+        tree->patterns_by_length[context_length]++;
+    }
+    if (added >= 0) tree->total_words += count;
+    return added;
+}
+
+// FNV-1a step over a token ID, building the sketch key of a pattern from
+// its next word back through its context
+static inline uint64_t pattern_key(uint64_t key, uint32_t token) {
+    return (key ^ token) * 0x100000001b3ull;
+}
+
+// Count to add for next after (token, node's context): 1 if the tree holds
+// the pattern, its estimate once the sketch promotes it, else 0
+static uint32_t admitted_count(const ContextNode* node, uint32_t token, uint32_t next, uint64_t key,
+                               const ContextAdmission* admission) {
+    const ContextNode* child = context_node_child(node, token);
+    if (child && context_node_find(child, next)) return 1;
+    
+    uint32_t estimate = count_min_add(admission->sketch, key, 1);
+    return estimate >= admission->promote_at ? estimate : 0;
+}
+
+// Single pass over a line: for each position, walk back through the
+// preceding tokens once and count the word at every context length.
+// Only positions whose preceding token falls in the shard are counted.
+static size_t ingest_positions(ContextTree* tree, const uint32_t* tokens, int num_tokens, int min_length,
+                               uint32_t num_shards, uint32_t shard, const ContextAdmission* admission) {
+    size_t added = 0;
+    if (min_length < 1) min_length = 1;
+    
+    for (int i = min_length; i < num_tokens; i++) {
+        if (num_shards > 1 && tokens[i - 1] % num_shards != shard) continue;
+        
+        ContextNode* node = tree->root;
+        int depth = i < tree->max_depth ? i : tree->max_depth;
+        uint64_t key = pattern_key(0xcbf29ce484222325ull, tokens[i]);
+        
+        for (int d = 1; d <= depth; d++) {
+            uint32_t count = 1;
+            if (admission) {
+                key = pattern_key(key, tokens[i - d]);
+                if (d >= admission->min_depth && d >= min_length) {
+                    count = admitted_count(node, tokens[i - d], tokens[i], key, admission);
+                    if (count == 0) break;
+                }
+            }
+            
+            node = get_child(tree, node, tokens[i - d]);
+            if (!node) return added;
+            
+            if (d < min_length) continue;
+            
+            int result = add_continuation(tree, node, tokens[i], count);
+            if (result < 0) return added;
+            if (result == 1) {
+                tree->num_patterns++;
+                tree->patterns_by_length[d]++;
+            }
+            tree->total_words += count;
+            added++;
+        }
+    }
+    
+    return added;
+}
+
+size_t context_tree_ingest(ContextTree* tree, const uint32_t* tokens, int num_tokens, int min_length) {
+    return ingest_positions(tree, tokens, num_tokens, min_length, 1, 0, NULL);
+}
+
+size_t context_tree_ingest_admitted(ContextTree* tree, const uint32_t* tokens, int num_tokens, int min_length,
+                                    const ContextAdmission* admission) {
+    return ingest_positions(tree, tokens, num_tokens, min_length, 1, 0, admission);
+}
+
+size_t context_tree_ingest_shard(ContextTree* tree, const uint32_t* tokens, int num_tokens, int min_length,
+                                 uint32_t num_shards, uint32_t shard) {
+    return ingest_positions(tree, tokens, num_tokens, min_length, num_shards, shard, NULL);
+}
+
+// Merge src (at depth) into dst, moving src's nodes where dst has none
+static int merge_node(ContextTree* tree, ContextNode* dst, ContextNode* src, int depth) {
+    if (src->ranked) tree->num_ranked--;   // src itself is discarded
+    
+    for (uint32_t i = 0; i < src->num_continuations; i++) {
+        const Continuation* c = &src->continuations[i];
+        int result = add_continuation(tree, dst, c->next, c->count);
+        if (result < 0) return 0;
+        if (result == 0) {
+            tree->num_patterns--;
+            tree->patterns_by_length[depth]--;
+        }
+    }
+    
+    for (uint32_t i = 0; i < src->num_children; i++) {
+        ContextNode* child = src->children[i];
+        uint32_t pos = child_position(dst, child->token);
+        
+        if (pos < dst->num_children && dst->children[pos]->token == child->token) {
+            tree->num_nodes--;
+            tree->node_bytes -= sizeof(ContextNode);
+            if (!merge_node(tree, dst->children[pos], child, depth + 1)) return 0;
+            continue;
+        }
+        
+        if (dst->num_children >= dst->child_capacity) {
+            uint32_t new_capacity = dst->child_capacity ? dst->child_capacity * 2 : 2;
+            ContextNode** children = grow_array(tree, dst->children, dst->num_children,
+                                                dst->child_capacity, new_capacity, sizeof(ContextNode*));
+            if (!children) return 0;
+            tree->node_bytes += (new_capacity - dst->child_capacity) * sizeof(ContextNode*);
+            dst->children = children;
+            dst->child_capacity = new_capacity;
+        }
+        
+        memmove(&dst->children[pos + 1], &dst->children[pos],
+                (dst->num_children - pos) * sizeof(ContextNode*));
+        dst->children[pos] = child;
+        dst->num_children++;
+    }
+    
+    return 1;
+}
+
+static int compare_ranked(const void* a, const void* b) {
+    const Continuation* x = a;
+    const Continuation* y = b;
+    if (x->count != y->count) return x->count > y->count ? -1 : 1;
+    return x->next < y->next ? -1 : (x->next > y->next);
+}
+
+// Build a node's ranked array; returns 1 if it was built
+static int rank_node(ContextTree* tree, ContextNode* node) {
+    if (node->ranked || node->num_continuations == 0) return 0;
+    
+    if (node->num_continuations == 1) {
+        node->ranked = node->continuations;
+    } else {
+        size_t bytes = node->num_continuations * sizeof(Continuation);
+        node->ranked = arena_alloc_slab(tree->arena, bytes);
+        if (!node->ranked) return 0;
+        
+        memcpy(node->ranked, node->continuations, bytes);
+        qsort(node->ranked, node->num_continuations, sizeof(Continuation), compare_ranked);
+        tree->node_bytes += bytes;
+    }
+    
+    tree->num_ranked++;
+    return 1;
+}
+
+static size_t freeze_node(ContextTree* tree, ContextNode* node) {
+    size_t ranked = rank_node(tree, node);
+    for (uint32_t i = 0; i < node->num_children; i++) {
+        ranked += freeze_node(tree, node->children[i]);
+    }
+    return ranked;
+}
+
+// Rank every unranked node; returns how many were ranked
+size_t context_tree_freeze(ContextTree* tree) {
+    return freeze_node(tree, tree->root);
+}
+
+const Continuation* context_tree_ranked(ContextTree* tree, const ContextNode* node) {
+    // Nodes belong to the tree, so a stale ranking can be rebuilt in place
+    if (!node->ranked) rank_node(tree, (ContextNode*)node);
+    return node->num_continuations ? node->ranked : node->continuations;
+}
+
+int context_tree_merge(ContextTree* dst, ContextTree* src) {
+    if (dst->max_depth != src->max_depth) return 0;
+    
+    // Nodes moved out of src stay in its blocks, so dst takes them over
+    arena_adopt(dst->arena, src->arena);
+    
+    // Start from src's totals and subtract what turns out to be shared
+    dst->num_nodes += src->num_nodes - 1;
+    dst->num_patterns += src->num_patterns;
+    dst->num_ranked += src->num_ranked;
+    dst->total_words += src->total_words;
+    dst->node_bytes += src->node_bytes - sizeof(ContextNode);
+    for (int d = 0; d <= CONTEXT_TREE_MAX_DEPTH; d++) {
+        dst->patterns_by_length[d] += src->patterns_by_length[d];
+    }
+    
+    int ok = merge_node(dst, dst->root, src->root, 0);
+    
+    arena_destroy(src->arena);
+    free(src);
+    return ok;
+}
+
+static int add_subtree(ContextTree* dst, const ContextNode* node, uint32_t* context, int depth) {
+    int max_depth = dst->max_depth;
+    
+    for (uint32_t i = 0; i < node->num_continuations; i++) {
+        const Continuation* c = &node->continuations[i];
+        if (context_tree_add(dst, context + max_depth - depth, depth, c->next, c->count) < 0) return 0;
+    }
+    
+    for (uint32_t i = 0; i < node->num_children && depth < max_depth; i++) {
+        context[max_depth - depth - 1] = node->children[i]->token;
+        if (!add_subtree(dst, node->children[i], context, depth + 1)) return 0;
+    }
+    
+    return 1;
+}
+
+// Add every count in src to dst, leaving src untouched
+int context_tree_add_tree(ContextTree* dst, const ContextTree* src) {
+    uint32_t context[CONTEXT_TREE_MAX_DEPTH];
+    if (dst->max_depth < src->max_depth) return 0;
+    return add_subtree(dst, src->root, context, 0);
+}
+
+// Copy state for context_tree_prune. Surviving children are collected on
+// one shared stack, so each kept node gets an exactly sized child array.
+typedef struct {
+    ContextTree* dst;
+    uint32_t min_count;
+    int min_depth;
+    ContextNode** stack;
+    size_t top;
+    size_t capacity;
+} PruneState;
+
+static int push_child(PruneState* state, ContextNode* child) {
+    if (state->top >= state->capacity) {
+        size_t capacity = state->capacity ? state->capacity * 2 : 1024;
+        ContextNode** stack = realloc(state->stack, capacity * sizeof(ContextNode*));
+        if (!stack) return 0;
+        state->stack = stack;
+        state->capacity = capacity;
+    }
+    state->stack[state->top++] = child;
+    return 1;
+}
+
+// Copy what survives of node; *copy stays NULL when nothing does
+static int prune_node(PruneState* state, const ContextNode* node, int depth, ContextNode** copy) {
+    ContextTree* dst = state->dst;
+    uint32_t min_count = depth >= state->min_depth ? state->min_count : 0;
+    *copy = NULL;
+    
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < node->num_continuations; i++) {
+        if (node->continuations[i].count >= min_count) kept++;
+    }
+    
+    size_t frame = state->top;
+    for (uint32_t i = 0; i < node->num_children && depth < dst->max_depth; i++) {
+        ContextNode* child;
+        if (!prune_node(state, node->children[i], depth + 1, &child)) return 0;
+        if (child && !push_child(state, child)) return 0;
+    }
+    
+    uint32_t num_children = (uint32_t)(state->top - frame);
+    if (depth > 0 && kept == 0 && num_children == 0) return 1;
+    
+    ContextNode* result = depth == 0 ? dst->root : create_node(dst, node->token);
+    if (!result) return 0;
+    
+    if (num_children > 0) {
+        result->children = arena_alloc_slab(dst->arena, num_children * sizeof(ContextNode*));
+        if (!result->children) return 0;
+        memcpy(result->children, &state->stack[frame], num_children * sizeof(ContextNode*));
+        result->num_children = result->child_capacity = num_children;
+        dst->node_bytes += num_children * sizeof(ContextNode*);
+        state->top = frame;
+    }
+    
+    if (kept > 0) {
+        result->continuations = arena_alloc_slab(dst->arena, kept * sizeof(Continuation));
+        if (!result->continuations) return 0;
+        
+        for (uint32_t i = 0; i < node->num_continuations; i++) {
+            const Continuation* c = &node->continuations[i];
+            if (c->count < min_count) continue;
+            result->continuations[result->num_continuations++] = *c;
+            result->total_count += c->count;
+            dst->total_words += c->count;
+        }
+        result->continuation_capacity = kept;
+        dst->node_bytes += kept * sizeof(Continuation);
+        dst->num_patterns += kept;
+        dst->patterns_by_length[depth] += kept;
+    }
+    
+    *copy = result;
+    return 1;
+}
+
+ContextTree* context_tree_prune(const ContextTree* tree, uint32_t min_count, int min_depth) {
+    PruneState state = {0};
+    state.dst = context_tree_create(tree->max_depth);
+    state.min_count = min_count;
+    state.min_depth = min_depth;
+    if (!state.dst) return NULL;
+    
+    ContextNode* root;
+    int ok = prune_node(&state, tree->root, 0, &root);
+    free(state.stack);
+    
+    if (!ok) {
+        context_tree_destroy(state.dst);
+        return NULL;
+    }
+    return state.dst;
+}
+
+int context_tree_match(const ContextTree* tree, const uint32_t* context, int context_length, const ContextNode** nodes) {
+    const ContextNode* node = tree->root;
+    int limit = context_length < tree->max_depth ? context_length : tree->max_depth;
+    int depth = 0;
+    
+    nodes[0] = node;
+    while (depth < limit) {
+        node = context_node_child(node, context[context_length - depth - 1]);
+        if (!node) break;
+        nodes[++depth] = node;
+    }
+    
+    return depth;
+}
+
+void context_tree_match_batch(const ContextTree* tree, const uint32_t* const* contexts, const int* context_lengths,
+                              int count, const ContextNode** nodes, int* depths) {
+    int stride = tree->max_depth + 1;
+    int walking = 0;
+    
+    for (int i = 0; i < count; i++) {
+        nodes[i * stride] = tree->root;
+        depths[i] = 0;
+        if (context_lengths[i] > 0) walking++;
+    }
+    
+    for (int depth = 0; walking > 0; depth++) {
+        // The first probe of each search reads the middle child slot
+        for (int i = 0; i < count; i++) {
+            if (depths[i] != depth) continue;
+            const ContextNode* node = nodes[i * stride + depth];
+            if (node->num_children) __builtin_prefetch(&node->children[node->num_children / 2]);
+        }
+        
+        walking = 0;
+        for (int i = 0; i < count; i++) {
+            int limit = context_lengths[i] < tree->max_depth ? context_lengths[i] : tree->max_depth;
+            if (depths[i] != depth || depth >= limit) continue;
+            
+            const ContextNode* child = context_node_child(nodes[i * stride + depth],
+                                                          contexts[i][context_lengths[i] - depth - 1]);
+            if (!child) continue;
+            
+            __builtin_prefetch(child);
+            nodes[i * stride + depth + 1] = child;
+            depths[i] = depth + 1;
+            if (depth + 1 < limit) walking++;
+        }
+    }
+}
+
+size_t context_tree_memory_usage(const ContextTree* tree) {
+    if (!tree) return 0;
+    return sizeof(ContextTree) + sizeof(Arena) + tree->arena->bytes_reserved;
+}
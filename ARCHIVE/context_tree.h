@@ -0,0 +1,107 @@
+#ifndef CONTEXT_TREE_H
+#define CONTEXT_TREE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "arena.h"
+#include "count_min.h"
+
+// Deepest context the tree will index
+#define CONTEXT_TREE_MAX_DEPTH 100
+
+// Count of one word following a context
+typedef struct {
+    uint32_t next;     // Vocabulary ID
+    uint32_t count;
+} Continuation;
+
+// Node for the context ending in the tokens on the path from the root.
+// The tree is keyed right-to-left: a child of the node for context C
+// represents (token, C), so one walk from the root visits every suffix
+// of a context from shortest to longest.
+typedef struct ContextNode {
+    uint32_t token;                  // Token this edge prepends to the context
+    uint32_t num_children;
+    uint32_t child_capacity;
+    uint32_t num_continuations;
+    uint32_t continuation_capacity;
+    uint32_t total_count;            // Sum of continuation counts
+    struct ContextNode** children;   // Sorted by token
+    Continuation* continuations;     // Sorted by next
+    Continuation* ranked;            // By descending count once frozen; NULL when stale
+} ContextNode;
+
+// Suffix trie over token IDs
+typedef struct {
+    ContextNode* root;
+    int max_depth;
+    
+    size_t num_nodes;
+    size_t num_patterns;             // Distinct (context, next) pairs
+    size_t total_words;              // Continuation counts added
+    size_t node_bytes;               // Bytes held by nodes, child and continuation arrays
+    size_t patterns_by_length[CONTEXT_TREE_MAX_DEPTH + 1];
+    size_t num_ranked;               // Nodes with a current ranked array
+    Arena* arena;                    // Owns nodes and their arrays
+} ContextTree;
+
+// Lifecycle. Nodes live in the tree's arena, so destroying a tree frees
+// its blocks without walking the nodes.
+ContextTree* context_tree_create(int max_depth);
+void context_tree_destroy(ContextTree* tree);
+
+// Training
+int context_tree_add(ContextTree* tree, const uint32_t* context, int context_length, uint32_t next, uint32_t count);
+size_t context_tree_ingest(ContextTree* tree, const uint32_t* tokens, int num_tokens, int min_length);
+
+// Approximate counting for rare deep patterns. A pattern the tree does not
+// hold yet, with a context of at least min_depth tokens, is counted in the
+// sketch and enters the tree with its estimate once that reaches
+// promote_at. No pattern is seen more often than its shorter suffix, so
+// the walk stops at the first length still in the sketch.
+typedef struct {
+    CountMinSketch* sketch;
+    int min_depth;
+    uint32_t promote_at;
+} ContextAdmission;
+
+size_t context_tree_ingest_admitted(ContextTree* tree, const uint32_t* tokens, int num_tokens, int min_length,
+                                    const ContextAdmission* admission);
+
+// Parallel training: each shard counts only positions whose preceding token
+// is congruent to shard, so shard trees share no nodes below the root and
+// merge by moving subtrees. Counts are summed, so the merged tree is the
+// same whatever the shard count or merge order.
+size_t context_tree_ingest_shard(ContextTree* tree, const uint32_t* tokens, int num_tokens, int min_length,
+                                 uint32_t num_shards, uint32_t shard);
+int context_tree_merge(ContextTree* dst, ContextTree* src);    // Consumes src
+int context_tree_add_tree(ContextTree* dst, const ContextTree* src);
+
+// Memory budget: copy the tree into a fresh arena, leaving out patterns
+// seen fewer than min_count times after contexts of min_depth or more
+// tokens, and nodes left with nothing below them. The caller destroys the
+// original to hand its memory back. The copy is unranked.
+ContextTree* context_tree_prune(const ContextTree* tree, uint32_t min_count, int min_depth);
+
+// Lookup: nodes[d] receives the node for the last d tokens of context, for
+// d = 0 .. returned depth. Longer suffixes than the returned depth are unseen.
+int context_tree_match(const ContextTree* tree, const uint32_t* context, int context_length, const ContextNode** nodes);
+const ContextNode* context_node_child(const ContextNode* node, uint32_t token);
+
+// Match count contexts level by level. At each level the next lookups of
+// every context are prefetched before any is searched, so the cache misses
+// of independent walks overlap. nodes holds count rows of max_depth + 1.
+void context_tree_match_batch(const ContextTree* tree, const uint32_t* const* contexts, const int* context_lengths,
+                              int count, const ContextNode** nodes, int* depths);
+const Continuation* context_node_find(const ContextNode* node, uint32_t next);
+
+// Serving: rank each context's continuations by count after training, so
+// the best next words are a prefix of one array. Adding to a context drops
+// its ranking, which context_tree_ranked rebuilds on the next read.
+size_t context_tree_freeze(ContextTree* tree);
+const Continuation* context_tree_ranked(ContextTree* tree, const ContextNode* node);   // NULL if out of memory
+
+// Statistics
+size_t context_tree_memory_usage(const ContextTree* tree);
+
+#endif // CONTEXT_TREE_H
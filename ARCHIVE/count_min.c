@@ -0,0 +1,79 @@
+#include "count_min.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Smallest sketch worth building
+#define COUNT_MIN_MIN_WIDTH 1024
+
+// Per-row multipliers; odd, so each row scatters keys differently
+static const uint64_t row_seeds[COUNT_MIN_ROWS] = {
+    0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull, 0xd6e8feb86659fd93ull
+};
+
+// Counter index of key in row
+static inline uint32_t row_index(const CountMinSketch* sketch, int row, uint64_t key) {
+    uint64_t h = (key ^ (key >> 31)) * row_seeds[row];
+    return (uint32_t)(h >> 32) & (sketch->width - 1);
+}
+
+CountMinSketch* count_min_create(size_t bytes) {
+    uint32_t width = COUNT_MIN_MIN_WIDTH;
+    while ((size_t)width * 2 * COUNT_MIN_ROWS * sizeof(uint32_t) <= bytes && width < (1u << 30)) {
+        width *= 2;
+    }
+    
+    CountMinSketch* sketch = calloc(1, sizeof(CountMinSketch));
+    if (!sketch) return NULL;
+    
+    sketch->width = width;
+    sketch->counters = calloc((size_t)width * COUNT_MIN_ROWS, sizeof(uint32_t));
+    if (!sketch->counters) {
+        free(sketch);
+        return NULL;
+    }
+    return sketch;
+}
+
+void count_min_destroy(CountMinSketch* sketch) {
+    if (!sketch) return;
+    free(sketch->counters);
+    free(sketch);
+}
+
+void count_min_clear(CountMinSketch* sketch) {
+    memset(sketch->counters, 0, (size_t)sketch->width * COUNT_MIN_ROWS * sizeof(uint32_t));
+    sketch->total = 0;
+}
+
+uint32_t count_min_add(CountMinSketch* sketch, uint64_t key, uint32_t count) {
+    uint32_t* cells[COUNT_MIN_ROWS];
+    uint32_t estimate = UINT32_MAX;
+    
+    for (int row = 0; row < COUNT_MIN_ROWS; row++) {
+        cells[row] = &sketch->counters[(size_t)row * sketch->width + row_index(sketch, row, key)];
+        if (*cells[row] < estimate) estimate = *cells[row];
+    }
+    
+    // Raise only the counters that are below the new estimate
+    uint32_t target = estimate > UINT32_MAX - count ? UINT32_MAX : estimate + count;
+    for (int row = 0; row < COUNT_MIN_ROWS; row++) {
+        if (*cells[row] < target) *cells[row] = target;
+    }
+    
+    sketch->total += count;
+    return target;
+}
+
+uint32_t count_min_estimate(const CountMinSketch* sketch, uint64_t key) {
+    uint32_t estimate = UINT32_MAX;
+    for (int row = 0; row < COUNT_MIN_ROWS; row++) {
+        uint32_t value = sketch->counters[(size_t)row * sketch->width + row_index(sketch, row, key)];
+        if (value < estimate) estimate = value;
+    }
+    return estimate;
+}
+
+size_t count_min_memory_usage(const CountMinSketch* sketch) {
+    if (!sketch) return 0;
+    return sizeof(CountMinSketch) + (size_t)sketch->width * COUNT_MIN_ROWS * sizeof(uint32_t);
+}
@@ -0,0 +1,32 @@
+#ifndef COUNT_MIN_H
+#define COUNT_MIN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Independent rows; an estimate is the smallest of a key's counters
+#define COUNT_MIN_ROWS 4
+
+// Count-min sketch: approximate counts for an open-ended key space in a
+// fixed amount of memory. Estimates never undercount. Updates are
+// conservative (only counters at the current minimum are raised), which
+// keeps the overcount from colliding keys small.
+typedef struct {
+    uint32_t width;              // Counters per row, power of two
+    uint32_t* counters;          // COUNT_MIN_ROWS * width
+    uint64_t total;              // Sum of all counts added
+} CountMinSketch;
+
+// Lifecycle. The width is the largest power of two that fits in bytes.
+CountMinSketch* count_min_create(size_t bytes);
+void count_min_destroy(CountMinSketch* sketch);
+void count_min_clear(CountMinSketch* sketch);
+
+// Counting; count_min_add returns the key's estimate after the add
+uint32_t count_min_add(CountMinSketch* sketch, uint64_t key, uint32_t count);
+uint32_t count_min_estimate(const CountMinSketch* sketch, uint64_t key);
+
+// Statistics
+size_t count_min_memory_usage(const CountMinSketch* sketch);
+
+#endif // COUNT_MIN_H
@@ -84,7 +84,8 @@ int decompose_query(WorkflowState* workflow, const char* input) {
                 calc_start += 9; // Skip "Calculate"
                 while (*calc_start == ' ') calc_start++;
                 
-                char* part = strtok(calc_start, ",");
+                char* save;
+                char* part = strtok_r(calc_start, ",", &save);
                 while (part && workflow->num_steps < MAX_REASONING_STEPS - 2) {
                     if (strlen(part) > 2) {
                         ReasoningStep* step = &workflow->steps[workflow->num_steps];
@@ -93,7 +94,7 @@ int decompose_query(WorkflowState* workflow, const char* input) {
                         strncpy(step->input, part, 511);
                         workflow->num_steps++;
                     }
-                    part = strtok(NULL, ",");
+                    part = strtok_r(NULL, ",", &save);
                 }
             }
         }
@@ -103,7 +104,8 @@ int decompose_query(WorkflowState* workflow, const char* input) {
             strncpy(temp, input, 511);
             temp[511] = '\0';
             
-            char* part = strtok(temp, "?");
+            char* save;
+            char* part = strtok_r(temp, "?", &save);
             while (part && workflow->num_steps < MAX_REASONING_STEPS - 2) {
                 if (strlen(part) > 3) {  // Skip empty parts
                     ReasoningStep* step = &workflow->steps[workflow->num_steps];
@@ -114,7 +116,7 @@ int decompose_query(WorkflowState* workflow, const char* input) {
                     step->completed = 0;
                     workflow->num_steps++;
                 }
-                part = strtok(NULL, "?");
+                part = strtok_r(NULL, "?", &save);
             }
         }
         // Handle "and" separator
@@ -453,7 +455,8 @@ float calculate_response_quality(const char* query, const char* response) {
     to_lowercase(response_lower);
     
     // Count matching keywords
-    char* word = strtok(query_lower, " ");
+    char* save;
+    char* word = strtok_r(query_lower, " ", &save);
     int keyword_matches = 0;
     int total_keywords = 0;
     
@@ -462,7 +465,7 @@ float calculate_response_quality(const char* query, const char* response) {
         if (strlen(word) > 3 && strstr(response_lower, word)) {
             keyword_matches++;
         }
-        word = strtok(NULL, " ");
+        word = strtok_r(NULL, " ", &save);
     }
     
     if (total_keywords > 0) {
@@ -552,12 +555,24 @@ int execute_workflow(WorkflowState* workflow) {
     return 1;  // Workflow completed
 }
 
-// Synthesize results from all steps
-char* synthesize_results(WorkflowState* workflow) {
-    if (!workflow) return NULL;
+// Append text to the response in out, truncating at size
+static void append_result(char* out, size_t size, size_t* length, const char* text) {
+    size_t room = size - *length - 1;
+    size_t n = strlen(text);
+    if (n > room) n = room;
+    memcpy(out + *length, text, n);
+    *length += n;
+    out[*length] = '\0';
+}
+
+// Synthesize results from all steps into a caller-provided buffer of size
+// bytes. Returns the response length.
+size_t synthesize_results_into(WorkflowState* workflow, char* out, size_t size) {
+    if (!out || size == 0) return 0;
+    out[0] = '\0';
+    if (!workflow) return 0;
     
-    static char final_response[2048];
-    strcpy(final_response, "");
+    size_t length = 0;
     
     // First check if we have a synthesis step with output
     for (int i = 0; i < workflow->num_steps; i++) {
@@ -566,8 +581,8 @@ char* synthesize_results(WorkflowState* workflow) {
             strlen(workflow->steps[i].output) > 0 &&
             strcmp(workflow->steps[i].output, "Processing...") != 0) {
             
-            strcpy(final_response, workflow->steps[i].output);
-            return final_response;
+            append_result(out, size, &length, workflow->steps[i].output);
+            return length;
         }
     }
     
@@ -582,18 +597,29 @@ char* synthesize_results(WorkflowState* workflow) {
             step->type != STEP_COMPLETE) {
             
             // Add spacing between outputs
-            if (has_output && strlen(final_response) > 0) {
-                strcat(final_response, " ");
+            if (has_output && length > 0) {
+                append_result(out, size, &length, " ");
             }
             
             // For ANALYZE steps that are sub-questions, include the output
             if (step->type == STEP_ANALYZE || step->type == STEP_EXECUTE) {
-                strcat(final_response, step->output);
+                append_result(out, size, &length, step->output);
                 has_output = 1;
             }
         }
     }
     
+    return length;
+}
+
+// Synthesize results from all steps. The result lives in a static buffer
+// that the next call overwrites; concurrent callers use
+// synthesize_results_into.
+char* synthesize_results(WorkflowState* workflow) {
+    if (!workflow) return NULL;
+    
+    static char final_response[2048];
+    synthesize_results_into(workflow, final_response, sizeof(final_response));
     return final_response;
 }
 
@@ -1,6 +1,7 @@
 #ifndef DYNAMIC_WORKFLOWS_H
 #define DYNAMIC_WORKFLOWS_H
 
+#include <stddef.h>
 #include "analysis_functions.h"
 
 // Configuration
@@ -107,6 +108,7 @@ char* refine_response(WorkflowState* workflow, const char* response);
 int plan_workflow(WorkflowState* workflow, AnalysisResult* analysis);
 int execute_workflow(WorkflowState* workflow);
 char* synthesize_results(WorkflowState* workflow);
+size_t synthesize_results_into(WorkflowState* workflow, char* out, size_t size);
 void update_workflow_progress(WorkflowState* workflow);
 
 // Transformer-like operations
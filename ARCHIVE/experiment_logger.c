@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 
 #define MAX_EXPERIMENTS 1000
 
@@ -12,6 +13,9 @@ static int experiment_count = 0;
 static int experiment_capacity = 0;
 static FILE* log_file = NULL;
 
+// Replies may be generated on several threads at once
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+
 // Initialize the experiment logger
 void init_experiment_logger(void) {
     experiment_capacity = MAX_EXPERIMENTS;
@@ -33,7 +37,9 @@ void init_experiment_logger(void) {
 void log_experiment(ExperimentType type, const char* description, 
                    const char* input, const char* output, 
                    const char* metrics, float score, int success) {
+    pthread_mutex_lock(&log_lock);
     if (!experiments || experiment_count >= experiment_capacity) {
+        pthread_mutex_unlock(&log_lock);
         printf("Warning: Experiment log full, cannot log more experiments\n");
         return;
     }
@@ -63,7 +69,7 @@ void log_experiment(ExperimentType type, const char* description,
     // Real-time logging to file
     if (log_file) {
         const char* type_names[] = {"SUPERPOSITION", "COHERENCE", "LOOKAHEAD", 
-                                   "ANALYSIS", "PERFORMANCE", "DISCOVERY"};
+                                   "ANALYSIS", "PERFORMANCE", "DISCOVERY", "REFINEMENT"};
         fprintf(log_file, "[%s] %s | Score: %.3f | Success: %s\n",
                 type_names[type], description, score, success ? "YES" : "NO");
         if (input && strlen(input) > 0) {
@@ -78,6 +84,7 @@ void log_experiment(ExperimentType type, const char* description,
         fprintf(log_file, "\n");
         fflush(log_file);
     }
+    pthread_mutex_unlock(&log_lock);
 }
 
 // Log superposition experiment
@@ -143,7 +150,7 @@ void save_experiment_log(const char* filename) {
     for (int i = 0; i < experiment_count; i++) {
         ExperimentLog* exp = &experiments[i];
         const char* type_names[] = {"superposition", "coherence", "lookahead", 
-                                   "analysis", "performance", "discovery"};
+                                   "analysis", "performance", "discovery", "refinement"};
         
         fprintf(file, "    {\n");
         fprintf(file, "      \"id\": %d,\n", i + 1);
@@ -176,7 +183,7 @@ void print_experiment_summary(void) {
     printf("Total experiments: %d\n", experiment_count);
     
     // Count by type
-    int type_counts[6] = {0};
+    int type_counts[EXP_REFINEMENT + 1] = {0};
     int successes = 0;
     float total_score = 0.0;
     
@@ -187,10 +194,10 @@ void print_experiment_summary(void) {
     }
     
     const char* type_names[] = {"Superposition", "Coherence", "Lookahead", 
-                               "Analysis", "Performance", "Discovery"};
+                               "Analysis", "Performance", "Discovery", "Refinement"};
     
     printf("\nExperiments by type:\n");
-    for (int i = 0; i < 6; i++) {
+    for (int i = 0; i <= EXP_REFINEMENT; i++) {
         if (type_counts[i] > 0) {
             printf("  %s: %d\n", type_names[i], type_counts[i]);
         }
@@ -3,8 +3,13 @@
 
 #include "gate_types.h"
 
-#define HASH_SIZE 65536
+#define HASH_SIZE 65536    // Power of two: addresses are masked
 #define MAX_WORD_LENGTH 50
+#define CHAIN_HISTOGRAM_MAX 8  // Longest collision chain given its own row in show_chat_stats
+
+#if HASH_SIZE & (HASH_SIZE - 1)
+#error "HASH_SIZE must be a power of two"
+#endif
 
 // Pattern structure
 typedef struct Pattern {
@@ -12,7 +17,6 @@ typedef struct Pattern {
     char word2[MAX_WORD_LENGTH];
     char next[MAX_WORD_LENGTH];
     int count;
-    Gate* gate;
     struct Pattern* collision_next;
 } Pattern;
 
@@ -30,6 +34,7 @@ void process_text(ChatSystem* sys, const char* text);
 void train_from_file(ChatSystem* sys, const char* filename);
 char* find_best_continuation(ChatSystem* sys, const char* w1, const char* w2);
 void generate_response(ChatSystem* sys, const char* input);
+void show_chat_stats(ChatSystem* sys);
 void chat_loop(ChatSystem* sys);
 
 #endif // GAIA_CHAT_H
\ No newline at end of file
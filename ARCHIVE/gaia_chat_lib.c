@@ -5,18 +5,12 @@
 #include <ctype.h>
 #include <time.h>
 #include "gaia_chat.h"
+#include "hash64.h"
 
-// Hash function
+// Hash function: a hash64 of both words, masked to the table
 uint32_t compute_pattern_address(const char* w1, const char* w2) {
-    uint32_t hash = 5381;
-    for (int i = 0; w1[i]; i++) {
-        hash = ((hash << 5) + hash) + w1[i];
-    }
-    hash = ((hash << 5) + hash) + ' ';
-    for (int i = 0; w2[i]; i++) {
-        hash = ((hash << 5) + hash) + w2[i];
-    }
-    return hash % HASH_SIZE;
+    uint64_t hash = hash64_string(w2, hash64_string(w1, HASH64_SEED));
+    return (uint32_t)hash & (HASH_SIZE - 1);
 }
 
 // Create system
@@ -46,7 +40,6 @@ void learn_pattern(ChatSystem* sys, const char* w1, const char* w2, const char*
     strcpy(new_p->word2, w2);
     strcpy(new_p->next, next);
     new_p->count = 1;
-    new_p->gate = gate_create("THRESHOLD");
     
     if (prev) {
         prev->collision_next = new_p;
@@ -228,12 +221,45 @@ void generate_response(ChatSystem* sys, const char* input) {
     printf("\n");
 }
 
+// Pattern count and how evenly the address hash spreads them.
+// histogram[n] counts chains of n patterns, longer ones in the last row.
+void show_chat_stats(ChatSystem* sys) {
+    int used_buckets = 0;
+    int max_chain = 0;
+    int histogram[CHAIN_HISTOGRAM_MAX + 2] = {0};
+    
+    for (int i = 0; i < HASH_SIZE; i++) {
+        int chain_len = 0;
+        for (Pattern* p = sys->patterns[i]; p; p = p->collision_next) chain_len++;
+        
+        if (chain_len > 0) used_buckets++;
+        if (chain_len > max_chain) max_chain = chain_len;
+        histogram[chain_len > CHAIN_HISTOGRAM_MAX ? CHAIN_HISTOGRAM_MAX + 1 : chain_len]++;
+    }
+    
+    printf("\n=== gaia Stats ===\n");
+    printf("- Patterns: %d from %d words\n", sys->total_patterns, sys->total_words);
+    printf("- Buckets used: %d/%d (%.1f%%)\n",
+           used_buckets, HASH_SIZE, (used_buckets * 100.0) / HASH_SIZE);
+    printf("- Max collision chain: %d\n", max_chain);
+    printf("- Average chain length: %.2f\n",
+           used_buckets ? (float)sys->total_patterns / used_buckets : 0);
+    
+    printf("\nChain length histogram:\n");
+    for (int n = 0; n <= CHAIN_HISTOGRAM_MAX + 1; n++) {
+        if (histogram[n] == 0) continue;
+        printf("- %s%d: %d buckets (%.1f%%)\n", n > CHAIN_HISTOGRAM_MAX ? ">" : "",
+               n > CHAIN_HISTOGRAM_MAX ? CHAIN_HISTOGRAM_MAX : n, histogram[n], (histogram[n] * 100.0) / HASH_SIZE);
+    }
+    printf("\n");
+}
+
 // Interactive chat
 void chat_loop(ChatSystem* sys) {
     char input[1024];
     
     printf("\n=== gaia Chat ===\n");
-    printf("Type 'quit' to exit\n\n");
+    printf("Type 'stats' for pattern statistics, 'quit' to exit\n\n");
     
     while (1) {
         printf("You: ");
@@ -246,6 +272,10 @@ void chat_loop(ChatSystem* sys) {
         }
         
         if (strcmp(input, "quit") == 0) break;
+        if (strcmp(input, "stats") == 0) {
+            show_chat_stats(sys);
+            continue;
+        }
         
         if (strlen(input) > 0) {
             // Learn from user input (optional)
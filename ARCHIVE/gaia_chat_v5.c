@@ -11,11 +11,28 @@
 #include "gate_types.h"
 #include "function_registry.h"
 #include "gaia_functions.h"
+#include "vocabulary.h"
+#include "tokenizer.h"
+#include "context_tree.h"
+#include "count_min.h"
+#include "beam_search.h"
+#include "parallel_training.h"
+#include "sampling.h"
 
-#define HASH_SIZE 2097152     // 2M buckets (8x larger for 100-token patterns)
 #define MAX_WORD_LENGTH 50
 #define MAX_INPUT_LENGTH 1024
+#define MAX_TEXT_WORDS 500    // Words kept per training line
+#define TRAIN_LINE_SIZE 2048  // fgets buffer for training files
 #define CONTEXT_SIZE 100      // 100-token context window!
+#define MAX_CANDIDATES 100    // Largest --top-k
+#define DEFAULT_TOP_K 32      // Next words considered per generated word
+#define MAX_RESPONSE_WORDS 50 // Words generated per reply
+#define LOOKAHEAD_SLOTS 4096  // Lookahead cache entries per reply, power of two
+#define PRUNE_MIN_DEPTH 3     // Shortest context whose rare patterns may be dropped
+#define PRUNE_TARGET_NUM 3    // Pruning aims for 3/4 of the memory budget
+#define PRUNE_TARGET_DEN 4
+#define SKETCH_BUDGET_SHARE 8 // The count-min sketch takes 1/8 of the budget
+#define SKETCH_PROMOTE_AT 2   // Sketched patterns get exact counts from their 2nd sighting
 #define PAD_TOKEN "[PAD]"
 #define MAX_SUPERPOSITION 5   // Maximum states to maintain
 #define SUPERPOSITION_THRESHOLD 0.8  // Similarity threshold to trigger superposition
@@ -23,153 +40,242 @@
 // Feature flags
 static int use_superposition = 0;  // Set to 1 to enable superposition mode
 static int debug_superposition = 0;  // Set to 1 for superposition debug output
+static int training_threads = 1;     // Workers for train_from_directory
+static int top_k = DEFAULT_TOP_K;    // Candidates scored with lookahead
+static size_t memory_budget = 0;     // Bytes for tree and sketch; 0 = unbounded
+static int use_sketch = 0;           // Count rare deep patterns approximately first
+static int beam_width = 1;           // Above 1, replies come from beam search
+static uint64_t sample_seed = 0;     // Run seed for superposition; replies draw from (seed, reply)
 
-// Enhanced pattern structure for 100-token context
-typedef struct Pattern {
-    char context[CONTEXT_SIZE][MAX_WORD_LENGTH];  // 100 words of context
-    char next[MAX_WORD_LENGTH];                   // Next word
-    int context_length;                           // Actual context length
-    int count;
-    Gate* gate;
-    struct Pattern* collision_next;
-} Pattern;
-
-// Chat system with more tracking
+// Lookahead result for one candidate after one context. The deepest node
+// a context matches fixes every suffix the lookahead walk can reach, so
+// (node, word) identifies the count.
 typedef struct {
-    Pattern* patterns[HASH_SIZE];
-    int total_patterns;
+    const ContextNode* node;
+    uint32_t word;
+    uint32_t stamp;              // Reply that filled the entry; stale otherwise
+    int continuations;
+} LookaheadEntry;
+
+// Chat system with more tracking; patterns live in a context tree over token IDs
+typedef struct {
+    ContextTree* tree;
+    Vocabulary* vocab;
     int total_words;
-    int patterns_by_length[CONTEXT_SIZE + 1];  // Track patterns of each context length
-    int hash_collisions;                       // Track collision performance
     int pattern_lookups;                       // Track lookup performance
+    
+    // Candidate dedup: word ID -> candidate slot, valid while the word's
+    // stamp equals the current lookup's
+    uint32_t* candidate_slot;
+    uint32_t* candidate_stamp;
+    uint32_t candidate_capacity;
+    uint32_t current_stamp;
+    
+    // Per-reply lookahead cache. Generation tends to revisit the same
+    // contexts, and the tree does not change while a reply is generated.
+    LookaheadEntry* lookahead;
+    uint32_t lookahead_stamp;
+    uint32_t lookahead_used;
+    int lookahead_hits;
+    
+    uint64_t replies;            // Replies generated; numbers each reply's random stream
+    BeamSearch* beam;            // NULL for greedy generation
+    
+    // Memory budget mode
+    CountMinSketch* sketch;      // Admits rare deep patterns; NULL without --sketch
+    uint32_t prune_count;        // Current minimum count for deep patterns
+    size_t counts_seen;          // (context, next) occurrences trained on
+    size_t pruned_patterns;      // Patterns dropped by pruning
+    int budget_exhausted;        // Pruning can no longer get under the budget
 } ChatSystem;
 
-// Enhanced hash function for 100-token context
-uint32_t compute_pattern_address(char context[][MAX_WORD_LENGTH], int context_length) {
-    uint64_t hash = 5381;  // Use 64-bit for better distribution
-    
-    for (int i = 0; i < context_length; i++) {
-        for (int j = 0; context[i][j]; j++) {
-            hash = ((hash << 5) + hash) + context[i][j];
-        }
-        hash = ((hash << 5) + hash) + ' ';
+// Release the system; the tree and vocabulary free their arenas in bulk
+void destroy_chat_system(ChatSystem* sys) {
+    if (!sys) return;
+    context_tree_destroy(sys->tree);
+    vocab_destroy(sys->vocab);
+    free(sys->candidate_slot);
+    free(sys->candidate_stamp);
+    free(sys->lookahead);
+    count_min_destroy(sys->sketch);
+    beam_search_destroy(sys->beam);
+    free(sys);
+}
+
+// Start a candidate lookup, sizing the dedup arrays to the vocabulary
+static int begin_candidates(ChatSystem* sys) {
+    uint32_t words = vocab_size(sys->vocab);
+    if (words > sys->candidate_capacity) {
+        uint32_t capacity = words * 2;
+        uint32_t* slot = realloc(sys->candidate_slot, capacity * sizeof(uint32_t));
+        if (slot) sys->candidate_slot = slot;
+        uint32_t* stamp = realloc(sys->candidate_stamp, capacity * sizeof(uint32_t));
+        if (stamp) sys->candidate_stamp = stamp;
+        if (!slot || !stamp) return 0;
+        
+        memset(stamp + sys->candidate_capacity, 0, (capacity - sys->candidate_capacity) * sizeof(uint32_t));
+        sys->candidate_capacity = capacity;
     }
     
-    return (uint32_t)(hash % HASH_SIZE);
+    // Stamp 0 marks unused words, so clear the stamps when it wraps
+    if (++sys->current_stamp == 0) {
+        memset(sys->candidate_stamp, 0, sys->candidate_capacity * sizeof(uint32_t));
+        sys->current_stamp = 1;
+    }
+    return 1;
 }
 
-// Create system
-ChatSystem* create_chat_system() {
-    ChatSystem* sys = calloc(1, sizeof(ChatSystem));
-    printf("Allocated %.1f MB for hash table\n", 
-           (HASH_SIZE * sizeof(Pattern*)) / (1024.0 * 1024.0));
-    return sys;
+// Drop every cached lookahead; called when a reply starts
+static void begin_lookahead(ChatSystem* sys) {
+    sys->lookahead_used = 0;
+    if (++sys->lookahead_stamp == 0) {
+        memset(sys->lookahead, 0, LOOKAHEAD_SLOTS * sizeof(LookaheadEntry));
+        sys->lookahead_stamp = 1;
+    }
 }
 
-// Check if two contexts match
-int contexts_match(char ctx1[][MAX_WORD_LENGTH], char ctx2[][MAX_WORD_LENGTH], int len) {
-    for (int i = 0; i < len; i++) {
-        if (strcmp(ctx1[i], ctx2[i]) != 0) {
-            return 0;
-        }
+// Entry for (node, word): either filled this reply or empty and claimed for
+// it. NULL once the cache is half full, so callers just compute the count.
+static LookaheadEntry* lookahead_entry(ChatSystem* sys, const ContextNode* node, uint32_t word) {
+    uint32_t mask = LOOKAHEAD_SLOTS - 1;
+    uint32_t pos = ((uint32_t)((uintptr_t)node >> 4) ^ (word * 0x9e3779b1u)) & mask;
+    
+    for (;;) {
+        LookaheadEntry* entry = &sys->lookahead[pos];
+        if (entry->stamp != sys->lookahead_stamp) {
+            if (sys->lookahead_used * 2 >= LOOKAHEAD_SLOTS) return NULL;
+            sys->lookahead_used++;
+            entry->node = node;
+            entry->word = word;
+            entry->stamp = sys->lookahead_stamp;
+            entry->continuations = -1;
+            return entry;
+        }
+        if (entry->node == node && entry->word == word) return entry;
+        pos = (pos + 1) & mask;
     }
-    return 1;
 }
 
-// Learn pattern with variable-length context
-void learn_pattern(ChatSystem* sys, char context[][MAX_WORD_LENGTH], int context_length, const char* next) {
-    if (context_length < 2 || context_length > CONTEXT_SIZE) return;  // Minimum 2 tokens
-    
-    uint32_t addr = compute_pattern_address(context, context_length);
-    Pattern* p = sys->patterns[addr];
-    
-    // Count collisions for performance tracking
-    int collision_count = 0;
+// Rank every context's next words by count so generation reads the best
+// candidates straight off each context
+void freeze_patterns(ChatSystem* sys) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t ranked = context_tree_freeze(sys->tree);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    printf("Froze %zu contexts in %.1f ms\n", ranked,
+           (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6);
+}
+
+// Create system
+ChatSystem* create_chat_system() {
+    ChatSystem* sys = calloc(1, sizeof(ChatSystem));
+    if (!sys) return NULL;
+    
+    sys->tree = context_tree_create(CONTEXT_SIZE);
+    sys->vocab = vocab_create();
+    sys->lookahead = calloc(LOOKAHEAD_SLOTS, sizeof(LookaheadEntry));
+    if (!sys->tree || !sys->vocab || !sys->lookahead) {
+        destroy_chat_system(sys);
+        return NULL;
+    }
     
-    // Find existing pattern
-    while (p) {
-        collision_count++;
-        if (p->context_length == context_length &&
-            contexts_match(p->context, context, context_length) &&
-            strcmp(p->next, next) == 0) {
-            p->count++;
-            return;
+    if (beam_width > 1) {
+        BeamConfig config = {beam_width, MAX_RESPONSE_WORDS, 2};
+        sys->beam = beam_search_create(&config, CONTEXT_SIZE);
+        if (!sys->beam) {
+            destroy_chat_system(sys);
+            return NULL;
         }
-        if (p->collision_next == NULL) break;
-        p = p->collision_next;
     }
     
-    if (collision_count > 1) sys->hash_collisions++;
-    
-    // Create new pattern
-    Pattern* new_p = malloc(sizeof(Pattern));
-    
-    // Copy context
-    for (int i = 0; i < context_length; i++) {
-        strncpy(new_p->context[i], context[i], MAX_WORD_LENGTH-1);
-        new_p->context[i][MAX_WORD_LENGTH-1] = '\0';
-    }
-    // Pad remaining slots
-    for (int i = context_length; i < CONTEXT_SIZE; i++) {
-        strcpy(new_p->context[i], PAD_TOKEN);
+    if (use_sketch) {
+        sys->sketch = count_min_create(memory_budget ? memory_budget / SKETCH_BUDGET_SHARE : 16 << 20);
+        if (!sys->sketch) {
+            destroy_chat_system(sys);
+            return NULL;
+        }
+        printf("Count-min sketch: %.1f MB for patterns of %d+ token contexts\n",
+               count_min_memory_usage(sys->sketch) / (1024.0 * 1024.0), PRUNE_MIN_DEPTH);
     }
     
-    strncpy(new_p->next, next, MAX_WORD_LENGTH-1);
-    new_p->next[MAX_WORD_LENGTH-1] = '\0';
-    new_p->context_length = context_length;
-    new_p->count = 1;
-    new_p->gate = gate_create("THRESHOLD");
-    new_p->collision_next = NULL;
-    
-    if (p) {
-        p->collision_next = new_p;
-    } else {
-        sys->patterns[addr] = new_p;
+    printf("Allocated context tree for %d-token contexts\n", CONTEXT_SIZE);
+    return sys;
+}
+
+// Learn pattern with variable-length context
+void learn_pattern(ChatSystem* sys, const uint32_t* context, int context_length, uint32_t next) {
+    if (context_length < 2 || context_length > CONTEXT_SIZE) return;  // Minimum 2 tokens
+    context_tree_add(sys->tree, context, context_length, next, 1);
+}
+
+// Bytes the budget covers: the context tree and the sketch
+static size_t budgeted_memory(const ChatSystem* sys) {
+    return context_tree_memory_usage(sys->tree) + count_min_memory_usage(sys->sketch);
+}
+
+// Once the tree outgrows the budget, drop the rarest deep patterns,
+// raising the minimum count until usage is back under the target. Pruned
+// trees are rebuilt in a fresh arena, so the old one's memory is freed.
+static void enforce_memory_budget(ChatSystem* sys) {
+    if (!memory_budget || sys->budget_exhausted || budgeted_memory(sys) <= memory_budget) return;
+    
+    size_t target = memory_budget / PRUNE_TARGET_DEN * PRUNE_TARGET_NUM;
+    if (sys->prune_count < 2) sys->prune_count = 2;
+    
+    while (budgeted_memory(sys) > target) {
+        ContextTree* pruned = context_tree_prune(sys->tree, sys->prune_count, PRUNE_MIN_DEPTH);
+        if (!pruned) {
+            printf("\nWarning: out of memory while pruning\n");
+            sys->budget_exhausted = 1;
+            return;
+        }
+        
+        size_t dropped = sys->tree->num_patterns - pruned->num_patterns;
+        context_tree_destroy(sys->tree);
+        sys->tree = pruned;
+        sys->pruned_patterns += dropped;
+        
+        if (dropped == 0) {
+            printf("\nWarning: %.1f MB budget is below the size of the %d-token contexts; no longer pruning\n",
+                   memory_budget / (1024.0 * 1024.0), PRUNE_MIN_DEPTH - 1);
+            sys->budget_exhausted = 1;
+            return;
+        }
+        if (budgeted_memory(sys) > target) sys->prune_count++;
     }
-    
-    sys->total_patterns++;
-    sys->patterns_by_length[context_length]++;
+}
+
+// Find the words of a training line; parallel training workers use it to
+// tokenize exactly like process_text
+int tokenize_text(const char* text, TokenSpan* spans, int max_words) {
+    return tokenize_spans(text, strlen(text), spans, max_words);
 }
 
 // Process text with sliding window up to 100 tokens
 void process_text(ChatSystem* sys, const char* text) {
-    char words[500][MAX_WORD_LENGTH] = {0};  // Larger buffer for longer texts
-    int word_count = 0;
+    uint32_t words[MAX_TEXT_WORDS];  // Larger buffer for longer texts
     
-    // Tokenize
-    char* copy = strdup(text);
-    char* token = strtok(copy, " \t\n,.!?;:");
+    // Tokenize straight into word IDs
+    int word_count = tokenize_intern(sys->vocab, text, strlen(text), words, MAX_TEXT_WORDS);
     
-    while (token && word_count < 500) {
-        // Convert to lowercase
-        for (int i = 0; token[i]; i++) {
-            token[i] = tolower(token[i]);
-        }
-        strncpy(words[word_count++], token, MAX_WORD_LENGTH-1);
-        words[word_count-1][MAX_WORD_LENGTH-1] = '\0';
-        token = strtok(NULL, " \t\n,.!?;:");
+    // Learn patterns with varying context sizes (2 to CONTEXT_SIZE) in one
+    // pass: each word walks back through its preceding context once
+    if (sys->sketch) {
+        ContextAdmission admission = {sys->sketch, PRUNE_MIN_DEPTH, SKETCH_PROMOTE_AT};
+        context_tree_ingest_admitted(sys->tree, words, word_count, 2, &admission);
+    } else {
+        context_tree_ingest(sys->tree, words, word_count, 2);
     }
     
-    // Learn patterns with varying context sizes (2 to CONTEXT_SIZE)
-    for (int i = 0; i < word_count; i++) {
-        // Try multiple context lengths starting from minimum 2
-        for (int ctx_len = 2; ctx_len <= CONTEXT_SIZE && i + ctx_len < word_count; ctx_len++) {
-            char context[CONTEXT_SIZE][MAX_WORD_LENGTH];
-            
-            // Build context
-            for (int j = 0; j < ctx_len; j++) {
-                strcpy(context[j], words[i + j]);
-            }
-            
-            // Learn pattern
-            if (i + ctx_len < word_count) {
-                learn_pattern(sys, context, ctx_len, words[i + ctx_len]);
-            }
-        }
+    // Word i is counted after each of its min(i, CONTEXT_SIZE) - 1 contexts
+    for (int i = 2; i < word_count; i++) {
+        sys->counts_seen += (i < CONTEXT_SIZE ? i : CONTEXT_SIZE) - 1;
     }
     
     sys->total_words += word_count;
-    free(copy);
+    enforce_memory_budget(sys);
 }
 
 // Train from file (same as before)
@@ -181,24 +287,27 @@ void train_from_file(ChatSystem* sys, const char* filename) {
     }
     
     printf("Training from %s...\n", filename);
-    char line[2048];  // Larger line buffer for 100-token contexts
+    char line[TRAIN_LINE_SIZE];  // Larger line buffer for 100-token contexts
     int lines = 0;
     
     while (fgets(line, sizeof(line), f)) {
         process_text(sys, line);
         lines++;
         if (lines % 5 == 0) {  // Less frequent updates for performance
-            printf("\rProcessed %d lines, %d patterns", lines, sys->total_patterns);
+            printf("\rProcessed %d lines, %zu patterns", lines, sys->tree->num_patterns);
             fflush(stdout);
         }
     }
     
-    printf("\nTraining complete: %d patterns\n", sys->total_patterns);
+    printf("\nTraining complete: %zu patterns\n", sys->tree->num_patterns);
     fclose(f);
 }
 
 // Recursively train from directory
-void train_from_directory(ChatSystem* sys, const char* path) {
+// Visit every .txt file under path, recursing into subdirectories
+typedef void (*TrainFileVisitor)(const char* filename, void* user_data);
+
+static void walk_training_files(const char* path, TrainFileVisitor visit, void* user_data) {
     DIR* dir = opendir(path);
     if (!dir) return;
     
@@ -213,9 +322,9 @@ void train_from_directory(ChatSystem* sys, const char* path) {
         struct stat st;
         if (stat(full_path, &st) == 0) {
             if (S_ISDIR(st.st_mode)) {
-                train_from_directory(sys, full_path);
+                walk_training_files(full_path, visit, user_data);
             } else if (strstr(entry->d_name, ".txt")) {
-                train_from_file(sys, full_path);
+                visit(full_path, user_data);
             }
         }
     }
@@ -223,9 +332,54 @@ void train_from_directory(ChatSystem* sys, const char* path) {
     closedir(dir);
 }
 
+static void train_file_visitor(const char* filename, void* user_data) {
+    train_from_file((ChatSystem*)user_data, filename);
+}
+
+static void collect_file_visitor(const char* filename, void* user_data) {
+    if (!train_corpus_load_file((TrainCorpus*)user_data, filename, TRAIN_LINE_SIZE)) {
+        printf("Warning: Could not read %s\n", filename);
+    }
+}
+
+// Read every file first, then tokenize and count with training_threads
+// workers. Produces the same vocabulary and patterns as the serial walk.
+static void train_from_directory_parallel(ChatSystem* sys, const char* path) {
+    TrainCorpus corpus;
+    train_corpus_init(&corpus);
+    walk_training_files(path, collect_file_visitor, &corpus);
+    
+    TrainConfig config = {
+        .num_threads = training_threads,
+        .max_tokens = MAX_TEXT_WORDS,
+        .min_tokens = 0,
+        .min_length = 2,
+        .tokenize = tokenize_text
+    };
+    TrainResult result = {0};
+    
+    printf("Training from %zu lines with %d threads...\n", corpus.num_lines, training_threads);
+    if (!train_parallel(sys->tree, sys->vocab, &corpus, &config, &result)) {
+        printf("Warning: parallel training failed\n");
+    }
+    sys->total_words += result.tokens;
+    
+    printf("Training complete: %zu patterns\n", sys->tree->num_patterns);
+    train_corpus_free(&corpus);
+}
+
+void train_from_directory(ChatSystem* sys, const char* path) {
+    // The budget is enforced line by line, which only the serial path does
+    if (training_threads > 1 && !memory_budget && !sys->sketch) {
+        train_from_directory_parallel(sys, path);
+    } else {
+        walk_training_files(path, train_file_visitor, sys);
+    }
+}
+
 // Multi-step lookahead structure
 typedef struct {
-    char word[MAX_WORD_LENGTH];
+    uint32_t word;      // Vocabulary ID
     int path_score;
     int found_continuations;
     float probability;  // For superposition mode
@@ -239,77 +393,91 @@ typedef struct {
     int collapse_step;
 } SuperpositionState;
 
-// Find best continuation with multi-step lookahead
-char* find_best_continuation(ChatSystem* sys, char context[][MAX_WORD_LENGTH], int context_length) {
+// Continuations after context + word, summed over every suffix of at least
+// min_context tokens
+static int count_lookahead(ChatSystem* sys, const uint32_t* context, int context_length, uint32_t word,
+                           int min_context) {
+    uint32_t new_context[CONTEXT_SIZE];
+    int new_length = context_length;
+    
+    // Append candidate, shifting the window only when it is full
+    if (new_length < CONTEXT_SIZE) {
+        memcpy(new_context, context, context_length * sizeof(uint32_t));
+        new_context[new_length++] = word;
+    } else {
+        memcpy(new_context, context + 1, (context_length - 1) * sizeof(uint32_t));
+        new_context[context_length - 1] = word;
+    }
+    
+    const ContextNode* nodes[CONTEXT_SIZE + 1];
+    int new_depth = context_tree_match(sys->tree, new_context, new_length, nodes);
+    int found = 0;
+    for (int try_len = new_depth; try_len >= min_context; try_len--) {
+        found += nodes[try_len]->num_continuations;
+    }
+    return found;
+}
+
+// Find best continuation with multi-step lookahead. Superposition draws
+// from rng, the reply's own generator.
+const char* find_best_continuation(ChatSystem* sys, const uint32_t* context, int context_length, Rng* rng) {
     sys->pattern_lookups++;
     
-    // Step 1: Find all possible next words
-    WordCandidate candidates[100] = {0};  // Up to 100 candidates
+    // Step 1: Find the most frequent next words, longest context first
+    WordCandidate candidates[MAX_CANDIDATES] = {0};
     int num_candidates = 0;
+    if (!begin_candidates(sys)) return NULL;
+    uint32_t stamp = sys->current_stamp;
+    
+    // One walk finds the node for every suffix of the context
+    const ContextNode* nodes[CONTEXT_SIZE + 1];
+    int depth = context_tree_match(sys->tree, context, context_length, nodes);
     
     int min_context = 2;
-    for (int try_len = context_length; try_len >= min_context && num_candidates < 100; try_len--) {
-        uint32_t addr = compute_pattern_address(context + (context_length - try_len), try_len);
-        Pattern* p = sys->patterns[addr];
+    for (int try_len = depth; try_len >= min_context && num_candidates < top_k; try_len--) {
+        const ContextNode* node = nodes[try_len];
         
-        while (p && num_candidates < 100) {
-            if (p->context_length == try_len &&
-                contexts_match(p->context, context + (context_length - try_len), try_len)) {
-                
-                // Check if we already have this word as candidate
-                int existing = -1;
-                for (int i = 0; i < num_candidates; i++) {
-                    if (strcmp(candidates[i].word, p->next) == 0) {
-                        existing = i;
-                        break;
-                    }
-                }
-                
-                int score = p->count * try_len;  // Prefer longer contexts
-                if (existing >= 0) {
-                    // Update existing candidate with better score
-                    if (score > candidates[existing].path_score) {
-                        candidates[existing].path_score = score;
-                    }
-                } else {
-                    // Add new candidate
-                    strncpy(candidates[num_candidates].word, p->next, MAX_WORD_LENGTH-1);
-                    candidates[num_candidates].path_score = score;
-                    candidates[num_candidates].found_continuations = 0;
-                    num_candidates++;
+        // Words come by count, so the slice taken is the top of the context
+        const Continuation* conts = context_tree_ranked(sys->tree, node);
+        if (!conts) conts = node->continuations;
+        
+        for (uint32_t c = 0; c < node->num_continuations && num_candidates < top_k; c++) {
+            const Continuation* p = &conts[c];
+            int score = p->count * try_len;  // Prefer longer contexts
+            
+            if (sys->candidate_stamp[p->next] == stamp) {
+                // Update existing candidate with better score
+                WordCandidate* existing = &candidates[sys->candidate_slot[p->next]];
+                if (score > existing->path_score) {
+                    existing->path_score = score;
                 }
+            } else {
+                // Add new candidate
+                sys->candidate_stamp[p->next] = stamp;
+                sys->candidate_slot[p->next] = num_candidates;
+                candidates[num_candidates].word = p->next;
+                candidates[num_candidates].path_score = score;
+                candidates[num_candidates].found_continuations = 0;
+                num_candidates++;
             }
-            p = p->collision_next;
         }
     }
     
     if (num_candidates == 0) return NULL;
     
-    // Step 2: For each candidate, check if it has good continuations (lookahead)
+    // Step 2: For each candidate, check if it has good continuations (lookahead).
+    // Candidates need a match of min_context tokens, so the deepest node
+    // stands for the whole reachable context and keys the cache.
+    const ContextNode* deepest = nodes[depth];
     for (int i = 0; i < num_candidates; i++) {
-        // Build new context with this candidate word
-        char new_context[CONTEXT_SIZE][MAX_WORD_LENGTH];
-        int new_length = context_length;
-        
-        // Copy current context and add candidate
-        for (int j = 0; j < context_length - 1; j++) {
-            strcpy(new_context[j], context[j + 1]);
-        }
-        strcpy(new_context[context_length - 1], candidates[i].word);
-        if (new_length < CONTEXT_SIZE) new_length++;
-        
-        // Count how many continuations this candidate has
-        for (int try_len = new_length; try_len >= min_context; try_len--) {
-            uint32_t addr = compute_pattern_address(new_context + (new_length - try_len), try_len);
-            Pattern* p = sys->patterns[addr];
-            
-            while (p) {
-                if (p->context_length == try_len &&
-                    contexts_match(p->context, new_context + (new_length - try_len), try_len)) {
-                    candidates[i].found_continuations++;
-                }
-                p = p->collision_next;
-            }
+        LookaheadEntry* cached = lookahead_entry(sys, deepest, candidates[i].word);
+        if (cached && cached->continuations >= 0) {
+            candidates[i].found_continuations = cached->continuations;
+            sys->lookahead_hits++;
+        } else {
+            candidates[i].found_continuations = count_lookahead(sys, context, context_length,
+                                                                candidates[i].word, min_context);
+            if (cached) cached->continuations = candidates[i].found_continuations;
         }
         
         // Boost score for words that have continuations (lookahead bonus)
@@ -344,43 +512,32 @@ char* find_best_continuation(ChatSystem* sys, char context[][MAX_WORD_LENGTH], i
             }
         }
         
-        // Use superposition if multiple similar candidates
+        // Use superposition if multiple similar candidates: sample them
+        // by score
         if (similar_count > 1) {
-            // Calculate probabilities
-            float total_score = 0;
-            for (int i = 0; i < num_candidates && i < MAX_SUPERPOSITION; i++) {
-                if (candidates[i].path_score >= top_score * SUPERPOSITION_THRESHOLD) {
-                    total_score += candidates[i].path_score;
-                }
+            float weights[MAX_SUPERPOSITION];
+            int num_states = num_candidates < MAX_SUPERPOSITION ? num_candidates : MAX_SUPERPOSITION;
+            for (int i = 0; i < num_states; i++) {
+                int similar = candidates[i].path_score >= top_score * SUPERPOSITION_THRESHOLD;
+                weights[i] = similar ? candidates[i].path_score : 0;
             }
             
-            // Sample from distribution
-            float random_val = (float)rand() / RAND_MAX;
-            float cumulative = 0;
-            
-            for (int i = 0; i < num_candidates && i < MAX_SUPERPOSITION; i++) {
-                if (candidates[i].path_score >= top_score * SUPERPOSITION_THRESHOLD) {
-                    candidates[i].probability = candidates[i].path_score / total_score;
-                    cumulative += candidates[i].probability;
-                    
-                    if (random_val <= cumulative) {
-                        if (debug_superposition) {
-                            printf("SUPERPOSITION: Selected '%s' (prob=%.2f) from %d similar candidates\n",
-                                   candidates[i].word, candidates[i].probability, similar_count);
-                        }
-                        static char result[MAX_WORD_LENGTH];
-                        strcpy(result, candidates[i].word);
-                        return result;
-                    }
+            AliasTable table;
+            if (alias_build(&table, weights, num_states)) {
+                int i = alias_sample(&table, rng);
+                if (debug_superposition) {
+                    float total_score = 0;
+                    for (int j = 0; j < num_states; j++) total_score += weights[j];
+                    printf("SUPERPOSITION: Selected '%s' (prob=%.2f) from %d similar candidates\n",
+                           vocab_word(sys->vocab, candidates[i].word), weights[i] / total_score, similar_count);
                 }
+                return vocab_word(sys->vocab, candidates[i].word);
             }
         }
     }
     
     // Default: return best candidate (deterministic)
-    static char result[MAX_WORD_LENGTH];
-    strcpy(result, candidates[best_idx].word);
-    return result;
+    return vocab_word(sys->vocab, candidates[best_idx].word);
 }
 
 // Function pattern recognition and execution
@@ -503,8 +660,30 @@ char* try_function_call(const char* input) {
     return NULL;  // No function pattern matched
 }
 
+// Beam search over whole responses instead of one greedy word at a time
+static void generate_beam_response(ChatSystem* sys, const uint32_t* context, int context_length,
+                                   char* output, int max_len) {
+    uint32_t words[MAX_RESPONSE_WORDS];
+    int count = beam_search_run(sys->beam, sys->tree, context, context_length, words);
+    
+    size_t used = 0;
+    for (int i = 0; i < count; i++) {
+        const char* word = vocab_word(sys->vocab, words[i]);
+        size_t length = strlen(word);
+        if (used + length + 2 > (size_t)max_len) break;
+        
+        if (used > 0) output[used++] = ' ';
+        memcpy(output + used, word, length + 1);
+        used += length;
+    }
+}
+
 // Generate response with 100-token context
 void generate_response(ChatSystem* sys, const char* input, char* output, int max_len) {
+    begin_lookahead(sys);
+    Rng rng;
+    rng_seed(&rng, sample_seed, sys->replies++);
+    
     // First, try to handle with function calls
     char* function_result = try_function_call(input);
     if (function_result) {
@@ -514,30 +693,18 @@ void generate_response(ChatSystem* sys, const char* input, char* output, int max
     }
     
     // If no function matched, use pattern matching
-    // Tokenize input
-    char words[200][MAX_WORD_LENGTH] = {0};
-    int word_count = 0;
-    
-    char* copy = strdup(input);
-    char* token = strtok(copy, " \t\n,.!?;:");
-    
-    while (token && word_count < 200) {
-        for (int i = 0; token[i]; i++) {
-            token[i] = tolower(token[i]);
-        }
-        strncpy(words[word_count++], token, MAX_WORD_LENGTH-1);
-        words[word_count-1][MAX_WORD_LENGTH-1] = '\0';
-        token = strtok(NULL, " \t\n,.!?;:");
-    }
+    // Tokenize input (unknown words match no pattern)
+    uint32_t words[200];
+    int word_count = tokenize_lookup(sys->vocab, input, strlen(input), words, 200);
     
     // Build initial context from input (up to 100 tokens)
-    char context[CONTEXT_SIZE][MAX_WORD_LENGTH];
+    uint32_t context[CONTEXT_SIZE];
     int context_length = 0;
     
     // Fill context with input words
     int start_idx = word_count > CONTEXT_SIZE ? word_count - CONTEXT_SIZE : 0;
     for (int i = start_idx; i < word_count && context_length < CONTEXT_SIZE; i++) {
-        strcpy(context[context_length], words[i]);
+        context[context_length] = words[i];
         context_length++;
     }
     
@@ -545,8 +712,13 @@ void generate_response(ChatSystem* sys, const char* input, char* output, int max
     strcpy(output, "");
     int generated = 0;
     
-    while (generated < 50 && strlen(output) < max_len - MAX_WORD_LENGTH) {
-        char* next = find_best_continuation(sys, context, context_length);
+    if (sys->beam) {
+        generate_beam_response(sys, context, context_length, output, max_len);
+        return;
+    }
+    
+    while (generated < MAX_RESPONSE_WORDS && strlen(output) < max_len - MAX_WORD_LENGTH) {
+        const char* next = find_best_continuation(sys, context, context_length, &rng);
         
         if (!next) {
             // No continuation found with minimum context
@@ -557,17 +729,16 @@ void generate_response(ChatSystem* sys, const char* input, char* output, int max
         strcat(output, next);
         
         // Shift context window less aggressively - keep more original context
+        uint32_t next_id = vocab_lookup(sys->vocab, next);
         if (context_length < CONTEXT_SIZE) {
             // If we have room, just add the word
-            strcpy(context[context_length], next);
+            context[context_length] = next_id;
             context_length++;
         } else {
             // Only shift if we're at max capacity - shift by half, not one
             int shift_amount = context_length / 2;
-            for (int i = 0; i < context_length - shift_amount; i++) {
-                strcpy(context[i], context[i + shift_amount]);
-            }
-            strcpy(context[context_length - shift_amount], next);
+            memmove(context, context + shift_amount, (context_length - shift_amount) * sizeof(uint32_t));
+            context[context_length - shift_amount] = next_id;
             context_length = context_length - shift_amount + 1;
         }
         
@@ -576,14 +747,12 @@ void generate_response(ChatSystem* sys, const char* input, char* output, int max
         // Debug: show why generation stops
         if (generated == 1) {
             // Check if we can continue from this new context
-            char* next_check = find_best_continuation(sys, context, context_length);
+            const char* next_check = find_best_continuation(sys, context, context_length, &rng);
             if (!next_check) {
                 // printf("DEBUG: No continuation after first word\n");
             }
         }
     }
-    
-    free(copy);
 }
 
 // Chat loop
@@ -621,51 +790,61 @@ void chat_loop(ChatSystem* sys) {
 
 // Print comprehensive statistics
 void print_stats(ChatSystem* sys) {
+    ContextTree* tree = sys->tree;
+    
     printf("\n=== GAIA V3 Pattern Statistics ===\n");
-    printf("Total patterns: %d\n", sys->total_patterns);
-    printf("Hash table size: %d buckets\n", HASH_SIZE);
-    printf("Hash collisions: %d\n", sys->hash_collisions);
+    printf("Total patterns: %zu\n", tree->num_patterns);
+    printf("Context tree nodes: %zu\n", tree->num_nodes);
     printf("Pattern lookups: %d\n", sys->pattern_lookups);
+    printf("Lookahead cache hits: %d\n", sys->lookahead_hits);
     
     printf("\nPatterns by context length:\n");
-    int total_meaningful = 0;
     for (int i = 3; i <= CONTEXT_SIZE; i++) {
-        if (sys->patterns_by_length[i] > 0) {
-            printf("  %d-token contexts: %d\n", i, sys->patterns_by_length[i]);
-            total_meaningful += sys->patterns_by_length[i];
+        if (tree->patterns_by_length[i] > 0) {
+            printf("  %d-token contexts: %zu\n", i, tree->patterns_by_length[i]);
         }
     }
     
     // Calculate memory usage
-    size_t pattern_memory = sys->total_patterns * sizeof(Pattern);
-    size_t hash_memory = HASH_SIZE * sizeof(Pattern*);
-    size_t total_memory = pattern_memory + hash_memory;
+    size_t tree_memory = context_tree_memory_usage(tree);
+    size_t vocab_memory = vocab_memory_usage(sys->vocab);
+    size_t total_memory = tree_memory + vocab_memory;
+    size_t fixed_bytes = sizeof(char[CONTEXT_SIZE][MAX_WORD_LENGTH]) + MAX_WORD_LENGTH +
+                         2 * sizeof(int) + 2 * sizeof(void*);
     
     printf("\nMemory usage:\n");
-    printf("  Patterns: %.1f MB\n", pattern_memory / (1024.0 * 1024.0));
-    printf("  Hash table: %.1f MB\n", hash_memory / (1024.0 * 1024.0));
+    printf("  Vocabulary: %u words, %.1f KB\n", vocab_size(sys->vocab), vocab_memory / 1024.0);
+    printf("  Context tree: %.1f MB\n", tree_memory / (1024.0 * 1024.0));
     printf("  Total: %.1f MB\n", total_memory / (1024.0 * 1024.0));
+    if (tree->num_patterns > 0) {
+        double per_pattern = (double)tree_memory / tree->num_patterns;
+        printf("  Bytes per pattern: %.1f (fixed-array layout: %zu, %.0fx smaller)\n",
+               per_pattern, fixed_bytes, fixed_bytes / per_pattern);
+    }
     
-    // Calculate hash table usage
-    int used_buckets = 0;
-    int max_chain = 0;
-    for (int i = 0; i < HASH_SIZE; i++) {
-        if (sys->patterns[i]) {
-            used_buckets++;
-            int chain_len = 0;
-            Pattern* p = sys->patterns[i];
-            while (p) {
-                chain_len++;
-                p = p->collision_next;
-            }
-            if (chain_len > max_chain) max_chain = chain_len;
+    // Nodes are shared by every context with the same suffix
+    printf("\nContext tree sharing:\n");
+    printf("  Patterns per node: %.1f\n", tree->num_patterns / (float)tree->num_nodes);
+    printf("  Avg bytes per node: %.1f\n", tree->node_bytes / (float)tree->num_nodes);
+    
+    if (memory_budget || sys->sketch) {
+        printf("\nMemory budget:\n");
+        if (memory_budget) {
+            printf("  Used: %.1f MB of %.1f MB\n", budgeted_memory(sys) / (1024.0 * 1024.0),
+                   memory_budget / (1024.0 * 1024.0));
+        }
+        if (sys->sketch) {
+            printf("  Sketch: %.1f MB, %llu counts\n", count_min_memory_usage(sys->sketch) / (1024.0 * 1024.0),
+                   (unsigned long long)sys->sketch->total);
+        }
+        printf("  Minimum count for %d+ token contexts: %u\n", PRUNE_MIN_DEPTH,
+               sys->prune_count > 1 ? sys->prune_count : 1);
+        printf("  Patterns kept: %zu, pruned: %zu\n", tree->num_patterns, sys->pruned_patterns);
+        if (sys->counts_seen > 0) {
+            printf("  Coverage: %.1f%% of %zu trained (context, next) occurrences\n",
+                   100.0 * tree->total_words / sys->counts_seen, sys->counts_seen);
         }
     }
-    
-    printf("\nHash table performance:\n");
-    printf("  Utilization: %.1f%%\n", (used_buckets * 100.0) / HASH_SIZE);
-    printf("  Longest chain: %d\n", max_chain);
-    printf("  Avg patterns per bucket: %.1f\n", sys->total_patterns / (float)used_buckets);
 }
 
 int main(int argc, char* argv[]) {
@@ -673,6 +852,7 @@ int main(int argc, char* argv[]) {
     printf("=====================================================================\n\n");
     
     // Parse command line arguments
+    int seeded = 0;
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--superposition") == 0) {
             use_superposition = 1;
@@ -680,20 +860,53 @@ int main(int argc, char* argv[]) {
         } else if (strcmp(argv[i], "--debug-superposition") == 0) {
             debug_superposition = 1;
             printf("Superposition debug: ENABLED\n");
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            training_threads = atoi(argv[++i]);
+            if (training_threads < 1) training_threads = 1;
+            if (training_threads > TRAIN_MAX_THREADS) training_threads = TRAIN_MAX_THREADS;
+            printf("Training threads: %d\n", training_threads);
+        } else if (strcmp(argv[i], "--top-k") == 0 && i + 1 < argc) {
+            top_k = atoi(argv[++i]);
+            if (top_k < 1) top_k = 1;
+            if (top_k > MAX_CANDIDATES) top_k = MAX_CANDIDATES;
+            printf("Top-k candidates: %d\n", top_k);
+        } else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc) {
+            memory_budget = (size_t)atol(argv[++i]) << 20;
+            printf("Memory budget: %zu MB\n", memory_budget >> 20);
+        } else if (strcmp(argv[i], "--beam") == 0 && i + 1 < argc) {
+            beam_width = atoi(argv[++i]);
+            if (beam_width < 1) beam_width = 1;
+            if (beam_width > BEAM_MAX_WIDTH) beam_width = BEAM_MAX_WIDTH;
+            printf("Beam width: %d\n", beam_width);
+        } else if (strcmp(argv[i], "--sketch") == 0) {
+            use_sketch = 1;
+            printf("Approximate counting for rare patterns: ENABLED\n");
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            sample_seed = strtoull(argv[++i], NULL, 0);
+            seeded = 1;
         } else if (strcmp(argv[i], "--help") == 0) {
             printf("Usage: %s [options]\n", argv[0]);
             printf("Options:\n");
             printf("  --superposition       Enable selective superposition for ambiguous contexts\n");
             printf("  --debug-superposition Show superposition selection details\n");
+            printf("  --threads N           Train with N worker threads\n");
+            printf("  --top-k N             Score the N most frequent next words (default %d, max %d)\n",
+                   DEFAULT_TOP_K, MAX_CANDIDATES);
+            printf("  --beam N              Generate with an N-wide beam search (max %d)\n", BEAM_MAX_WIDTH);
+            printf("  --memory-budget MB    Prune rare %d+ token patterns to keep the model under MB\n",
+                   PRUNE_MIN_DEPTH);
+            printf("  --sketch              Count rare patterns in a count-min sketch until seen twice\n");
+            printf("  --seed N              Seed superposition sampling, so runs replay exactly\n");
             printf("  --help               Show this help message\n");
             return 0;
         }
     }
     
-    // Seed random for superposition sampling with microsecond precision
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    srand(ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + getpid());
+    // Seed superposition sampling; the seed is shown so a run can be replayed
+    if (!seeded) sample_seed = rng_entropy_seed();
+    if (use_superposition) {
+        printf("Superposition seed: %llu\n", (unsigned long long)sample_seed);
+    }
     
     // Initialize gates
     gate_registry_init();
@@ -713,11 +926,20 @@ int main(int argc, char* argv[]) {
     list_functions();
     
     ChatSystem* sys = create_chat_system();
+    if (training_threads > 1 && (memory_budget || use_sketch)) {
+        printf("Memory budget mode trains on one thread\n");
+    }
     
     // Train on ALL datasets
     printf("Training on all datasets with %d-token context window...\n", CONTEXT_SIZE);
+    struct timespec train_start, train_end;
+    clock_gettime(CLOCK_MONOTONIC, &train_start);
     train_from_directory(sys, "datasets");
+    clock_gettime(CLOCK_MONOTONIC, &train_end);
+    printf("Training took %.2f seconds\n", (train_end.tv_sec - train_start.tv_sec) +
+           (train_end.tv_nsec - train_start.tv_nsec) / 1e9);
     
+    freeze_patterns(sys);
     print_stats(sys);
     printf("\nReady for chat with 100-token context!\n");
     
@@ -725,16 +947,7 @@ int main(int argc, char* argv[]) {
     chat_loop(sys);
     
     // Cleanup
-    for (int i = 0; i < HASH_SIZE; i++) {
-        Pattern* p = sys->patterns[i];
-        while (p) {
-            Pattern* next = p->collision_next;
-            if (p->gate) gate_destroy(p->gate);
-            free(p);
-            p = next;
-        }
-    }
-    free(sys);
+    destroy_chat_system(sys);
     
     // Cleanup
     function_registry_cleanup();
@@ -13,11 +13,14 @@
 #include "gaia_functions.h"
 #include "analysis_functions.h"
 #include "experiment_logger.h"
+#include "vocabulary.h"
+#include "tokenizer.h"
+#include "pattern_store.h"
+#include "sampling.h"
 
 // Forward declarations
 char* handle_function_call(const char* input);
 
-#define HASH_SIZE 2097152     // 2M buckets (8x larger for 100-token patterns)
 #define MAX_WORD_LENGTH 50
 #define MAX_INPUT_LENGTH 1024
 #define CONTEXT_SIZE 100      // 100-token context window!
@@ -29,39 +32,25 @@ char* handle_function_call(const char* input);
 static int use_superposition = 0;  // Set to 1 to enable superposition mode
 static int debug_superposition = 0;  // Set to 1 for superposition debug output
 static int use_analysis = 1;  // Set to 1 to enable V6 analysis features
+static uint64_t sample_seed = 0;  // Run seed for superposition; replies draw from (seed, reply)
 
-// Enhanced pattern structure for 100-token context
-typedef struct Pattern {
-    char context[CONTEXT_SIZE][MAX_WORD_LENGTH];  // 100 words of context
-    char next[MAX_WORD_LENGTH];                   // Next word
-    int context_length;                           // Actual context length
-    int count;
-    Gate* gate;
-    struct Pattern* collision_next;
-} Pattern;
-
-// Chat system with more tracking
+// Chat system with more tracking; patterns are stored as interned token IDs
 typedef struct {
-    Pattern* patterns[HASH_SIZE];
+    PatternStore* store;
+    Vocabulary* vocab;
     int total_patterns;
     int total_words;
     int patterns_by_length[CONTEXT_SIZE + 1];  // Track patterns of each context length
-    int hash_collisions;                       // Track collision performance
     int pattern_lookups;                       // Track lookup performance
+    uint64_t replies;                          // Numbers each reply's random stream
 } ChatSystem;
 
-// Enhanced hash function for 100-token context
-uint32_t compute_pattern_address(char context[][MAX_WORD_LENGTH], int context_length) {
-    uint64_t hash = 5381;  // Use 64-bit for better distribution
-    
-    for (int i = 0; i < context_length; i++) {
-        for (int j = 0; context[i][j] != '\0'; j++) {
-            hash = ((hash << 5) + hash) + (unsigned char)context[i][j];
-        }
-        hash = ((hash << 5) + hash) + '|';  // Word separator
-    }
-    
-    return (uint32_t)(hash % HASH_SIZE);
+// Release the chat system and everything it owns
+void destroy_chat_system(ChatSystem* system) {
+    if (!system) return;
+    pattern_store_destroy(system->store);
+    vocab_destroy(system->vocab);
+    free(system);
 }
 
 // Initialize the chat system
@@ -72,83 +61,36 @@ ChatSystem* init_chat_system() {
         return NULL;
     }
     
-    // Initialize hash table
-    for (int i = 0; i < HASH_SIZE; i++) {
-        system->patterns[i] = NULL;
+    // Initialize pattern store and vocabulary
+    system->store = pattern_store_create(PATTERN_STORE_DEFAULT_SLOTS);
+    system->vocab = vocab_create();
+    if (!system->store || !system->vocab) {
+        printf("Failed to allocate pattern store\n");
+        destroy_chat_system(system);
+        return NULL;
     }
     
-    printf("Chat system initialized with %d hash buckets\n", HASH_SIZE);
+    printf("Chat system initialized with %u pattern slots\n", system->store->num_slots);
     return system;
 }
 
-// Tokenize input into words
-int tokenize_input(const char* input, char tokens[][MAX_WORD_LENGTH], int max_tokens) {
-    int token_count = 0;
-    char temp[MAX_INPUT_LENGTH];
-    strncpy(temp, input, MAX_INPUT_LENGTH - 1);
-    temp[MAX_INPUT_LENGTH - 1] = '\0';
-    
-    char* token = strtok(temp, " \t\n\r.,!?;:");
-    while (token && token_count < max_tokens) {
-        // Convert to lowercase
-        for (int i = 0; token[i]; i++) {
-            token[i] = tolower(token[i]);
-        }
-        
-        strncpy(tokens[token_count], token, MAX_WORD_LENGTH - 1);
-        tokens[token_count][MAX_WORD_LENGTH - 1] = '\0';
-        token_count++;
-        
-        token = strtok(NULL, " \t\n\r.,!?;:");
-    }
-    
-    return token_count;
-}
-
-// Enhanced pattern storage with collision handling
-void store_pattern(ChatSystem* system, char context[][MAX_WORD_LENGTH], int context_length, const char* next) {
+// Enhanced pattern storage with collision handling; hash is
+// pattern_store_hash of the context
+void store_pattern(ChatSystem* system, const uint32_t* context, int context_length,
+                   uint32_t hash, uint32_t next) {
     system->pattern_lookups++;
     
-    uint32_t address = compute_pattern_address(context, context_length);
-    Pattern* current = system->patterns[address];
-    
-    // Search for existing pattern in collision chain
-    while (current) {
-        if (current->context_length == context_length) {
-            int match = 1;
-            for (int i = 0; i < context_length; i++) {
-                if (strcmp(current->context[i], context[i]) != 0) {
-                    match = 0;
-                    break;
-                }
-            }
-            if (match && strcmp(current->next, next) == 0) {
-                current->count++;
-                return;  // Pattern already exists, incremented count
-            }
-        }
-        current = current->collision_next;
+    // Search for existing pattern among the context's continuations
+    Pattern* existing = pattern_store_find_hashed(system->store, context, context_length, hash, next);
+    if (existing) {
+        existing->count++;
+        return;  // Pattern already exists, incremented count
     }
     
-    // Create new pattern
-    Pattern* pattern = calloc(1, sizeof(Pattern));
-    if (!pattern) return;
-    
-    pattern->context_length = context_length;
-    for (int i = 0; i < context_length; i++) {
-        strncpy(pattern->context[i], context[i], MAX_WORD_LENGTH - 1);
-        pattern->context[i][MAX_WORD_LENGTH - 1] = '\0';
-    }
-    strncpy(pattern->next, next, MAX_WORD_LENGTH - 1);
-    pattern->next[MAX_WORD_LENGTH - 1] = '\0';
-    pattern->count = 1;
-    
-    // Insert at head of collision chain
-    if (system->patterns[address]) {
-        system->hash_collisions++;
+    // Create new pattern on the context's probe sequence
+    if (!pattern_store_insert_hashed(system->store, context, context_length, hash, next)) {
+        return;
     }
-    pattern->collision_next = system->patterns[address];
-    system->patterns[address] = pattern;
     
     system->total_patterns++;
     system->patterns_by_length[context_length]++;
@@ -156,83 +98,54 @@ void store_pattern(ChatSystem* system, char context[][MAX_WORD_LENGTH], int cont
 
 // Multi-step lookahead for better word selection
 typedef struct {
-    char word[MAX_WORD_LENGTH];
+    uint32_t word;  // Vocabulary ID
     int found_continuations;
     float coherence_score;
     float total_score;
 } WordCandidate;
 
-int find_word_candidates(ChatSystem* system, char context[][MAX_WORD_LENGTH], int context_length, WordCandidate* candidates, int max_candidates) {
+int find_word_candidates(ChatSystem* system, const uint32_t* context, int context_length, WordCandidate* candidates, int max_candidates) {
     int candidate_count = 0;
-    uint32_t address = compute_pattern_address(context, context_length);
-    Pattern* current = system->patterns[address];
+    PatternIter iter;
+    Pattern* current = pattern_store_first(system->store, context, context_length, &iter);
     
     while (current && candidate_count < max_candidates) {
-        if (current->context_length == context_length) {
-            int match = 1;
-            for (int i = 0; i < context_length; i++) {
-                if (strcmp(current->context[i], context[i]) != 0) {
-                    match = 0;
-                    break;
-                }
-            }
-            if (match) {
-                strncpy(candidates[candidate_count].word, current->next, MAX_WORD_LENGTH - 1);
-                candidates[candidate_count].word[MAX_WORD_LENGTH - 1] = '\0';
-                candidates[candidate_count].found_continuations = 0;
-                candidates[candidate_count].coherence_score = 0.0;
-                candidates[candidate_count].total_score = 0.0;
-                candidate_count++;
-            }
-        }
-        current = current->collision_next;
+        candidates[candidate_count].word = current->next;
+        candidates[candidate_count].found_continuations = 0;
+        candidates[candidate_count].coherence_score = 0.0;
+        candidates[candidate_count].total_score = 0.0;
+        candidate_count++;
+        current = pattern_store_next(&iter);
     }
     
     return candidate_count;
 }
 
 // Check continuations for lookahead
-void check_continuations(ChatSystem* system, char context[][MAX_WORD_LENGTH], int context_length, const char* candidate_word, WordCandidate* candidate) {
+void check_continuations(ChatSystem* system, const uint32_t* context, int context_length, uint32_t candidate_word, WordCandidate* candidate) {
     // Create new context with candidate word
-    char new_context[CONTEXT_SIZE][MAX_WORD_LENGTH];
+    uint32_t new_context[CONTEXT_SIZE];
     int new_length = context_length + 1;
     if (new_length > CONTEXT_SIZE) {
         // Shift context window
-        for (int i = 0; i < CONTEXT_SIZE - 1; i++) {
-            strcpy(new_context[i], context[i + 1]);
-        }
-        strcpy(new_context[CONTEXT_SIZE - 1], candidate_word);
+        memcpy(new_context, context + 1, (CONTEXT_SIZE - 1) * sizeof(uint32_t));
+        new_context[CONTEXT_SIZE - 1] = candidate_word;
         new_length = CONTEXT_SIZE;
     } else {
-        for (int i = 0; i < context_length; i++) {
-            strcpy(new_context[i], context[i]);
-        }
-        strcpy(new_context[context_length], candidate_word);
+        memcpy(new_context, context, context_length * sizeof(uint32_t));
+        new_context[context_length] = candidate_word;
     }
     
     // Count how many continuations this leads to
-    uint32_t address = compute_pattern_address(new_context, new_length);
-    Pattern* current = system->patterns[address];
-    
-    while (current) {
-        if (current->context_length == new_length) {
-            int match = 1;
-            for (int i = 0; i < new_length; i++) {
-                if (strcmp(current->context[i], new_context[i]) != 0) {
-                    match = 0;
-                    break;
-                }
-            }
-            if (match) {
-                candidate->found_continuations++;
-            }
-        }
-        current = current->collision_next;
+    PatternIter iter;
+    for (Pattern* current = pattern_store_first(system->store, new_context, new_length, &iter);
+         current; current = pattern_store_next(&iter)) {
+        candidate->found_continuations++;
     }
 }
 
 // Calculate coherence score using V6 analysis
-void calculate_coherence_score(char context[][MAX_WORD_LENGTH], int context_length, WordCandidate* candidate) {
+void calculate_coherence_score(ChatSystem* system, const uint32_t* context, int context_length, WordCandidate* candidate) {
     if (!use_analysis) {
         candidate->coherence_score = 0.5;  // Default neutral score
         return;
@@ -241,16 +154,19 @@ void calculate_coherence_score(char context[][MAX_WORD_LENGTH], int context_leng
     // Build context string
     char context_str[1024] = "";
     for (int i = 0; i < context_length && i < 10; i++) {  // Use last 10 words for coherence
+        const char* word = vocab_word(system->vocab, context[i]);
+        if (!word) continue;
         if (i > 0) strcat(context_str, " ");
-        strcat(context_str, context[i]);
+        strcat(context_str, word);
     }
     
     // Use analysis functions to score coherence
-    CoherenceScore score = analyze_coherence(context_str, candidate->word);
+    const char* candidate_word = vocab_word(system->vocab, candidate->word);
+    CoherenceScore score = analyze_coherence(context_str, candidate_word);
     candidate->coherence_score = score.overall_score;
     
     // Log coherence experiment
-    log_coherence_experiment(context_str, candidate->word, 
+    log_coherence_experiment(context_str, candidate_word, 
                            score.semantic_similarity, score.grammatical_fit,
                            score.topic_consistency, score.overall_score);
 }
@@ -264,7 +180,7 @@ typedef struct {
 } SuperpositionState;
 
 // Generate superposition states
-int generate_superposition_states(ChatSystem* system, char context[][MAX_WORD_LENGTH], int context_length, SuperpositionState* states, int max_states) {
+int generate_superposition_states(ChatSystem* system, const uint32_t* context, int context_length, SuperpositionState* states, int max_states) {
     WordCandidate candidates[100];
     int candidate_count = find_word_candidates(system, context, context_length, candidates, 100);
     
@@ -273,7 +189,7 @@ int generate_superposition_states(ChatSystem* system, char context[][MAX_WORD_LE
     // Score each candidate
     for (int i = 0; i < candidate_count; i++) {
         check_continuations(system, context, context_length, candidates[i].word, &candidates[i]);
-        calculate_coherence_score(context, context_length, &candidates[i]);
+        calculate_coherence_score(system, context, context_length, &candidates[i]);
         candidates[i].total_score = candidates[i].found_continuations * 0.6 + candidates[i].coherence_score * 0.4;
     }
     
@@ -302,7 +218,8 @@ int generate_superposition_states(ChatSystem* system, char context[][MAX_WORD_LE
     
     for (int i = 0; i < candidate_count && i < max_states; i++) {
         if (candidates[i].total_score > 0.1) {  // Minimum threshold
-            strcpy(states[state_count].word, candidates[i].word);
+            strncpy(states[state_count].word, vocab_word(system->vocab, candidates[i].word), MAX_WORD_LENGTH - 1);
+            states[state_count].word[MAX_WORD_LENGTH - 1] = '\0';
             states[state_count].continuation_count = candidates[i].found_continuations;
             states[state_count].coherence_score = candidates[i].coherence_score;
             total_score += candidates[i].total_score;
@@ -319,36 +236,31 @@ int generate_superposition_states(ChatSystem* system, char context[][MAX_WORD_LE
     return state_count;
 }
 
-// Choose word from superposition collapse
-char* collapse_superposition(SuperpositionState* states, int state_count) {
+// Choose word from superposition collapse, sampling states by probability
+// with the reply's generator
+char* collapse_superposition(SuperpositionState* states, int state_count, Rng* rng) {
     if (state_count == 0) return NULL;
     
-    // Add randomness with microsecond precision
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    srand(ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + getpid());
-    
-    float random_val = (float)rand() / RAND_MAX;
-    float cumulative = 0.0;
+    float probs[MAX_SUPERPOSITION];
+    int count = state_count < MAX_SUPERPOSITION ? state_count : MAX_SUPERPOSITION;
+    for (int i = 0; i < count; i++) {
+        probs[i] = states[i].probability;
+    }
     
-    for (int i = 0; i < state_count; i++) {
-        cumulative += states[i].probability;
-        if (random_val <= cumulative) {
-            // Log superposition experiment
-            float probs[MAX_SUPERPOSITION];
-            for (int j = 0; j < state_count && j < MAX_SUPERPOSITION; j++) {
-                probs[j] = states[j].probability;
-            }
-            log_superposition_experiment("", state_count, probs, states[i].word);
-            return states[i].word;
-        }
+    AliasTable table;
+    if (!alias_build(&table, probs, count)) {
+        return states[0].word;  // Fallback to first state
     }
     
-    return states[0].word;  // Fallback to first state
+    // Log superposition experiment
+    int chosen = alias_sample(&table, rng);
+    log_superposition_experiment("", state_count, probs, states[chosen].word);
+    return states[chosen].word;
 }
 
 // V6 Enhanced word finding with analysis integration
-char* find_next_word_v6(ChatSystem* system, char context[][MAX_WORD_LENGTH], int context_length, const char* original_input) {
+char* find_next_word_v6(ChatSystem* system, const uint32_t* context, int context_length, const char* original_input,
+                        Rng* rng) {
     system->pattern_lookups++;
     
     // Use V6 analysis to understand the input better
@@ -395,7 +307,7 @@ char* find_next_word_v6(ChatSystem* system, char context[][MAX_WORD_LENGTH], int
                 }
             }
             
-            char* result = collapse_superposition(states, state_count);
+            char* result = collapse_superposition(states, state_count, rng);
             if (result) {
                 char* final_result = malloc(strlen(result) + 1);
                 strcpy(final_result, result);
@@ -413,7 +325,7 @@ char* find_next_word_v6(ChatSystem* system, char context[][MAX_WORD_LENGTH], int
     // Score candidates with V6 coherence analysis
     for (int i = 0; i < candidate_count; i++) {
         check_continuations(system, context, context_length, candidates[i].word, &candidates[i]);
-        calculate_coherence_score(context, context_length, &candidates[i]);
+        calculate_coherence_score(system, context, context_length, &candidates[i]);
         candidates[i].total_score = candidates[i].found_continuations * 0.6 + candidates[i].coherence_score * 0.4;
     }
     
@@ -425,9 +337,7 @@ char* find_next_word_v6(ChatSystem* system, char context[][MAX_WORD_LENGTH], int
         }
     }
     
-    char* result = malloc(strlen(candidates[best_idx].word) + 1);
-    strcpy(result, candidates[best_idx].word);
-    return result;
+    return strdup(vocab_word(system->vocab, candidates[best_idx].word));
 }
 
 // Enhanced function call handler with V6 analysis
@@ -501,6 +411,8 @@ void generate_response_v6(ChatSystem* system, const char* input) {
     }
     
     printf("GAIA V6: ");
+    Rng rng;
+    rng_seed(&rng, sample_seed, system->replies++);
     
     // V6 Analysis first
     if (use_analysis) {
@@ -563,31 +475,22 @@ void generate_response_v6(ChatSystem* system, const char* input) {
         return;
     }
     
-    // Tokenize input
-    char tokens[CONTEXT_SIZE][MAX_WORD_LENGTH];
-    int token_count = tokenize_input(input, tokens, CONTEXT_SIZE);
+    // Tokenize input straight into the initial context (unknown words
+    // match no pattern)
+    uint32_t context[CONTEXT_SIZE];
+    int context_length = tokenize_lookup(system->vocab, input, strlen(input), context, CONTEXT_SIZE);
     
-    if (token_count == 0) {
+    if (context_length == 0) {
         printf("I need some words to work with.\n");
         return;
     }
     
-    // Generate response using pattern matching
-    char context[CONTEXT_SIZE][MAX_WORD_LENGTH];
-    int context_length = 0;
-    
-    // Build initial context from input
-    for (int i = 0; i < token_count && i < CONTEXT_SIZE; i++) {
-        strcpy(context[i], tokens[i]);
-        context_length++;
-    }
-    
-    // Generate up to 20 words
+    // Generate response using pattern matching, up to 20 words
     int words_generated = 0;
     int max_words = 20;
     
     while (words_generated < max_words) {
-        char* next_word = find_next_word_v6(system, context, context_length, input);
+        char* next_word = find_next_word_v6(system, context, context_length, input, &rng);
         
         if (!next_word) {
             if (words_generated == 0) {
@@ -600,23 +503,22 @@ void generate_response_v6(ChatSystem* system, const char* input) {
         fflush(stdout);
         
         // Update context for next iteration
+        uint32_t next_id = vocab_lookup(system->vocab, next_word);
         if (context_length < CONTEXT_SIZE) {
-            strcpy(context[context_length], next_word);
+            context[context_length] = next_id;
             context_length++;
         } else {
             // Shift context window
-            for (int i = 0; i < CONTEXT_SIZE - 1; i++) {
-                strcpy(context[i], context[i + 1]);
-            }
-            strcpy(context[CONTEXT_SIZE - 1], next_word);
+            memmove(context, context + 1, (CONTEXT_SIZE - 1) * sizeof(uint32_t));
+            context[CONTEXT_SIZE - 1] = next_id;
         }
         
+        char last_char = next_word[strlen(next_word) - 1];
         free(next_word);
         words_generated++;
         
         // Natural stopping points
         if (words_generated >= 3) {
-            char last_char = context[context_length - 1][strlen(context[context_length - 1]) - 1];
             if (last_char == '.' || last_char == '!' || last_char == '?') {
                 break;
             }
@@ -624,7 +526,7 @@ void generate_response_v6(ChatSystem* system, const char* input) {
         
         // Stop if we've generated a reasonable response
         if (words_generated >= 8 && words_generated % 4 == 0) {
-            if (rand() % 3 == 0) break;  // 33% chance to stop at natural points
+            if (rng_below(&rng, 3) == 0) break;  // 33% chance to stop at natural points
         }
     }
     
@@ -650,21 +552,28 @@ int load_training_data(ChatSystem* system, const char* filename) {
         if (strlen(line) < 3) continue;  // Skip very short lines
         
         // Tokenize the line
-        char tokens[CONTEXT_SIZE][MAX_WORD_LENGTH];
-        int token_count = tokenize_input(line, tokens, CONTEXT_SIZE);
+        TokenSpan spans[CONTEXT_SIZE];
+        int token_count = tokenize_spans(line, strlen(line), spans, CONTEXT_SIZE);
         
         if (token_count < 2) continue;  // Need at least 2 tokens
         
-        // Create patterns of various lengths (1 to CONTEXT_SIZE)
+        // Intern tokens once per line
+        uint32_t ids[CONTEXT_SIZE];
+        for (int i = 0; i < token_count; i++) {
+            ids[i] = vocab_intern_lower(system->vocab, line + spans[i].start, spans[i].length);
+        }
+        
+        // Create patterns of various lengths (1 to CONTEXT_SIZE). Each start keeps the
+        // running hash of its context, so each longer context costs one hash
+        // step rather than a full rehash
+        uint64_t states[CONTEXT_SIZE];
+        for (int start = 0; start < token_count; start++) states[start] = PATTERN_HASH_SEED;
+        
         for (int context_len = 1; context_len < token_count && context_len <= CONTEXT_SIZE; context_len++) {
             for (int start = 0; start + context_len < token_count; start++) {
-                char context[CONTEXT_SIZE][MAX_WORD_LENGTH];
-                for (int i = 0; i < context_len; i++) {
-                    strcpy(context[i], tokens[start + i]);
-                }
-                const char* next_word = tokens[start + context_len];
-                
-                store_pattern(system, context, context_len, next_word);
+                states[start] = pattern_hash_extend(states[start], ids[start + context_len - 1]);
+                store_pattern(system, ids + start, context_len, pattern_hash_finish(states[start]),
+                              ids[start + context_len]);
                 system->total_words++;
             }
         }
@@ -682,16 +591,37 @@ int load_training_data(ChatSystem* system, const char* filename) {
     return 1;
 }
 
+// Print pattern memory compared with the fixed-array layout
+void print_memory_stats(ChatSystem* system) {
+    size_t pattern_bytes = system->store->pattern_bytes;
+    size_t table_bytes = pattern_store_memory_usage(system->store) - pattern_bytes;
+    size_t vocab_bytes = vocab_memory_usage(system->vocab);
+    size_t fixed_bytes = sizeof(char[CONTEXT_SIZE][MAX_WORD_LENGTH]) + MAX_WORD_LENGTH +
+                         2 * sizeof(int) + 2 * sizeof(void*);
+    
+    printf("\nMemory usage:\n");
+    printf("  Vocabulary: %u words, %.1f KB\n", vocab_size(system->vocab), vocab_bytes / 1024.0);
+    printf("  Patterns: %.1f MB\n", pattern_bytes / (1024.0 * 1024.0));
+    printf("  Hash table: %.1f MB (%u slots, %.0f%% load)\n", table_bytes / (1024.0 * 1024.0),
+           system->store->num_slots, pattern_store_load_factor(system->store) * 100.0);
+    if (system->total_patterns > 0) {
+        double per_pattern = (double)pattern_bytes / system->total_patterns;
+        printf("  Bytes per pattern: %.1f (fixed-array layout: %zu, %.0fx smaller)\n",
+               per_pattern, fixed_bytes, fixed_bytes / per_pattern);
+    }
+}
+
 // Print system statistics
 void print_system_stats(ChatSystem* system) {
     printf("\n=== GAIA V6 System Statistics ===\n");
     printf("Total patterns: %d\n", system->total_patterns);
     printf("Total words processed: %d\n", system->total_words);
-    printf("Hash collisions: %d\n", system->hash_collisions);
+    printf("Hash collisions: %zu\n", system->store->displaced);
     printf("Pattern lookups: %d\n", system->pattern_lookups);
     printf("Hash efficiency: %.2f%%\n", 
-           system->hash_collisions > 0 ? 
-           100.0 * (1.0 - (float)system->hash_collisions / system->pattern_lookups) : 100.0);
+           system->total_patterns > 0 ? 
+           100.0 * (1.0 - (float)system->store->displaced / system->total_patterns) : 100.0);
+    print_memory_stats(system);
     
     printf("\nPatterns by context length:\n");
     for (int i = 1; i <= 10 && i <= CONTEXT_SIZE; i++) {
@@ -711,9 +641,9 @@ void print_system_stats(ChatSystem* system) {
 int main(int argc, char* argv[]) {
     printf("=== GAIA V6 - Enhanced Analysis & Superposition ===\n");
     printf("Context window: %d tokens\n", CONTEXT_SIZE);
-    printf("Hash table size: %d buckets\n", HASH_SIZE);
     
     // Parse command line arguments
+    int seeded = 0;
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--superposition") == 0) {
             use_superposition = 1;
@@ -724,9 +654,16 @@ int main(int argc, char* argv[]) {
         } else if (strcmp(argv[i], "--no-analysis") == 0) {
             use_analysis = 0;
             printf("Analysis functions: DISABLED\n");
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            sample_seed = strtoull(argv[++i], NULL, 0);
+            seeded = 1;
         }
     }
     
+    // Seed superposition sampling; the seed is shown so a run can be replayed
+    if (!seeded) sample_seed = rng_entropy_seed();
+    printf("Superposition seed: %llu\n", (unsigned long long)sample_seed);
+    
     // Initialize function registry and experiment logger
     function_registry_init();
     register_gaia_functions();
@@ -799,8 +736,8 @@ int main(int argc, char* argv[]) {
     
     function_registry_cleanup();
     cleanup_experiment_logger();
+    destroy_chat_system(system);
     
-    // Cleanup (basic - in real system would need proper cleanup)
     printf("GAIA V6 session ended.\n");
     return 0;
 }
\ No newline at end of file
@@ -15,12 +15,14 @@
 #include "experiment_logger.h"
 #include "dynamic_workflows.h"
 #include "explanations.h"
+#include "vocabulary.h"
+#include "tokenizer.h"
+#include "pattern_store.h"
 
 // Forward declarations
 char* handle_function_call(const char* input);
 char* generate_response_for_step(void* system, ReasoningStep* step);
 
-#define HASH_SIZE 2097152
 #define MAX_WORD_LENGTH 50
 #define MAX_INPUT_LENGTH 1024
 #define CONTEXT_SIZE 100
@@ -35,38 +37,22 @@ static int use_analysis = 1;
 static int use_workflows = 1;  // V7 feature flag
 static int debug_workflows = 0;
 
-// Pattern structure (same as V6)
-typedef struct Pattern {
-    char context[CONTEXT_SIZE][MAX_WORD_LENGTH];
-    char next[MAX_WORD_LENGTH];
-    int context_length;
-    int count;
-    Gate* gate;
-    struct Pattern* collision_next;
-} Pattern;
-
-// Chat system (same as V6)
+// Chat system: patterns are stored as interned token IDs
 typedef struct {
-    Pattern* patterns[HASH_SIZE];
+    PatternStore* store;
+    Vocabulary* vocab;
     int total_patterns;
     int total_words;
     int patterns_by_length[CONTEXT_SIZE + 1];
-    int hash_collisions;
     int pattern_lookups;
 } ChatSystem;
 
-// Hash function (same as V6)
-uint32_t compute_pattern_address(char context[][MAX_WORD_LENGTH], int context_length) {
-    uint64_t hash = 5381;
-    
-    for (int i = 0; i < context_length; i++) {
-        for (int j = 0; context[i][j] != '\0'; j++) {
-            hash = ((hash << 5) + hash) + (unsigned char)context[i][j];
-        }
-        hash = ((hash << 5) + hash) + '|';
-    }
-    
-    return (uint32_t)(hash % HASH_SIZE);
+// Release the chat system (same as V6)
+void destroy_chat_system(ChatSystem* system) {
+    if (!system) return;
+    pattern_store_destroy(system->store);
+    vocab_destroy(system->vocab);
+    free(system);
 }
 
 // Initialize chat system
@@ -77,109 +63,48 @@ ChatSystem* init_chat_system() {
         return NULL;
     }
     
-    for (int i = 0; i < HASH_SIZE; i++) {
-        system->patterns[i] = NULL;
+    system->store = pattern_store_create(PATTERN_STORE_DEFAULT_SLOTS);
+    system->vocab = vocab_create();
+    if (!system->store || !system->vocab) {
+        printf("Failed to allocate pattern store\n");
+        destroy_chat_system(system);
+        return NULL;
     }
     
-    printf("Chat system initialized with %d hash buckets\n", HASH_SIZE);
+    printf("Chat system initialized with %u pattern slots\n", system->store->num_slots);
     return system;
 }
 
-// Tokenize input (same as V6)
-int tokenize_input(const char* input, char tokens[][MAX_WORD_LENGTH], int max_tokens) {
-    int token_count = 0;
-    char temp[MAX_INPUT_LENGTH];
-    strncpy(temp, input, MAX_INPUT_LENGTH - 1);
-    temp[MAX_INPUT_LENGTH - 1] = '\0';
-    
-    char* token = strtok(temp, " \t\n\r.,!?;:");
-    while (token && token_count < max_tokens) {
-        for (int i = 0; token[i]; i++) {
-            token[i] = tolower(token[i]);
-        }
-        
-        strncpy(tokens[token_count], token, MAX_WORD_LENGTH - 1);
-        tokens[token_count][MAX_WORD_LENGTH - 1] = '\0';
-        token_count++;
-        
-        token = strtok(NULL, " \t\n\r.,!?;:");
-    }
-    
-    return token_count;
-}
-
-// Store pattern (same as V6)
-void store_pattern(ChatSystem* system, char context[][MAX_WORD_LENGTH], int context_length, const char* next) {
+// Store pattern over interned token IDs whose context hash is known
+void store_pattern(ChatSystem* system, const uint32_t* context, int context_length,
+                   uint32_t hash, uint32_t next) {
     system->pattern_lookups++;
     
-    uint32_t address = compute_pattern_address(context, context_length);
-    Pattern* current = system->patterns[address];
-    
-    while (current) {
-        if (current->context_length == context_length) {
-            int match = 1;
-            for (int i = 0; i < context_length; i++) {
-                if (strcmp(current->context[i], context[i]) != 0) {
-                    match = 0;
-                    break;
-                }
-            }
-            if (match && strcmp(current->next, next) == 0) {
-                current->count++;
-                return;
-            }
-        }
-        current = current->collision_next;
-    }
-    
-    Pattern* pattern = calloc(1, sizeof(Pattern));
-    if (!pattern) return;
-    
-    pattern->context_length = context_length;
-    for (int i = 0; i < context_length; i++) {
-        strncpy(pattern->context[i], context[i], MAX_WORD_LENGTH - 1);
-        pattern->context[i][MAX_WORD_LENGTH - 1] = '\0';
+    Pattern* existing = pattern_store_find_hashed(system->store, context, context_length, hash, next);
+    if (existing) {
+        existing->count++;
+        return;
     }
-    strncpy(pattern->next, next, MAX_WORD_LENGTH - 1);
-    pattern->next[MAX_WORD_LENGTH - 1] = '\0';
-    pattern->count = 1;
     
-    if (system->patterns[address]) {
-        system->hash_collisions++;
+    if (!pattern_store_insert_hashed(system->store, context, context_length, hash, next)) {
+        return;
     }
-    pattern->collision_next = system->patterns[address];
-    system->patterns[address] = pattern;
     
     system->total_patterns++;
     system->patterns_by_length[context_length]++;
 }
 
 // Find next word (simplified from V6)
-char* find_next_word(ChatSystem* system, char context[][MAX_WORD_LENGTH], int context_length) {
+char* find_next_word(ChatSystem* system, const uint32_t* context, int context_length) {
     system->pattern_lookups++;
     
-    uint32_t address = compute_pattern_address(context, context_length);
-    Pattern* current = system->patterns[address];
-    
-    while (current) {
-        if (current->context_length == context_length) {
-            int match = 1;
-            for (int i = 0; i < context_length; i++) {
-                if (strcmp(current->context[i], context[i]) != 0) {
-                    match = 0;
-                    break;
-                }
-            }
-            if (match) {
-                char* result = malloc(strlen(current->next) + 1);
-                strcpy(result, current->next);
-                return result;
-            }
-        }
-        current = current->collision_next;
+    PatternIter iter;
+    Pattern* match = pattern_store_first(system->store, context, context_length, &iter);
+    if (!match) {
+        return NULL;
     }
     
-    return NULL;
+    return strdup(vocab_word(system->vocab, match->next));
 }
 
 // V7: Generate response for a specific workflow step
@@ -245,8 +170,8 @@ char* generate_response_for_step(void* system_ptr, ReasoningStep* step) {
                 return strdup("I can help explain mathematical concepts. Please ask about specific operations like addition, subtraction, multiplication, or division.");
             } else {
                 // Use pattern matching for general queries
-                char tokens[CONTEXT_SIZE][MAX_WORD_LENGTH];
-                int token_count = tokenize_input(query_input, tokens, CONTEXT_SIZE);
+                TokenSpan spans[CONTEXT_SIZE];
+                int token_count = tokenize_spans(query_input, strlen(query_input), spans, CONTEXT_SIZE);
                 
                 if (token_count > 0) {
                     // Generate a simple response
@@ -516,8 +441,8 @@ void generate_response_v7(ChatSystem* system, const char* input) {
     }
     
     // Basic pattern matching
-    char tokens[CONTEXT_SIZE][MAX_WORD_LENGTH];
-    int token_count = tokenize_input(input, tokens, CONTEXT_SIZE);
+    TokenSpan spans[CONTEXT_SIZE];
+    int token_count = tokenize_spans(input, strlen(input), spans, CONTEXT_SIZE);
     
     if (token_count == 0) {
         printf("I need some words to work with.\n");
@@ -544,20 +469,25 @@ int load_training_data(ChatSystem* system, const char* filename) {
         line[strcspn(line, "\n")] = 0;
         if (strlen(line) < 3) continue;
         
-        char tokens[CONTEXT_SIZE][MAX_WORD_LENGTH];
-        int token_count = tokenize_input(line, tokens, CONTEXT_SIZE);
+        TokenSpan spans[CONTEXT_SIZE];
+        int token_count = tokenize_spans(line, strlen(line), spans, CONTEXT_SIZE);
         
         if (token_count < 2) continue;
         
+        uint32_t ids[CONTEXT_SIZE];
+        for (int i = 0; i < token_count; i++) {
+            ids[i] = vocab_intern_lower(system->vocab, line + spans[i].start, spans[i].length);
+        }
+        
+        // Extend each start's running hash by one token per length
+        uint64_t states[CONTEXT_SIZE];
+        for (int start = 0; start < token_count; start++) states[start] = PATTERN_HASH_SEED;
+        
         for (int context_len = 1; context_len < token_count && context_len <= CONTEXT_SIZE; context_len++) {
             for (int start = 0; start + context_len < token_count; start++) {
-                char context[CONTEXT_SIZE][MAX_WORD_LENGTH];
-                for (int i = 0; i < context_len; i++) {
-                    strcpy(context[i], tokens[start + i]);
-                }
-                const char* next_word = tokens[start + context_len];
-                
-                store_pattern(system, context, context_len, next_word);
+                states[start] = pattern_hash_extend(states[start], ids[start + context_len - 1]);
+                store_pattern(system, ids + start, context_len, pattern_hash_finish(states[start]),
+                              ids[start + context_len]);
                 system->total_words++;
             }
         }
@@ -575,16 +505,37 @@ int load_training_data(ChatSystem* system, const char* filename) {
     return 1;
 }
 
+// Print pattern memory compared with the fixed-array layout
+void print_memory_stats(ChatSystem* system) {
+    size_t pattern_bytes = system->store->pattern_bytes;
+    size_t table_bytes = pattern_store_memory_usage(system->store) - pattern_bytes;
+    size_t vocab_bytes = vocab_memory_usage(system->vocab);
+    size_t fixed_bytes = sizeof(char[CONTEXT_SIZE][MAX_WORD_LENGTH]) + MAX_WORD_LENGTH +
+                         2 * sizeof(int) + 2 * sizeof(void*);
+    
+    printf("\nMemory usage:\n");
+    printf("  Vocabulary: %u words, %.1f KB\n", vocab_size(system->vocab), vocab_bytes / 1024.0);
+    printf("  Patterns: %.1f MB\n", pattern_bytes / (1024.0 * 1024.0));
+    printf("  Hash table: %.1f MB (%u slots, %.0f%% load)\n", table_bytes / (1024.0 * 1024.0),
+           system->store->num_slots, pattern_store_load_factor(system->store) * 100.0);
+    if (system->total_patterns > 0) {
+        double per_pattern = (double)pattern_bytes / system->total_patterns;
+        printf("  Bytes per pattern: %.1f (fixed-array layout: %zu, %.0fx smaller)\n",
+               per_pattern, fixed_bytes, fixed_bytes / per_pattern);
+    }
+}
+
 // Print system statistics (enhanced for V7)
 void print_system_stats(ChatSystem* system) {
     printf("\n=== GAIA V7 System Statistics ===\n");
     printf("Total patterns: %d\n", system->total_patterns);
     printf("Total words processed: %d\n", system->total_words);
-    printf("Hash collisions: %d\n", system->hash_collisions);
+    printf("Hash collisions: %zu\n", system->store->displaced);
     printf("Pattern lookups: %d\n", system->pattern_lookups);
     printf("Hash efficiency: %.2f%%\n", 
-           system->hash_collisions > 0 ? 
-           100.0 * (1.0 - (float)system->hash_collisions / system->pattern_lookups) : 100.0);
+           system->total_patterns > 0 ? 
+           100.0 * (1.0 - (float)system->store->displaced / system->total_patterns) : 100.0);
+    print_memory_stats(system);
     
     printf("\nPatterns by context length:\n");
     for (int i = 1; i <= 10 && i <= CONTEXT_SIZE; i++) {
@@ -605,7 +556,6 @@ void print_system_stats(ChatSystem* system) {
 int main(int argc, char* argv[]) {
     printf("=== GAIA V7 - Dynamic Workflows & Iterative Reasoning ===\n");
     printf("Context window: %d tokens\n", CONTEXT_SIZE);
-    printf("Hash table size: %d buckets\n", HASH_SIZE);
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -700,8 +650,8 @@ int main(int argc, char* argv[]) {
     
     function_registry_cleanup();
     cleanup_experiment_logger();
+    destroy_chat_system(system);
     
-    // Basic cleanup
     printf("GAIA V7 session ended.\n");
     return 0;
 }
\ No newline at end of file
@@ -4,8 +4,10 @@
 #include <stdint.h>
 #include <ctype.h>
 #include <time.h>
+#include <errno.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <math.h>
 #include <unistd.h>
 #include "gate_types.h"
@@ -16,76 +18,109 @@
 #include "dynamic_workflows.h"
 #include "explanations.h"
 #include "transformer_attention.h"
+#include "vocabulary.h"
+#include "tokenizer.h"
+#include "context_tree.h"
+#include "parallel_training.h"
+#include "model_snapshot.h"
+#include "training_journal.h"
+#include "packed_model.h"
+#include "batch_inference.h"
+#include "model_swap.h"
 
-// Forward declarations
-char* handle_function_call(const char* input);
-char* generate_response_for_step(void* system, ReasoningStep* step);
-
-#define HASH_SIZE 2097152
 #define MAX_WORD_LENGTH 50
 #define MAX_INPUT_LENGTH 1024
+#define DEFAULT_MODEL_PATH "gaia_v8.model"
+#define DEFAULT_PACKED_PATH "gaia_v8.packed"
+#define PACKED_COUNT_BITS 8
 #define CONTEXT_SIZE 100
 #define PAD_TOKEN "[PAD]"
 #define MAX_SUPERPOSITION 5
 #define SUPERPOSITION_THRESHOLD 0.8
+#define MAX_RESPONSE_LENGTH 2048
+
+// Process settings, fixed once the model is loaded
+static int training_threads = 1; // Workers for load_training_data
+static const char* model_path = NULL; // Snapshot to map instead of training
 
-// Feature flags
-static int use_superposition = 0;
-static int debug_superposition = 0;
-static int use_analysis = 1;
-static int use_workflows = 1;
-static int use_attention = 1;  // V8 feature flag
-static int use_refinement = 1; // V8 feature flag
-static int debug_attention = 0;
-static int debug_refinement = 0;
-static int debug_workflows = 0;
-
-// Pattern structure (same as V7)
-typedef struct Pattern {
-    char context[CONTEXT_SIZE][MAX_WORD_LENGTH];
-    char next[MAX_WORD_LENGTH];
-    int context_length;
-    int count;
-    struct Pattern* collision_next;
-} Pattern;
-
-// Chat system (same as V7)
+// Seconds one reply spent in each stage, for benchmarks
 typedef struct {
-    Pattern* patterns[HASH_SIZE];
-    int total_patterns;
-    int total_words;
-    int patterns_by_length[CONTEXT_SIZE + 1];
-    int hash_collisions;
+    double setup;                // Building the reply's V8Enhancement
+    double workflow;
+    double attention;
+    double refinement;
+} V8Timings;
+
+// One reply's feature flags and output. Nothing a reply needs is kept in
+// globals or static buffers, so any number of threads can call
+// generate_response_v8 at once against the same ChatSystem.
+typedef struct {
+    int use_analysis;
+    int use_workflows;
+    int use_attention;           // V8 feature flag
+    int use_refinement;          // V8 feature flag
+    int debug_attention;
+    int debug_refinement;
+    int debug_workflows;
+    int log_experiments;         // Record refinements in the experiment log
+    char* output;                // Caller's buffer for the reply
+    size_t output_size;
+    V8Timings* timings;          // Filled in when set
+} V8Request;
+
+// Defaults of the interactive chat
+static const V8Request V8_DEFAULT_REQUEST = {
+    .use_analysis = 1,
+    .use_workflows = 1,
+    .use_attention = 1,
+    .use_refinement = 1,
+    .log_experiments = 1
+};
+
+// Chat system: patterns live in a context tree over interned token IDs.
+// Replies only read it; training, compaction and saving need the caller to
+// stop replying first.
+// When started from a saved model, the trained patterns are served from the
+// mapped snapshot and the tree only holds what was learned since; those
+// lines are also in the journal until the next compaction.
+typedef struct {
+    ContextTree* tree;
+    Vocabulary* vocab;
+    ModelSnapshot* model;
+    TrainingJournal* journal;
+    uint32_t generation;         // Snapshot generation the journal extends
+    TransformerLayer* transformer; // Attention weights, read by every reply
     int pattern_lookups;
+    int hot_swapped;             // Swapped in while running; model_path is not its file
 } ChatSystem;
 
-// V8 Enhancement context
+// V8 Enhancement context, one per reply
 typedef struct {
-    TransformerLayer* transformer;
+    TransformerLayer* transformer;  // Borrowed from the ChatSystem
     AttentionContext* attention_ctx;
     RefinementContext* refinement_ctx;
     float base_quality;
     float enhanced_quality;
 } V8Enhancement;
 
-// Hash function (same as V7)
-uint32_t compute_pattern_address(char context[][MAX_WORD_LENGTH], int context_length) {
-    uint64_t hash = 5381;
-    
-    for (int i = 0; i < context_length; i++) {
-        for (int j = 0; context[i][j] != '\0'; j++) {
-            hash = ((hash << 5) + hash) + (unsigned char)context[i][j];
-        }
-        hash = ((hash << 5) + hash) + '|';
-    }
-    
-    return (uint32_t)(hash % HASH_SIZE);
+// Release the chat system (same as V7)
+void destroy_chat_system(ChatSystem* system) {
+    if (!system) return;
+    context_tree_destroy(system->tree);
+    vocab_destroy(system->vocab);   // May borrow words from the mapped model
+    snapshot_close(system->model);
+    journal_close(system->journal);
+    destroy_transformer_layer(system->transformer);
+    free(system);
 }
 
-// Initialize chat system
-ChatSystem* init_chat_system() {
-    printf("Allocating chat system...\n");
-    fflush(stdout);
+// Initialize chat system. quiet skips the progress messages, for versions
+// loaded in the background while the chat loop owns the terminal.
+ChatSystem* init_chat_system(int quiet) {
+    if (!quiet) {
+        printf("Allocating chat system...\n");
+        fflush(stdout);
+    }
     
     ChatSystem* system = calloc(1, sizeof(ChatSystem));
     if (!system) {
@@ -93,50 +128,34 @@ ChatSystem* init_chat_system() {
         return NULL;
     }
     
-    printf("Initializing %d hash buckets...\n", HASH_SIZE);
-    fflush(stdout);
+    if (!quiet) {
+        printf("Initializing context tree...\n");
+        fflush(stdout);
+    }
     
-    // Already initialized to NULL by calloc, no need to loop
+    system->tree = context_tree_create(CONTEXT_SIZE);
+    system->vocab = vocab_create();
+    system->transformer = create_transformer_layer();
+    if (!system->tree || !system->vocab || !system->transformer) {
+        printf("Failed to allocate context tree\n");
+        destroy_chat_system(system);
+        return NULL;
+    }
     
-    printf("Chat system initialized with %d hash buckets\n", HASH_SIZE);
-    fflush(stdout);
+    if (!quiet) {
+        printf("Chat system initialized with %d-token context tree\n", CONTEXT_SIZE);
+        fflush(stdout);
+    }
     return system;
 }
 
-// Tokenize input (same as V7)
-int tokenize_input(const char* input, char tokens[][MAX_WORD_LENGTH], int max_tokens) {
-    int token_count = 0;
-    char temp[MAX_INPUT_LENGTH];
-    strncpy(temp, input, MAX_INPUT_LENGTH - 1);
-    temp[MAX_INPUT_LENGTH - 1] = '\0';
-    
-    char* token = strtok(temp, " \t\n\r.,!?;:");
-    while (token && token_count < max_tokens) {
-        for (int i = 0; token[i]; i++) {
-            token[i] = tolower(token[i]);
-        }
-        
-        strncpy(tokens[token_count], token, MAX_WORD_LENGTH - 1);
-        tokens[token_count][MAX_WORD_LENGTH - 1] = '\0';
-        token_count++;
-        
-        token = strtok(NULL, " \t\n\r.,!?;:");
-    }
-    
-    return token_count;
-}
 
 // V8: Create enhancement context
-V8Enhancement* create_v8_enhancement() {
+V8Enhancement* create_v8_enhancement(const ChatSystem* system) {
     V8Enhancement* v8 = calloc(1, sizeof(V8Enhancement));
     if (!v8) return NULL;
     
-    v8->transformer = create_transformer_layer();
-    if (!v8->transformer) {
-        free(v8);
-        return NULL;
-    }
-    
+    v8->transformer = system->transformer;
     return v8;
 }
 
@@ -144,9 +163,7 @@ V8Enhancement* create_v8_enhancement() {
 void destroy_v8_enhancement(V8Enhancement* v8) {
     if (!v8) return;
     
-    if (v8->transformer) {
-        destroy_transformer_layer(v8->transformer);
-    }
+    free(v8->attention_ctx);
     if (v8->refinement_ctx) {
         destroy_refinement_context(v8->refinement_ctx);
     }
@@ -155,12 +172,13 @@ void destroy_v8_enhancement(V8Enhancement* v8) {
 }
 
 // V8: Apply attention-based enhancement
-char* apply_attention_enhancement(V8Enhancement* v8, const char* input, const char* base_response) {
-    if (!v8 || !use_attention) {
+char* apply_attention_enhancement(V8Enhancement* v8, const V8Request* request, const char* input,
+                                  const char* base_response) {
+    if (!v8 || !request->use_attention) {
         return strdup(base_response);
     }
     
-    if (debug_attention) {
+    if (request->debug_attention) {
         printf("\n[V8 Attention] Enhancing response with self-attention...\n");
     }
     
@@ -168,31 +186,35 @@ char* apply_attention_enhancement(V8Enhancement* v8, const char* input, const ch
     Token tokens[MAX_SEQ_LENGTH];
     int num_tokens = tokenize_for_attention(input, tokens, MAX_SEQ_LENGTH);
     
-    if (num_tokens > 0) {
+    // Every head's scores, kept off the worker threads' stacks
+    if (num_tokens > 0 && !v8->attention_ctx) {
+        v8->attention_ctx = malloc(sizeof(AttentionContext));
+    }
+    
+    if (num_tokens > 0 && v8->attention_ctx) {
         // Create embeddings
         create_embeddings(tokens, num_tokens);
         add_position_encoding(tokens, num_tokens);
         
         // Create attention context
-        AttentionContext ctx = {
-            .tokens = tokens,
-            .num_tokens = num_tokens,
-            .layer = v8->transformer
-        };
+        AttentionContext* ctx = v8->attention_ctx;
+        ctx->tokens = tokens;
+        ctx->num_tokens = num_tokens;
+        ctx->layer = v8->transformer;
         
         // Apply multi-head attention
-        apply_multi_head_attention(&ctx);
+        apply_multi_head_attention(ctx);
         
-        if (debug_attention) {
+        if (request->debug_attention) {
             // Visualize attention patterns
             for (int h = 0; h < NUM_HEADS && h < 2; h++) {
-                print_attention_matrix(&v8->transformer->heads[h], tokens, num_tokens);
+                print_attention_matrix(ctx, h);
             }
         }
         
         // Get attention confidence
-        float attention_confidence = get_attention_confidence(&ctx);
-        if (debug_attention) {
+        float attention_confidence = get_attention_confidence(ctx);
+        if (request->debug_attention) {
             printf("[V8 Attention] Confidence: %.2f\n", attention_confidence);
         }
     }
@@ -201,12 +223,13 @@ char* apply_attention_enhancement(V8Enhancement* v8, const char* input, const ch
 }
 
 // V8: Apply iterative refinement
-char* apply_iterative_refinement(V8Enhancement* v8, const char* input, const char* response) {
-    if (!v8 || !use_refinement) {
+char* apply_iterative_refinement(V8Enhancement* v8, const V8Request* request, const char* input,
+                                 const char* response) {
+    if (!v8 || !request->use_refinement) {
         return strdup(response);
     }
     
-    if (debug_refinement) {
+    if (request->debug_refinement) {
         printf("\n[V8 Refinement] Starting iterative refinement...\n");
     }
     
@@ -220,7 +243,7 @@ char* apply_iterative_refinement(V8Enhancement* v8, const char* input, const cha
     ResponseAnalysis* base_analysis = analyze_response(input, response);
     v8->base_quality = base_analysis->overall_quality;
     
-    if (debug_refinement) {
+    if (request->debug_refinement) {
         printf("[V8 Refinement] Base quality: %.2f\n", v8->base_quality);
         printf("  Coherence: %.2f, Relevance: %.2f, Completeness: %.2f, Grammar: %.2f\n",
                base_analysis->coherence_score, base_analysis->relevance_score,
@@ -232,7 +255,7 @@ char* apply_iterative_refinement(V8Enhancement* v8, const char* input, const cha
     if (v8->base_quality < 0.8) {
         refined_response = refine_response_v8(v8->refinement_ctx);
         
-        if (debug_refinement) {
+        if (request->debug_refinement) {
             printf("[V8 Refinement] Refined response: '%s'\n", refined_response);
         }
         
@@ -240,18 +263,20 @@ char* apply_iterative_refinement(V8Enhancement* v8, const char* input, const cha
         ResponseAnalysis* refined_analysis = analyze_response(input, refined_response);
         v8->enhanced_quality = refined_analysis->overall_quality;
         
-        if (debug_refinement) {
+        if (request->debug_refinement) {
             printf("[V8 Refinement] Enhanced quality: %.2f (improvement: +%.2f)\n",
                    v8->enhanced_quality, v8->enhanced_quality - v8->base_quality);
             printf("[V8 Refinement] Iterations: %d\n", v8->refinement_ctx->iteration_count);
         }
         
         // Log experiment
-        char notes[256];
-        snprintf(notes, 255, "Refinement: %.2f -> %.2f in %d iterations",
-                v8->base_quality, v8->enhanced_quality, v8->refinement_ctx->iteration_count);
-        log_experiment(EXP_REFINEMENT, "V8 Iterative Refinement", input, refined_response,
-                      notes, v8->enhanced_quality, 1);
+        if (request->log_experiments) {
+            char notes[256];
+            snprintf(notes, 255, "Refinement: %.2f -> %.2f in %d iterations",
+                    v8->base_quality, v8->enhanced_quality, v8->refinement_ctx->iteration_count);
+            log_experiment(EXP_REFINEMENT, "V8 Iterative Refinement", input, refined_response,
+                          notes, v8->enhanced_quality, 1);
+        }
         
         // Cleanup
         for (int i = 0; i < refined_analysis->num_issues; i++) {
@@ -280,7 +305,8 @@ char* apply_iterative_refinement(V8Enhancement* v8, const char* input, const cha
     }
 }
 
-// Enhanced function call handler (from V7)
+// Enhanced function call handler (from V7). Returns a malloc'd reply, or
+// NULL when the input is not a function call.
 char* handle_function_call(const char* input) {
     if (!input) return NULL;
     
@@ -290,14 +316,16 @@ char* handle_function_call(const char* input) {
         int num = -1;
         char temp[256];
         strncpy(temp, input, 255);
-        char* token = strtok(temp, " ");
+        temp[255] = '\0';
+        char* save;
+        char* token = strtok_r(temp, " ", &save);
         while (token) {
             int val = atoi(token);
             if (val > 0 || (val == 0 && strcmp(token, "0") == 0)) {
                 num = val;
                 break;
             }
-            token = strtok(NULL, " ");
+            token = strtok_r(NULL, " ", &save);
         }
         
         if (num >= 0) {
@@ -323,14 +351,16 @@ char* handle_function_call(const char* input) {
             // Try to extract a number
             char temp[256];
             strncpy(temp, input, 255);
-            char* token = strtok(temp, " ");
+            temp[255] = '\0';
+            char* save;
+            char* token = strtok_r(temp, " ", &save);
             while (token) {
                 int val = atoi(token);
                 if (val > 0) {
                     num = val;
                     break;
                 }
-                token = strtok(NULL, " ");
+                token = strtok_r(NULL, " ", &save);
             }
         }
         
@@ -349,14 +379,16 @@ char* handle_function_call(const char* input) {
         int num = -1;
         char temp[256];
         strncpy(temp, input, 255);
-        char* token = strtok(temp, " ");
+        temp[255] = '\0';
+        char* save;
+        char* token = strtok_r(temp, " ", &save);
         while (token) {
             int val = atoi(token);
             if (val > 0) {
                 num = val;
                 break;
             }
-            token = strtok(NULL, " ");
+            token = strtok_r(NULL, " ", &save);
         }
         
         if (num > 0) {
@@ -436,9 +468,9 @@ char* handle_function_call(const char* input) {
     return NULL;
 }
 
-// Generate response for workflow step (from V7)
-char* generate_response_for_step(void* system_ptr, ReasoningStep* step) {
-    ChatSystem* system = (ChatSystem*)system_ptr;
+// Generate a malloc'd response for a workflow step (from V7)
+char* generate_response_for_step(const ChatSystem* system, const V8Request* request, ReasoningStep* step) {
+    (void)system; // Steps do not consult the patterns yet
     char response[512] = "";
     
     if (!step) {
@@ -483,7 +515,7 @@ char* generate_response_for_step(void* system_ptr, ReasoningStep* step) {
             // First check if we have input to work with
             const char* query_input = strlen(step->input) > 0 ? step->input : step->description;
             
-            if (debug_workflows) {
+            if (request->debug_workflows) {
                 printf("[V8 Debug] EXECUTE step - desc: '%s', input: '%s', using: '%s'\n", 
                        step->description, step->input, query_input);
             }
@@ -491,7 +523,7 @@ char* generate_response_for_step(void* system_ptr, ReasoningStep* step) {
             // Try function call first for calculations
             char* calc_result = handle_function_call(query_input);
             if (calc_result) {
-                if (debug_workflows) {
+                if (request->debug_workflows) {
                     printf("[V8 Debug] Function call returned: %s\n", calc_result);
                 }
                 return calc_result;
@@ -511,8 +543,8 @@ char* generate_response_for_step(void* system_ptr, ReasoningStep* step) {
                 return strdup("I can help explain mathematical concepts. Please ask about specific operations like addition, subtraction, multiplication, or division.");
             } else {
                 // Use pattern matching for general queries
-                char tokens[CONTEXT_SIZE][MAX_WORD_LENGTH];
-                int token_count = tokenize_input(query_input, tokens, CONTEXT_SIZE);
+                TokenSpan spans[CONTEXT_SIZE];
+                int token_count = tokenize_spans(query_input, strlen(query_input), spans, CONTEXT_SIZE);
                 
                 if (token_count > 0) {
                     // Generate a simple response
@@ -546,36 +578,56 @@ char* generate_response_for_step(void* system_ptr, ReasoningStep* step) {
     return strdup("Processing...");
 }
 
-// V8: Enhanced response generation with attention and refinement
-void generate_response_v8(ChatSystem* system, const char* input) {
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Copy a finished reply into the request's buffer, truncating to fit
+static size_t write_reply(const V8Request* request, const char* text) {
+    if (!request->output || request->output_size == 0) return 0;
+    
+    size_t length = strlen(text);
+    if (length >= request->output_size) length = request->output_size - 1;
+    memcpy(request->output, text, length);
+    request->output[length] = '\0';
+    return length;
+}
+
+// V8: Enhanced response generation with attention and refinement. The reply
+// is written to request->output; returns its length. Reentrant: the system
+// is only read and all scratch state is local to the call.
+size_t generate_response_v8(const ChatSystem* system, const V8Request* request, const char* input) {
+    if (request->timings) memset(request->timings, 0, sizeof(V8Timings));
+    
     if (!input || strlen(input) == 0) {
-        printf("Please provide some input.\n");
-        return;
+        return write_reply(request, "Please provide some input.");
     }
     
     // Quick test for prime which we know works
     if (strstr(input, "prime")) {
         char* result = handle_function_call(input);
         if (result) {
-            printf("GAIA V8: %s\n", result);
+            size_t length = write_reply(request, result);
             free(result);
-            return;
+            return length;
         }
     }
     
-    printf("GAIA V8: ");
-    fflush(stdout);
-    
     // Create V8 enhancement context
-    V8Enhancement* v8 = create_v8_enhancement();
-    if (!v8 && (debug_workflows || debug_refinement)) {
+    double stage_start = now_seconds();
+    V8Enhancement* v8 = create_v8_enhancement(system);
+    if (request->timings) request->timings->setup = now_seconds() - stage_start;
+    if (!v8 && (request->debug_workflows || request->debug_refinement)) {
         printf("[V8 Debug] Failed to create V8 enhancement context\n");
     }
     
     // First, use V7 workflow system to generate base response
     char* base_response = NULL;
+    stage_start = now_seconds();
     
-    if (use_workflows) {
+    if (request->use_workflows) {
         // Create workflow
         WorkflowState* workflow = create_workflow();
         if (!workflow) {
@@ -585,7 +637,7 @@ void generate_response_v8(ChatSystem* system, const char* input) {
             // Decompose query
             int num_steps = decompose_query(workflow, input);
             
-            if (debug_workflows) {
+            if (request->debug_workflows) {
                 printf("\n[V8 Debug] Created workflow with %d steps for query: '%s'\n", num_steps, input);
                 for (int i = 0; i < num_steps; i++) {
                     printf("[V8 Debug] Step %d: %s (%d)\n", i+1, 
@@ -599,7 +651,7 @@ void generate_response_v8(ChatSystem* system, const char* input) {
                 ReasoningStep* step = &workflow->steps[workflow->current_step];
                 
                 if (!step->completed) {
-                    char* step_response = generate_response_for_step(system, step);
+                    char* step_response = generate_response_for_step(system, request, step);
                     if (step_response) {
                         strncpy(step->output, step_response, 511);
                         step->output[511] = '\0';
@@ -613,10 +665,11 @@ void generate_response_v8(ChatSystem* system, const char* input) {
             }
             
             // Synthesize results
-            char* synthesis = synthesize_results(workflow);
-            base_response = synthesis ? strdup(synthesis) : strdup("No response generated");
+            char synthesis[MAX_RESPONSE_LENGTH];
+            synthesize_results_into(workflow, synthesis, sizeof(synthesis));
+            base_response = strdup(synthesis);
             
-            if (debug_workflows) {
+            if (request->debug_workflows) {
                 printf("\n[V8 Debug] Base response: '%s'\n", base_response);
             }
             
@@ -626,22 +679,27 @@ void generate_response_v8(ChatSystem* system, const char* input) {
         // Simple response without workflow
         base_response = strdup("I need workflows enabled to process this request.");
     }
+    if (request->timings) request->timings->workflow = now_seconds() - stage_start;
     
     // Apply V8 enhancements
     char* enhanced_response = base_response;
     
     if (v8) {
         // Apply attention-based enhancement
-        char* attention_enhanced = apply_attention_enhancement(v8, input, base_response);
+        stage_start = now_seconds();
+        char* attention_enhanced = apply_attention_enhancement(v8, request, input, base_response);
+        if (request->timings) request->timings->attention = now_seconds() - stage_start;
         
-        if (debug_workflows || debug_refinement) {
+        if (request->debug_workflows || request->debug_refinement) {
             printf("[V8 Debug] After attention: '%s'\n", attention_enhanced);
         }
         
         // Apply iterative refinement
-        enhanced_response = apply_iterative_refinement(v8, input, attention_enhanced);
+        stage_start = now_seconds();
+        enhanced_response = apply_iterative_refinement(v8, request, input, attention_enhanced);
+        if (request->timings) request->timings->refinement = now_seconds() - stage_start;
         
-        if (debug_workflows || debug_refinement) {
+        if (request->debug_workflows || request->debug_refinement) {
             printf("[V8 Debug] After refinement: '%s'\n", enhanced_response);
         }
         
@@ -650,11 +708,12 @@ void generate_response_v8(ChatSystem* system, const char* input) {
         }
     }
     
-    // Output final response
+    // Final response
+    size_t length;
     if (enhanced_response && strlen(enhanced_response) > 0) {
-        printf("%s\n", enhanced_response);
+        length = write_reply(request, enhanced_response);
     } else {
-        printf("(empty response generated)\n");
+        length = write_reply(request, "(empty response generated)");
     }
     
     // Cleanup
@@ -663,65 +722,164 @@ void generate_response_v8(ChatSystem* system, const char* input) {
     }
     free(base_response);
     destroy_v8_enhancement(v8);
+    return length;
+}
+
+// Answer one line of the interactive chat on stdout
+void print_response_v8(const ChatSystem* system, const V8Request* options, const char* input) {
+    char reply[MAX_RESPONSE_LENGTH];
+    V8Request request = *options;
+    request.output = reply;
+    request.output_size = sizeof(reply);
+    
+    generate_response_v8(system, &request, input);
+    if (!input || strlen(input) == 0) {
+        printf("%s\n", reply);
+    } else {
+        printf("GAIA V8: %s\n", reply);
+    }
 }
 
-// Store pattern (same as V7)
-void store_pattern(ChatSystem* system, char context[][MAX_WORD_LENGTH], int context_length, const char* next) {
+// Store a single pattern over interned token IDs
+void store_pattern(ChatSystem* system, const uint32_t* context, int context_length, uint32_t next) {
     system->pattern_lookups++;
     
-    uint32_t address = compute_pattern_address(context, context_length);
-    Pattern* current = system->patterns[address];
+    // V8: No gate needed for patterns
+    context_tree_add(system->tree, context, context_length, next, 1);
+}
+
+// Tokens of a training line up to its newline, skipping lines under three
+// characters; shared by the serial loader and parallel training workers
+int tokenize_training_line(const char* line, TokenSpan* spans, int max_tokens) {
+    size_t length = strcspn(line, "\n");
+    if (length < 3) return 0;
+    return tokenize_spans(line, length, spans, max_tokens);
+}
+
+// Count one training line into the tree. Returns 0 for lines too short to
+// hold a pattern.
+int train_line(ChatSystem* system, const char* line) {
+    TokenSpan spans[CONTEXT_SIZE];
+    int token_count = tokenize_training_line(line, spans, CONTEXT_SIZE);
+    if (token_count < 2) return 0;
+    
+    uint32_t ids[CONTEXT_SIZE];
+    for (int i = 0; i < token_count; i++) {
+        ids[i] = vocab_intern_lower(system->vocab, line + spans[i].start, spans[i].length);
+    }
     
-    while (current) {
-        if (current->context_length == context_length) {
-            int match = 1;
-            for (int i = 0; i < context_length; i++) {
-                if (strcmp(current->context[i], context[i]) != 0) {
-                    match = 0;
-                    break;
-                }
-            }
-            
-            if (match && strcmp(current->next, next) == 0) {
-                current->count++;
-                return;
-            }
-        }
-        
-        if (!current->collision_next) {
-            system->hash_collisions++;
-            break;
-        }
-        current = current->collision_next;
+    context_tree_ingest(system->tree, ids, token_count, 1);
+    return 1;
+}
+
+// With --model, learning is kept only through the journal. A version
+// swapped in while running has none, so what it learned would be lost at
+// exit without a word.
+static int can_journal(const ChatSystem* system) {
+    if (model_path && !system->journal) {
+        printf("Not learning: this model has no training journal to keep it past exit\n");
+        return 0;
     }
+    return 1;
+}
+
+// Online training: count a new line into the live system and journal it, so
+// the work is proportional to the line rather than the whole corpus.
+// Returns 1 once learned, 0 for a line too short and -1 when refused.
+int ingest_line(ChatSystem* system, const char* line) {
+    if (!can_journal(system)) return -1;
+    if (!train_line(system, line)) return 0;
+    if (system->journal && !journal_append(system->journal, line)) {
+        printf("Warning: could not journal training line\n");
+    }
+    return 1;
+}
+
+// Ingest every line of a file of new dialogue
+int ingest_file(ChatSystem* system, const char* filename) {
+    if (!can_journal(system)) return 0;
     
-    Pattern* new_pattern = calloc(1, sizeof(Pattern));
-    if (!new_pattern) {
-        printf("Failed to allocate pattern\n");
-        return;
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        printf("Could not open training file: %s\n", filename);
+        return 0;
     }
     
-    for (int i = 0; i < context_length; i++) {
-        strcpy(new_pattern->context[i], context[i]);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    char line[MAX_INPUT_LENGTH];
+    int lines_ingested = 0;
+    while (fgets(line, sizeof(line), file)) {
+        lines_ingested += ingest_line(system, line) > 0;
     }
-    strcpy(new_pattern->next, next);
-    new_pattern->context_length = context_length;
-    new_pattern->count = 1;
+    fclose(file);
     
-    // V8: No gate needed for patterns
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Ingested %d lines from %s in %.2f ms (%zu patterns pending compaction)\n",
+           lines_ingested, filename,
+           (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6,
+           system->tree->num_patterns);
+    return 1;
+}
+
+static void replay_journal_line(const char* line, void* context) {
+    train_line((ChatSystem*)context, line);
+}
+
+// Bring a freshly mapped model up to date and keep journaling
+int open_journal(ChatSystem* system, const char* path, int replay) {
+    if (replay) {
+        size_t replayed = journal_replay(path, system->generation, replay_journal_line, system);
+        if (replayed > 0) {
+            printf("Replayed %zu journaled lines from %s\n", replayed, path);
+        }
+    }
     
-    if (current) {
-        current->collision_next = new_pattern;
-    } else {
-        system->patterns[address] = new_pattern;
+    system->journal = journal_open(path, system->generation);
+    if (!system->journal) {
+        printf("Warning: could not open training journal %s\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+// Load training data with training_threads workers; same patterns as the
+// serial loop below
+int load_training_data_parallel(ChatSystem* system, const char* filename) {
+    TrainCorpus corpus;
+    train_corpus_init(&corpus);
+    
+    if (!train_corpus_load_file(&corpus, filename, MAX_INPUT_LENGTH)) {
+        printf("Could not open training file: %s\n", filename);
+        train_corpus_free(&corpus);
+        return 0;
     }
     
-    system->total_patterns++;
-    system->patterns_by_length[context_length]++;
+    printf("Loading training data from %s with %d threads...\n", filename, training_threads);
+    
+    TrainConfig config = {
+        .num_threads = training_threads,
+        .max_tokens = CONTEXT_SIZE,
+        .min_tokens = 2,
+        .min_length = 1,
+        .tokenize = tokenize_training_line
+    };
+    TrainResult result = {0};
+    int ok = train_parallel(system->tree, system->vocab, &corpus, &config, &result);
+    train_corpus_free(&corpus);
+    
+    printf("Training complete: %zu lines, %zu patterns, %zu words\n", 
+           result.lines_used, system->tree->num_patterns, system->tree->total_words);
+    return ok;
 }
 
-// Load training data (same as V7)
+// Load training data: each line is ingested into the context tree in one pass
 int load_training_data(ChatSystem* system, const char* filename) {
+    if (training_threads > 1) {
+        return load_training_data_parallel(system, filename);
+    }
+    
     FILE* file = fopen(filename, "r");
     if (!file) {
         printf("Could not open training file: %s\n", filename);
@@ -734,26 +892,7 @@ int load_training_data(ChatSystem* system, const char* filename) {
     printf("Loading training data from %s...\n", filename);
     
     while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\n")] = 0;
-        if (strlen(line) < 3) continue;
-        
-        char tokens[CONTEXT_SIZE][MAX_WORD_LENGTH];
-        int token_count = tokenize_input(line, tokens, CONTEXT_SIZE);
-        
-        if (token_count < 2) continue;
-        
-        for (int context_len = 1; context_len < token_count && context_len <= CONTEXT_SIZE; context_len++) {
-            for (int start = 0; start + context_len < token_count; start++) {
-                char context[CONTEXT_SIZE][MAX_WORD_LENGTH];
-                for (int i = 0; i < context_len; i++) {
-                    strcpy(context[i], tokens[start + i]);
-                }
-                const char* next_word = tokens[start + context_len];
-                
-                store_pattern(system, context, context_len, next_word);
-                system->total_words++;
-            }
-        }
+        if (!train_line(system, line)) continue;
         
         lines_processed++;
         if (lines_processed % 1000 == 0) {
@@ -762,28 +901,290 @@ int load_training_data(ChatSystem* system, const char* filename) {
     }
     
     fclose(file);
-    printf("Training complete: %d lines, %d patterns, %d words\n", 
-           lines_processed, system->total_patterns, system->total_words);
+    printf("Training complete: %d lines, %zu patterns, %zu words\n", 
+           lines_processed, system->tree->num_patterns, system->tree->total_words);
     
     return 1;
 }
 
+// Serve from a mapped model; the vocabulary must be empty. quiet skips the
+// timing report, as in init_chat_system.
+static int use_model(ChatSystem* system, ModelSnapshot* model, const char* source,
+                     const struct timespec* start, int quiet) {
+    if (model->header->max_depth != CONTEXT_SIZE || !snapshot_load_vocab(model, system->vocab)) {
+        printf("Model %s does not match this build\n", source);
+        snapshot_close(model);
+        return 0;
+    }
+    
+    system->model = model;
+    system->generation = model->header->generation;
+    if (quiet) return 1;
+    
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Mapped model %s: %llu patterns, %u words, %.1f MB in %.2f ms\n", source,
+           (unsigned long long)model->header->num_patterns, model->header->num_words,
+           model->size / (1024.0 * 1024.0),
+           (end.tv_sec - start->tv_sec) * 1000.0 + (end.tv_nsec - start->tv_nsec) / 1e6);
+    return 1;
+}
+
+// Map a saved model instead of training
+int load_model(ChatSystem* system, const char* path, int quiet) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    ModelSnapshot* model = snapshot_open(path);
+    if (!model) {
+        printf("Could not load model %s: %s\n", path,
+               errno == EINVAL ? "not a valid model file" : strerror(errno));
+        return 0;
+    }
+    return use_model(system, model, path, &start, quiet);
+}
+
+// Attach a model another process published; its pages are shared by
+// every process attached to it
+int attach_model(ChatSystem* system, const char* name, int quiet) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    ModelSnapshot* model = snapshot_attach(name);
+    if (!model) {
+        printf("No model published as %s\n", name);
+        return 0;
+    }
+    return use_model(system, model, name, &start, quiet);
+}
+
+// Write the current model. A mapped base model is combined with the
+// patterns learned since it was loaded.
+int save_model(ChatSystem* system, const char* path) {
+    int ok;
+    
+    if (system->model) {
+        ContextTree* combined = snapshot_thaw(system->model);
+        ok = combined && context_tree_add_tree(combined, system->tree) &&
+             snapshot_write(path, system->vocab, combined, system->generation);
+        context_tree_destroy(combined);
+    } else {
+        ok = snapshot_write(path, system->vocab, system->tree, system->generation);
+    }
+    
+    if (ok) {
+        printf("Model saved to %s\n", path);
+    } else {
+        printf("Failed to save model to %s\n", path);
+    }
+    return ok;
+}
+
+// Export the read-only serving form of the current model, combined with a
+// mapped base model like save_model
+int export_packed_model(ChatSystem* system, const char* path) {
+    ContextTree* combined = NULL;
+    const ContextTree* tree = system->tree;
+    int ok = 1;
+    
+    if (system->model) {
+        combined = snapshot_thaw(system->model);
+        ok = combined && context_tree_add_tree(combined, system->tree);
+        tree = combined;
+    }
+    
+    ok = ok && packed_write(path, system->vocab, tree, PACKED_COUNT_BITS, system->generation);
+    PackedModel* packed = ok ? packed_open(path) : NULL;
+    if (packed) {
+        printf("Packed model written to %s: %.1f KB (%.1f KB as a tree), counts within %.2f%%\n",
+               path, packed->size / 1024.0, context_tree_memory_usage(tree) / 1024.0,
+               packed->header->max_count_error * 100);
+    } else {
+        printf("Failed to export packed model to %s\n", path);
+    }
+    
+    packed_close(packed);
+    context_tree_destroy(combined);
+    return packed != NULL;
+}
+
+// Publish the current model for other processes to attach, combined with
+// a mapped base model like save_model
+int publish_model(ChatSystem* system, const char* name) {
+    ContextTree* combined = NULL;
+    const ContextTree* tree = system->tree;
+    int ok = 1;
+    
+    if (system->model) {
+        combined = snapshot_thaw(system->model);
+        ok = combined && context_tree_add_tree(combined, system->tree);
+        tree = combined;
+    }
+    
+    ok = ok && snapshot_publish(name, system->vocab, tree, system->generation);
+    ModelSnapshot* published = ok ? snapshot_attach(name) : NULL;
+    if (published) {
+        printf("Model published as %s: %llu patterns, %.1f MB\n", name,
+               (unsigned long long)published->header->num_patterns,
+               published->size / (1024.0 * 1024.0));
+    } else {
+        printf("Failed to publish model as %s\n", name);
+    }
+    
+    snapshot_close(published);
+    context_tree_destroy(combined);
+    return published != NULL;
+}
+
+// Fold the journal into a new snapshot generation at model_path, then serve
+// from the new mapping with an empty journal and delta tree
+int compact_model(ChatSystem* system) {
+    if (!model_path) {
+        printf("Compaction needs --model\n");
+        return 0;
+    }
+    if (system->hot_swapped) {
+        printf("Compaction only applies to the model loaded at startup\n");
+        return 0;
+    }
+    
+    // A crash after the rename leaves a journal for the old generation,
+    // which the next start ignores instead of counting its lines twice
+    system->generation++;
+    if (!save_model(system, model_path)) {
+        system->generation--;
+        return 0;
+    }
+    if (system->journal) journal_reset(system->journal, system->generation);
+    
+    // Word IDs are unchanged, so the new mapping replaces vocabulary and
+    // delta tree together
+    ModelSnapshot* model = snapshot_open(model_path);
+    Vocabulary* vocab = vocab_create();
+    ContextTree* tree = context_tree_create(CONTEXT_SIZE);
+    if (!model || !vocab || !tree || !snapshot_load_vocab(model, vocab)) {
+        printf("Compacted model written, but could not be remapped\n");
+        context_tree_destroy(tree);
+        vocab_destroy(vocab);
+        snapshot_close(model);
+        return 0;
+    }
+    
+    context_tree_destroy(system->tree);
+    vocab_destroy(system->vocab);
+    snapshot_close(system->model);
+    system->tree = tree;
+    system->vocab = vocab;
+    system->model = model;
+    
+    printf("Compacted into generation %u: %llu patterns\n", system->generation,
+           (unsigned long long)model->header->num_patterns);
+    return 1;
+}
+
+// Map the model file at source, or attach the model published under that
+// name, as a version to hot swap in. Nothing it learns is journaled.
+// swap_loader_main reports how long it took.
+ChatSystem* load_chat_version(const char* source, int attach) {
+    ChatSystem* system = init_chat_system(1);
+    if (!system) return NULL;
+    
+    int ok = attach ? attach_model(system, source, 1) : load_model(system, source, 1);
+    if (!ok) {
+        destroy_chat_system(system);
+        return NULL;
+    }
+    system->hot_swapped = 1;
+    return system;
+}
+
+// SwapRelease for versions of the chat system
+void release_chat_version(void* version) {
+    destroy_chat_system(version);
+}
+
+// Patterns in the mapped model plus those only learned in this process
+size_t total_pattern_count(ChatSystem* system) {
+    if (!system->model) return system->tree->num_patterns;
+    return system->model->header->num_patterns + snapshot_count_new(system->model, system->tree);
+}
+
+size_t total_word_count(ChatSystem* system) {
+    size_t count = system->tree->total_words;
+    if (system->model) count += system->model->header->total_words;
+    return count;
+}
+
+// Resident and shared bytes of this process. Without /proc only the peak
+// is known, and shared is reported as 0.
+static void process_memory(size_t* resident, size_t* shared) {
+    *resident = *shared = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        unsigned long size, pages, shared_pages;
+        if (fscanf(statm, "%lu %lu %lu", &size, &pages, &shared_pages) == 3) {
+            long page_size = sysconf(_SC_PAGESIZE);
+            *resident = (size_t)pages * page_size;
+            *shared = (size_t)shared_pages * page_size;
+        }
+        fclose(statm);
+        return;
+    }
+    
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        *resident = usage.ru_maxrss;          // Bytes on macOS
+#else
+        *resident = usage.ru_maxrss * 1024;
+#endif
+    }
+}
+
+// Print pattern memory compared with the fixed-array layout
+void print_memory_stats(ChatSystem* system) {
+    ContextTree* tree = system->tree;
+    size_t tree_bytes = context_tree_memory_usage(tree);
+    size_t vocab_bytes = vocab_memory_usage(system->vocab);
+    size_t fixed_bytes = sizeof(char[CONTEXT_SIZE][MAX_WORD_LENGTH]) + MAX_WORD_LENGTH +
+                         2 * sizeof(int) + sizeof(void*);
+    
+    printf("\nMemory usage:\n");
+    printf("  Vocabulary: %u words, %.1f KB\n", vocab_size(system->vocab), vocab_bytes / 1024.0);
+    printf("  Context tree: %zu nodes, %.1f MB\n", tree->num_nodes, tree_bytes / (1024.0 * 1024.0));
+    if (system->model) {
+        printf("  Mapped model: %llu nodes, %.1f MB (read-only, shared page cache)\n",
+               (unsigned long long)system->model->header->num_nodes, system->model->size / (1024.0 * 1024.0));
+        tree_bytes += system->model->size;
+    }
+    size_t resident, shared;
+    process_memory(&resident, &shared);
+    printf("  Process resident: %.1f MB, %.1f MB of it shared\n",
+           resident / (1024.0 * 1024.0), shared / (1024.0 * 1024.0));
+    size_t num_patterns = total_pattern_count(system);
+    if (num_patterns > 0) {
+        double per_pattern = (double)tree_bytes / num_patterns;
+        printf("  Bytes per pattern: %.1f (fixed-array layout: %zu, %.0fx smaller)\n",
+               per_pattern, fixed_bytes, fixed_bytes / per_pattern);
+    }
+}
+
 // Print system statistics (enhanced for V8)
-void print_system_stats(ChatSystem* system) {
+void print_system_stats(ChatSystem* system, const V8Request* options) {
     printf("\n=== GAIA V8 System Statistics ===\n");
-    printf("Total patterns: %d\n", system->total_patterns);
-    printf("Total words processed: %d\n", system->total_words);
-    printf("Hash collisions: %d\n", system->hash_collisions);
+    printf("Total patterns: %zu\n", total_pattern_count(system));
+    printf("Total words processed: %zu\n", total_word_count(system));
     printf("Pattern lookups: %d\n", system->pattern_lookups);
+    print_memory_stats(system);
     
     printf("\nV8 Features enabled:\n");
-    printf("  Dynamic workflows: %s\n", use_workflows ? "ON" : "OFF");
-    printf("  Self-attention: %s\n", use_attention ? "ON" : "OFF");
-    printf("  Iterative refinement: %s\n", use_refinement ? "ON" : "OFF");
-    printf("  Analysis functions: %s\n", use_analysis ? "ON" : "OFF");
-    printf("  Debug workflows: %s\n", debug_workflows ? "ON" : "OFF");
-    printf("  Debug attention: %s\n", debug_attention ? "ON" : "OFF");
-    printf("  Debug refinement: %s\n", debug_refinement ? "ON" : "OFF");
+    printf("  Dynamic workflows: %s\n", options->use_workflows ? "ON" : "OFF");
+    printf("  Self-attention: %s\n", options->use_attention ? "ON" : "OFF");
+    printf("  Iterative refinement: %s\n", options->use_refinement ? "ON" : "OFF");
+    printf("  Analysis functions: %s\n", options->use_analysis ? "ON" : "OFF");
+    printf("  Debug workflows: %s\n", options->debug_workflows ? "ON" : "OFF");
+    printf("  Debug attention: %s\n", options->debug_attention ? "ON" : "OFF");
+    printf("  Debug refinement: %s\n", options->debug_refinement ? "ON" : "OFF");
     
     printf("\nTransformer configuration:\n");
     printf("  Hidden dimension: %d\n", HIDDEN_DIM);
@@ -793,33 +1194,261 @@ void print_system_stats(ChatSystem* system) {
     printf("=======================================\n\n");
 }
 
+// Command-line front end: batch mode and the chat loop. benchmark_v8.c and
+// test_v8_direct_call.c include this file with GAIA_CHAT_V8_NO_MAIN defined
+// and drive generate_response_v8 themselves.
+#ifndef GAIA_CHAT_V8_NO_MAIN
+// Batch mode settings
+static const char* batch_path = NULL; // Prompts to answer instead of chatting ("-" for stdin)
+static int batch_threads = 0; // Most reply workers to try in batch mode; 0 for one per CPU
+
+// Shared memory serving: one loader publishes, chat processes attach
+static const char* publish_name = NULL; // Publish the model under this name and exit
+static const char* attach_name = NULL; // Published model to serve instead of training
+
+// Model to hot swap in once serving has started
+static const char* swap_source = NULL;
+static int swap_attach = 0; // swap_source is a published name, not a file
+
+// Read-only state the batch workers answer from
+typedef struct {
+    ModelSwap* swap;
+    const V8Request* options;
+} V8BatchContext;
+
+// BatchAnswer over generate_response_v8. Each prompt is answered by the
+// model current when it was picked up, even if a swap lands meanwhile.
+static size_t answer_batch_prompt(void* context, const char* prompt, char* output, size_t output_size) {
+    const V8BatchContext* batch = context;
+    V8Request request = *batch->options;
+    request.output = output;
+    request.output_size = output_size;
+    
+    int slot;
+    const ChatSystem* system = swap_enter(batch->swap, &slot);
+    size_t length = generate_response_v8(system, &request, prompt);
+    swap_exit(batch->swap, slot);
+    return length;
+}
+
+// Loads the next model on its own thread while replies go on
+typedef struct {
+    ModelSwap* swap;
+    pthread_t thread;
+    int busy;                    // Set while a swap is in progress
+    int joinable;
+    int attach;
+    char source[1024];
+} SwapLoader;
+
+static void* swap_loader_main(void* arg) {
+    SwapLoader* loader = arg;
+    double start = now_seconds();
+    ChatSystem* version = load_chat_version(loader->source, loader->attach);
+    
+    if (!version) {
+        printf("Hot swap: could not load %s, still serving the current model\n", loader->source);
+    } else {
+        double loaded = now_seconds();
+        uint64_t number = swap_publish(loader->swap, version);
+        printf("Hot swap: %s is serving as version %llu, loaded in %.2f ms\n", loader->source,
+               (unsigned long long)number, (loaded - start) * 1000);
+        
+        // Replies already running finish on the previous model
+        while (swap_reclaim(loader->swap) > 0) {
+            struct timespec pause = {0, 1000000};
+            nanosleep(&pause, NULL);
+        }
+        printf("Hot swap: previous model released %.2f ms after the swap\n",
+               (now_seconds() - loaded) * 1000);
+    }
+    fflush(stdout);
+    __atomic_store_n(&loader->busy, 0, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static int start_swap(SwapLoader* loader, const char* source, int attach) {
+    if (__atomic_load_n(&loader->busy, __ATOMIC_ACQUIRE)) {
+        printf("A hot swap is already in progress\n");
+        return 0;
+    }
+    if (loader->joinable) pthread_join(loader->thread, NULL);
+    loader->joinable = 0;
+    
+    snprintf(loader->source, sizeof(loader->source), "%s", source);
+    loader->attach = attach;
+    loader->busy = 1;
+    printf("Hot swap: loading %s in the background\n", source);
+    fflush(stdout);
+    if (pthread_create(&loader->thread, NULL, swap_loader_main, loader) != 0) {
+        loader->busy = 0;
+        printf("Could not start the hot swap\n");
+        return 0;
+    }
+    loader->joinable = 1;
+    return 1;
+}
+
+// Wait for a swap in progress to finish
+static void finish_swap(SwapLoader* loader) {
+    if (loader->joinable) pthread_join(loader->thread, NULL);
+    loader->joinable = 0;
+}
+
+// Read one prompt per line; returns the number read into *prompts
+static size_t read_batch_prompts(const char* path, char*** prompts) {
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    *prompts = NULL;
+    if (!file) {
+        printf("Could not open batch file: %s\n", path);
+        return 0;
+    }
+    
+    size_t count = 0, capacity = 0;
+    char* line = NULL;
+    size_t line_size = 0;
+    while (getline(&line, &line_size, file) != -1) {
+        line[strcspn(line, "\r\n")] = 0;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char** grown = realloc(*prompts, capacity * sizeof(char*));
+            if (!grown) break;
+            *prompts = grown;
+        }
+        (*prompts)[count] = strdup(line);
+        if (!(*prompts)[count]) break;
+        count++;
+    }
+    
+    free(line);
+    if (file != stdin) fclose(file);
+    return count;
+}
+
+// Answer every prompt in batch_path, doubling the worker count from one up
+// to batch_threads, and report throughput and latency for each. Replies
+// from the widest run are printed in prompt order.
+static int run_batch(ModelSwap* swap, const V8Request* options) {
+    char** prompts;
+    size_t count = read_batch_prompts(batch_path, &prompts);
+    if (count == 0) {
+        free(prompts);
+        printf("No prompts to answer.\n");
+        return 0;
+    }
+    
+    int max_threads = batch_threads;
+    if (max_threads < 1) max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads < 1) max_threads = 1;
+    if (max_threads > BATCH_MAX_THREADS) max_threads = BATCH_MAX_THREADS;
+    
+    // Every run answers the whole batch again, so logging each refinement
+    // would only fill the experiment log and serialize the workers on it
+    V8Request request = *options;
+    request.log_experiments = 0;
+    V8BatchContext context = {swap, &request};
+    BatchConfig config = {
+        .output_size = MAX_RESPONSE_LENGTH,
+        .answer = answer_batch_prompt,
+        .context = &context
+    };
+    
+    printf("\n=== Batch inference: %zu prompts ===\n", count);
+    printf("%8s %10s %12s %12s\n", "threads", "qps", "p50 (ms)", "p99 (ms)");
+    
+    BatchResult result = {0};
+    int ok = 1;
+    for (int threads = 1; ok; threads *= 2) {
+        if (threads > max_threads) threads = max_threads;
+        
+        batch_result_free(&result);
+        config.num_threads = threads;
+        ok = batch_run((const char* const*)prompts, count, &config, &result);
+        if (ok) {
+            printf("%8d %10.1f %12.3f %12.3f\n", threads, batch_queries_per_second(&result),
+                   batch_latency_percentile(&result, 50) * 1000,
+                   batch_latency_percentile(&result, 99) * 1000);
+        }
+        if (threads == max_threads) break;
+    }
+    
+    if (ok) {
+        printf("\n");
+        for (size_t i = 0; i < count; i++) {
+            printf("You: %s\nGAIA V8: %s\n", prompts[i], result.replies[i]);
+        }
+    } else {
+        printf("Batch inference failed: out of memory\n");
+    }
+    
+    batch_result_free(&result);
+    for (size_t i = 0; i < count; i++) free(prompts[i]);
+    free(prompts);
+    return ok;
+}
+
 // Main function
 int main(int argc, char* argv[]) {
     printf("=== GAIA V8 - Recursive Refinement & Transformer Architecture ===\n");
     printf("Context window: %d tokens\n", CONTEXT_SIZE);
-    printf("Hash table size: %d buckets\n", HASH_SIZE);
     printf("Transformer heads: %d\n", NUM_HEADS);
     
+    // Reply flags for this session; the chat loop toggles them
+    V8Request options = V8_DEFAULT_REQUEST;
+    
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--no-workflows") == 0) {
-            use_workflows = 0;
+            options.use_workflows = 0;
             printf("Dynamic workflows: DISABLED\n");
         } else if (strcmp(argv[i], "--no-attention") == 0) {
-            use_attention = 0;
+            options.use_attention = 0;
             printf("Self-attention: DISABLED\n");
         } else if (strcmp(argv[i], "--no-refinement") == 0) {
-            use_refinement = 0;
+            options.use_refinement = 0;
             printf("Iterative refinement: DISABLED\n");
         } else if (strcmp(argv[i], "--debug-attention") == 0) {
-            debug_attention = 1;
+            options.debug_attention = 1;
             printf("Attention debugging: ENABLED\n");
         } else if (strcmp(argv[i], "--debug-refinement") == 0) {
-            debug_refinement = 1;
+            options.debug_refinement = 1;
             printf("Refinement debugging: ENABLED\n");
         } else if (strcmp(argv[i], "--debug-workflows") == 0) {
-            debug_workflows = 1;
+            options.debug_workflows = 1;
             printf("Workflow debugging: ENABLED\n");
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            training_threads = atoi(argv[++i]);
+            if (training_threads < 1) training_threads = 1;
+            if (training_threads > TRAIN_MAX_THREADS) training_threads = TRAIN_MAX_THREADS;
+            printf("Training threads: %d\n", training_threads);
+        } else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            model_path = argv[++i];
+            printf("Model file: %s\n", model_path);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_path = argv[++i];
+            printf("Batch prompts: %s\n", batch_path);
+        } else if (strcmp(argv[i], "--batch-threads") == 0 && i + 1 < argc) {
+            batch_threads = atoi(argv[++i]);
+            printf("Batch threads: up to %d\n", batch_threads);
+        } else if (strcmp(argv[i], "--publish") == 0 && i + 1 < argc) {
+            publish_name = argv[++i];
+            printf("Publishing model as: %s\n", publish_name);
+        } else if (strcmp(argv[i], "--attach") == 0 && i + 1 < argc) {
+            attach_name = argv[++i];
+            printf("Attaching model: %s\n", attach_name);
+        } else if (strcmp(argv[i], "--swap-model") == 0 && i + 1 < argc) {
+            swap_source = argv[++i];
+            swap_attach = 0;
+            printf("Hot swapping in model: %s\n", swap_source);
+        } else if (strcmp(argv[i], "--swap-attach") == 0 && i + 1 < argc) {
+            swap_source = argv[++i];
+            swap_attach = 1;
+            printf("Hot swapping in published model: %s\n", swap_source);
+        } else if (strcmp(argv[i], "--unpublish") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            int ok = snapshot_unpublish(name);
+            printf(ok ? "Unpublished %s\n" : "No model published as %s\n", name);
+            return ok ? 0 : 1;
         }
     }
     
@@ -829,39 +1458,113 @@ int main(int argc, char* argv[]) {
     init_experiment_logger();
     
     // Initialize chat system
-    ChatSystem* system = init_chat_system();
+    ChatSystem* system = init_chat_system(0);
     if (!system) {
         function_registry_cleanup();
         cleanup_experiment_logger();
         return 1;
     }
     
-    printf("Loading training data...\n");
-    fflush(stdout);
+    // Map the saved model if there is one; otherwise train and save it.
+    // Lines learned online are journaled next to the model. An attached
+    // model is shared, so what this process learns stays its own.
+    // A model that exists but does not load is never trained over, since
+    // its journal would be started over with it.
+    char journal_path[1024] = "";
+    if (model_path) snprintf(journal_path, sizeof(journal_path), "%s.journal", model_path);
+    
+    int model_ready = 1;
+    if (attach_name) {
+        model_ready = attach_model(system, attach_name, 0);
+    } else if (model_path && access(model_path, F_OK) == 0) {
+        model_ready = load_model(system, model_path, 0);
+        if (model_ready) open_journal(system, journal_path, 1);
+    } else if (model_path && errno != ENOENT) {
+        printf("Could not access model %s: %s\n", model_path, strerror(errno));
+        model_ready = 0;
+    } else if (model_path && access(journal_path, F_OK) == 0) {
+        printf("Journal %s has no model to extend; move it aside to retrain\n", journal_path);
+        model_ready = 0;
+    } else {
+        printf("Loading training data...\n");
+        fflush(stdout);
+        
+        // Load training data
+        if (!load_training_data(system, "conversational_flow.txt")) {
+            printf("Warning: Could not load primary training data\n");
+        }
+        
+        printf("Training data loaded.\n");
+        fflush(stdout);
+        
+        system->generation = 1;
+        if (model_path && save_model(system, model_path)) {
+            open_journal(system, journal_path, 0);
+        }
+    }
     
-    // Load training data
-    if (!load_training_data(system, "conversational_flow.txt")) {
-        printf("Warning: Could not load primary training data\n");
+    if (!model_ready) {
+        function_registry_cleanup();
+        cleanup_experiment_logger();
+        destroy_chat_system(system);
+        return 1;
     }
     
-    printf("Training data loaded.\n");
-    fflush(stdout);
+    print_system_stats(system, &options);
     
-    print_system_stats(system);
+    // The published segment outlives the loader
+    if (publish_name) {
+        int ok = publish_model(system, publish_name);
+        function_registry_cleanup();
+        cleanup_experiment_logger();
+        destroy_chat_system(system);
+        return ok ? 0 : 1;
+    }
+    
+    // From here on replies pin the model they start on, so another can be
+    // swapped in while they run
+    ModelSwap swap;
+    SwapLoader loader = {.swap = &swap};
+    if (!swap_init(&swap, system, release_chat_version)) {
+        function_registry_cleanup();
+        cleanup_experiment_logger();
+        destroy_chat_system(system);
+        return 1;
+    }
+    if (swap_source) start_swap(&loader, swap_source, swap_attach);
+    
+    // Batch mode answers a file of prompts instead of chatting
+    if (batch_path) {
+        int ok = run_batch(&swap, &options);
+        finish_swap(&loader);
+        function_registry_cleanup();
+        cleanup_experiment_logger();
+        swap_destroy(&swap);
+        return ok ? 0 : 1;
+    }
     
     // Interactive chat loop
     char input[MAX_INPUT_LENGTH];
     printf("V8 Chat ready! (Type 'quit' to exit, 'stats' for statistics)\n");
-    printf("Special commands: 'toggle-attention', 'toggle-refinement', 'attention-test'\n\n");
+    printf("Special commands: 'toggle-attention', 'toggle-refinement', 'attention-test',\n"
+           "                  'learn <text>', 'learn-file <path>', 'compact', 'save-model [path]',\n"
+           "                  'export-packed [path]', 'swap-model <path>', 'swap-attach <name>'\n\n");
     
+    // Each command pins the current model, but waiting for input does not,
+    // so a swapped out model is released as soon as its last reply ends
+    int slot = -1;
     while (1) {
+        if (slot >= 0) swap_exit(&swap, slot);
+        slot = -1;
+        
         printf("You: ");
         fflush(stdout);
         if (!fgets(input, sizeof(input), stdin)) break;
+        system = swap_enter(&swap, &slot);
         
         input[strcspn(input, "\n")] = 0;
         if (strlen(input) == 0) {
-            generate_response_v8(system, input);
+            print_response_v8(system, &options, input);
             continue;
         }
         
@@ -870,52 +1573,85 @@ int main(int argc, char* argv[]) {
             printf("Quitting...\n");
             break;
         } else if (strcmp(input, "stats") == 0) {
-            print_system_stats(system);
+            print_system_stats(system, &options);
+            continue;
+        } else if (strncmp(input, "learn ", 6) == 0) {
+            int learned = ingest_line(system, input + 6);
+            if (learned >= 0) printf(learned ? "Learned.\n" : "Too short to learn from.\n");
+            continue;
+        } else if (strncmp(input, "learn-file ", 11) == 0) {
+            ingest_file(system, input + 11);
+            continue;
+        } else if (strcmp(input, "compact") == 0) {
+            compact_model(system);
+            continue;
+        } else if (strncmp(input, "save-model", 10) == 0 && (input[10] == '\0' || input[10] == ' ')) {
+            const char* path = input[10] ? input + 11 : (model_path ? model_path : DEFAULT_MODEL_PATH);
+            // Overwriting the model the journal extends is a compaction
+            if (model_path && strcmp(path, model_path) == 0) {
+                compact_model(system);
+            } else {
+                save_model(system, path);
+            }
+            continue;
+        } else if (strncmp(input, "export-packed", 13) == 0 && (input[13] == '\0' || input[13] == ' ')) {
+            export_packed_model(system, input[13] ? input + 14 : DEFAULT_PACKED_PATH);
+            continue;
+        } else if (strncmp(input, "swap-model ", 11) == 0) {
+            start_swap(&loader, input + 11, 0);
+            continue;
+        } else if (strncmp(input, "swap-attach ", 12) == 0) {
+            start_swap(&loader, input + 12, 1);
             continue;
         } else if (strcmp(input, "toggle-attention") == 0) {
-            use_attention = !use_attention;
-            printf("Self-attention: %s\n", use_attention ? "ENABLED" : "DISABLED");
+            options.use_attention = !options.use_attention;
+            printf("Self-attention: %s\n", options.use_attention ? "ENABLED" : "DISABLED");
             continue;
         } else if (strcmp(input, "toggle-refinement") == 0) {
-            use_refinement = !use_refinement;
-            printf("Iterative refinement: %s\n", use_refinement ? "ENABLED" : "DISABLED");
+            options.use_refinement = !options.use_refinement;
+            printf("Iterative refinement: %s\n", options.use_refinement ? "ENABLED" : "DISABLED");
             continue;
         } else if (strcmp(input, "debug-attention") == 0) {
-            debug_attention = !debug_attention;
-            printf("Attention debugging: %s\n", debug_attention ? "ENABLED" : "DISABLED");
+            options.debug_attention = !options.debug_attention;
+            printf("Attention debugging: %s\n", options.debug_attention ? "ENABLED" : "DISABLED");
             continue;
         } else if (strcmp(input, "debug-refinement") == 0) {
-            debug_refinement = !debug_refinement;
-            printf("Refinement debugging: %s\n", debug_refinement ? "ENABLED" : "DISABLED");
+            options.debug_refinement = !options.debug_refinement;
+            printf("Refinement debugging: %s\n", options.debug_refinement ? "ENABLED" : "DISABLED");
             continue;
         } else if (strcmp(input, "attention-test") == 0) {
             // Test attention mechanism
             const char* test_input = "What is the meaning of life?";
             printf("Testing attention on: '%s'\n", test_input);
-            debug_attention = 1;
-            generate_response_v8(system, test_input);
-            debug_attention = 0;
+            V8Request test = options;
+            test.debug_attention = 1;
+            print_response_v8(system, &test, test_input);
             continue;
         } else if (strcmp(input, "refinement-test") == 0) {
             // Test refinement
             const char* test_input = "explain addition";
             printf("Testing refinement on: '%s'\n", test_input);
-            debug_refinement = 1;
-            generate_response_v8(system, test_input);
-            debug_refinement = 0;
+            V8Request test = options;
+            test.debug_refinement = 1;
+            print_response_v8(system, &test, test_input);
             continue;
         }
         
-        generate_response_v8(system, input);
+        print_response_v8(system, &options, input);
     }
+    if (slot >= 0) swap_exit(&swap, slot);
     
-    print_system_stats(system);
+    // No swap is left running, so the current model can be read unpinned
+    finish_swap(&loader);
+    print_system_stats(swap.current, &options);
     print_experiment_summary();
     save_experiment_log("gaia_v8_session.json");
     
     function_registry_cleanup();
     cleanup_experiment_logger();
+    swap_destroy(&swap);
     
     printf("GAIA V8 session ended.\n");
     return 0;
-}
\ No newline at end of file
+}
+#endif // GAIA_CHAT_V8_NO_MAIN
@@ -0,0 +1,74 @@
+#include "hash64.h"
+#include <string.h>
+
+// Odd constants with well-mixed bits (the wyhash secret)
+#define HASH64_P0 0xa0761d6478bd642full
+#define HASH64_P1 0xe7037ed1a0b428dbull
+#define HASH64_P2 0x8ebc6af09c88c6e3ull
+
+uint64_t hash64_mix(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+#else
+    // Schoolbook 128-bit product from 32-bit halves
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+    uint64_t lo = (cross << 32) | (uint32_t)lo_lo;
+    uint64_t hi = hi_hi + (hi_lo >> 32) + (cross >> 32);
+    return lo ^ hi;
+#endif
+}
+
+static uint64_t read64(const unsigned char* p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+static uint64_t read32(const unsigned char* p) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+// Short keys, such as words, are read as two overlapping halves and cost
+// two multiplies; longer ones take one more per 16 bytes. Byte order only
+// has to be the same within a process.
+uint64_t hash64_bytes(const void* data, size_t length, uint64_t seed) {
+    const unsigned char* p = data;
+    uint64_t a, b;
+    seed ^= HASH64_P0;
+    
+    if (length <= 16) {
+        if (length >= 4) {
+            size_t half = (length >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + half);
+            b = (read32(p + length - 4) << 32) | read32(p + length - 4 - half);
+        } else if (length > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t left = length;
+        for (; left > 16; left -= 16, p += 16) {
+            seed = hash64_mix(read64(p) ^ HASH64_P1, read64(p + 8) ^ seed);
+        }
+        a = read64(p + left - 16);
+        b = read64(p + left - 8);
+    }
+    return hash64_mix(HASH64_P1 ^ length, hash64_mix(a ^ HASH64_P1, b ^ seed ^ HASH64_P2));
+}
+
+uint64_t hash64_string(const char* text, uint64_t seed) {
+    return hash64_bytes(text, strlen(text), seed);
+}
+
+uint64_t hash64_token(uint64_t state, uint32_t token) {
+    return hash64_mix(state ^ HASH64_P0, token ^ HASH64_P1);
+}
@@ -0,0 +1,25 @@
+#ifndef HASH64_H
+#define HASH64_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Starting state for hashes that are not chained from an earlier one
+#define HASH64_SEED 0x589965cc75374cc3ull
+
+// 64-bit hashing in the style of wyhash: every step is one 64x64->128-bit
+// multiply whose halves are folded together, so each output bit depends
+// on every input bit. Any run of low bits is well spread, so tables can
+// index with a power-of-two mask instead of a modulo.
+uint64_t hash64_mix(uint64_t a, uint64_t b);
+
+// Hash length bytes of data, starting from seed. Chaining one call's
+// result into the next as seed hashes several fields as one key; each
+// field's length is mixed in, so no separator is needed.
+uint64_t hash64_bytes(const void* data, size_t length, uint64_t seed);
+uint64_t hash64_string(const char* text, uint64_t seed);
+
+// Extend a running state by one token ID
+uint64_t hash64_token(uint64_t state, uint32_t token);
+
+#endif // HASH64_H
@@ -0,0 +1,487 @@
+#include "model_snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+// Sections go either to a stream or straight into a shared mapping
+typedef struct {
+    FILE* file;
+    char* memory;                // Zero-filled, so padding is free
+    uint64_t position;
+} SnapshotSink;
+
+// Pad the output up to offset
+static int pad_to(SnapshotSink* sink, uint64_t offset) {
+    static const char zeros[8] = {0};
+    if (sink->file && offset > sink->position &&
+        fwrite(zeros, 1, offset - sink->position, sink->file) != offset - sink->position) {
+        return 0;
+    }
+    sink->position = offset;
+    return 1;
+}
+
+static int write_section(SnapshotSink* sink, const void* data, size_t size) {
+    if (size > 0) {
+        if (sink->memory) {
+            memcpy(sink->memory + sink->position, data, size);
+        } else if (fwrite(data, 1, size, sink->file) != size) {
+            return 0;
+        }
+    }
+    sink->position += size;
+    return 1;
+}
+
+// Everything written besides the tree's own continuation arrays
+typedef struct {
+    SnapshotHeader header;
+    const ContextNode** order;   // Breadth-first
+    SnapshotNode* nodes;
+    uint32_t* word_offsets;
+} SnapshotLayout;
+
+static void free_layout(SnapshotLayout* layout) {
+    free(layout->order);
+    free(layout->nodes);
+    free(layout->word_offsets);
+}
+
+static int build_layout(SnapshotLayout* layout, const Vocabulary* vocab, const ContextTree* tree,
+                        uint32_t generation) {
+    // Breadth-first order puts each node's children next to each other
+    layout->order = malloc(tree->num_nodes * sizeof(ContextNode*));
+    layout->nodes = malloc(tree->num_nodes * sizeof(SnapshotNode));
+    layout->word_offsets = malloc((vocab->num_words + 1) * sizeof(uint32_t));
+    if (!layout->order || !layout->nodes || !layout->word_offsets) {
+        free_layout(layout);
+        return 0;
+    }
+    
+    const ContextNode** order = layout->order;
+    SnapshotNode* nodes = layout->nodes;
+    uint32_t* word_offsets = layout->word_offsets;
+    size_t num_nodes = 1;
+    uint64_t num_continuations = 0;
+    order[0] = tree->root;
+    for (size_t i = 0; i < num_nodes; i++) {
+        const ContextNode* node = order[i];
+        nodes[i].token = node->token;
+        nodes[i].num_children = node->num_children;
+        nodes[i].first_child = (uint32_t)num_nodes;
+        nodes[i].num_continuations = node->num_continuations;
+        nodes[i].first_continuation = (uint32_t)num_continuations;
+        nodes[i].total_count = node->total_count;
+        
+        for (uint32_t c = 0; c < node->num_children; c++) {
+            order[num_nodes++] = node->children[c];
+        }
+        num_continuations += node->num_continuations;
+    }
+    
+    uint32_t string_bytes = 0;
+    for (uint32_t id = 0; id < vocab->num_words; id++) {
+        word_offsets[id] = string_bytes;
+        string_bytes += (uint32_t)strlen(vocab->words[id]) + 1;
+    }
+    word_offsets[vocab->num_words] = string_bytes;
+    
+    SnapshotHeader* header = &layout->header;
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header->version = SNAPSHOT_VERSION;
+    header->byte_order = SNAPSHOT_BYTE_ORDER;
+    header->max_depth = tree->max_depth;
+    header->generation = generation;
+    header->num_words = vocab->num_words;
+    header->num_word_slots = vocab->num_slots;
+    header->num_nodes = num_nodes;
+    header->num_patterns = num_continuations;
+    header->total_words = tree->total_words;
+    for (int d = 0; d <= CONTEXT_TREE_MAX_DEPTH; d++) {
+        header->patterns_by_length[d] = tree->patterns_by_length[d];
+    }
+    
+    header->word_offsets_offset = align8(sizeof(SnapshotHeader));
+    header->word_slots_offset = align8(header->word_offsets_offset + (vocab->num_words + 1) * sizeof(uint32_t));
+    header->strings_offset = align8(header->word_slots_offset + (uint64_t)vocab->num_slots * sizeof(uint32_t));
+    header->nodes_offset = align8(header->strings_offset + string_bytes);
+    header->continuations_offset = align8(header->nodes_offset + num_nodes * sizeof(SnapshotNode));
+    header->file_size = header->continuations_offset + num_continuations * sizeof(Continuation);
+    return 1;
+}
+
+// The header goes first with the given magic
+static int emit(SnapshotSink* sink, const SnapshotLayout* layout, const Vocabulary* vocab,
+                const char* magic) {
+    const SnapshotHeader* h = &layout->header;
+    SnapshotHeader header = *h;
+    memcpy(header.magic, magic, sizeof(header.magic));
+    
+    int ok = write_section(sink, &header, sizeof(header));
+    ok = ok && pad_to(sink, h->word_offsets_offset);
+    ok = ok && write_section(sink, layout->word_offsets, (vocab->num_words + 1) * sizeof(uint32_t));
+    ok = ok && pad_to(sink, h->word_slots_offset);
+    ok = ok && write_section(sink, vocab->slots, vocab->num_slots * sizeof(uint32_t));
+    ok = ok && pad_to(sink, h->strings_offset);
+    for (uint32_t id = 0; ok && id < vocab->num_words; id++) {
+        ok = write_section(sink, vocab->words[id], strlen(vocab->words[id]) + 1);
+    }
+    ok = ok && pad_to(sink, h->nodes_offset);
+    ok = ok && write_section(sink, layout->nodes, h->num_nodes * sizeof(SnapshotNode));
+    ok = ok && pad_to(sink, h->continuations_offset);
+    for (size_t i = 0; ok && i < h->num_nodes; i++) {
+        ok = write_section(sink, layout->order[i]->continuations,
+                           layout->order[i]->num_continuations * sizeof(Continuation));
+    }
+    return ok;
+}
+
+int snapshot_write(const char* path, const Vocabulary* vocab, const ContextTree* tree,
+                   uint32_t generation) {
+    SnapshotLayout layout;
+    if (!build_layout(&layout, vocab, tree, generation)) return 0;
+    
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* file = fopen(tmp_path, "wb");
+    SnapshotSink sink = { .file = file };
+    int ok = file != NULL && emit(&sink, &layout, vocab, SNAPSHOT_MAGIC);
+    
+    // Durable before the rename, since compaction then drops the journal
+    if (ok && (fflush(file) != 0 || fsync(fileno(file)) != 0)) ok = 0;
+    if (file && fclose(file) != 0) ok = 0;
+    if (ok) {
+        ok = rename(tmp_path, path) == 0;
+    } else if (file) {
+        remove(tmp_path);
+    }
+    
+    free_layout(&layout);
+    return ok;
+}
+
+// Shared memory objects cannot be renamed into place, so the segment is
+// filled through a mapping (the only way macOS allows) and the magic is
+// stored last: a process attaching early finds it unfinished instead of
+// reading a half-written model, and snapshot_attach waits for it.
+// Processes still attached to an earlier segment of the same name keep it
+// until they detach.
+int snapshot_publish(const char* name, const Vocabulary* vocab, const ContextTree* tree,
+                     uint32_t generation) {
+    SnapshotLayout layout;
+    if (!build_layout(&layout, vocab, tree, generation)) return 0;
+    
+    size_t size = layout.header.file_size;
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        free_layout(&layout);
+        return 0;
+    }
+    
+    void* base = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    
+    int ok = base != MAP_FAILED;
+    if (ok) {
+        static const char unfinished[8] = {0};
+        SnapshotSink sink = { .memory = base };
+        ok = emit(&sink, &layout, vocab, unfinished);
+        __sync_synchronize();
+        if (ok) memcpy(((SnapshotHeader*)base)->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        munmap(base, size);
+    }
+    if (!ok) shm_unlink(name);
+    
+    free_layout(&layout);
+    return ok;
+}
+
+int snapshot_unpublish(const char* name) {
+    return shm_unlink(name) == 0;
+}
+
+// Whether count items of size bytes starting at offset end by end,
+// without overflowing on a corrupt count
+static int section_fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t end) {
+    return offset % 8 == 0 && offset <= end && count <= (end - offset) / size;
+}
+
+// Check that the header is ours and that every index and offset stored in
+// the file stays inside it. A file or segment that passes can be served
+// without further checks, however it was damaged or whoever wrote it.
+static int validate(const ModelSnapshot* snapshot) {
+    const SnapshotHeader* h = snapshot->header;
+    if (snapshot->size < sizeof(SnapshotHeader)) return 0;
+    if (memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) return 0;
+    if (h->version != SNAPSHOT_VERSION || h->byte_order != SNAPSHOT_BYTE_ORDER) return 0;
+    if (h->file_size != snapshot->size || h->num_nodes < 1) return 0;
+    if (h->num_nodes > UINT32_MAX || h->num_patterns > UINT32_MAX) return 0;
+    if (h->max_depth < 1 || h->max_depth > CONTEXT_TREE_MAX_DEPTH) return 0;
+    if (h->num_word_slots == 0 || (h->num_word_slots & (h->num_word_slots - 1)) != 0) return 0;
+    
+    if (!section_fits(h->word_offsets_offset, (uint64_t)h->num_words + 1, sizeof(uint32_t), h->word_slots_offset)) return 0;
+    if (!section_fits(h->word_slots_offset, h->num_word_slots, sizeof(uint32_t), h->strings_offset)) return 0;
+    if (!section_fits(h->strings_offset, 0, 1, h->nodes_offset)) return 0;
+    if (!section_fits(h->nodes_offset, h->num_nodes, sizeof(SnapshotNode), h->continuations_offset)) return 0;
+    if (!section_fits(h->continuations_offset, h->num_patterns, sizeof(Continuation), h->file_size)) return 0;
+    
+    // Each word ends with its NUL before the next one starts, and the last
+    // inside the string section
+    const char* bytes = snapshot->base;
+    const uint32_t* offsets = (const uint32_t*)(bytes + h->word_offsets_offset);
+    const char* strings = bytes + h->strings_offset;
+    if (offsets[h->num_words] > h->nodes_offset - h->strings_offset) return 0;
+    for (uint32_t id = 0; id < h->num_words; id++) {
+        if (offsets[id] >= offsets[id + 1] || strings[offsets[id + 1] - 1] != '\0') return 0;
+    }
+    
+    const uint32_t* slots = (const uint32_t*)(bytes + h->word_slots_offset);
+    for (uint32_t i = 0; i < h->num_word_slots; i++) {
+        if (slots[i] > h->num_words) return 0;
+    }
+    
+    // Children come after their parent in breadth-first order, so the
+    // tree cannot loop back on itself
+    const SnapshotNode* nodes = (const SnapshotNode*)(bytes + h->nodes_offset);
+    for (uint64_t i = 0; i < h->num_nodes; i++) {
+        const SnapshotNode* node = &nodes[i];
+        if (i > 0 && node->token >= h->num_words) return 0;
+        if (node->num_children > 0 &&
+            (node->first_child <= i || (uint64_t)node->first_child + node->num_children > h->num_nodes)) {
+            return 0;
+        }
+        if ((uint64_t)node->first_continuation + node->num_continuations > h->num_patterns) return 0;
+    }
+    
+    const Continuation* continuations = (const Continuation*)(bytes + h->continuations_offset);
+    for (uint64_t i = 0; i < h->num_patterns; i++) {
+        if (continuations[i].next >= h->num_words) return 0;
+    }
+    return 1;
+}
+
+// Map a model file or segment read-only; fd is closed either way. Sets
+// *unfinished when a publisher has not yet sized or completed it, and
+// errno to EINVAL when it is not a valid model.
+static ModelSnapshot* map_snapshot(int fd, int* unfinished) {
+    struct stat st;
+    int sized = fstat(fd, &st) == 0;
+    *unfinished = sized && st.st_size == 0;
+    if (!sized || st.st_size < (off_t)sizeof(SnapshotHeader)) {
+        int error = sized ? EINVAL : errno;
+        close(fd);
+        errno = error;
+        return NULL;
+    }
+    
+    void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+    
+    static const char unpublished[8] = {0};
+    *unfinished = memcmp(base, unpublished, sizeof(unpublished)) == 0;
+    
+    ModelSnapshot* snapshot = calloc(1, sizeof(ModelSnapshot));
+    if (!snapshot) {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+    
+    snapshot->base = base;
+    snapshot->size = st.st_size;
+    snapshot->header = base;
+    if (!validate(snapshot)) {
+        snapshot_close(snapshot);
+        errno = EINVAL;
+        return NULL;
+    }
+    
+    const char* bytes = base;
+    const SnapshotHeader* h = snapshot->header;
+    snapshot->word_offsets = (const uint32_t*)(bytes + h->word_offsets_offset);
+    snapshot->word_slots = (const uint32_t*)(bytes + h->word_slots_offset);
+    snapshot->strings = bytes + h->strings_offset;
+    snapshot->nodes = (const SnapshotNode*)(bytes + h->nodes_offset);
+    snapshot->continuations = (const Continuation*)(bytes + h->continuations_offset);
+    return snapshot;
+}
+
+ModelSnapshot* snapshot_open(const char* path) {
+    int unfinished;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    return map_snapshot(fd, &unfinished);
+}
+
+// A republish leaves the name missing for a moment and then unfinished
+// while the model is copied in, so both are retried: missing only briefly,
+// unfinished for as long as a publisher could take to fill it.
+ModelSnapshot* snapshot_attach(const char* name) {
+    for (int waited_ms = 0; ; waited_ms += SNAPSHOT_ATTACH_POLL_MS) {
+        int unfinished = 0;
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd >= 0) {
+            ModelSnapshot* snapshot = map_snapshot(fd, &unfinished);
+            if (snapshot) return snapshot;
+        } else if (errno != ENOENT) {
+            return NULL;
+        }
+        
+        int limit = unfinished ? SNAPSHOT_ATTACH_WAIT_MS : SNAPSHOT_ATTACH_MISSING_MS;
+        if (waited_ms >= limit || (fd >= 0 && !unfinished)) return NULL;
+        usleep(SNAPSHOT_ATTACH_POLL_MS * 1000);
+    }
+}
+
+void snapshot_close(ModelSnapshot* snapshot) {
+    if (!snapshot) return;
+    munmap(snapshot->base, snapshot->size);
+    free(snapshot);
+}
+
+const char* snapshot_word(const ModelSnapshot* snapshot, uint32_t id) {
+    if (id >= snapshot->header->num_words) return NULL;
+    return snapshot->strings + snapshot->word_offsets[id];
+}
+
+uint32_t snapshot_lookup(const ModelSnapshot* snapshot, const char* word) {
+    uint32_t mask = snapshot->header->num_word_slots - 1;
+    uint32_t pos = vocab_hash(word) & mask;
+    
+    for (uint32_t probes = 0; probes <= mask && snapshot->word_slots[pos]; probes++) {
+        uint32_t id = snapshot->word_slots[pos] - 1;
+        if (strcmp(snapshot_word(snapshot, id), word) == 0) return id;
+        pos = (pos + 1) & mask;
+    }
+    
+    return VOCAB_NONE;
+}
+
+const SnapshotNode* snapshot_root(const ModelSnapshot* snapshot) {
+    return &snapshot->nodes[0];
+}
+
+const SnapshotNode* snapshot_child(const ModelSnapshot* snapshot, const SnapshotNode* node, uint32_t token) {
+    const SnapshotNode* children = &snapshot->nodes[node->first_child];
+    uint32_t lo = 0, hi = node->num_children;
+    
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (children[mid].token < token) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    if (lo < node->num_children && children[lo].token == token) return &children[lo];
+    return NULL;
+}
+
+const Continuation* snapshot_continuations(const ModelSnapshot* snapshot, const SnapshotNode* node) {
+    return &snapshot->continuations[node->first_continuation];
+}
+
+int snapshot_match(const ModelSnapshot* snapshot, const uint32_t* context, int context_length,
+                   const SnapshotNode** nodes) {
+    const SnapshotNode* node = snapshot_root(snapshot);
+    int max_depth = (int)snapshot->header->max_depth;
+    int limit = context_length < max_depth ? context_length : max_depth;
+    int depth = 0;
+    
+    nodes[0] = node;
+    while (depth < limit) {
+        node = snapshot_child(snapshot, node, context[context_length - depth - 1]);
+        if (!node) break;
+        nodes[++depth] = node;
+    }
+    
+    return depth;
+}
+
+// Fill an empty vocabulary with the model's words under the same IDs. The
+// words point into the mapping, which must outlive the vocabulary.
+int snapshot_load_vocab(const ModelSnapshot* snapshot, Vocabulary* vocab) {
+    if (vocab_size(vocab) != 0) return 0;
+    
+    for (uint32_t id = 0; id < snapshot->header->num_words; id++) {
+        if (vocab_intern_static(vocab, snapshot_word(snapshot, id)) != id) return 0;
+    }
+    return 1;
+}
+
+static int thaw_node(const ModelSnapshot* snapshot, ContextTree* tree, const SnapshotNode* node,
+                     uint32_t* context, int depth) {
+    int max_depth = tree->max_depth;
+    const Continuation* conts = snapshot_continuations(snapshot, node);
+    
+    for (uint32_t i = 0; i < node->num_continuations; i++) {
+        if (context_tree_add(tree, context + max_depth - depth, depth, conts[i].next, conts[i].count) < 0) {
+            return 0;
+        }
+    }
+    
+    for (uint32_t c = 0; c < node->num_children && depth < max_depth; c++) {
+        const SnapshotNode* child = &snapshot->nodes[node->first_child + c];
+        context[max_depth - depth - 1] = child->token;
+        if (!thaw_node(snapshot, tree, child, context, depth + 1)) return 0;
+    }
+    
+    return 1;
+}
+
+// Rebuild a mutable context tree from the mapping, e.g. to fold new
+// training into a fresh snapshot
+ContextTree* snapshot_thaw(const ModelSnapshot* snapshot) {
+    ContextTree* tree = context_tree_create((int)snapshot->header->max_depth);
+    uint32_t context[CONTEXT_TREE_MAX_DEPTH];
+    if (!tree) return NULL;
+    
+    if (!thaw_node(snapshot, tree, snapshot_root(snapshot), context, 0)) {
+        context_tree_destroy(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+// Count continuations of node missing from the matching snapshot node.
+// Both continuation lists are sorted by next, so one merge pass suffices.
+static size_t count_new(const ModelSnapshot* snapshot, const SnapshotNode* base, const ContextNode* node) {
+    size_t count = 0;
+    
+    if (!base) {
+        count = node->num_continuations;
+    } else {
+        const Continuation* existing = snapshot_continuations(snapshot, base);
+        uint32_t j = 0;
+        for (uint32_t i = 0; i < node->num_continuations; i++) {
+            uint32_t next = node->continuations[i].next;
+            while (j < base->num_continuations && existing[j].next < next) j++;
+            if (j >= base->num_continuations || existing[j].next != next) count++;
+        }
+    }
+    
+    for (uint32_t c = 0; c < node->num_children; c++) {
+        const ContextNode* child = node->children[c];
+        count += count_new(snapshot, base ? snapshot_child(snapshot, base, child->token) : NULL, child);
+    }
+    return count;
+}
+
+size_t snapshot_count_new(const ModelSnapshot* snapshot, const ContextTree* tree) {
+    return count_new(snapshot, snapshot_root(snapshot), tree->root);
+}
@@ -0,0 +1,100 @@
+#ifndef MODEL_SNAPSHOT_H
+#define MODEL_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "vocabulary.h"
+#include "context_tree.h"
+
+// On-disk model format. Every reference inside the file is an index or a
+// byte offset from the start of the file, so it can be mapped read-only at
+// any address and shared between processes through the page cache.
+#define SNAPSHOT_MAGIC "GAIAMDL"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;         // SNAPSHOT_BYTE_ORDER as written by the host
+    uint32_t max_depth;
+    uint32_t num_words;
+    uint32_t num_word_slots;     // Power of two
+    uint32_t generation;         // Bumped by each compaction, see training_journal.h
+    uint64_t num_nodes;
+    uint64_t num_patterns;       // Equals the number of continuations
+    uint64_t total_words;
+    uint64_t patterns_by_length[CONTEXT_TREE_MAX_DEPTH + 1];
+    
+    // Section offsets from the start of the file, each 8-byte aligned
+    uint64_t word_offsets_offset;   // uint32_t[num_words + 1] into the string section
+    uint64_t word_slots_offset;     // uint32_t[num_word_slots], ID + 1, 0 = empty
+    uint64_t strings_offset;        // NUL-terminated words
+    uint64_t nodes_offset;          // SnapshotNode[num_nodes]
+    uint64_t continuations_offset;  // Continuation[num_patterns]
+    uint64_t file_size;
+} SnapshotHeader;
+
+// Context tree node in breadth-first order. The children of a node are
+// consecutive nodes sorted by token, so no child pointers are stored.
+typedef struct {
+    uint32_t token;
+    uint32_t num_children;
+    uint32_t first_child;        // Node index
+    uint32_t num_continuations;
+    uint32_t first_continuation; // Continuation index, sorted by next
+    uint32_t total_count;
+} SnapshotNode;
+
+// A model file mapped into memory
+typedef struct {
+    void* base;
+    size_t size;
+    const SnapshotHeader* header;
+    const uint32_t* word_offsets;
+    const uint32_t* word_slots;
+    const char* strings;
+    const SnapshotNode* nodes;
+    const Continuation* continuations;
+} ModelSnapshot;
+
+// Writing (to path.tmp, then renamed into place)
+int snapshot_write(const char* path, const Vocabulary* vocab, const ContextTree* tree,
+                   uint32_t generation);
+
+// Mapping. On failure errno says why: EINVAL for a file that is not a
+// valid model (truncated, corrupt or from another format version).
+ModelSnapshot* snapshot_open(const char* path);
+void snapshot_close(ModelSnapshot* snapshot);
+
+// Serving one copy to many processes: a loader publishes the model into
+// the POSIX shared memory object name ("/gaia_v8"), which then outlives it
+// until unpublished. Only the publishing user can attach. Attaching maps
+// it read-only like snapshot_open, waiting out a publish in progress, and
+// snapshot_close detaches.
+#define SNAPSHOT_ATTACH_POLL_MS 10
+#define SNAPSHOT_ATTACH_MISSING_MS 100   // How long a name may be missing
+#define SNAPSHOT_ATTACH_WAIT_MS 5000     // How long a segment may stay unfinished
+
+int snapshot_publish(const char* name, const Vocabulary* vocab, const ContextTree* tree,
+                     uint32_t generation);
+ModelSnapshot* snapshot_attach(const char* name);
+int snapshot_unpublish(const char* name);
+
+// Queries, all served from the mapping
+const char* snapshot_word(const ModelSnapshot* snapshot, uint32_t id);
+uint32_t snapshot_lookup(const ModelSnapshot* snapshot, const char* word);
+const SnapshotNode* snapshot_root(const ModelSnapshot* snapshot);
+const SnapshotNode* snapshot_child(const ModelSnapshot* snapshot, const SnapshotNode* node, uint32_t token);
+const Continuation* snapshot_continuations(const ModelSnapshot* snapshot, const SnapshotNode* node);
+int snapshot_match(const ModelSnapshot* snapshot, const uint32_t* context, int context_length,
+                   const SnapshotNode** nodes);
+
+// Loading into live structures
+int snapshot_load_vocab(const ModelSnapshot* snapshot, Vocabulary* vocab);
+ContextTree* snapshot_thaw(const ModelSnapshot* snapshot);
+
+// Patterns of tree that the snapshot does not already hold
+size_t snapshot_count_new(const ModelSnapshot* snapshot, const ContextTree* tree);
+
+#endif // MODEL_SNAPSHOT_H
@@ -0,0 +1,101 @@
+#include "model_swap.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+int swap_init(ModelSwap* swap, void* initial, SwapRelease release) {
+    memset(swap, 0, sizeof(*swap));
+    swap->current = initial;
+    swap->epoch = 1;
+    swap->release = release;
+    return pthread_mutex_init(&swap->lock, NULL) == 0;
+}
+
+void swap_destroy(ModelSwap* swap) {
+    while (swap->retired) {
+        SwapRetired* retired = swap->retired;
+        swap->retired = retired->next;
+        swap->release(retired->version);
+        free(retired);
+    }
+    if (swap->current) swap->release(swap->current);
+    swap->current = NULL;
+    pthread_mutex_destroy(&swap->lock);
+}
+
+// The slot is announced before the pointer is read. A publisher that
+// misses the announcement has already swapped the pointer, so the reader
+// gets the new version; one that sees it keeps the old version for it. A
+// stale epoch only makes the reader keep versions a little longer.
+void* swap_enter(ModelSwap* swap, int* slot) {
+    uint32_t start = __atomic_fetch_add(&swap->next_reader, 1, __ATOMIC_RELAXED);
+    
+    while (1) {
+        uint64_t epoch = __atomic_load_n(&swap->epoch, __ATOMIC_SEQ_CST);
+        for (uint32_t i = 0; i < SWAP_MAX_READERS; i++) {
+            uint32_t s = (start + i) % SWAP_MAX_READERS;
+            uint64_t idle = 0;
+            if (__atomic_compare_exchange_n(&swap->readers[s].epoch, &idle, epoch, 0,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                *slot = (int)s;
+                return __atomic_load_n(&swap->current, __ATOMIC_SEQ_CST);
+            }
+        }
+        sched_yield();
+    }
+}
+
+void swap_exit(ModelSwap* swap, int slot) {
+    __atomic_store_n(&swap->readers[slot].epoch, 0, __ATOMIC_RELEASE);
+}
+
+uint64_t swap_publish(ModelSwap* swap, void* version) {
+    SwapRetired* retired = malloc(sizeof(SwapRetired));
+    
+    pthread_mutex_lock(&swap->lock);
+    void* old = __atomic_exchange_n(&swap->current, version, __ATOMIC_SEQ_CST);
+    uint64_t epoch = __atomic_add_fetch(&swap->epoch, 1, __ATOMIC_SEQ_CST);
+    uint64_t number = ++swap->version;
+    
+    if (old && retired) {
+        retired->version = old;
+        retired->epoch = epoch;
+        retired->next = swap->retired;
+        swap->retired = retired;
+        retired = NULL;
+    }
+    pthread_mutex_unlock(&swap->lock);
+    
+    // Without memory to track it, the old version is leaked rather than
+    // freed under a reader
+    free(retired);
+    return number;
+}
+
+size_t swap_reclaim(ModelSwap* swap) {
+    pthread_mutex_lock(&swap->lock);
+    
+    // Oldest epoch any reader is still in
+    uint64_t oldest = UINT64_MAX;
+    for (int i = 0; i < SWAP_MAX_READERS; i++) {
+        uint64_t epoch = __atomic_load_n(&swap->readers[i].epoch, __ATOMIC_SEQ_CST);
+        if (epoch != 0 && epoch < oldest) oldest = epoch;
+    }
+    
+    size_t waiting = 0;
+    SwapRetired** link = &swap->retired;
+    while (*link) {
+        SwapRetired* retired = *link;
+        if (retired->epoch <= oldest) {
+            *link = retired->next;
+            swap->release(retired->version);
+            free(retired);
+        } else {
+            waiting++;
+            link = &retired->next;
+        }
+    }
+    
+    pthread_mutex_unlock(&swap->lock);
+    return waiting;
+}
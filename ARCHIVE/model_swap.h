@@ -0,0 +1,59 @@
+#ifndef MODEL_SWAP_H
+#define MODEL_SWAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// Most readers that can hold a version at once
+#define SWAP_MAX_READERS 256
+
+// Frees a version nobody can still be reading
+typedef void (*SwapRelease)(void* version);
+
+// A reader's announced epoch, alone on its cache line. 0 when idle.
+typedef struct {
+    uint64_t epoch;
+    char padding[64 - sizeof(uint64_t)];
+} SwapReader;
+
+typedef struct SwapRetired {
+    void* version;
+    uint64_t epoch;              // First epoch whose readers cannot see it
+    struct SwapRetired* next;
+} SwapRetired;
+
+// Versioned pointer with epoch-based reclamation. Readers pin whatever
+// version is current for the length of one request; a publish swaps in a
+// new version without waiting for them, and the old one is released once
+// every reader that could have seen it has left.
+typedef struct {
+    void* current;
+    uint64_t epoch;              // Bumped by each publish, starts at 1
+    uint64_t version;            // Publishes so far
+    uint32_t next_reader;        // Where the next reader starts looking for a slot
+    SwapReader readers[SWAP_MAX_READERS];
+    SwapRelease release;
+    pthread_mutex_t lock;        // Held by publish and reclaim
+    SwapRetired* retired;
+} ModelSwap;
+
+int swap_init(ModelSwap* swap, void* initial, SwapRelease release);
+
+// Releases the current and every retired version; no reader may remain
+void swap_destroy(ModelSwap* swap);
+
+// Pin the current version until swap_exit(swap, *slot). Never blocks a
+// publisher; waits only while all SWAP_MAX_READERS slots are taken.
+void* swap_enter(ModelSwap* swap, int* slot);
+void swap_exit(ModelSwap* swap, int slot);
+
+// Make version current and retire the previous one. Returns the new
+// version number.
+uint64_t swap_publish(ModelSwap* swap, void* version);
+
+// Release retired versions that no reader can still hold. Returns how
+// many are still waiting.
+size_t swap_reclaim(ModelSwap* swap);
+
+#endif // MODEL_SWAP_H
@@ -0,0 +1,741 @@
+#include "packed_model.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+// Pad the stream up to offset
+static int pad_to(FILE* file, uint64_t* position, uint64_t offset) {
+    static const char zeros[8] = {0};
+    if (offset > *position && fwrite(zeros, 1, offset - *position, file) != offset - *position) {
+        return 0;
+    }
+    *position = offset;
+    return 1;
+}
+
+static int write_section(FILE* file, uint64_t* position, const void* data, size_t size) {
+    if (size > 0 && fwrite(data, 1, size, file) != size) return 0;
+    *position += size;
+    return 1;
+}
+
+// Bits needed to hold value
+static uint32_t bit_width(uint64_t value) {
+    uint32_t width = 0;
+    while (value) {
+        width++;
+        value >>= 1;
+    }
+    return width;
+}
+
+// Words for a bit array, with one spare so a read never straddles the end
+static uint64_t words_for_bits(uint64_t bits) {
+    return (bits + 63) / 64 + 1;
+}
+
+static void put_bits(uint64_t* words, uint64_t index, uint32_t width, uint64_t value) {
+    if (width == 0) return;
+    uint64_t bit = index * width;
+    uint32_t shift = bit % 64;
+    words[bit / 64] |= value << shift;
+    if (shift + width > 64) words[bit / 64 + 1] |= value >> (64 - shift);
+}
+
+static uint64_t get_bits(const uint64_t* words, uint64_t index, uint32_t width) {
+    if (width == 0) return 0;
+    uint64_t bit = index * width;
+    uint32_t shift = bit % 64;
+    uint64_t value = words[bit / 64] >> shift;
+    if (shift + width > 64) value |= words[bit / 64 + 1] << (64 - shift);
+    return value & ((1ULL << width) - 1);
+}
+
+// Elias-Fano sequence being written
+typedef struct {
+    PackedSequence meta;
+    uint64_t* low;
+    uint64_t* high;
+    uint64_t* samples;
+    uint64_t low_words;
+    uint64_t high_words;
+    uint64_t num_samples;
+} SequenceBuild;
+
+static uint64_t sequence_low_words(const PackedSequence* seq) {
+    return words_for_bits(seq->count * seq->low_bits);
+}
+
+static uint64_t sequence_high_words(const PackedSequence* seq) {
+    return words_for_bits(seq->count + (seq->universe >> seq->low_bits) + 1);
+}
+
+static uint64_t sequence_num_samples(const PackedSequence* seq) {
+    return seq->count / PACKED_EF_SAMPLE + 1;
+}
+
+// Encode count nondecreasing values
+static int sequence_build(SequenceBuild* build, const uint64_t* values, uint64_t count) {
+    memset(build, 0, sizeof(SequenceBuild));
+    build->meta.count = count;
+    build->meta.universe = count ? values[count - 1] : 0;
+    if (count > 0 && build->meta.universe / count > 1) {
+        build->meta.low_bits = bit_width(build->meta.universe / count) - 1;
+    }
+    
+    build->low_words = sequence_low_words(&build->meta);
+    build->high_words = sequence_high_words(&build->meta);
+    build->num_samples = sequence_num_samples(&build->meta);
+    build->low = calloc(build->low_words, sizeof(uint64_t));
+    build->high = calloc(build->high_words, sizeof(uint64_t));
+    build->samples = calloc(build->num_samples, sizeof(uint64_t));
+    if (!build->low || !build->high || !build->samples) return 0;
+    
+    uint32_t low_bits = build->meta.low_bits;
+    for (uint64_t i = 0; i < count; i++) {
+        put_bits(build->low, i, low_bits, values[i] & ((1ULL << low_bits) - 1));
+        uint64_t pos = (values[i] >> low_bits) + i;
+        build->high[pos / 64] |= 1ULL << (pos % 64);
+        if (i % PACKED_EF_SAMPLE == 0) build->samples[i / PACKED_EF_SAMPLE] = pos;
+    }
+    return 1;
+}
+
+static void sequence_free(SequenceBuild* build) {
+    free(build->low);
+    free(build->high);
+    free(build->samples);
+}
+
+// Value index of a sequence: select the index-th one of the high bits,
+// starting from the nearest sample, and append the low bits
+static uint64_t sequence_get(const PackedModel* model, const PackedSequence* seq, uint64_t index) {
+    const char* base = model->base;
+    const uint64_t* high = (const uint64_t*)(base + seq->high_offset);
+    const uint64_t* samples = (const uint64_t*)(base + seq->samples_offset);
+    
+    uint64_t pos = samples[index / PACKED_EF_SAMPLE];
+    uint64_t skip = index % PACKED_EF_SAMPLE;
+    uint64_t word = pos / 64;
+    uint64_t bits = high[word] & (~0ULL << (pos % 64));
+    
+    for (uint64_t ones = __builtin_popcountll(bits); skip >= ones; ones = __builtin_popcountll(bits)) {
+        skip -= ones;
+        bits = high[++word];
+    }
+    while (skip--) bits &= bits - 1;
+    pos = word * 64 + __builtin_ctzll(bits);
+    
+    const uint64_t* low = (const uint64_t*)(base + seq->low_offset);
+    return ((pos - index) << seq->low_bits) | get_bits(low, index, seq->low_bits);
+}
+
+// Log-spaced count of each code, ending at max_count. Small counts stay
+// exact while the spacing is under one.
+static void build_levels(uint32_t* levels, uint32_t num_levels, uint32_t max_count) {
+    double log_max = log((double)max_count);
+    levels[0] = 0;
+    for (uint32_t k = 1; k < num_levels; k++) {
+        uint32_t level = (uint32_t)(exp(log_max * (k - 1) / (num_levels - 2)) + 0.5);
+        levels[k] = level > levels[k - 1] ? level : levels[k - 1] + 1;
+    }
+    levels[num_levels - 1] = max_count;
+}
+
+// Code of the level nearest count by ratio; count is at most the top
+// level. Without levels the code is the count.
+static uint32_t quantize(const uint32_t* levels, uint32_t num_levels, uint32_t count, double* max_error) {
+    if (num_levels == 0) return count;
+    
+    uint32_t lo = 0, hi = num_levels - 1;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (levels[mid] < count) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    if (lo > 1 && levels[lo] != count &&
+        (double)count * count < (double)levels[lo - 1] * levels[lo]) {
+        lo--;
+    }
+    
+    if (count > 0) {
+        double error = fabs((double)levels[lo] - count) / count;
+        if (error > *max_error) *max_error = error;
+    }
+    return lo;
+}
+
+static int compare_words(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+// Child or continuation with its token renumbered to a packed word ID
+typedef struct {
+    uint32_t token;
+    uint32_t index;
+} RankedEntry;
+
+static int compare_entries(const void* a, const void* b) {
+    const RankedEntry* x = a;
+    const RankedEntry* y = b;
+    return (x->token > y->token) - (x->token < y->token);
+}
+
+static void put_varint(unsigned char** out, size_t value) {
+    while (value >= 0x80) {
+        *(*out)++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *(*out)++ = (unsigned char)value;
+}
+
+static size_t get_varint(const char** in) {
+    size_t value = 0;
+    int shift = 0;
+    unsigned char byte;
+    do {
+        byte = (unsigned char)*(*in)++;
+        value |= (size_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+// Front-code sorted words: each block opens with a whole word, the rest
+// store the length shared with the word before and the remaining suffix
+static unsigned char* front_code(const char* const* sorted, uint32_t num_words,
+                                 uint32_t* block_offsets, size_t* size) {
+    size_t bound = 0;
+    for (uint32_t i = 0; i < num_words; i++) bound += strlen(sorted[i]) + 1 + 10;
+    unsigned char* bytes = malloc(bound ? bound : 1);
+    if (!bytes) return NULL;
+    
+    unsigned char* out = bytes;
+    for (uint32_t i = 0; i < num_words; i++) {
+        size_t shared = 0;
+        if (i % PACKED_VOCAB_BLOCK == 0) {
+            block_offsets[i / PACKED_VOCAB_BLOCK] = (uint32_t)(out - bytes);
+        } else {
+            while (sorted[i][shared] && sorted[i][shared] == sorted[i - 1][shared]) shared++;
+            put_varint(&out, shared);
+        }
+        size_t length = strlen(sorted[i] + shared) + 1;
+        memcpy(out, sorted[i] + shared, length);
+        out += length;
+    }
+    
+    block_offsets[(num_words + PACKED_VOCAB_BLOCK - 1) / PACKED_VOCAB_BLOCK] = (uint32_t)(out - bytes);
+    *size = out - bytes;
+    return bytes;
+}
+
+int packed_write(const char* path, const Vocabulary* vocab, const ContextTree* tree,
+                 int count_bits, uint32_t generation) {
+    if (count_bits != 8 && count_bits != 16) return 0;
+    
+    uint32_t num_words = vocab->num_words;
+    uint32_t num_blocks = (num_words + PACKED_VOCAB_BLOCK - 1) / PACKED_VOCAB_BLOCK;
+    uint32_t token_bits = bit_width(num_words > 1 ? num_words - 1 : 1);
+    size_t num_nodes = tree->num_nodes;
+    size_t num_patterns = tree->num_patterns;
+    
+    const char** sorted = malloc((num_words ? num_words : 1) * sizeof(char*));
+    uint32_t* rank = malloc((num_words ? num_words : 1) * sizeof(uint32_t));
+    uint32_t* block_offsets = malloc((num_blocks + 1) * sizeof(uint32_t));
+    uint32_t* levels = malloc(((size_t)1 << count_bits) * sizeof(uint32_t));
+    RankedEntry* entries = malloc((num_words ? num_words : 1) * sizeof(RankedEntry));
+    const ContextNode** order = malloc(num_nodes * sizeof(ContextNode*));
+    uint64_t* first_child = malloc((num_nodes + 1) * sizeof(uint64_t));
+    uint64_t* first_continuation = malloc((num_nodes + 1) * sizeof(uint64_t));
+    uint64_t* tokens = calloc(words_for_bits((uint64_t)num_nodes * token_bits), sizeof(uint64_t));
+    uint64_t* totals = calloc(words_for_bits((uint64_t)num_nodes * count_bits), sizeof(uint64_t));
+    uint64_t* nexts = calloc(words_for_bits((uint64_t)num_patterns * token_bits), sizeof(uint64_t));
+    uint64_t* counts = calloc(words_for_bits((uint64_t)num_patterns * count_bits), sizeof(uint64_t));
+    unsigned char* words = NULL;
+    SequenceBuild children, continuations;
+    memset(&children, 0, sizeof(children));
+    memset(&continuations, 0, sizeof(continuations));
+    int ok = sorted && rank && block_offsets && levels && entries && order &&
+             first_child && first_continuation && tokens && totals && nexts && counts;
+    
+    // Packed word IDs are ranks in byte order
+    size_t word_bytes = 0;
+    if (ok) {
+        for (uint32_t id = 0; id < num_words; id++) sorted[id] = vocab->words[id];
+        qsort(sorted, num_words, sizeof(char*), compare_words);
+        for (uint32_t i = 0; i < num_words; i++) rank[vocab_lookup(vocab, sorted[i])] = i;
+        words = front_code((const char* const*)sorted, num_words, block_offsets, &word_bytes);
+        ok = words != NULL;
+    }
+    
+    // Breadth-first order with children sorted by packed ID
+    uint32_t max_count = 0;
+    size_t count_nodes = 0;
+    uint64_t count_patterns = 0;
+    if (ok) {
+        order[count_nodes++] = tree->root;
+        for (size_t i = 0; i < count_nodes; i++) {
+            const ContextNode* node = order[i];
+            first_child[i] = count_nodes;
+            first_continuation[i] = count_patterns;
+            if (node->total_count > max_count) max_count = node->total_count;
+            
+            for (uint32_t c = 0; c < node->num_children; c++) {
+                entries[c].token = rank[node->children[c]->token];
+                entries[c].index = c;
+            }
+            qsort(entries, node->num_children, sizeof(RankedEntry), compare_entries);
+            for (uint32_t c = 0; c < node->num_children && count_nodes < num_nodes; c++) {
+                order[count_nodes++] = node->children[entries[c].index];
+            }
+            count_patterns += node->num_continuations;
+        }
+        first_child[count_nodes] = count_nodes;
+        first_continuation[count_nodes] = count_patterns;
+        ok = count_nodes == num_nodes && count_patterns == num_patterns;
+    }
+    
+    // Tokens, totals and continuations in that order
+    uint32_t num_levels = 0;
+    double max_error = 0;
+    if (ok) {
+        if (max_count >> count_bits) {
+            num_levels = 1u << count_bits;
+            build_levels(levels, num_levels, max_count);
+        }
+        for (size_t i = 0; i < num_nodes; i++) {
+            const ContextNode* node = order[i];
+            if (i > 0) put_bits(tokens, i, token_bits, rank[node->token]);
+            put_bits(totals, i, count_bits, quantize(levels, num_levels, node->total_count, &max_error));
+            
+            for (uint32_t c = 0; c < node->num_continuations; c++) {
+                entries[c].token = rank[node->continuations[c].next];
+                entries[c].index = c;
+            }
+            qsort(entries, node->num_continuations, sizeof(RankedEntry), compare_entries);
+            for (uint32_t c = 0; c < node->num_continuations; c++) {
+                uint64_t slot = first_continuation[i] + c;
+                uint32_t count = node->continuations[entries[c].index].count;
+                put_bits(nexts, slot, token_bits, entries[c].token);
+                put_bits(counts, slot, count_bits, quantize(levels, num_levels, count, &max_error));
+            }
+        }
+        
+        ok = sequence_build(&children, first_child, num_nodes + 1) &&
+             sequence_build(&continuations, first_continuation, num_nodes + 1);
+    }
+    
+    PackedHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PACKED_MAGIC, sizeof(PACKED_MAGIC));
+    header.version = PACKED_VERSION;
+    header.byte_order = PACKED_BYTE_ORDER;
+    header.max_depth = tree->max_depth;
+    header.num_words = num_words;
+    header.num_blocks = num_blocks;
+    header.token_bits = token_bits;
+    header.count_bits = count_bits;
+    header.generation = generation;
+    header.num_levels = num_levels;
+    header.num_nodes = num_nodes;
+    header.num_patterns = num_patterns;
+    header.total_words = tree->total_words;
+    header.max_count_error = max_error;
+    header.first_child = children.meta;
+    header.first_continuation = continuations.meta;
+    
+    uint64_t token_words = words_for_bits((uint64_t)num_nodes * token_bits);
+    uint64_t total_words = words_for_bits((uint64_t)num_nodes * count_bits);
+    uint64_t next_words = words_for_bits((uint64_t)num_patterns * token_bits);
+    uint64_t count_words = words_for_bits((uint64_t)num_patterns * count_bits);
+    
+    header.block_offsets_offset = align8(sizeof(PackedHeader));
+    header.words_offset = align8(header.block_offsets_offset + (num_blocks + 1) * sizeof(uint32_t));
+    header.levels_offset = align8(header.words_offset + word_bytes);
+    header.tokens_offset = align8(header.levels_offset + num_levels * sizeof(uint32_t));
+    header.totals_offset = header.tokens_offset + token_words * 8;
+    header.nexts_offset = header.totals_offset + total_words * 8;
+    header.counts_offset = header.nexts_offset + next_words * 8;
+    header.first_child.low_offset = header.counts_offset + count_words * 8;
+    header.first_child.high_offset = header.first_child.low_offset + children.low_words * 8;
+    header.first_child.samples_offset = header.first_child.high_offset + children.high_words * 8;
+    header.first_continuation.low_offset = header.first_child.samples_offset + children.num_samples * 8;
+    header.first_continuation.high_offset = header.first_continuation.low_offset + continuations.low_words * 8;
+    header.first_continuation.samples_offset = header.first_continuation.high_offset + continuations.high_words * 8;
+    header.file_size = header.first_continuation.samples_offset + continuations.num_samples * 8;
+    
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* file = ok ? fopen(tmp_path, "wb") : NULL;
+    ok = ok && file != NULL;
+    uint64_t position = 0;
+    
+    ok = ok && write_section(file, &position, &header, sizeof(header));
+    ok = ok && pad_to(file, &position, header.block_offsets_offset);
+    ok = ok && write_section(file, &position, block_offsets, (num_blocks + 1) * sizeof(uint32_t));
+    ok = ok && pad_to(file, &position, header.words_offset);
+    ok = ok && write_section(file, &position, words, word_bytes);
+    ok = ok && pad_to(file, &position, header.levels_offset);
+    ok = ok && write_section(file, &position, levels, num_levels * sizeof(uint32_t));
+    ok = ok && pad_to(file, &position, header.tokens_offset);
+    ok = ok && write_section(file, &position, tokens, token_words * 8);
+    ok = ok && write_section(file, &position, totals, total_words * 8);
+    ok = ok && write_section(file, &position, nexts, next_words * 8);
+    ok = ok && write_section(file, &position, counts, count_words * 8);
+    ok = ok && write_section(file, &position, children.low, children.low_words * 8);
+    ok = ok && write_section(file, &position, children.high, children.high_words * 8);
+    ok = ok && write_section(file, &position, children.samples, children.num_samples * 8);
+    ok = ok && write_section(file, &position, continuations.low, continuations.low_words * 8);
+    ok = ok && write_section(file, &position, continuations.high, continuations.high_words * 8);
+    ok = ok && write_section(file, &position, continuations.samples, continuations.num_samples * 8);
+    
+    if (ok && (fflush(file) != 0 || fsync(fileno(file)) != 0)) ok = 0;
+    if (file && fclose(file) != 0) ok = 0;
+    if (ok) {
+        ok = rename(tmp_path, path) == 0;
+    } else if (file) {
+        remove(tmp_path);
+    }
+    
+    sequence_free(&children);
+    sequence_free(&continuations);
+    free(sorted);
+    free(rank);
+    free(block_offsets);
+    free(levels);
+    free(entries);
+    free(order);
+    free(first_child);
+    free(first_continuation);
+    free(tokens);
+    free(totals);
+    free(nexts);
+    free(counts);
+    free(words);
+    return ok;
+}
+
+static int sequence_fits(const PackedSequence* seq, uint64_t count, uint64_t universe, uint64_t file_size) {
+    if (seq->count != count || seq->universe != universe || seq->low_bits > 32) return 0;
+    if (seq->low_offset % 8 || seq->high_offset % 8 || seq->samples_offset % 8) return 0;
+    if (seq->low_offset > file_size || seq->high_offset > file_size || seq->samples_offset > file_size) return 0;
+    return seq->low_offset + sequence_low_words(seq) * 8 <= file_size &&
+           seq->high_offset + sequence_high_words(seq) * 8 <= file_size &&
+           seq->samples_offset + sequence_num_samples(seq) * 8 <= file_size;
+}
+
+// Decode a whole sequence once: every sample must name the one it
+// samples, and the values must climb to exactly the universe, so
+// sequence_get never scans or indexes past the sequence
+static int sequence_valid(const PackedModel* model, const PackedSequence* seq) {
+    const char* base = model->base;
+    const uint64_t* low = (const uint64_t*)(base + seq->low_offset);
+    const uint64_t* high = (const uint64_t*)(base + seq->high_offset);
+    const uint64_t* samples = (const uint64_t*)(base + seq->samples_offset);
+    uint64_t high_words = sequence_high_words(seq);
+    uint64_t index = 0, previous = 0;
+    
+    for (uint64_t word = 0; word < high_words && index < seq->count; word++) {
+        for (uint64_t bits = high[word]; bits && index < seq->count; bits &= bits - 1) {
+            uint64_t pos = word * 64 + __builtin_ctzll(bits);
+            if (index % PACKED_EF_SAMPLE == 0 && samples[index / PACKED_EF_SAMPLE] != pos) return 0;
+            
+            uint64_t value = ((pos - index) << seq->low_bits) | get_bits(low, index, seq->low_bits);
+            if (value < previous || value > seq->universe) return 0;
+            previous = value;
+            index++;
+        }
+    }
+    return index == seq->count && (seq->count == 0 || previous == seq->universe);
+}
+
+// Every block of front-coded words must parse inside its own bytes
+static int words_valid(const PackedModel* model) {
+    const PackedHeader* h = model->header;
+    const char* bytes = model->base;
+    const uint32_t* offsets = (const uint32_t*)(bytes + h->block_offsets_offset);
+    const char* words = bytes + h->words_offset;
+    if (offsets[h->num_blocks] > h->levels_offset - h->words_offset) return 0;
+    
+    for (uint32_t b = 0; b < h->num_blocks; b++) {
+        if (offsets[b] > offsets[b + 1]) return 0;
+        const char* entry = words + offsets[b];
+        const char* end = words + offsets[b + 1];
+        uint32_t entries = h->num_words - b * PACKED_VOCAB_BLOCK;
+        if (entries > PACKED_VOCAB_BLOCK) entries = PACKED_VOCAB_BLOCK;
+        size_t length = 0;
+        
+        for (uint32_t e = 0; e < entries; e++) {
+            size_t shared = 0;
+            for (int shift = 0; e > 0; shift += 7) {
+                if (entry >= end || shift > 28) return 0;
+                unsigned char byte = (unsigned char)*entry++;
+                shared |= (size_t)(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) break;
+            }
+            
+            const char* nul = entry < end ? memchr(entry, '\0', end - entry) : NULL;
+            if (!nul || shared > length) return 0;
+            length = shared + (nul - entry);
+            entry = nul + 1;
+        }
+    }
+    return 1;
+}
+
+// Check that the header is ours, that the sections fit in the file, and
+// that every stored offset and word ID stays inside its section
+static int validate(const PackedModel* model) {
+    const PackedHeader* h = model->header;
+    if (model->size < sizeof(PackedHeader)) return 0;
+    if (memcmp(h->magic, PACKED_MAGIC, sizeof(PACKED_MAGIC)) != 0) return 0;
+    if (h->version != PACKED_VERSION || h->byte_order != PACKED_BYTE_ORDER) return 0;
+    if (h->file_size != model->size || h->num_nodes < 1) return 0;
+    if (h->num_nodes > UINT32_MAX || h->num_patterns > UINT32_MAX) return 0;
+    if (h->max_depth < 1 || h->max_depth > CONTEXT_TREE_MAX_DEPTH) return 0;
+    if (h->count_bits != 8 && h->count_bits != 16) return 0;
+    if (h->token_bits < 1 || h->token_bits > 32) return 0;
+    if (h->num_blocks != (h->num_words + PACKED_VOCAB_BLOCK - 1) / PACKED_VOCAB_BLOCK) return 0;
+    
+    // Offsets past the end could wrap the sums below
+    if (h->block_offsets_offset > h->file_size || h->words_offset > h->file_size ||
+        h->levels_offset > h->file_size || h->tokens_offset > h->file_size ||
+        h->totals_offset > h->file_size || h->nexts_offset > h->file_size ||
+        h->counts_offset > h->file_size) {
+        return 0;
+    }
+    if (h->block_offsets_offset + (h->num_blocks + 1) * sizeof(uint32_t) > h->words_offset) return 0;
+    if (h->words_offset > h->levels_offset) return 0;
+    if (h->num_levels != 0 && h->num_levels != (1u << h->count_bits)) return 0;
+    if (h->levels_offset + (uint64_t)h->num_levels * sizeof(uint32_t) > h->tokens_offset) return 0;
+    if (h->tokens_offset % 8 || h->totals_offset % 8 || h->nexts_offset % 8 || h->counts_offset % 8) return 0;
+    if (h->tokens_offset + words_for_bits(h->num_nodes * h->token_bits) * 8 > h->totals_offset) return 0;
+    if (h->totals_offset + words_for_bits(h->num_nodes * h->count_bits) * 8 > h->nexts_offset) return 0;
+    if (h->nexts_offset + words_for_bits(h->num_patterns * h->token_bits) * 8 > h->counts_offset) return 0;
+    if (h->counts_offset + words_for_bits(h->num_patterns * h->count_bits) * 8 > h->file_size) return 0;
+    if (!sequence_fits(&h->first_child, h->num_nodes + 1, h->num_nodes, h->file_size)) return 0;
+    if (!sequence_fits(&h->first_continuation, h->num_nodes + 1, h->num_patterns, h->file_size)) return 0;
+    if (!sequence_valid(model, &h->first_child) || !sequence_valid(model, &h->first_continuation)) return 0;
+    if (!words_valid(model)) return 0;
+    
+    // Word IDs; the root has no token
+    const char* bytes = model->base;
+    const uint64_t* tokens = (const uint64_t*)(bytes + h->tokens_offset);
+    const uint64_t* nexts = (const uint64_t*)(bytes + h->nexts_offset);
+    for (uint64_t i = 1; i < h->num_nodes; i++) {
+        if (get_bits(tokens, i, h->token_bits) >= h->num_words) return 0;
+    }
+    for (uint64_t i = 0; i < h->num_patterns; i++) {
+        if (get_bits(nexts, i, h->token_bits) >= h->num_words) return 0;
+    }
+    return 1;
+}
+
+PackedModel* packed_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(PackedHeader)) {
+        close(fd);
+        return NULL;
+    }
+    
+    void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+    
+    PackedModel* model = calloc(1, sizeof(PackedModel));
+    if (!model) {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+    
+    model->base = base;
+    model->size = st.st_size;
+    model->header = base;
+    if (!validate(model)) {
+        packed_close(model);
+        return NULL;
+    }
+    
+    const char* bytes = base;
+    const PackedHeader* h = model->header;
+    model->block_offsets = (const uint32_t*)(bytes + h->block_offsets_offset);
+    model->words = bytes + h->words_offset;
+    model->levels = (const uint32_t*)(bytes + h->levels_offset);
+    model->tokens = (const uint64_t*)(bytes + h->tokens_offset);
+    model->totals = (const uint64_t*)(bytes + h->totals_offset);
+    model->nexts = (const uint64_t*)(bytes + h->nexts_offset);
+    model->counts = (const uint64_t*)(bytes + h->counts_offset);
+    return model;
+}
+
+void packed_close(PackedModel* model) {
+    if (!model) return;
+    munmap(model->base, model->size);
+    free(model);
+}
+
+// Binary search the block heads, then walk the block keeping how much of
+// word the current entry matches, so no entry has to be rebuilt
+uint32_t packed_lookup(const PackedModel* model, const char* word) {
+    uint32_t lo = 0, hi = model->header->num_blocks;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (strcmp(model->words + model->block_offsets[mid], word) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) return PACKED_NONE;
+    
+    uint32_t first = (lo - 1) * PACKED_VOCAB_BLOCK;
+    uint32_t end = first + PACKED_VOCAB_BLOCK;
+    if (end > model->header->num_words) end = model->header->num_words;
+    
+    const char* entry = model->words + model->block_offsets[lo - 1];
+    size_t matched = 0;
+    while (entry[matched] && entry[matched] == word[matched]) matched++;
+    if (entry[matched] == word[matched]) return first;
+    entry += strlen(entry) + 1;
+    
+    for (uint32_t id = first + 1; id < end; id++) {
+        size_t shared = get_varint(&entry);
+        const unsigned char* suffix = (const unsigned char*)entry;
+        entry += strlen(entry) + 1;
+        
+        // Entries sharing less with the one before than word did are past it
+        if (shared < matched) return PACKED_NONE;
+        if (shared > matched) continue;
+        
+        const unsigned char* rest = (const unsigned char*)word + matched;
+        size_t i = 0;
+        while (suffix[i] && suffix[i] == rest[i]) i++;
+        if (suffix[i] == rest[i]) return id;
+        if (suffix[i] > rest[i]) return PACKED_NONE;
+        matched += i;
+    }
+    
+    return PACKED_NONE;
+}
+
+// Copy text to buffer at offset, keeping within size - 1 bytes
+static void place(char* buffer, size_t size, size_t offset, const char* text) {
+    for (size_t i = 0; text[i] && offset + i + 1 < size; i++) buffer[offset + i] = text[i];
+}
+
+size_t packed_word(const PackedModel* model, uint32_t id, char* buffer, size_t size) {
+    if (id >= model->header->num_words) {
+        if (size > 0) buffer[0] = '\0';
+        return 0;
+    }
+    
+    const char* entry = model->words + model->block_offsets[id / PACKED_VOCAB_BLOCK];
+    size_t length = strlen(entry);
+    place(buffer, size, 0, entry);
+    entry += length + 1;
+    
+    for (uint32_t k = id / PACKED_VOCAB_BLOCK * PACKED_VOCAB_BLOCK; k < id; k++) {
+        size_t shared = get_varint(&entry);
+        size_t suffix = strlen(entry);
+        place(buffer, size, shared, entry);
+        length = shared + suffix;
+        entry += suffix + 1;
+    }
+    
+    if (size > 0) buffer[length < size ? length : size - 1] = '\0';
+    return length;
+}
+
+uint32_t packed_child(const PackedModel* model, uint32_t node, uint32_t token) {
+    uint32_t bits = model->header->token_bits;
+    uint64_t lo = sequence_get(model, &model->header->first_child, node);
+    uint64_t end = sequence_get(model, &model->header->first_child, node + 1);
+    uint64_t hi = end;
+    
+    while (lo < hi) {
+        uint64_t mid = (lo + hi) / 2;
+        if (get_bits(model->tokens, mid, bits) < token) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    if (lo < end && get_bits(model->tokens, lo, bits) == token) return (uint32_t)lo;
+    return PACKED_NONE;
+}
+
+int packed_match(const PackedModel* model, const uint32_t* context, int context_length, uint32_t* nodes) {
+    uint32_t node = 0;
+    int max_depth = (int)model->header->max_depth;
+    int limit = context_length < max_depth ? context_length : max_depth;
+    int depth = 0;
+    
+    nodes[0] = node;
+    while (depth < limit) {
+        node = packed_child(model, node, context[context_length - depth - 1]);
+        if (node == PACKED_NONE) break;
+        nodes[++depth] = node;
+    }
+    
+    return depth;
+}
+
+// Count stored under code
+static uint32_t level(const PackedModel* model, uint64_t code) {
+    return model->header->num_levels ? model->levels[code] : (uint32_t)code;
+}
+
+uint32_t packed_num_continuations(const PackedModel* model, uint32_t node) {
+    const PackedSequence* seq = &model->header->first_continuation;
+    return (uint32_t)(sequence_get(model, seq, node + 1) - sequence_get(model, seq, node));
+}
+
+Continuation packed_continuation(const PackedModel* model, uint32_t node, uint32_t index) {
+    uint64_t slot = sequence_get(model, &model->header->first_continuation, node) + index;
+    Continuation continuation;
+    continuation.next = (uint32_t)get_bits(model->nexts, slot, model->header->token_bits);
+    continuation.count = level(model, get_bits(model->counts, slot, model->header->count_bits));
+    return continuation;
+}
+
+uint32_t packed_count(const PackedModel* model, uint32_t node, uint32_t next) {
+    uint32_t bits = model->header->token_bits;
+    uint64_t lo = sequence_get(model, &model->header->first_continuation, node);
+    uint64_t end = sequence_get(model, &model->header->first_continuation, node + 1);
+    uint64_t hi = end;
+    
+    while (lo < hi) {
+        uint64_t mid = (lo + hi) / 2;
+        if (get_bits(model->nexts, mid, bits) < next) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    if (lo < end && get_bits(model->nexts, lo, bits) == next) {
+        return level(model, get_bits(model->counts, lo, model->header->count_bits));
+    }
+    return 0;
+}
+
+uint32_t packed_total_count(const PackedModel* model, uint32_t node) {
+    return level(model, get_bits(model->totals, node, model->header->count_bits));
+}
@@ -0,0 +1,111 @@
+#ifndef PACKED_MODEL_H
+#define PACKED_MODEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "vocabulary.h"
+#include "context_tree.h"
+
+// Read-only serving form of a trained model, a fraction of the size of a
+// snapshot (model_snapshot.h). Like a snapshot it is queried in place from
+// a read-only mapping; unlike one it cannot be thawed back exactly, since
+// counts are quantized.
+//
+// - Words are sorted and front coded in blocks of PACKED_VOCAB_BLOCK, so
+//   word IDs in a packed model are ranks in that order, not the IDs of the
+//   vocabulary it was exported from.
+// - Nodes are in breadth-first order with each node's children sorted by
+//   token, like a snapshot. Child and continuation offsets only grow along
+//   that order and are stored Elias-Fano encoded.
+// - Tokens are bit packed at the width of the largest word ID. Counts take
+//   8 or 16 bits: stored as they are while the largest count fits,
+//   otherwise as codes into a table of log-spaced levels.
+#define PACKED_MAGIC "GAIAPKD"
+#define PACKED_VERSION 1
+#define PACKED_BYTE_ORDER 0x01020304u
+#define PACKED_VOCAB_BLOCK 16
+#define PACKED_EF_SAMPLE 256     // Ones between select samples
+#define PACKED_NONE UINT32_MAX
+
+// Monotone sequence of count values in [0, universe]: the low low_bits of
+// each value bit packed, the rest in unary in a bit vector, and the
+// position of every PACKED_EF_SAMPLE-th one of that vector
+typedef struct {
+    uint64_t count;
+    uint64_t universe;
+    uint32_t low_bits;
+    uint32_t reserved;
+    uint64_t low_offset;         // uint64_t words
+    uint64_t high_offset;        // uint64_t words
+    uint64_t samples_offset;     // uint64_t[count / PACKED_EF_SAMPLE + 1]
+} PackedSequence;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;         // PACKED_BYTE_ORDER as written by the host
+    uint32_t max_depth;
+    uint32_t num_words;
+    uint32_t num_blocks;         // Front-coded blocks of words
+    uint32_t token_bits;         // Width of a packed word ID
+    uint32_t count_bits;         // Width of a count code, 8 or 16
+    uint32_t generation;
+    uint32_t num_levels;         // Entries in the level table; 0 when codes are counts
+    uint32_t reserved;
+    uint64_t num_nodes;
+    uint64_t num_patterns;
+    uint64_t total_words;
+    double max_count_error;      // Largest relative error of a stored count
+    
+    // Section offsets from the start of the file, each 8-byte aligned
+    uint64_t block_offsets_offset;  // uint32_t[num_blocks + 1] into the word section
+    uint64_t words_offset;          // Front-coded words
+    uint64_t levels_offset;         // uint32_t[num_levels], count of each code
+    uint64_t tokens_offset;         // token_bits per node, the root's unused
+    uint64_t totals_offset;         // count_bits per node
+    uint64_t nexts_offset;          // token_bits per continuation
+    uint64_t counts_offset;         // count_bits per continuation
+    PackedSequence first_child;     // num_nodes + 1 node indexes
+    PackedSequence first_continuation; // num_nodes + 1 continuation indexes
+    uint64_t file_size;
+} PackedHeader;
+
+// A packed model mapped into memory
+typedef struct {
+    void* base;
+    size_t size;
+    const PackedHeader* header;
+    const uint32_t* block_offsets;
+    const char* words;
+    const uint32_t* levels;
+    const uint64_t* tokens;
+    const uint64_t* totals;
+    const uint64_t* nexts;
+    const uint64_t* counts;
+} PackedModel;
+
+// Export (to path.tmp, then renamed into place). count_bits is 8 or 16.
+int packed_write(const char* path, const Vocabulary* vocab, const ContextTree* tree,
+                 int count_bits, uint32_t generation);
+
+// Mapping
+PackedModel* packed_open(const char* path);
+void packed_close(PackedModel* model);
+
+// Words. packed_word copies a word into buffer, truncating to size - 1
+// bytes, and returns its full length; 0 for an unknown ID.
+uint32_t packed_lookup(const PackedModel* model, const char* word);
+size_t packed_word(const PackedModel* model, uint32_t id, char* buffer, size_t size);
+
+// Nodes are indexes, the root is 0. packed_match fills nodes like
+// snapshot_match.
+uint32_t packed_child(const PackedModel* model, uint32_t node, uint32_t token);
+int packed_match(const PackedModel* model, const uint32_t* context, int context_length, uint32_t* nodes);
+
+// Continuations of a node, sorted by next, with dequantized counts
+uint32_t packed_num_continuations(const PackedModel* model, uint32_t node);
+Continuation packed_continuation(const PackedModel* model, uint32_t node, uint32_t index);
+uint32_t packed_count(const PackedModel* model, uint32_t node, uint32_t next);   // 0 if unseen
+uint32_t packed_total_count(const PackedModel* model, uint32_t node);
+
+#endif // PACKED_MODEL_H
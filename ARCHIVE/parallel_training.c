@@ -0,0 +1,251 @@
+#include "parallel_training.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Tokens of one chunk of lines, as local IDs until remapped
+typedef struct {
+    const TrainCorpus* corpus;
+    const TrainConfig* config;
+    size_t first_line;
+    size_t end_line;
+    
+    Vocabulary* local_vocab;
+    uint32_t* id_map;            // Local ID -> global ID
+    uint32_t* tokens;
+    size_t num_tokens;
+    size_t token_capacity;
+    int* line_lengths;           // Token count of each line kept
+    size_t num_lines;
+    int ok;
+} TrainChunk;
+
+// One shard of the counting pass
+typedef struct {
+    TrainChunk* chunks;
+    int num_chunks;
+    const TrainConfig* config;
+    uint32_t num_shards;
+    uint32_t shard;
+    ContextTree* tree;
+    size_t counts_added;
+} TrainShard;
+
+void train_corpus_init(TrainCorpus* corpus) {
+    memset(corpus, 0, sizeof(TrainCorpus));
+}
+
+void train_corpus_free(TrainCorpus* corpus) {
+    for (size_t i = 0; i < corpus->num_lines; i++) {
+        free(corpus->lines[i]);
+    }
+    free(corpus->lines);
+    memset(corpus, 0, sizeof(TrainCorpus));
+}
+
+int train_corpus_add(TrainCorpus* corpus, const char* line) {
+    if (corpus->num_lines >= corpus->capacity) {
+        size_t new_capacity = corpus->capacity ? corpus->capacity * 2 : 1024;
+        char** lines = realloc(corpus->lines, new_capacity * sizeof(char*));
+        if (!lines) return 0;
+        corpus->lines = lines;
+        corpus->capacity = new_capacity;
+    }
+    
+    char* copy = strdup(line);
+    if (!copy) return 0;
+    corpus->lines[corpus->num_lines++] = copy;
+    return 1;
+}
+
+// Read a file with the same fgets buffer size as the serial loader, so
+// overlong lines are split at the same places
+int train_corpus_load_file(TrainCorpus* corpus, const char* filename, size_t line_size) {
+    FILE* file = fopen(filename, "r");
+    if (!file) return 0;
+    
+    char* line = malloc(line_size);
+    if (!line) {
+        fclose(file);
+        return 0;
+    }
+    
+    int ok = 1;
+    while (ok && fgets(line, (int)line_size, file)) {
+        ok = train_corpus_add(corpus, line);
+    }
+    
+    free(line);
+    fclose(file);
+    return ok;
+}
+
+static int append_token(TrainChunk* chunk, uint32_t id) {
+    if (chunk->num_tokens >= chunk->token_capacity) {
+        size_t new_capacity = chunk->token_capacity ? chunk->token_capacity * 2 : 4096;
+        uint32_t* tokens = realloc(chunk->tokens, new_capacity * sizeof(uint32_t));
+        if (!tokens) return 0;
+        chunk->tokens = tokens;
+        chunk->token_capacity = new_capacity;
+    }
+    
+    chunk->tokens[chunk->num_tokens++] = id;
+    return 1;
+}
+
+// Pass 1: tokenize a chunk into its private vocabulary
+static void* tokenize_chunk(void* arg) {
+    TrainChunk* chunk = arg;
+    const TrainConfig* config = chunk->config;
+    TokenSpan* spans = malloc(config->max_tokens * sizeof(TokenSpan));
+    
+    chunk->local_vocab = vocab_create();
+    chunk->line_lengths = malloc((chunk->end_line - chunk->first_line + 1) * sizeof(int));
+    chunk->ok = spans && chunk->local_vocab && chunk->line_lengths;
+    
+    for (size_t i = chunk->first_line; chunk->ok && i < chunk->end_line; i++) {
+        const char* line = chunk->corpus->lines[i];
+        int count = config->tokenize(line, spans, config->max_tokens);
+        if (count >= config->min_tokens) {
+            for (int t = 0; t < count && chunk->ok; t++) {
+                uint32_t id = vocab_intern_lower(chunk->local_vocab, line + spans[t].start, spans[t].length);
+                chunk->ok = id != VOCAB_NONE && append_token(chunk, id);
+            }
+            chunk->line_lengths[chunk->num_lines++] = count;
+        }
+    }
+    
+    free(spans);
+    return NULL;
+}
+
+// Pass 2: rewrite a chunk's tokens with global IDs
+static void* remap_chunk(void* arg) {
+    TrainChunk* chunk = arg;
+    for (size_t i = 0; i < chunk->num_tokens; i++) {
+        chunk->tokens[i] = chunk->id_map[chunk->tokens[i]];
+    }
+    return NULL;
+}
+
+// Pass 3: count every line, keeping only positions in this shard
+static void* count_shard(void* arg) {
+    TrainShard* shard = arg;
+    
+    for (int c = 0; c < shard->num_chunks; c++) {
+        const TrainChunk* chunk = &shard->chunks[c];
+        const uint32_t* tokens = chunk->tokens;
+        
+        for (size_t l = 0; l < chunk->num_lines; l++) {
+            int length = chunk->line_lengths[l];
+            shard->counts_added += context_tree_ingest_shard(shard->tree, tokens, length,
+                                                             shard->config->min_length,
+                                                             shard->num_shards, shard->shard);
+            tokens += length;
+        }
+    }
+    
+    return NULL;
+}
+
+// Run fn over every argument, one thread each; falls back to the calling
+// thread if a thread cannot be started
+static void run_workers(void* (*fn)(void*), void* args, size_t arg_size, int count) {
+    pthread_t threads[TRAIN_MAX_THREADS];
+    int started[TRAIN_MAX_THREADS];
+    
+    for (int i = 0; i < count; i++) {
+        void* arg = (char*)args + i * arg_size;
+        started[i] = i > 0 && pthread_create(&threads[i], NULL, fn, arg) == 0;
+        if (!started[i] && i > 0) fn(arg);
+    }
+    
+    fn(args);
+    
+    for (int i = 1; i < count; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+}
+
+int train_parallel(ContextTree* tree, Vocabulary* vocab, const TrainCorpus* corpus,
+                   const TrainConfig* config, TrainResult* result) {
+    int num_threads = config->num_threads;
+    if (num_threads < 1) num_threads = 1;
+    if (num_threads > TRAIN_MAX_THREADS) num_threads = TRAIN_MAX_THREADS;
+    
+    TrainChunk* chunks = calloc(num_threads, sizeof(TrainChunk));
+    TrainShard* shards = calloc(num_threads, sizeof(TrainShard));
+    if (!chunks || !shards) {
+        free(chunks);
+        free(shards);
+        return 0;
+    }
+    
+    // Contiguous chunks keep each chunk's lines in corpus order
+    for (int i = 0; i < num_threads; i++) {
+        chunks[i].corpus = corpus;
+        chunks[i].config = config;
+        chunks[i].first_line = corpus->num_lines * i / num_threads;
+        chunks[i].end_line = corpus->num_lines * (i + 1) / num_threads;
+    }
+    
+    run_workers(tokenize_chunk, chunks, sizeof(TrainChunk), num_threads);
+    
+    // Intern each chunk's words in first-seen order, chunk by chunk
+    int ok = 1;
+    for (int i = 0; i < num_threads && ok; i++) {
+        TrainChunk* chunk = &chunks[i];
+        uint32_t words = vocab_size(chunk->local_vocab);
+        
+        ok = chunk->ok && (chunk->id_map = malloc((words + 1) * sizeof(uint32_t))) != NULL;
+        for (uint32_t id = 0; ok && id < words; id++) {
+            chunk->id_map[id] = vocab_intern(vocab, vocab_word(chunk->local_vocab, id));
+            ok = chunk->id_map[id] != VOCAB_NONE;
+        }
+    }
+    
+    if (ok) {
+        run_workers(remap_chunk, chunks, sizeof(TrainChunk), num_threads);
+        
+        for (int i = 0; i < num_threads; i++) {
+            shards[i].chunks = chunks;
+            shards[i].num_chunks = num_threads;
+            shards[i].config = config;
+            shards[i].num_shards = num_threads;
+            shards[i].shard = i;
+            shards[i].tree = context_tree_create(tree->max_depth);
+            if (!shards[i].tree) ok = 0;
+        }
+    }
+    
+    if (ok) {
+        run_workers(count_shard, shards, sizeof(TrainShard), num_threads);
+    }
+    
+    // Merge in shard order; shard trees are consumed
+    TrainResult totals = {0};
+    for (int i = 0; i < num_threads; i++) {
+        if (shards[i].tree) {
+            if (ok) {
+                ok = context_tree_merge(tree, shards[i].tree);
+            } else {
+                context_tree_destroy(shards[i].tree);
+            }
+        }
+        totals.counts_added += shards[i].counts_added;
+        totals.lines_used += chunks[i].num_lines;
+        totals.tokens += chunks[i].num_tokens;
+        
+        vocab_destroy(chunks[i].local_vocab);
+        free(chunks[i].id_map);
+        free(chunks[i].tokens);
+        free(chunks[i].line_lengths);
+    }
+    
+    if (result) *result = totals;
+    
+    free(chunks);
+    free(shards);
+    return ok;
+}
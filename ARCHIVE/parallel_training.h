@@ -0,0 +1,52 @@
+#ifndef PARALLEL_TRAINING_H
+#define PARALLEL_TRAINING_H
+
+#include <stddef.h>
+#include "vocabulary.h"
+#include "context_tree.h"
+#include "tokenizer.h"
+
+#define TRAIN_MAX_THREADS 256
+
+// Finds at most max_tokens tokens of line without modifying it; they are
+// interned lowercased. Runs on several threads at once, so it must not keep
+// state between calls.
+typedef int (*TrainTokenizer)(const char* line, TokenSpan* spans, int max_tokens);
+
+// Training lines in the order the serial path would read them
+typedef struct {
+    char** lines;
+    size_t num_lines;
+    size_t capacity;
+} TrainCorpus;
+
+typedef struct {
+    int num_threads;
+    int max_tokens;              // Tokens kept per line
+    int min_tokens;              // Lines with fewer tokens are skipped
+    int min_length;              // Shortest context counted
+    TrainTokenizer tokenize;
+} TrainConfig;
+
+typedef struct {
+    size_t lines_used;           // Lines with at least min_tokens tokens
+    size_t tokens;
+    size_t counts_added;         // Continuation counts added to the tree
+} TrainResult;
+
+// Corpus
+void train_corpus_init(TrainCorpus* corpus);
+void train_corpus_free(TrainCorpus* corpus);
+int train_corpus_add(TrainCorpus* corpus, const char* line);
+int train_corpus_load_file(TrainCorpus* corpus, const char* filename, size_t line_size);
+
+// Tokenize and count with config->num_threads workers. Lines are split into
+// contiguous chunks, each interned into a private vocabulary; the private
+// vocabularies are then merged in chunk order, which assigns the same IDs
+// as interning the lines one by one. Counting is sharded by context
+// token and the shard trees are merged into tree, so the result is
+// identical to the serial path.
+int train_parallel(ContextTree* tree, Vocabulary* vocab, const TrainCorpus* corpus,
+                   const TrainConfig* config, TrainResult* result);
+
+#endif // PARALLEL_TRAINING_H
@@ -0,0 +1,290 @@
+#include "pattern_store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Grow once more than 3/4 of the slots are used
+#define PATTERN_MAX_LOAD_NUM 3
+#define PATTERN_MAX_LOAD_DEN 4
+
+// Bitmask of the slots in the group starting at group whose control byte is value
+static inline uint32_t group_match(const uint8_t* group, uint8_t value) {
+#if defined(__SSE2__)
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)value)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < PATTERN_GROUP_SIZE; i++) {
+        if (group[i] == value) mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+static inline uint8_t fingerprint(uint32_t hash) {
+    return (uint8_t)(hash >> 25);
+}
+
+// Set a control byte, keeping the mirrored tail in sync so a group read
+// near the end of the array wraps around to the first slots
+static inline void set_ctrl(PatternStore* store, uint32_t slot, uint8_t value) {
+    store->ctrl[slot] = value;
+    if (slot < PATTERN_GROUP_SIZE) {
+        store->ctrl[store->num_slots + slot] = value;
+    }
+}
+
+static int allocate_slots(PatternStore* store, uint32_t num_slots) {
+    uint8_t* ctrl = malloc(num_slots + PATTERN_GROUP_SIZE);
+    Pattern** slots = calloc(num_slots, sizeof(Pattern*));
+    if (!ctrl || !slots) {
+        free(ctrl);
+        free(slots);
+        return 0;
+    }
+    
+    memset(ctrl, PATTERN_CTRL_EMPTY, num_slots + PATTERN_GROUP_SIZE);
+    store->ctrl = ctrl;
+    store->slots = slots;
+    store->num_slots = num_slots;
+    return 1;
+}
+
+PatternStore* pattern_store_create(uint32_t initial_slots) {
+    PatternStore* store = calloc(1, sizeof(PatternStore));
+    if (!store) return NULL;
+    
+    uint32_t num_slots = PATTERN_GROUP_SIZE;
+    while (num_slots < initial_slots && num_slots < (1u << 31)) {
+        num_slots <<= 1;
+    }
+    
+    store->arena = arena_create(ARENA_DEFAULT_BLOCK_SIZE);
+    if (!store->arena || !allocate_slots(store, num_slots)) {
+        arena_destroy(store->arena);
+        free(store);
+        return NULL;
+    }
+    
+    return store;
+}
+
+void pattern_store_destroy(PatternStore* store) {
+    if (!store) return;
+    
+    arena_destroy(store->arena);
+    free(store->ctrl);
+    free(store->slots);
+    free(store);
+}
+
+// Drop every pattern but keep the slot arrays for the next generation
+void pattern_store_clear(PatternStore* store) {
+    if (!store) return;
+    
+    arena_reset(store->arena);
+    memset(store->ctrl, PATTERN_CTRL_EMPTY, store->num_slots + PATTERN_GROUP_SIZE);
+    memset(store->slots, 0, store->num_slots * sizeof(Pattern*));
+    store->num_patterns = 0;
+    store->pattern_bytes = 0;
+    store->displaced = 0;
+}
+
+// hash64 step over one token ID. The running state of a context is
+// extended one token at a time, so every prefix of a context is hashed in
+// the same pass.
+uint64_t pattern_hash_extend(uint64_t state, uint32_t token) {
+    return hash64_token(state, token);
+}
+
+// Fold a running state to the 32 bits kept with each pattern. Every state
+// bit already depends on every token, so the low bits index the table and
+// the high bits are the fingerprint.
+uint32_t pattern_hash_finish(uint64_t state) {
+    return (uint32_t)(state ^ (state >> 32));
+}
+
+uint32_t pattern_store_hash(const uint32_t* context, int context_length) {
+    uint64_t state = PATTERN_HASH_SEED;
+    for (int i = 0; i < context_length; i++) {
+        state = pattern_hash_extend(state, context[i]);
+    }
+    return pattern_hash_finish(state);
+}
+
+int pattern_context_matches(const Pattern* pattern, const uint32_t* context, int context_length) {
+    if (pattern->context_length != context_length) return 0;
+    return memcmp(pattern->context, context, context_length * sizeof(uint32_t)) == 0;
+}
+
+// First free slot on the probe sequence for hash
+static uint32_t find_free_slot(const PatternStore* store, uint32_t hash) {
+    uint32_t mask = store->num_slots - 1;
+    uint32_t pos = hash & mask;
+    
+    for (;;) {
+        uint32_t empty = group_match(&store->ctrl[pos], PATTERN_CTRL_EMPTY);
+        if (empty) {
+            return (pos + __builtin_ctz(empty)) & mask;
+        }
+        pos = (pos + PATTERN_GROUP_SIZE) & mask;
+    }
+}
+
+static void place_pattern(PatternStore* store, Pattern* pattern) {
+    uint32_t slot = find_free_slot(store, pattern->hash);
+    if (slot != (pattern->hash & (store->num_slots - 1))) {
+        store->displaced++;
+    }
+    
+    set_ctrl(store, slot, fingerprint(pattern->hash));
+    store->slots[slot] = pattern;
+}
+
+// Double the slot count and reinsert every pattern from its stored hash
+static int grow(PatternStore* store) {
+    uint8_t* old_ctrl = store->ctrl;
+    Pattern** old_slots = store->slots;
+    uint32_t old_num_slots = store->num_slots;
+    
+    if (old_num_slots >= (1u << 31) || !allocate_slots(store, old_num_slots * 2)) {
+        return 0;
+    }
+    
+    store->displaced = 0;
+    for (uint32_t i = 0; i < old_num_slots; i++) {
+        if (old_slots[i]) place_pattern(store, old_slots[i]);
+    }
+    
+    free(old_ctrl);
+    free(old_slots);
+    return 1;
+}
+
+Pattern* pattern_store_find(PatternStore* store, const uint32_t* context, int context_length, uint32_t next) {
+    return pattern_store_find_hashed(store, context, context_length,
+                                     pattern_store_hash(context, context_length), next);
+}
+
+Pattern* pattern_store_find_hashed(PatternStore* store, const uint32_t* context, int context_length,
+                                   uint32_t hash, uint32_t next) {
+    PatternIter iter;
+    for (Pattern* p = pattern_store_first_hashed(store, context, context_length, hash, &iter); p;
+         p = pattern_store_next(&iter)) {
+        if (p->next == next) return p;
+    }
+    return NULL;
+}
+
+Pattern* pattern_store_insert(PatternStore* store, const uint32_t* context, int context_length, uint32_t next) {
+    return pattern_store_insert_hashed(store, context, context_length,
+                                       pattern_store_hash(context, context_length), next);
+}
+
+// hash must be pattern_store_hash of the context
+Pattern* pattern_store_insert_hashed(PatternStore* store, const uint32_t* context, int context_length,
+                                     uint32_t hash, uint32_t next) {
+    if (context_length < 1 || context_length > PATTERN_MAX_CONTEXT) return NULL;
+    
+    if ((store->num_patterns + 1) * PATTERN_MAX_LOAD_DEN > (size_t)store->num_slots * PATTERN_MAX_LOAD_NUM) {
+        if (!grow(store)) {
+            printf("Failed to grow pattern store\n");
+            return NULL;
+        }
+    }
+    
+    size_t size = sizeof(Pattern) + context_length * sizeof(uint32_t);
+    Pattern* pattern = arena_alloc(store->arena, size);
+    if (!pattern) {
+        printf("Failed to allocate pattern\n");
+        return NULL;
+    }
+    
+    memcpy(pattern->context, context, context_length * sizeof(uint32_t));
+    pattern->context_length = (uint16_t)context_length;
+    pattern->hash = hash;
+    pattern->next = next;
+    pattern->count = 1;
+    
+    place_pattern(store, pattern);
+    
+    store->num_patterns++;
+    store->pattern_bytes += size;
+    return pattern;
+}
+
+static void load_group(PatternIter* iter) {
+    const uint8_t* group = &iter->store->ctrl[iter->pos];
+    iter->matches = group_match(group, fingerprint(iter->hash));
+    iter->last_group = group_match(group, PATTERN_CTRL_EMPTY) != 0;
+}
+
+// Advance to the next slot on the probe sequence whose pattern has the context
+static Pattern* seek_match(PatternIter* iter) {
+    const PatternStore* store = iter->store;
+    uint32_t mask = store->num_slots - 1;
+    
+    for (;;) {
+        while (iter->matches) {
+            uint32_t slot = (iter->pos + __builtin_ctz(iter->matches)) & mask;
+            iter->matches &= iter->matches - 1;
+            
+            Pattern* p = store->slots[slot];
+            if (p->hash == iter->hash && pattern_context_matches(p, iter->context, iter->context_length)) {
+                return iter->current = p;
+            }
+        }
+        
+        if (iter->last_group || ++iter->probes >= store->num_slots / PATTERN_GROUP_SIZE) {
+            return iter->current = NULL;
+        }
+        iter->pos = (iter->pos + PATTERN_GROUP_SIZE) & mask;
+        load_group(iter);
+    }
+}
+
+Pattern* pattern_store_first(PatternStore* store, const uint32_t* context, int context_length, PatternIter* iter) {
+    return pattern_store_first_hashed(store, context, context_length,
+                                      pattern_store_hash(context, context_length), iter);
+}
+
+Pattern* pattern_store_first_hashed(PatternStore* store, const uint32_t* context, int context_length,
+                                    uint32_t hash, PatternIter* iter) {
+    iter->store = store;
+    iter->context = context;
+    iter->context_length = context_length;
+    iter->hash = hash;
+    iter->pos = iter->hash & (store->num_slots - 1);
+    iter->probes = 0;
+    
+    load_group(iter);
+    return seek_match(iter);
+}
+
+Pattern* pattern_store_next(PatternIter* iter) {
+    if (!iter->current) return NULL;
+    return seek_match(iter);
+}
+
+void pattern_store_foreach(PatternStore* store, PatternVisitor visitor, void* user_data) {
+    for (uint32_t i = 0; i < store->num_slots; i++) {
+        if (store->slots[i]) visitor(store->slots[i], user_data);
+    }
+}
+
+size_t pattern_store_memory_usage(const PatternStore* store) {
+    if (!store) return 0;
+    return sizeof(PatternStore) +
+           store->num_slots * sizeof(Pattern*) +
+           store->num_slots + PATTERN_GROUP_SIZE +
+           sizeof(Arena) + store->arena->bytes_reserved;
+}
+
+double pattern_store_load_factor(const PatternStore* store) {
+    if (!store || store->num_slots == 0) return 0.0;
+    return (double)store->num_patterns / store->num_slots;
+}
@@ -0,0 +1,97 @@
+#ifndef PATTERN_STORE_H
+#define PATTERN_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "arena.h"
+#include "hash64.h"
+
+// Longest context a pattern can hold
+#define PATTERN_MAX_CONTEXT 100
+
+// Slots probed together; one control byte per slot
+#define PATTERN_GROUP_SIZE 16
+
+// Starting size for stores that grow on demand
+#define PATTERN_STORE_DEFAULT_SLOTS 1024
+
+// Control byte of a free slot. Used slots hold a 7-bit hash fingerprint.
+#define PATTERN_CTRL_EMPTY 0x80
+
+// N-gram pattern over interned token IDs. The context is stored inline with
+// exactly context_length entries instead of a fixed word matrix.
+typedef struct Pattern {
+    uint32_t hash;               // Hash of the context, kept for probing and growth
+    uint32_t next;               // ID of the word that followed the context
+    uint32_t count;
+    uint16_t context_length;
+    uint32_t context[];          // Context token IDs
+} Pattern;
+
+// Open-addressing pattern store in the Swiss-table style. A control byte
+// array holds a fingerprint per slot so a whole group of slots is checked
+// with one compare before any Pattern is touched. Patterns with the same
+// context share a probe sequence, so all continuations of a context are
+// found by scanning it until a group with a free slot.
+typedef struct {
+    uint8_t* ctrl;               // num_slots + PATTERN_GROUP_SIZE bytes; tail mirrors the head
+    Pattern** slots;
+    uint32_t num_slots;          // Power of two
+    size_t num_patterns;
+    size_t pattern_bytes;        // Bytes held by Pattern nodes
+    size_t displaced;            // Patterns stored away from their home slot
+    Arena* arena;                // Owns every Pattern node
+} PatternStore;
+
+// Iterator over the patterns that share one context
+typedef struct {
+    const PatternStore* store;
+    const uint32_t* context;
+    int context_length;
+    uint32_t hash;
+    uint32_t pos;                // Start of the group being scanned
+    uint32_t probes;             // Groups scanned so far
+    uint32_t matches;            // Fingerprint hits left in this group
+    int last_group;              // Group has a free slot, so the sequence ends here
+    Pattern* current;
+} PatternIter;
+
+// Lifecycle. Destroying or clearing a store releases all of its patterns
+// at once.
+PatternStore* pattern_store_create(uint32_t initial_slots);
+void pattern_store_destroy(PatternStore* store);
+void pattern_store_clear(PatternStore* store);
+
+// Hashing. A context hash is a 64-bit running state extended from
+// PATTERN_HASH_SEED one token at a time and then finished, so callers that
+// need every length of a context can hash them incrementally and pass the
+// result to the _hashed variants below.
+#define PATTERN_HASH_SEED HASH64_SEED
+uint64_t pattern_hash_extend(uint64_t state, uint32_t token);
+uint32_t pattern_hash_finish(uint64_t state);
+uint32_t pattern_store_hash(const uint32_t* context, int context_length);
+
+// Insertion and exact lookup
+Pattern* pattern_store_find(PatternStore* store, const uint32_t* context, int context_length, uint32_t next);
+Pattern* pattern_store_insert(PatternStore* store, const uint32_t* context, int context_length, uint32_t next);
+Pattern* pattern_store_find_hashed(PatternStore* store, const uint32_t* context, int context_length,
+                                   uint32_t hash, uint32_t next);
+Pattern* pattern_store_insert_hashed(PatternStore* store, const uint32_t* context, int context_length,
+                                     uint32_t hash, uint32_t next);
+
+// Iterate all continuations of a context
+Pattern* pattern_store_first(PatternStore* store, const uint32_t* context, int context_length, PatternIter* iter);
+Pattern* pattern_store_first_hashed(PatternStore* store, const uint32_t* context, int context_length,
+                                    uint32_t hash, PatternIter* iter);
+Pattern* pattern_store_next(PatternIter* iter);
+
+// Iterate every pattern in the store
+typedef void (*PatternVisitor)(Pattern* pattern, void* user_data);
+void pattern_store_foreach(PatternStore* store, PatternVisitor visitor, void* user_data);
+
+// Helpers
+int pattern_context_matches(const Pattern* pattern, const uint32_t* context, int context_length);
+size_t pattern_store_memory_usage(const PatternStore* store);
+double pattern_store_load_factor(const PatternStore* store);
+
+#endif // PATTERN_STORE_H
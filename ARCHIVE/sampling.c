@@ -0,0 +1,120 @@
+#include "sampling.h"
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// The state words come from splitmix64, which never yields the all-zero
+// state xoshiro cannot leave
+void rng_seed(Rng* rng, uint64_t seed, uint64_t stream) {
+    uint64_t state = seed;
+    uint64_t key = splitmix64(&state) ^ stream;
+    state = key;
+    for (int i = 0; i < 4; i++) {
+        rng->s[i] = splitmix64(&state);
+    }
+}
+
+uint64_t rng_entropy_seed(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t state = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    state ^= (uint64_t)getpid() << 32;
+    return splitmix64(&state);
+}
+
+uint64_t rng_next(Rng* rng) {
+    uint64_t* s = rng->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+double rng_uniform(Rng* rng) {
+    return (rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+// Multiply-shift; the bias for n far below 2^32 is negligible
+uint32_t rng_below(Rng* rng, uint32_t n) {
+    return (uint32_t)(((rng_next(rng) >> 32) * n) >> 32);
+}
+
+// Vose's construction: columns scaled to an average of 1 are paired off,
+// each short column topped up from a long one
+int alias_build(AliasTable* table, const float* weights, uint32_t n) {
+    if (n == 0 || n > SAMPLING_MAX_OUTCOMES) return 0;
+    
+    double total = 0;
+    uint32_t heaviest = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (weights[i] > 0) total += weights[i];
+        if (weights[i] > weights[heaviest]) heaviest = i;
+    }
+    if (total <= 0) return 0;
+    
+    double scaled[SAMPLING_MAX_OUTCOMES];
+    uint32_t small[SAMPLING_MAX_OUTCOMES], large[SAMPLING_MAX_OUTCOMES];
+    uint32_t num_small = 0, num_large = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        scaled[i] = weights[i] > 0 ? weights[i] * n / total : 0;
+        if (scaled[i] < 1.0) {
+            small[num_small++] = i;
+        } else {
+            large[num_large++] = i;
+        }
+    }
+    
+    while (num_small > 0 && num_large > 0) {
+        uint32_t s = small[--num_small];
+        uint32_t l = large[num_large - 1];
+        table->prob[s] = (float)scaled[s];
+        table->alias[s] = l;
+        
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0) {
+            num_large--;
+            small[num_small++] = l;
+        }
+    }
+    
+    // What is left is 1 up to rounding. A weightless column left over by
+    // rounding still hands its share to a real outcome.
+    while (num_large > 0) {
+        uint32_t l = large[--num_large];
+        table->prob[l] = 1.0f;
+        table->alias[l] = l;
+    }
+    while (num_small > 0) {
+        uint32_t s = small[--num_small];
+        table->prob[s] = weights[s] > 0 ? 1.0f : 0.0f;
+        table->alias[s] = weights[s] > 0 ? s : heaviest;
+    }
+    
+    table->size = n;
+    return 1;
+}
+
+// One draw picks the column from its high half and the coin from 24 low
+// bits, all a float holds exactly
+uint32_t alias_sample(const AliasTable* table, Rng* rng) {
+    uint64_t r = rng_next(rng);
+    uint32_t column = (uint32_t)(((r >> 32) * table->size) >> 32);
+    float coin = (uint32_t)(r & 0xffffff) * 0x1.0p-24f;
+    return coin < table->prob[column] ? column : table->alias[column];
+}
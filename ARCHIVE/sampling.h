@@ -0,0 +1,35 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <stdint.h>
+
+// Most outcomes an alias table can hold
+#define SAMPLING_MAX_OUTCOMES 128
+
+// xoshiro256** generator. Each reply seeds its own from a run seed and the
+// reply's number, so replies never share state across threads and any one
+// of them can be replayed from the seed alone.
+typedef struct {
+    uint64_t s[4];
+} Rng;
+
+void rng_seed(Rng* rng, uint64_t seed, uint64_t stream);
+uint64_t rng_entropy_seed(void);     // Clock and process ID, for unseeded runs
+uint64_t rng_next(Rng* rng);
+double rng_uniform(Rng* rng);        // [0, 1)
+uint32_t rng_below(Rng* rng, uint32_t n);
+
+// Walker alias table: O(n) to build over a set of weights, then each
+// sample is one draw and one comparison however many outcomes there are.
+// Outcomes of weight zero are never drawn.
+typedef struct {
+    uint32_t size;
+    float prob[SAMPLING_MAX_OUTCOMES];      // Chance of keeping a column's own outcome
+    uint32_t alias[SAMPLING_MAX_OUTCOMES];  // Outcome taken otherwise
+} AliasTable;
+
+// Returns 0 when there are no outcomes, too many, or no positive weight
+int alias_build(AliasTable* table, const float* weights, uint32_t n);
+uint32_t alias_sample(const AliasTable* table, Rng* rng);
+
+#endif // SAMPLING_H
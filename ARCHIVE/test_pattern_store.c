@@ -0,0 +1,1131 @@
+#include <stdio.h>
+#include <string.h>
+#include "arena.h"
+#include "vocabulary.h"
+#include "pattern_store.h"
+#include "count_min.h"
+#include "context_tree.h"
+#include "beam_search.h"
+#include "sampling.h"
+#include "tokenizer.h"
+#include "parallel_training.h"
+#include "model_snapshot.h"
+#include "training_journal.h"
+#include "packed_model.h"
+#include "batch_inference.h"
+#include "model_swap.h"
+#include <pthread.h>
+#include <unistd.h>
+
+// Test counters
+static int tests_run = 0;
+static int tests_passed = 0;
+
+// Test macro
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    tests_run++; \
+    if (test_func()) { \
+        tests_passed++; \
+        printf("  ✓ Passed\n\n"); \
+    } else { \
+        printf("  ✗ Failed\n\n"); \
+    } \
+} while(0)
+
+// Test spans against strtok on a line far longer than the old 1KB buffer,
+// with tokens at every alignment of the 16-byte scan
+int test_tokenizer_spans() {
+    char line[4096] = "";
+    const char* pieces[] = {"Alpha", " ", "b", ",", "GAMMA", "!? ", "delta", "\t", "e", "\r\n", "zeta-x", ": "};
+    for (int i = 0; strlen(line) < 3000; i++) {
+        strcat(line, pieces[i % 12]);
+        if (i % 7 == 0) strcat(line, "  ");
+    }
+    
+    char copy[4096];
+    strcpy(copy, line);
+    TokenSpan spans[2048];
+    int count = tokenize_spans(line, strlen(line), spans, 2048);
+    
+    int success = 1;
+    int expected = 0;
+    for (char* t = strtok(copy, TOKEN_DELIMITERS); t; t = strtok(NULL, TOKEN_DELIMITERS)) {
+        if (expected >= count || spans[expected].start != (size_t)(t - copy) ||
+            spans[expected].length != strlen(t)) {
+            success = 0;
+        }
+        expected++;
+    }
+    
+    // Case-folded interning matches interning the lowercase word
+    Vocabulary* vocab = vocab_create();
+    uint32_t ids[8];
+    int words = tokenize_intern(vocab, "The THE tHe. Zeta-X", 19, ids, 8);
+    uint32_t lookups[8];
+    int known = tokenize_lookup(vocab, "the unseen", 10, lookups, 8);
+    
+    printf("  %d tokens over %zu bytes (strtok %d), %u words interned\n",
+           count, strlen(line), expected, vocab_size(vocab));
+    
+    success = success && count == expected && count > 400 &&
+              words == 4 && ids[0] == ids[1] && ids[1] == ids[2] &&
+              vocab_lookup(vocab, "zeta-x") == ids[3] && vocab_intern(vocab, "the") == ids[0] &&
+              known == 2 && lookups[0] == ids[0] && lookups[1] == VOCAB_NONE;
+    
+    vocab_destroy(vocab);
+    return success;
+}
+
+// Test bump allocation, slab reuse and bulk reset
+int test_arena() {
+    Arena* arena = arena_create(1024);
+    if (!arena) return 0;
+    
+    char* a = arena_strdup(arena, "alpha");
+    uint32_t* b = arena_alloc(arena, 3 * sizeof(uint32_t));
+    void* big = arena_alloc(arena, 4096);
+    int aligned = ((uintptr_t)b % 8 == 0) && big != NULL;
+    
+    void* slab = arena_alloc_slab(arena, 48);
+    arena_free_slab(arena, slab, 48);
+    void* reused = arena_alloc_slab(arena, 64);
+    
+    printf("  %zu blocks, %zu bytes reserved, %zu used\n",
+           arena->num_blocks, arena->bytes_reserved, arena->bytes_used);
+    
+    int success = (aligned && strcmp(a, "alpha") == 0 && reused == slab &&
+                   arena->num_blocks == 2);
+    
+    arena_reset(arena);
+    success = success && arena->num_blocks == 0 && arena->bytes_reserved == 0 &&
+              arena_alloc(arena, 16) != NULL;
+    
+    arena_destroy(arena);
+    return success;
+}
+
+// Test that interning is stable and dense
+int test_vocab_interning() {
+    Vocabulary* vocab = vocab_create();
+    if (!vocab) return 0;
+    
+    uint32_t the = vocab_intern(vocab, "the");
+    uint32_t cat = vocab_intern(vocab, "cat");
+    uint32_t the_again = vocab_intern(vocab, "the");
+    
+    printf("  the=%u cat=%u size=%u\n", the, cat, vocab_size(vocab));
+    
+    int success = (the == 0 && cat == 1 && the_again == the &&
+                   vocab_size(vocab) == 2 &&
+                   strcmp(vocab_word(vocab, cat), "cat") == 0 &&
+                   vocab_lookup(vocab, "dog") == VOCAB_NONE);
+    
+    vocab_destroy(vocab);
+    return success;
+}
+
+// Test that the vocabulary index survives growth
+int test_vocab_growth() {
+    Vocabulary* vocab = vocab_create();
+    char word[32];
+    
+    for (int i = 0; i < 20000; i++) {
+        snprintf(word, sizeof(word), "word%d", i);
+        if (vocab_intern(vocab, word) != (uint32_t)i) {
+            vocab_destroy(vocab);
+            return 0;
+        }
+    }
+    
+    int success = 1;
+    for (int i = 0; i < 20000; i += 997) {
+        snprintf(word, sizeof(word), "word%d", i);
+        if (vocab_lookup(vocab, word) != (uint32_t)i) success = 0;
+    }
+    
+    printf("  %u words, %zu bytes\n", vocab_size(vocab), vocab_memory_usage(vocab));
+    vocab_destroy(vocab);
+    return success;
+}
+
+// Test insert, exact find and iteration over one context
+int test_store_continuations() {
+    PatternStore* store = pattern_store_create(1024);
+    if (!store) return 0;
+    
+    uint32_t ctx[] = {4, 7};
+    uint32_t other[] = {7, 4};
+    
+    pattern_store_insert(store, ctx, 2, 10);
+    pattern_store_insert(store, ctx, 2, 11);
+    pattern_store_insert(store, other, 2, 12);
+    pattern_store_insert(store, ctx, 1, 13);
+    
+    Pattern* p = pattern_store_find(store, ctx, 2, 11);
+    int found = (p && p->next == 11 && p->count == 1);
+    
+    int continuations = 0;
+    PatternIter iter;
+    for (Pattern* q = pattern_store_first(store, ctx, 2, &iter); q; q = pattern_store_next(&iter)) {
+        if (q->next != 10 && q->next != 11) found = 0;
+        continuations++;
+    }
+    
+    printf("  %zu patterns, %d continuations of [4 7]\n", store->num_patterns, continuations);
+    
+    int success = (found && continuations == 2 && store->num_patterns == 4 &&
+                   pattern_store_find(store, other, 2, 10) == NULL);
+    
+    pattern_store_destroy(store);
+    return success;
+}
+
+// Test that incremental hashing matches the full hash at every length and
+// that the _hashed variants find what the plain calls stored
+int test_store_running_hash() {
+    PatternStore* store = pattern_store_create(64);
+    if (!store) return 0;
+    
+    uint32_t ctx[] = {3, 1, 4, 1, 5, 9, 2, 6};
+    int length = sizeof(ctx) / sizeof(ctx[0]);
+    int success = 1;
+    
+    uint64_t state = PATTERN_HASH_SEED;
+    for (int len = 1; len <= length; len++) {
+        state = pattern_hash_extend(state, ctx[len - 1]);
+        uint32_t hash = pattern_hash_finish(state);
+        if (hash != pattern_store_hash(ctx, len)) success = 0;
+        
+        pattern_store_insert(store, ctx, len, 100 + len);
+        Pattern* p = pattern_store_find_hashed(store, ctx, len, hash, 100 + len);
+        if (!p || p->hash != hash) success = 0;
+        
+        PatternIter iter;
+        if (!pattern_store_first_hashed(store, ctx, len, hash, &iter)) success = 0;
+    }
+    
+    printf("  %d context lengths hashed in one pass\n", length);
+    
+    success = success && pattern_store_insert_hashed(store, ctx, 2, pattern_store_hash(ctx, 2), 7) &&
+              pattern_store_find(store, ctx, 2, 7) != NULL;
+    
+    pattern_store_destroy(store);
+    return success;
+}
+
+// Test that patterns stay reachable as the table grows
+int test_store_growth() {
+    PatternStore* store = pattern_store_create(16);
+    if (!store) return 0;
+    
+    // One context with many continuations plus many distinct contexts
+    uint32_t shared[] = {1, 2};
+    for (uint32_t next = 0; next < 200; next++) {
+        pattern_store_insert(store, shared, 2, next);
+    }
+    for (uint32_t i = 0; i < 5000; i++) {
+        uint32_t ctx[] = {i, i + 1, i + 2};
+        pattern_store_insert(store, ctx, 3, i);
+    }
+    
+    int success = 1;
+    int continuations = 0;
+    PatternIter iter;
+    for (Pattern* p = pattern_store_first(store, shared, 2, &iter); p; p = pattern_store_next(&iter)) {
+        continuations++;
+    }
+    for (uint32_t i = 0; i < 5000; i += 7) {
+        uint32_t ctx[] = {i, i + 1, i + 2};
+        Pattern* p = pattern_store_find(store, ctx, 3, i);
+        if (!p || p->next != i) success = 0;
+    }
+    uint32_t missing[] = {9, 9, 9};
+    
+    printf("  %zu patterns in %u slots (load %.2f), %d continuations of [1 2]\n",
+           store->num_patterns, store->num_slots, pattern_store_load_factor(store), continuations);
+    
+    success = success && continuations == 200 &&
+              pattern_store_load_factor(store) <= 0.75 &&
+              pattern_store_first(store, missing, 3, &iter) == NULL;
+    
+    // Clearing drops every pattern in one step and leaves the store usable
+    pattern_store_clear(store);
+    success = success && store->num_patterns == 0 &&
+              pattern_store_first(store, shared, 2, &iter) == NULL &&
+              pattern_store_insert(store, shared, 2, 1) != NULL;
+    
+    pattern_store_destroy(store);
+    return success;
+}
+
+// Test that patterns are sized by context length
+int test_store_memory() {
+    PatternStore* store = pattern_store_create(64);
+    uint32_t ctx[PATTERN_MAX_CONTEXT] = {0};
+    
+    pattern_store_insert(store, ctx, 1, 1);
+    size_t short_bytes = store->pattern_bytes;
+    pattern_store_insert(store, ctx, PATTERN_MAX_CONTEXT, 1);
+    size_t long_bytes = store->pattern_bytes - short_bytes;
+    
+    printf("  1-token pattern: %zu bytes, %d-token pattern: %zu bytes\n",
+           short_bytes, PATTERN_MAX_CONTEXT, long_bytes);
+    
+    int success = (short_bytes < 64 && long_bytes < short_bytes + PATTERN_MAX_CONTEXT * sizeof(uint32_t) + 8 &&
+                   pattern_store_insert(store, ctx, PATTERN_MAX_CONTEXT + 1, 1) == NULL);
+    
+    pattern_store_destroy(store);
+    return success;
+}
+
+// Test that single-pass ingest counts the same patterns as the sliding window
+int test_tree_ingest() {
+    ContextTree* tree = context_tree_create(3);
+    PatternStore* store = pattern_store_create(1024);
+    if (!tree || !store) return 0;
+    
+    uint32_t tokens[] = {1, 2, 3, 1, 2, 4, 1, 2, 3, 5};
+    int n = sizeof(tokens) / sizeof(tokens[0]);
+    
+    context_tree_ingest(tree, tokens, n, 1);
+    for (int len = 1; len <= 3; len++) {
+        for (int start = 0; start + len < n; start++) {
+            Pattern* p = pattern_store_find(store, tokens + start, len, tokens[start + len]);
+            if (p) {
+                p->count++;
+            } else {
+                pattern_store_insert(store, tokens + start, len, tokens[start + len]);
+            }
+        }
+    }
+    
+    int success = (tree->num_patterns == store->num_patterns);
+    for (int len = 1; len <= 3; len++) {
+        for (int start = 0; start + len < n; start++) {
+            Pattern* p = pattern_store_find(store, tokens + start, len, tokens[start + len]);
+            const ContextNode* nodes[4];
+            if (context_tree_match(tree, tokens + start, len, nodes) != len) {
+                success = 0;
+                continue;
+            }
+            const Continuation* c = context_node_find(nodes[len], p->next);
+            if (!c || c->count != p->count) success = 0;
+        }
+    }
+    
+    printf("  %zu patterns in tree, %zu in store, %zu nodes\n",
+           tree->num_patterns, store->num_patterns, tree->num_nodes);
+    
+    context_tree_destroy(tree);
+    pattern_store_destroy(store);
+    return success;
+}
+
+// Test that one match returns every backoff length
+int test_tree_match() {
+    ContextTree* tree = context_tree_create(4);
+    if (!tree) return 0;
+    
+    uint32_t ctx[] = {7, 8, 9};
+    context_tree_add(tree, ctx, 3, 20, 2);
+    context_tree_add(tree, ctx + 1, 2, 21, 1);
+    context_tree_add(tree, ctx + 2, 1, 22, 1);
+    context_tree_add(tree, ctx + 2, 1, 23, 1);
+    
+    // Unseen leading token stops the walk after the known suffix
+    uint32_t query[] = {6, 8, 9};
+    const ContextNode* nodes[5];
+    int depth = context_tree_match(tree, query, 3, nodes);
+    int full = context_tree_match(tree, ctx, 3, nodes);
+    
+    printf("  depth %d for [6 8 9], %d for [7 8 9]\n", depth, full);
+    
+    int success = (depth == 2 && full == 3 &&
+                   nodes[1]->num_continuations == 2 &&
+                   nodes[2]->continuations[0].next == 21 &&
+                   context_node_find(nodes[3], 20)->count == 2 &&
+                   context_tree_add(tree, query, 5, 1, 1) < 0);
+    
+    context_tree_destroy(tree);
+    return success;
+}
+
+// Test that frozen contexts rank words by count and re-rank after adds
+int test_tree_freeze() {
+    ContextTree* tree = context_tree_create(3);
+    if (!tree) return 0;
+    
+    uint32_t ctx[] = {4, 5};
+    context_tree_add(tree, ctx, 2, 30, 1);
+    context_tree_add(tree, ctx, 2, 10, 5);
+    context_tree_add(tree, ctx, 2, 20, 5);
+    context_tree_add(tree, ctx + 1, 1, 40, 2);
+    
+    size_t ranked = context_tree_freeze(tree);
+    const ContextNode* nodes[4];
+    context_tree_match(tree, ctx, 2, nodes);
+    const Continuation* r = context_tree_ranked(tree, nodes[2]);
+    
+    // Ties keep ID order; the ranking is a copy, not the sorted array
+    int success = ranked == 2 && tree->num_ranked == 2 &&
+                  r[0].next == 10 && r[1].next == 20 && r[2].next == 30 &&
+                  nodes[2]->continuations[2].next == 30 && context_tree_freeze(tree) == 0;
+    
+    // Adding drops the ranking; the next read rebuilds it
+    context_tree_add(tree, ctx, 2, 30, 9);
+    success = success && tree->num_ranked == 1;
+    r = context_tree_ranked(tree, nodes[2]);
+    
+    printf("  ranked %zu contexts, top word after update %u\n", ranked, r[0].next);
+    
+    success = success && r[0].next == 30 && r[0].count == 10 && tree->num_ranked == 2;
+    
+    context_tree_destroy(tree);
+    return success;
+}
+
+// Test that pruning drops only rare deep patterns and nodes left empty
+int test_tree_prune() {
+    ContextTree* tree = context_tree_create(4);
+    if (!tree) return 0;
+    
+    // A repeated phrase plus a tail of one-off words
+    uint32_t tokens[64];
+    int n = 0;
+    for (int r = 0; r < 3; r++) {
+        uint32_t phrase[] = {1, 2, 3, 4, 5};
+        memcpy(tokens + n, phrase, sizeof(phrase));
+        n += 5;
+    }
+    for (uint32_t t = 100; n < 64; t++) tokens[n++] = t;
+    context_tree_ingest(tree, tokens, n, 1);
+    
+    ContextTree* pruned = context_tree_prune(tree, 2, 3);
+    if (!pruned) {
+        context_tree_destroy(tree);
+        return 0;
+    }
+    
+    // Short contexts keep every pattern; deep ones keep only the phrase
+    int success = pruned->num_patterns < tree->num_patterns &&
+                  pruned->num_nodes < tree->num_nodes &&
+                  pruned->node_bytes < tree->node_bytes;
+    for (int d = 1; d < 3; d++) {
+        if (pruned->patterns_by_length[d] != tree->patterns_by_length[d]) success = 0;
+    }
+    
+    const ContextNode* nodes[5];
+    uint32_t phrase_context[] = {1, 2, 3};
+    success = success && context_tree_match(pruned, phrase_context, 3, nodes) == 3 &&
+              context_node_find(nodes[3], 4) && context_node_find(nodes[3], 4)->count == 3;
+    
+    uint32_t tail_context[] = {100, 101, 102};
+    success = success && context_tree_match(pruned, tail_context, 3, nodes) < 3 &&
+              context_tree_match(pruned, tail_context + 1, 2, nodes) == 2 &&
+              context_node_find(nodes[2], 103) != NULL;
+    
+    printf("  %zu -> %zu patterns, %zu -> %zu nodes\n",
+           tree->num_patterns, pruned->num_patterns, tree->num_nodes, pruned->num_nodes);
+    
+    context_tree_destroy(pruned);
+    context_tree_destroy(tree);
+    return success;
+}
+
+// Test that sketched patterns enter the tree only once seen twice, with
+// the count they had in the sketch
+int test_tree_admission() {
+    ContextTree* tree = context_tree_create(4);
+    CountMinSketch* sketch = count_min_create(64 * 1024);
+    if (!tree || !sketch) return 0;
+    
+    ContextAdmission admission = {sketch, 3, 2};
+    uint32_t once[] = {7, 8, 9, 10, 11};
+    uint32_t twice[] = {1, 2, 3, 4, 5};
+    context_tree_ingest_admitted(tree, once, 5, 1, &admission);
+    context_tree_ingest_admitted(tree, twice, 5, 1, &admission);
+    size_t after_one = tree->patterns_by_length[3];
+    context_tree_ingest_admitted(tree, twice, 5, 1, &admission);
+    context_tree_ingest_admitted(tree, twice, 5, 1, &admission);
+    
+    const ContextNode* nodes[5];
+    uint32_t seen_once[] = {8, 9, 10};
+    uint32_t seen_thrice[] = {2, 3, 4};
+    int success = after_one == 0 && tree->patterns_by_length[2] == 6 &&
+                  context_tree_match(tree, seen_once, 3, nodes) < 3 &&
+                  context_tree_match(tree, seen_thrice, 3, nodes) == 3 &&
+                  context_node_find(nodes[3], 5) && context_node_find(nodes[3], 5)->count == 3 &&
+                  count_min_estimate(sketch, 12345) == 0;
+    
+    printf("  %zu 3-token patterns admitted, %llu counts sketched\n",
+           tree->patterns_by_length[3], (unsigned long long)sketch->total);
+    
+    count_min_destroy(sketch);
+    context_tree_destroy(tree);
+    return success;
+}
+
+// Test batched matching against single walks, and that a wider beam never
+// returns a worse response per word than greedy search
+int test_beam_search() {
+    ContextTree* tree = context_tree_create(4);
+    if (!tree) return 0;
+    
+    // After [1 2], 3 is most frequent but leads into a branching tail;
+    // 4 is rarer but always continues the same way
+    uint32_t lines[][6] = {
+        {1, 2, 3, 5, 7}, {1, 2, 3, 6, 8}, {1, 2, 3, 9, 10},
+        {1, 2, 4, 11, 12, 13}, {1, 2, 4, 11, 12, 13}
+    };
+    int line_lengths[] = {5, 5, 5, 6, 6};
+    for (int l = 0; l < 5; l++) {
+        context_tree_ingest(tree, lines[l], line_lengths[l], 2);
+    }
+    
+    const uint32_t* contexts[3];
+    int lengths[3] = {2, 3, 1};
+    uint32_t a[] = {1, 2}, b[] = {2, 4, 11}, c[] = {99};
+    contexts[0] = a;
+    contexts[1] = b;
+    contexts[2] = c;
+    const ContextNode* batch[3 * 5];
+    int depths[3];
+    context_tree_match_batch(tree, contexts, lengths, 3, batch, depths);
+    
+    int success = 1;
+    for (int i = 0; i < 3; i++) {
+        const ContextNode* single[5];
+        int depth = context_tree_match(tree, contexts[i], lengths[i], single);
+        if (depth != depths[i] || single[depth] != batch[i * 5 + depth]) success = 0;
+    }
+    
+    uint32_t greedy_words[8], beam_words[8];
+    BeamConfig greedy_config = {1, 8, 2};
+    BeamConfig beam_config = {4, 8, 2};
+    BeamSearch* greedy = beam_search_create(&greedy_config, 4);
+    BeamSearch* beam = beam_search_create(&beam_config, 4);
+    if (!greedy || !beam) return 0;
+    
+    int greedy_length = beam_search_run(greedy, tree, a, 2, greedy_words);
+    int beam_length = beam_search_run(beam, tree, a, 2, beam_words);
+    
+    printf("  greedy: %d words, %.3f per word; beam 4: %d words, %.3f per word\n",
+           greedy_length, greedy->best_score / greedy_length, beam_length, beam->best_score / beam_length);
+    
+    success = success && greedy_length > 0 && greedy_words[0] == 3 &&
+              beam_length > 0 && beam_words[0] == 4 &&
+              beam->best_score / beam_length >= greedy->best_score / greedy_length;
+    
+    beam_search_destroy(greedy);
+    beam_search_destroy(beam);
+    context_tree_destroy(tree);
+    return success;
+}
+
+// Recursively compare two trees node by node
+static int same_node(const ContextNode* a, const ContextNode* b) {
+    if (a->token != b->token || a->total_count != b->total_count ||
+        a->num_children != b->num_children || a->num_continuations != b->num_continuations) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < a->num_continuations; i++) {
+        if (a->continuations[i].next != b->continuations[i].next ||
+            a->continuations[i].count != b->continuations[i].count) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < a->num_children; i++) {
+        if (!same_node(a->children[i], b->children[i])) return 0;
+    }
+    return 1;
+}
+
+// Test that seeded streams repeat and alias tables draw by weight
+int test_sampling() {
+    // One (seed, stream) pair is one sequence; another stream is another
+    Rng a, b, c;
+    rng_seed(&a, 42, 7);
+    rng_seed(&b, 42, 7);
+    rng_seed(&c, 42, 8);
+    int success = 1, differs = 0;
+    for (int i = 0; i < 100; i++) {
+        uint64_t x = rng_next(&a);
+        success = success && x == rng_next(&b);
+        differs += x != rng_next(&c);
+    }
+    success = success && differs > 90;
+    
+    for (int i = 0; i < 1000 && success; i++) {
+        double u = rng_uniform(&a);
+        success = u >= 0 && u < 1 && rng_below(&a, 5) < 5;
+    }
+    
+    // Drawn frequencies follow the weights; a zero weight is never drawn
+    float weights[] = {1, 0, 3, 6, 0.5f};
+    int counts[5] = {0};
+    AliasTable table;
+    success = success && alias_build(&table, weights, 5);
+    int draws = 200000;
+    for (int i = 0; i < draws && success; i++) counts[alias_sample(&table, &a)]++;
+    for (int i = 0; i < 5 && success; i++) {
+        double expected = draws * weights[i] / 10.5;
+        success = counts[i] > expected - 0.02 * draws && counts[i] < expected + 0.02 * draws;
+    }
+    success = success && counts[1] == 0 && counts[4] > 0;
+    
+    // Nothing to draw from
+    float zeros[] = {0, 0};
+    success = success && !alias_build(&table, zeros, 2) && !alias_build(&table, weights, 0) &&
+              !alias_build(&table, weights, SAMPLING_MAX_OUTCOMES + 1);
+    
+    // A single outcome is always drawn
+    success = success && alias_build(&table, weights + 3, 1) && alias_sample(&table, &a) == 0;
+    return success;
+}
+
+// Tokenizer for the parallel training test
+static int split_words(const char* line, TokenSpan* spans, int max_tokens) {
+    return tokenize_spans(line, strlen(line), spans, max_tokens);
+}
+
+// Test that parallel training matches the serial path for any thread count
+int test_parallel_training() {
+    const char* words[] = {"the", "cat", "sat", "on", "mat", "a", "dog", "ran", "far", "away", "and", "back"};
+    TrainCorpus corpus;
+    train_corpus_init(&corpus);
+    
+    unsigned int seed = 42;
+    for (int l = 0; l < 400; l++) {
+        char line[512] = "";
+        int length = 1 + (seed = seed * 1103515245 + 12345) % 20;
+        for (int w = 0; w < length; w++) {
+            seed = seed * 1103515245 + 12345;
+            strcat(line, words[(seed >> 16) % 12]);
+            strcat(line, " ");
+        }
+        train_corpus_add(&corpus, line);
+    }
+    
+    // Serial reference
+    Vocabulary* vocab = vocab_create();
+    ContextTree* tree = context_tree_create(8);
+    for (size_t l = 0; l < corpus.num_lines; l++) {
+        TokenSpan spans[64];
+        uint32_t ids[64];
+        const char* line = corpus.lines[l];
+        int count = split_words(line, spans, 64);
+        if (count < 2) continue;
+        for (int t = 0; t < count; t++) ids[t] = vocab_intern_lower(vocab, line + spans[t].start, spans[t].length);
+        context_tree_ingest(tree, ids, count, 1);
+    }
+    
+    int success = 1;
+    int thread_counts[] = {1, 3, 8};
+    for (int k = 0; k < 3; k++) {
+        Vocabulary* pvocab = vocab_create();
+        ContextTree* ptree = context_tree_create(8);
+        TrainConfig config = {thread_counts[k], 64, 2, 1, split_words};
+        TrainResult result;
+        
+        int ok = train_parallel(ptree, pvocab, &corpus, &config, &result);
+        int same_vocab = vocab_size(pvocab) == vocab_size(vocab);
+        for (uint32_t id = 0; same_vocab && id < vocab_size(vocab); id++) {
+            same_vocab = strcmp(vocab_word(vocab, id), vocab_word(pvocab, id)) == 0;
+        }
+        
+        printf("  %d threads: %zu patterns, %zu nodes, %zu bytes (serial %zu, %zu, %zu)\n", thread_counts[k],
+               ptree->num_patterns, ptree->num_nodes, ptree->node_bytes,
+               tree->num_patterns, tree->num_nodes, tree->node_bytes);
+        
+        success = success && ok && same_vocab &&
+                  ptree->num_patterns == tree->num_patterns &&
+                  ptree->num_nodes == tree->num_nodes &&
+                  ptree->total_words == tree->total_words &&
+                  ptree->node_bytes >= tree->node_bytes &&
+                  result.counts_added == tree->total_words &&
+                  same_node(ptree->root, tree->root);
+        
+        context_tree_destroy(ptree);
+        vocab_destroy(pvocab);
+    }
+    
+    context_tree_destroy(tree);
+    vocab_destroy(vocab);
+    train_corpus_free(&corpus);
+    return success;
+}
+
+static int snapshot_opens(const char* path) {
+    ModelSnapshot* model = snapshot_open(path);
+    snapshot_close(model);
+    return model != NULL;
+}
+
+static int packed_opens(const char* path) {
+    PackedModel* model = packed_open(path);
+    packed_close(model);
+    return model != NULL;
+}
+
+// Overwrite bytes of a model file, then report whether it still opens
+static int opens_when_patched(int (*opens)(const char* path), const char* path, uint64_t offset,
+                              const void* bytes, size_t size) {
+    char original[16];
+    FILE* file = fopen(path, "r+b");
+    if (!file) return 1;
+    fseek(file, (long)offset, SEEK_SET);
+    size_t saved = fread(original, 1, size, file);
+    fseek(file, (long)offset, SEEK_SET);
+    fwrite(bytes, 1, size, file);
+    fclose(file);
+    
+    int opened = opens(path);
+    
+    file = fopen(path, "r+b");
+    if (!file) return 1;
+    fseek(file, (long)offset, SEEK_SET);
+    fwrite(original, 1, saved, file);
+    fclose(file);
+    return opened;
+}
+
+// Test that a written model maps back with the same words and counts, and
+// that one with an index out of place is refused
+int test_snapshot_roundtrip() {
+    const char* path = "test_pattern_store.model";
+    const char* text[] = {"the", "cat", "sat", "on", "the", "mat", "and", "the", "cat", "ran"};
+    int n = sizeof(text) / sizeof(text[0]);
+    
+    Vocabulary* vocab = vocab_create();
+    ContextTree* tree = context_tree_create(3);
+    uint32_t ids[16];
+    for (int i = 0; i < n; i++) ids[i] = vocab_intern(vocab, text[i]);
+    context_tree_ingest(tree, ids, n, 1);
+    
+    if (!snapshot_write(path, vocab, tree, 1)) return 0;
+    ModelSnapshot* model = snapshot_open(path);
+    if (!model) {
+        remove(path);
+        return 0;
+    }
+    
+    // A child range past the last node, a word without its NUL and a
+    // continuation naming an unknown word
+    const SnapshotHeader* h = model->header;
+    uint32_t past_end = (uint32_t)h->num_nodes;
+    char letter = 'x';
+    uint32_t unknown = h->num_words;
+    int refused = !opens_when_patched(snapshot_opens, path, h->nodes_offset + offsetof(SnapshotNode, first_child),
+                                      &past_end, sizeof(past_end)) &&
+                  !opens_when_patched(snapshot_opens, path, h->strings_offset + model->word_offsets[1] - 1,
+                                      &letter, 1) &&
+                  !opens_when_patched(snapshot_opens, path, h->continuations_offset + offsetof(Continuation, next),
+                                      &unknown, sizeof(unknown)) &&
+                  opens_when_patched(snapshot_opens, path, 0, h->magic, sizeof(h->magic));
+    remove(path);
+    
+    // Queries straight from the mapping
+    uint32_t context[] = {snapshot_lookup(model, "the"), snapshot_lookup(model, "cat")};
+    const SnapshotNode* nodes[4];
+    int depth = snapshot_match(model, context, 2, nodes);
+    const Continuation* next = depth == 2 ? snapshot_continuations(model, nodes[2]) : NULL;
+    
+    printf("  %llu nodes, %llu patterns, %zu bytes mapped\n",
+           (unsigned long long)model->header->num_nodes,
+           (unsigned long long)model->header->num_patterns, model->size);
+    
+    int success = refused &&
+                  model->header->num_patterns == tree->num_patterns &&
+                  model->header->num_nodes == tree->num_nodes &&
+                  snapshot_lookup(model, "dog") == VOCAB_NONE &&
+                  next && nodes[2]->num_continuations == 2 &&
+                  strcmp(snapshot_word(model, next[0].next), "sat") == 0 &&
+                  strcmp(snapshot_word(model, next[1].next), "ran") == 0;
+    
+    // Borrowed vocabulary and thawed tree match the originals
+    Vocabulary* loaded = vocab_create();
+    ContextTree* thawed = snapshot_thaw(model);
+    success = success && snapshot_load_vocab(model, loaded) && thawed &&
+              vocab_lookup(loaded, "mat") == vocab_lookup(vocab, "mat") &&
+              thawed->num_patterns == tree->num_patterns &&
+              thawed->total_words == tree->total_words &&
+              same_node(thawed->root, tree->root);
+    
+    // Only patterns the mapping lacks count as new
+    uint32_t fresh[] = {vocab_lookup(vocab, "cat"), vocab_lookup(vocab, "the")};
+    context_tree_add(tree, fresh, 1, fresh[1], 1);
+    success = success && snapshot_count_new(model, tree) == 1;
+    
+    context_tree_destroy(thawed);
+    vocab_destroy(loaded);
+    snapshot_close(model);
+    context_tree_destroy(tree);
+    vocab_destroy(vocab);
+    return success;
+}
+
+// A publish that starts while another process is already attaching
+typedef struct {
+    const char* name;
+    const Vocabulary* vocab;
+    const ContextTree* tree;
+    int ok;
+} LatePublish;
+
+static void* publish_late(void* arg) {
+    LatePublish* late = arg;
+    usleep(30000);
+    late->ok = snapshot_publish(late->name, late->vocab, late->tree, 3);
+    return NULL;
+}
+
+// Test that a published model attaches with the same bytes as the file,
+// that processes attached to it keep it across a republish, and that an
+// attach during a publish waits for it
+int test_snapshot_shared() {
+    const char* path = "test_pattern_store.model";
+    const char* name = "/gaia_test_pattern_store";
+    const char* text[] = {"the", "cat", "sat", "on", "the", "mat"};
+    int n = sizeof(text) / sizeof(text[0]);
+    
+    Vocabulary* vocab = vocab_create();
+    ContextTree* tree = context_tree_create(3);
+    uint32_t ids[8];
+    for (int i = 0; i < n; i++) ids[i] = vocab_intern(vocab, text[i]);
+    context_tree_ingest(tree, ids, n, 1);
+    
+    if (!snapshot_write(path, vocab, tree, 1)) return 0;
+    ModelSnapshot* file = snapshot_open(path);
+    remove(path);
+    if (!file) return 0;
+    
+    int success = snapshot_publish(name, vocab, tree, 1);
+    ModelSnapshot* first = success ? snapshot_attach(name) : NULL;
+    success = first && first->size == file->size && memcmp(first->base, file->base, file->size) == 0;
+    
+    success = success && snapshot_publish(name, vocab, tree, 2);
+    ModelSnapshot* second = success ? snapshot_attach(name) : NULL;
+    success = second && second->header->generation == 2 && first->header->generation == 1 &&
+              snapshot_lookup(first, "mat") == vocab_lookup(vocab, "mat");
+    
+    success = success && snapshot_unpublish(name) && snapshot_attach(name) == NULL &&
+              snapshot_lookup(second, "cat") == vocab_lookup(vocab, "cat");
+    printf("  %zu bytes published\n", file->size);
+    
+    LatePublish late = { name, vocab, tree, 0 };
+    pthread_t publisher;
+    pthread_create(&publisher, NULL, publish_late, &late);
+    ModelSnapshot* third = snapshot_attach(name);
+    pthread_join(publisher, NULL);
+    success = success && late.ok && third && third->header->generation == 3;
+    
+    snapshot_unpublish(name);
+    snapshot_close(third);
+    snapshot_close(second);
+    snapshot_close(first);
+    snapshot_close(file);
+    context_tree_destroy(tree);
+    vocab_destroy(vocab);
+    return success;
+}
+
+// Check a live node against the packed node for the same context: same
+// children and continuations, counts within the model's tolerance
+static int same_packed_node(const PackedModel* model, uint32_t packed, const Vocabulary* vocab,
+                            const ContextNode* node) {
+    double tolerance = model->header->max_count_error + 1e-9;
+    double total = packed_total_count(model, packed);
+    if (total < node->total_count * (1 - tolerance) || total > node->total_count * (1 + tolerance)) return 0;
+    if (packed_num_continuations(model, packed) != node->num_continuations) return 0;
+    
+    for (uint32_t i = 0; i < node->num_continuations; i++) {
+        const Continuation* live = &node->continuations[i];
+        uint32_t next = packed_lookup(model, vocab_word(vocab, live->next));
+        double count = packed_count(model, packed, next);
+        if (count < live->count * (1 - tolerance) || count > live->count * (1 + tolerance)) return 0;
+    }
+    
+    for (uint32_t c = 0; c < node->num_children; c++) {
+        const ContextNode* child = node->children[c];
+        uint32_t token = packed_lookup(model, vocab_word(vocab, child->token));
+        uint32_t match = packed_child(model, packed, token);
+        if (match == PACKED_NONE || !same_packed_node(model, match, vocab, child)) return 0;
+    }
+    return 1;
+}
+
+// Test that a packed model answers like the tree it was exported from, in
+// a fraction of a snapshot's size, and that a damaged one is refused
+int test_packed_model() {
+    const char* path = "test_pattern_store.packed";
+    const char* snapshot_path = "test_pattern_store.model";
+    Vocabulary* vocab = vocab_create();
+    ContextTree* tree = context_tree_create(4);
+    
+    // Skewed counts, so 8-bit codes must round the common patterns
+    char line[64];
+    uint32_t ids[8];
+    for (int i = 0; i < 3000; i++) {
+        snprintf(line, sizeof(line), "the cat w%d sat on mat%d", i % 97, i % 13);
+        int n = tokenize_intern(vocab, line, strlen(line), ids, 8);
+        context_tree_ingest(tree, ids, n, 1);
+    }
+    
+    int success = 1;
+    for (int count_bits = 8; count_bits <= 16 && success; count_bits += 8) {
+        PackedModel* model = packed_write(path, vocab, tree, count_bits, 1) ? packed_open(path) : NULL;
+        if (!model) {
+            remove(path);
+            success = 0;
+            break;
+        }
+        
+        // A child sample off its one, a word ID past the vocabulary and a
+        // block running past the word section
+        const PackedHeader* h = model->header;
+        uint64_t stray = 3;
+        uint32_t unknown = ~0u;
+        uint32_t past_end = (uint32_t)(h->levels_offset - h->words_offset + 1);
+        success = !opens_when_patched(packed_opens, path, h->first_child.samples_offset,
+                                      &stray, sizeof(stray)) &&
+                  !opens_when_patched(packed_opens, path, h->nexts_offset, &unknown, sizeof(unknown)) &&
+                  !opens_when_patched(packed_opens, path, h->block_offsets_offset + sizeof(uint32_t),
+                                      &past_end, sizeof(past_end));
+        remove(path);
+        
+        snapshot_write(snapshot_path, vocab, tree, 1);
+        ModelSnapshot* snapshot = snapshot_open(snapshot_path);
+        remove(snapshot_path);
+        
+        printf("  %d-bit counts: %zu bytes vs %zu snapshot, max count error %.2f%%\n",
+               count_bits, model->size, snapshot ? snapshot->size : 0, model->header->max_count_error * 100);
+        
+        success = success && snapshot && model->size * 3 < snapshot->size &&
+                  model->header->num_patterns == tree->num_patterns &&
+                  same_packed_node(model, 0, vocab, tree->root);
+        
+        // Words survive front coding, and contexts match to the same depth
+        char word[8];
+        uint32_t context[] = {packed_lookup(model, "cat"), packed_lookup(model, "w5"), packed_lookup(model, "sat")};
+        uint32_t nodes[4];
+        success = success && packed_lookup(model, "dog") == PACKED_NONE &&
+                  packed_lookup(model, "mat") == PACKED_NONE &&
+                  packed_word(model, packed_lookup(model, "mat12"), word, sizeof(word)) == 5 &&
+                  strcmp(word, "mat12") == 0 &&
+                  packed_word(model, packed_lookup(model, "mat12"), word, 4) == 5 &&
+                  strcmp(word, "mat") == 0 &&
+                  packed_match(model, context, 3, nodes) == 3 &&
+                  packed_count(model, nodes[3], packed_lookup(model, "on")) > 0;
+        
+        // Counts under 2^16 are exact in 16 bits
+        if (count_bits == 16) success = success && model->header->max_count_error == 0;
+        
+        snapshot_close(snapshot);
+        packed_close(model);
+    }
+    
+    context_tree_destroy(tree);
+    vocab_destroy(vocab);
+    return success;
+}
+
+// Sums the lengths of replayed journal lines
+static void count_replayed(const char* line, void* context) {
+    int* total = context;
+    *total += (int)strlen(line);
+}
+
+// Test that a journal replays complete lines for its own generation only,
+// and that reopening it drops a torn line rather than appending to it
+int test_journal_replay() {
+    const char* path = "test_pattern_store.journal";
+    remove(path);
+    
+    TrainingJournal* journal = journal_open(path, 3);
+    if (!journal) return 0;
+    int ok = journal_append(journal, "hello there\n") && journal_append(journal, "how are you");
+    journal_close(journal);
+    
+    // Simulate a crash part way through an append
+    FILE* file = fopen(path, "a");
+    fputs("torn li", file);
+    fclose(file);
+    
+    int chars = 0;
+    size_t replayed = journal_replay(path, 3, count_replayed, &chars);
+    int stale_chars = 0;
+    size_t stale = journal_replay(path, 4, count_replayed, &stale_chars);
+    
+    journal = journal_open(path, 3);
+    ok = ok && journal && journal_append(journal, "after crash");
+    journal_close(journal);
+    int resumed_chars = 0;
+    size_t resumed = journal_replay(path, 3, count_replayed, &resumed_chars);
+    
+    // Reopening for the next generation starts the journal over
+    journal = journal_open(path, 4);
+    ok = ok && journal && journal_append(journal, "fresh line");
+    journal_close(journal);
+    int fresh_chars = 0;
+    size_t fresh = journal_replay(path, 4, count_replayed, &fresh_chars);
+    remove(path);
+    
+    printf("  replayed %zu lines, %zu stale, %zu after reopening, %zu after new generation\n",
+           replayed, stale, resumed, fresh);
+    
+    return ok && replayed == 2 && chars == 22 && stale == 0 && resumed == 3 && resumed_chars == 33 &&
+           fresh == 1 && fresh_chars == 10;
+}
+
+// Echoes the prompt reversed, counting calls in the shared context
+static size_t reverse_prompt(void* context, const char* prompt, char* output, size_t output_size) {
+    __atomic_fetch_add((int*)context, 1, __ATOMIC_RELAXED);
+    size_t length = strlen(prompt);
+    if (length >= output_size) length = output_size - 1;
+    for (size_t i = 0; i < length; i++) output[i] = prompt[length - 1 - i];
+    output[length] = '\0';
+    return length;
+}
+
+// Test that a worker pool answers every prompt once and keeps input order
+int test_batch_inference() {
+    char storage[200][16];
+    const char* prompts[200];
+    for (int i = 0; i < 200; i++) {
+        snprintf(storage[i], sizeof(storage[i]), "prompt %d", i);
+        prompts[i] = storage[i];
+    }
+    
+    int calls = 0;
+    BatchConfig config = {.num_threads = 8, .output_size = 8, .answer = reverse_prompt, .context = &calls};
+    BatchResult result;
+    if (!batch_run(prompts, 200, &config, &result)) return 0;
+    
+    // Replies are truncated to the output size and land in prompt order
+    int success = calls == 200 && result.count == 200;
+    for (int i = 0; i < 200 && success; i++) {
+        char expected[16];
+        reverse_prompt(&calls, prompts[i], expected, 8);
+        success = strcmp(result.replies[i], expected) == 0;
+    }
+    
+    double p50 = batch_latency_percentile(&result, 50);
+    double p99 = batch_latency_percentile(&result, 99);
+    printf("  %.0f queries/s, p50 %.2f us, p99 %.2f us\n",
+           batch_queries_per_second(&result), p50 * 1e6, p99 * 1e6);
+    success = success && p50 <= p99 && batch_queries_per_second(&result) > 0;
+    batch_result_free(&result);
+    
+    // Nearest-rank percentiles on known latencies
+    double latencies[] = {4, 1, 3, 2};
+    BatchResult known = {.latencies = latencies, .count = 4, .elapsed = 2};
+    success = success && batch_latency_percentile(&known, 50) == 2 &&
+              batch_latency_percentile(&known, 99) == 4 &&
+              batch_latency_percentile(&known, 0) == 1 &&
+              batch_queries_per_second(&known) == 2;
+    
+    return success;
+}
+
+// A served version for the swap test; released marks it freed
+typedef struct {
+    int freed;
+} SwapVersion;
+
+static void release_swap_version(void* version) {
+    __atomic_store_n(&((SwapVersion*)version)->freed, 1, __ATOMIC_SEQ_CST);
+}
+
+typedef struct {
+    ModelSwap* swap;
+    int stop;
+    int freed_under_reader;
+} SwapStress;
+
+// Pin versions and check none is freed while pinned
+static void* swap_stress_reader(void* arg) {
+    SwapStress* stress = arg;
+    while (!__atomic_load_n(&stress->stop, __ATOMIC_RELAXED)) {
+        int slot;
+        SwapVersion* version = swap_enter(stress->swap, &slot);
+        for (int spin = 0; spin < 100; spin++) {
+            if (__atomic_load_n(&version->freed, __ATOMIC_SEQ_CST)) stress->freed_under_reader = 1;
+        }
+        swap_exit(stress->swap, slot);
+    }
+    return NULL;
+}
+
+// Test that a pinned version outlives its replacement, is released once
+// unpinned, and is never freed under a reader while versions are swapped
+// from another thread
+int test_model_swap() {
+    static SwapVersion versions[2001];
+    ModelSwap swap;
+    if (!swap_init(&swap, &versions[0], release_swap_version)) return 0;
+    
+    int slot;
+    SwapVersion* pinned = swap_enter(&swap, &slot);
+    uint64_t number = swap_publish(&swap, &versions[1]);
+    int other;
+    SwapVersion* fresh = swap_enter(&swap, &other);
+    swap_exit(&swap, other);
+    
+    int success = pinned == &versions[0] && fresh == &versions[1] && number == 1 &&
+                  swap_reclaim(&swap) == 1 && !versions[0].freed;
+    swap_exit(&swap, slot);
+    success = success && swap_reclaim(&swap) == 0 && versions[0].freed;
+    
+    SwapStress stress = {.swap = &swap};
+    pthread_t readers[4];
+    for (int i = 0; i < 4; i++) pthread_create(&readers[i], NULL, swap_stress_reader, &stress);
+    for (int v = 2; v <= 2000; v++) {
+        swap_publish(&swap, &versions[v]);
+        swap_reclaim(&swap);
+    }
+    __atomic_store_n(&stress.stop, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < 4; i++) pthread_join(readers[i], NULL);
+    
+    // With the readers gone everything but the current version goes
+    success = success && !stress.freed_under_reader && swap_reclaim(&swap) == 0 &&
+              swap.version == 2000 && !versions[2000].freed;
+    for (int v = 1; v < 2000; v++) success = success && versions[v].freed;
+    
+    swap_destroy(&swap);
+    return success && versions[2000].freed;
+}
+
+int main() {
+    printf("=== Pattern Store Test Suite ===\n\n");
+    
+    RUN_TEST(test_arena);
+    RUN_TEST(test_vocab_interning);
+    RUN_TEST(test_vocab_growth);
+    RUN_TEST(test_tokenizer_spans);
+    RUN_TEST(test_store_continuations);
+    RUN_TEST(test_store_running_hash);
+    RUN_TEST(test_store_growth);
+    RUN_TEST(test_store_memory);
+    RUN_TEST(test_tree_ingest);
+    RUN_TEST(test_tree_match);
+    RUN_TEST(test_tree_freeze);
+    RUN_TEST(test_tree_prune);
+    RUN_TEST(test_tree_admission);
+    RUN_TEST(test_beam_search);
+    RUN_TEST(test_sampling);
+    RUN_TEST(test_parallel_training);
+    RUN_TEST(test_snapshot_roundtrip);
+    RUN_TEST(test_snapshot_shared);
+    RUN_TEST(test_packed_model);
+    RUN_TEST(test_journal_replay);
+    RUN_TEST(test_batch_inference);
+    RUN_TEST(test_model_swap);
+    
+    printf("=== Test Summary ===\n");
+    printf("Tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Success rate: %.1f%%\n", (tests_passed * 100.0) / tests_run);
+    
+    return tests_passed == tests_run ? 0 : 1;
+}
@@ -113,7 +113,7 @@ void test_attention_mechanism() {
     
     // Print attention patterns for first two heads
     for (int h = 0; h < 2 && h < NUM_HEADS; h++) {
-        print_attention_matrix(&layer->heads[h], tokens, num_tokens);
+        print_attention_matrix(&ctx, h);
     }
     
     // Get confidence
@@ -1,35 +1,7 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
-// Directly test the V8 functions
-
-// Declare the types we need
-typedef struct Pattern {
-    char context[100][50];
-    char next[50];
-    int context_length;
-    int count;
-    struct Pattern* collision_next;
-} Pattern;
-
-typedef struct {
-    Pattern* patterns[2097152];
-    int total_patterns;
-    int total_words;
-    int patterns_by_length[101];
-    int hash_collisions;
-    int pattern_lookups;
-} ChatSystem;
-
-// External functions
-extern void function_registry_init(void);
-extern void register_gaia_functions(void);
-extern void init_experiment_logger(void);
-extern ChatSystem* init_chat_system(void);
-extern void generate_response_v8(ChatSystem* system, const char* input);
-extern void function_registry_cleanup(void);
-extern void cleanup_experiment_logger(void);
+// Directly test the V8 functions. The engine is compiled in, as in
+// benchmark_v8, so its types and signatures can never drift from these calls.
+#define GAIA_CHAT_V8_NO_MAIN
+#include "gaia_chat_v8.c"
 
 int main() {
     printf("=== Direct V8 Test ===\n");
@@ -39,12 +11,18 @@ int main() {
     register_gaia_functions();
     init_experiment_logger();
     
-    ChatSystem* system = init_chat_system();
+    ChatSystem* system = init_chat_system(0);
     if (!system) {
         printf("Failed to create system\n");
         return 1;
     }
     
+    // Replies go into this buffer instead of straight to stdout
+    V8Request request = V8_DEFAULT_REQUEST;
+    char reply[MAX_RESPONSE_LENGTH];
+    request.output = reply;
+    request.output_size = sizeof(reply);
+    
     // Test queries
     const char* queries[] = {
         "What is 2 plus 2?",
@@ -56,16 +34,15 @@ int main() {
     
     for (int i = 0; queries[i]; i++) {
         printf("\nQuery %d: %s\n", i + 1, queries[i]);
-        printf("Response: ");
-        fflush(stdout);
-        
-        generate_response_v8(system, queries[i]);
+        generate_response_v8(system, &request, queries[i]);
+        printf("Response: %s\n", reply);
     }
     
     // Cleanup
+    destroy_chat_system(system);
     function_registry_cleanup();
     cleanup_experiment_logger();
     
     printf("\nTest completed\n");
     return 0;
-}
\ No newline at end of file
+}
@@ -251,6 +251,34 @@ int test_complex_workflow() {
     return success;
 }
 
+// Test synthesis into a caller buffer, which must truncate rather than
+// overflow when the step outputs do not fit
+int test_synthesize_into() {
+    WorkflowState* workflow = create_workflow();
+    if (!workflow) return 0;
+    
+    for (int i = 0; i < 3; i++) {
+        ReasoningStep* step = &workflow->steps[workflow->num_steps++];
+        step->type = STEP_EXECUTE;
+        step->completed = 1;
+        snprintf(step->output, sizeof(step->output), "part %d", i + 1);
+    }
+    
+    char full[64];
+    size_t length = synthesize_results_into(workflow, full, sizeof(full));
+    printf("  Synthesized: '%s'\n", full);
+    
+    char small[8];
+    size_t truncated = synthesize_results_into(workflow, small, sizeof(small));
+    
+    int success = strcmp(full, "part 1 part 2 part 3") == 0 && length == strlen(full) &&
+                  truncated == sizeof(small) - 1 && strncmp(small, full, truncated) == 0 &&
+                  strcmp(synthesize_results(workflow), full) == 0;
+    
+    destroy_workflow(workflow);
+    return success;
+}
+
 int main() {
     printf("=== Dynamic Workflows Test Suite ===\n\n");
     
@@ -264,6 +292,7 @@ int main() {
     RUN_TEST(test_quality_evaluation);
     RUN_TEST(test_full_workflow);
     RUN_TEST(test_complex_workflow);
+    RUN_TEST(test_synthesize_into);
     
     printf("=== Test Summary ===\n");
     printf("Tests run: %d\n", tests_run);
@@ -5,21 +5,49 @@
 #include <ctype.h>
 #include <math.h>
 #include "gate_types.h"
+#include "hash64.h"
+#include "vocabulary.h"
 
 #define MAX_WORD_LENGTH 50
-#define MAX_TRIGRAMS 1000
 #define MAX_CONTEXT 20
 #define CONFIDENCE_DECAY 0.95
+#define TRIGRAM_INITIAL_CAPACITY 1024  // Power of two
+#define TRIGRAM_NONE UINT32_MAX
 
-// Trigram association
+// Trigram association over interned word IDs
 typedef struct {
-    char words[3][MAX_WORD_LENGTH];  // 3-word context
-    char next_word[MAX_WORD_LENGTH];
+    uint32_t words[3];  // 3-word context
+    uint32_t next_word;
     int frequency;
     float confidence;
-    int last_seen;  // For decay
+    int last_seen;  // Decay is applied from this when the trigram is scored
+    uint32_t next_continuation;  // Older trigram with the same context
 } TrigramAssociation;
 
+// Trigrams sharing a context (w1 w2 w3), or only its last two or last
+// word, with leading words VOCAB_NONE. Context groups also chain their
+// continuations for learning.
+typedef struct {
+    uint32_t words[3];
+    uint32_t best;               // Highest ranked trigram, see trigram_rank
+    uint32_t continuations;      // Newest trigram of a full context
+    uint32_t next_in_bucket;
+} TrigramGroup;
+
+// Growable trigram store. Every trigram belongs to three groups, so a
+// full or partial context is one hash lookup away from its best
+// continuation. Both arrays double when full; the buckets, one per group
+// slot, are then rebuilt.
+typedef struct {
+    TrigramAssociation* entries;
+    uint32_t count;
+    uint32_t capacity;
+    TrigramGroup* groups;
+    uint32_t num_groups;
+    uint32_t group_capacity;     // Power of two, also the number of buckets
+    uint32_t* buckets;           // Newest group per bucket, TRIGRAM_NONE when empty
+} TrigramIndex;
+
 // Enhanced context
 typedef struct {
     char words[MAX_CONTEXT][MAX_WORD_LENGTH];
@@ -37,17 +65,114 @@ typedef struct {
 
 // V2 Processor
 typedef struct {
-    TrigramAssociation trigrams[MAX_TRIGRAMS];
-    int trigram_count;
+    TrigramIndex trigrams;
+    Vocabulary* vocab;
     EnhancedContext context;
     CoherenceMetrics metrics;
     int total_words_seen;
     Gate* coherence_network;
 } TextProcessorV2;
 
+static uint32_t group_bucket(const TrigramIndex* index, const uint32_t* words) {
+    uint64_t hash = hash64_token(hash64_token(hash64_token(HASH64_SEED, words[0]), words[1]), words[2]);
+    return (uint32_t)hash & (index->group_capacity - 1);
+}
+
+static int grow_groups(TrigramIndex* index, uint32_t capacity) {
+    TrigramGroup* groups = realloc(index->groups, capacity * sizeof(TrigramGroup));
+    if (!groups) return 0;
+    index->groups = groups;
+    
+    uint32_t* buckets = malloc(capacity * sizeof(uint32_t));
+    if (!buckets) return 0;
+    memset(buckets, 0xff, capacity * sizeof(uint32_t));
+    free(index->buckets);
+    index->buckets = buckets;
+    index->group_capacity = capacity;
+    
+    for (uint32_t g = 0; g < index->num_groups; g++) {
+        uint32_t b = group_bucket(index, groups[g].words);
+        groups[g].next_in_bucket = buckets[b];
+        buckets[b] = g;
+    }
+    return 1;
+}
+
+static uint32_t find_group(const TrigramIndex* index, const uint32_t* words) {
+    uint32_t g = index->buckets[group_bucket(index, words)];
+    while (g != TRIGRAM_NONE) {
+        const TrigramGroup* group = &index->groups[g];
+        if (group->words[0] == words[0] && group->words[1] == words[1] && group->words[2] == words[2]) {
+            return g;
+        }
+        g = group->next_in_bucket;
+    }
+    return TRIGRAM_NONE;
+}
+
+static uint32_t add_group(TrigramIndex* index, const uint32_t* words) {
+    if (index->num_groups == index->group_capacity && !grow_groups(index, index->group_capacity * 2)) {
+        return TRIGRAM_NONE;
+    }
+    
+    uint32_t g = index->num_groups++;
+    uint32_t b = group_bucket(index, words);
+    TrigramGroup* group = &index->groups[g];
+    memcpy(group->words, words, sizeof(group->words));
+    group->best = TRIGRAM_NONE;
+    group->continuations = TRIGRAM_NONE;
+    group->next_in_bucket = index->buckets[b];
+    index->buckets[b] = g;
+    return g;
+}
+
+// Decay makes a trigram's score confidence * frequency *
+// CONFIDENCE_DECAY^((now - last_seen) / 100). The now term is the same
+// for every trigram, so their order never changes as time passes, and it
+// is the order of this rank. It only rises when a trigram is learned
+// again, so each group keeps its best without rescanning, and decay is
+// only computed for the trigram a lookup returns.
+static double trigram_rank(const TrigramAssociation* tri) {
+    return log(tri->confidence * tri->frequency) - tri->last_seen * log(CONFIDENCE_DECAY) / 100.0;
+}
+
+// Ties go to the trigram learned first
+static void offer_best(TrigramIndex* index, uint32_t g, uint32_t t) {
+    TrigramGroup* group = &index->groups[g];
+    if (group->best == TRIGRAM_NONE || group->best == t) {
+        group->best = t;
+        return;
+    }
+    double rank = trigram_rank(&index->entries[t]);
+    double best = trigram_rank(&index->entries[group->best]);
+    if (rank > best || (rank == best && t < group->best)) group->best = t;
+}
+
+static int init_trigram_index(TrigramIndex* index) {
+    memset(index, 0, sizeof(*index));
+    index->entries = malloc(TRIGRAM_INITIAL_CAPACITY * sizeof(TrigramAssociation));
+    index->capacity = TRIGRAM_INITIAL_CAPACITY;
+    return index->entries && grow_groups(index, TRIGRAM_INITIAL_CAPACITY);
+}
+
+void free_trigram_index(TrigramIndex* index) {
+    free(index->entries);
+    free(index->groups);
+    free(index->buckets);
+    memset(index, 0, sizeof(*index));
+}
+
 // Initialize V2
 TextProcessorV2* create_v2_processor() {
     TextProcessorV2* proc = calloc(1, sizeof(TextProcessorV2));
+    if (!proc) return NULL;
+    proc->vocab = vocab_create();
+    if (!proc->vocab || !init_trigram_index(&proc->trigrams)) {
+        vocab_destroy(proc->vocab);
+        free_trigram_index(&proc->trigrams);
+        free(proc);
+        return NULL;
+    }
     proc->coherence_network = gate_create("ADAPTIVE_AND");
     
     // Initialize attention weights (exponential decay)
@@ -73,34 +198,68 @@ void update_context_v2(TextProcessorV2* proc, const char* word) {
     proc->total_words_seen++;
 }
 
-// Learn trigram
+// Learn trigram - O(1) amortized
 void learn_trigram(TextProcessorV2* proc, const char* w1, const char* w2, 
                    const char* w3, const char* next) {
-    // Search for existing trigram
-    TrigramAssociation* found = NULL;
-    for (int i = 0; i < proc->trigram_count; i++) {
-        if (strcmp(proc->trigrams[i].words[0], w1) == 0 &&
-            strcmp(proc->trigrams[i].words[1], w2) == 0 &&
-            strcmp(proc->trigrams[i].words[2], w3) == 0 &&
-            strcmp(proc->trigrams[i].next_word, next) == 0) {
-            found = &proc->trigrams[i];
-            break;
-        }
+    TrigramIndex* index = &proc->trigrams;
+    uint32_t words[3] = {
+        vocab_intern(proc->vocab, w1),
+        vocab_intern(proc->vocab, w2),
+        vocab_intern(proc->vocab, w3)
+    };
+    uint32_t next_word = vocab_intern(proc->vocab, next);
+    if (words[0] == VOCAB_NONE || words[1] == VOCAB_NONE || words[2] == VOCAB_NONE ||
+        next_word == VOCAB_NONE) {
+        return;
+    }
+    
+    uint32_t context = find_group(index, words);
+    if (context == TRIGRAM_NONE) context = add_group(index, words);
+    if (context == TRIGRAM_NONE) {
+        printf("Failed to grow trigram index\n");
+        return;
     }
     
-    if (found) {
+    // Search the context's continuations for an existing trigram
+    uint32_t t = index->groups[context].continuations;
+    while (t != TRIGRAM_NONE && index->entries[t].next_word != next_word) {
+        t = index->entries[t].next_continuation;
+    }
+    
+    if (t != TRIGRAM_NONE) {
+        TrigramAssociation* found = &index->entries[t];
         found->frequency++;
         found->confidence = 1.0 - (1.0 / found->frequency);  // Asymptotic to 1
         found->last_seen = proc->total_words_seen;
-    } else if (proc->trigram_count < MAX_TRIGRAMS) {
-        TrigramAssociation* tri = &proc->trigrams[proc->trigram_count++];
-        strcpy(tri->words[0], w1);
-        strcpy(tri->words[1], w2);
-        strcpy(tri->words[2], w3);
-        strcpy(tri->next_word, next);
+    } else {
+        if (index->count == index->capacity) {
+            TrigramAssociation* entries = realloc(index->entries, 2 * index->capacity * sizeof(TrigramAssociation));
+            if (!entries) {
+                printf("Failed to grow trigram index\n");
+                return;
+            }
+            index->entries = entries;
+            index->capacity *= 2;
+        }
+        
+        t = index->count++;
+        TrigramAssociation* tri = &index->entries[t];
+        memcpy(tri->words, words, sizeof(words));
+        tri->next_word = next_word;
         tri->frequency = 1;
         tri->confidence = 0.5;  // Initial confidence
         tri->last_seen = proc->total_words_seen;
+        tri->next_continuation = index->groups[context].continuations;
+        index->groups[context].continuations = t;
+    }
+    
+    // The trigram only gained rank, so it can only take over as best
+    offer_best(index, context, t);
+    for (int shared = 1; shared <= 2; shared++) {
+        uint32_t suffix[3] = {VOCAB_NONE, shared == 1 ? words[1] : VOCAB_NONE, words[2]};
+        uint32_t g = find_group(index, suffix);
+        if (g == TRIGRAM_NONE) g = add_group(index, suffix);
+        if (g != TRIGRAM_NONE) offer_best(index, g, t);
     }
 }
 
@@ -110,47 +269,34 @@ typedef struct {
     float score;
 } WordCandidate;
 
+// Best continuation of w1 w2 w3, or of its last two or last word when w1
+// or w1 and w2 are empty
 WordCandidate get_best_continuation(TextProcessorV2* proc, 
                                    const char* w1, const char* w2, const char* w3) {
-    WordCandidate candidates[50];
-    int candidate_count = 0;
-    
-    // Find all matching trigrams
-    for (int i = 0; i < proc->trigram_count; i++) {
-        // Handle partial matches for shorter contexts
-        int match = 1;
-        if (strlen(w1) > 0 && strcmp(proc->trigrams[i].words[0], w1) != 0) match = 0;
-        if (strlen(w2) > 0 && strcmp(proc->trigrams[i].words[1], w2) != 0) match = 0;
-        if (strcmp(proc->trigrams[i].words[2], w3) != 0) match = 0;
-        
-        if (match) {
-            
-            // Apply time decay
-            int age = proc->total_words_seen - proc->trigrams[i].last_seen;
-            float decay = pow(CONFIDENCE_DECAY, age / 100.0);
-            
-            // Calculate score
-            float score = proc->trigrams[i].confidence * 
-                         proc->trigrams[i].frequency * 
-                         decay;
-            
-            // Add to candidates
-            if (candidate_count < 50) {
-                strcpy(candidates[candidate_count].word, proc->trigrams[i].next_word);
-                candidates[candidate_count].score = score;
-                candidate_count++;
-            }
-        }
-    }
-    
-    // Find best candidate
     WordCandidate best = {"", 0.0};
-    for (int i = 0; i < candidate_count; i++) {
-        if (candidates[i].score > best.score) {
-            best = candidates[i];
+    
+    uint32_t words[3] = {VOCAB_NONE, VOCAB_NONE, vocab_lookup(proc->vocab, w3)};
+    if (strlen(w2) > 0) {
+        words[1] = vocab_lookup(proc->vocab, w2);
+        if (words[1] == VOCAB_NONE) return best;
+        if (strlen(w1) > 0) {
+            words[0] = vocab_lookup(proc->vocab, w1);
+            if (words[0] == VOCAB_NONE) return best;
         }
     }
+    if (words[2] == VOCAB_NONE) return best;
     
+    uint32_t g = find_group(&proc->trigrams, words);
+    if (g == TRIGRAM_NONE) return best;
+    const TrigramAssociation* tri = &proc->trigrams.entries[proc->trigrams.groups[g].best];
+    
+    // Apply time decay
+    int age = proc->total_words_seen - tri->last_seen;
+    float decay = pow(CONFIDENCE_DECAY, age / 100.0);
+    
+    // Calculate score
+    best.score = tri->confidence * tri->frequency * decay;
+    strcpy(best.word, vocab_word(proc->vocab, tri->next_word));
     return best;
 }
 
@@ -208,7 +354,7 @@ void process_text_v2(TextProcessorV2* proc, const char* input) {
     proc->metrics.perplexity = calculate_perplexity(proc);
     
     printf("Words processed: %d\n", word_count);
-    printf("Trigrams learned: %d\n", proc->trigram_count);
+    printf("Trigrams learned: %u\n", proc->trigrams.count);
     printf("Perplexity: %.2f\n", proc->metrics.perplexity);
 }
 
@@ -307,27 +453,30 @@ void generate_response_v2(TextProcessorV2* proc, const char* prompt) {
 void show_top_trigrams(TextProcessorV2* proc) {
     printf("\n=== Top Trigram Patterns ===\n");
     
-    // Sort by frequency * confidence
-    for (int i = 0; i < proc->trigram_count - 1; i++) {
-        for (int j = i + 1; j < proc->trigram_count; j++) {
-            float score_i = proc->trigrams[i].frequency * proc->trigrams[i].confidence;
-            float score_j = proc->trigrams[j].frequency * proc->trigrams[j].confidence;
-            if (score_j > score_i) {
-                TrigramAssociation temp = proc->trigrams[i];
-                proc->trigrams[i] = proc->trigrams[j];
-                proc->trigrams[j] = temp;
-            }
-        }
+    // Keep the ten best by frequency * confidence, best first
+    const TrigramIndex* index = &proc->trigrams;
+    const TrigramAssociation* top[10];
+    int num_top = 0;
+    for (uint32_t i = 0; i < index->count; i++) {
+        const TrigramAssociation* tri = &index->entries[i];
+        float score = tri->frequency * tri->confidence;
+        int pos = num_top;
+        while (pos > 0 && score > top[pos - 1]->frequency * top[pos - 1]->confidence) pos--;
+        if (pos >= 10) continue;
+        
+        if (num_top < 10) num_top++;
+        memmove(&top[pos + 1], &top[pos], (num_top - 1 - pos) * sizeof(top[0]));
+        top[pos] = tri;
     }
     
-    for (int i = 0; i < 10 && i < proc->trigram_count; i++) {
+    for (int i = 0; i < num_top; i++) {
         printf("%s %s %s -> %s (freq:%d, conf:%.2f)\n",
-               proc->trigrams[i].words[0],
-               proc->trigrams[i].words[1],
-               proc->trigrams[i].words[2],
-               proc->trigrams[i].next_word,
-               proc->trigrams[i].frequency,
-               proc->trigrams[i].confidence);
+               vocab_word(proc->vocab, top[i]->words[0]),
+               vocab_word(proc->vocab, top[i]->words[1]),
+               vocab_word(proc->vocab, top[i]->words[2]),
+               vocab_word(proc->vocab, top[i]->next_word),
+               top[i]->frequency,
+               top[i]->confidence);
     }
 }
 
@@ -346,6 +495,11 @@ int main() {
     register_adaptive_gates();
     
     TextProcessorV2* proc = create_v2_processor();
+    if (!proc) {
+        printf("Failed to create processor\n");
+        gate_registry_cleanup();
+        return 1;
+    }
     
     // Training corpus
     const char* training[] = {
@@ -372,26 +526,27 @@ int main() {
     printf("\n=== Generation Tests ===\n");
     // First check what patterns we have for "gaia is"
     printf("\n=== Checking learned patterns ===\n");
-    for (int i = 0; i < proc->trigram_count; i++) {
-        if (strstr(proc->trigrams[i].words[0], "gaia") ||
-            strstr(proc->trigrams[i].words[1], "gaia") ||
-            strstr(proc->trigrams[i].words[2], "gaia")) {
+    for (uint32_t i = 0; i < proc->trigrams.count; i++) {
+        const TrigramAssociation* tri = &proc->trigrams.entries[i];
+        const char* w1 = vocab_word(proc->vocab, tri->words[0]);
+        const char* w2 = vocab_word(proc->vocab, tri->words[1]);
+        const char* w3 = vocab_word(proc->vocab, tri->words[2]);
+        if (strstr(w1, "gaia") || strstr(w2, "gaia") || strstr(w3, "gaia")) {
             printf("Pattern: '%s' '%s' '%s' -> '%s'\n",
-                   proc->trigrams[i].words[0],
-                   proc->trigrams[i].words[1],
-                   proc->trigrams[i].words[2],
-                   proc->trigrams[i].next_word);
+                   w1, w2, w3, vocab_word(proc->vocab, tri->next_word));
         }
     }
     
     // Also check what "gaia is" patterns exist
     printf("\nSpecific 'gaia is' patterns:\n");
-    for (int i = 0; i < proc->trigram_count; i++) {
-        if (strcmp(proc->trigrams[i].words[1], "gaia") == 0 &&
-            strcmp(proc->trigrams[i].words[2], "is") == 0) {
+    uint32_t gaia = vocab_lookup(proc->vocab, "gaia");
+    uint32_t is = vocab_lookup(proc->vocab, "is");
+    for (uint32_t i = 0; i < proc->trigrams.count; i++) {
+        const TrigramAssociation* tri = &proc->trigrams.entries[i];
+        if (tri->words[1] == gaia && tri->words[2] == is) {
             printf("Found: '%s' 'gaia' 'is' -> '%s'\n",
-                   proc->trigrams[i].words[0],
-                   proc->trigrams[i].next_word);
+                   vocab_word(proc->vocab, tri->words[0]),
+                   vocab_word(proc->vocab, tri->next_word));
         }
     }
     
@@ -420,6 +575,8 @@ int main() {
     
     // Cleanup
     if (proc->coherence_network) gate_destroy(proc->coherence_network);
+    free_trigram_index(&proc->trigrams);
+    vocab_destroy(proc->vocab);
     free(proc);
     
     gate_registry_cleanup();
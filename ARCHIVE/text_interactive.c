@@ -16,7 +16,6 @@ typedef struct Pattern {
     char word2[MAX_WORD_LENGTH];
     char next[MAX_WORD_LENGTH];
     int count;
-    Gate* gate;
     struct Pattern* collision_next;
 } Pattern;
 
@@ -69,7 +68,6 @@ void learn_pattern(InteractiveSystem* sys, const char* w1, const char* w2, const
     strcpy(new_p->word2, w2);
     strcpy(new_p->next, next);
     new_p->count = 1;
-    new_p->gate = gate_create("THRESHOLD");
     
     if (prev) {
         prev->collision_next = new_p;
@@ -232,7 +230,6 @@ void interactive_loop(InteractiveSystem* sys) {
                 Pattern* p = sys->patterns[i];
                 while (p) {
                     Pattern* next = p->collision_next;
-                    if (p->gate) gate_destroy(p->gate);
                     free(p);
                     p = next;
                 }
@@ -322,7 +319,6 @@ int main() {
         Pattern* p = sys->patterns[i];
         while (p) {
             Pattern* next = p->collision_next;
-            if (p->gate) gate_destroy(p->gate);
             free(p);
             p = next;
         }
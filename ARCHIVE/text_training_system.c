@@ -4,11 +4,23 @@
 #include <stdint.h>
 #include <ctype.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "gate_types.h"
+#include "hash64.h"
+#include "vocabulary.h"
 
-#define HASH_SIZE 65536  // 2^16 for fast modulo
+#define HASH_SIZE 65536  // Power of two: addresses are masked, not reduced modulo
 #define MAX_WORD_LENGTH 50
-#define STREAM_BUFFER_SIZE 4096
+#define STREAM_BUFFER_SIZE (1 << 20)  // Bytes per read; the only input held in memory
+
+#if HASH_SIZE & (HASH_SIZE - 1)
+#error "HASH_SIZE must be a power of two"
+#endif
+
+// Longest collision chain given its own row in show_stats
+#define CHAIN_HISTOGRAM_MAX 8
 
 // Pattern stored at computed address
 typedef struct Pattern {
@@ -16,7 +28,6 @@ typedef struct Pattern {
     char word2[MAX_WORD_LENGTH];
     char next[MAX_WORD_LENGTH];
     int count;
-    Gate* gate;
     struct Pattern* collision_next;  // Handle hash collisions
 } Pattern;
 
@@ -24,39 +35,64 @@ typedef struct Pattern {
 typedef struct {
     Pattern* patterns[HASH_SIZE];  // Hash table of patterns
     int total_patterns;
-    int total_words;
+    size_t total_words;
+    size_t total_bytes;        // Stream bytes read
     Gate* learning_rate_gate;  // Controls adaptation speed
     
-    // Stream processing
-    char buffer[STREAM_BUFFER_SIZE];
-    int buffer_pos;
-    char prev_word[MAX_WORD_LENGTH];
-    char prev_prev_word[MAX_WORD_LENGTH];
+    // Stream processing. Words are interned once, so the last two words are
+    // a shift register of IDs. A word cut off at the end of a read block
+    // waits in word until the next block completes it.
+    Vocabulary* vocab;
+    uint32_t prev_id;
+    uint32_t prev_prev_id;
+    char word[MAX_WORD_LENGTH];
+    int word_len;
 } TrainingSystem;
 
-// Compute pattern address
+// Lowercase form of each byte that can be part of a word, 0 for delimiters
+static unsigned char word_chars[256];
+
+// Compute pattern address: a hash64 of both words, masked to the table
 uint32_t compute_pattern_address(const char* w1, const char* w2) {
-    uint32_t hash = 5381;
-    
-    // DJB2 hash
-    for (int i = 0; w1[i]; i++) {
-        hash = ((hash << 5) + hash) + w1[i];
-    }
-    hash = ((hash << 5) + hash) + ' ';  // separator
-    for (int i = 0; w2[i]; i++) {
-        hash = ((hash << 5) + hash) + w2[i];
-    }
-    
-    return hash % HASH_SIZE;
+    uint64_t hash = hash64_string(w2, hash64_string(w1, HASH64_SEED));
+    return (uint32_t)hash & (HASH_SIZE - 1);
 }
 
 // Create training system
 TrainingSystem* create_training_system() {
+    for (int c = 0; c < 256; c++) {
+        word_chars[c] = (isalnum(c) || c == '\'' || c == '-') ? tolower(c) : 0;
+    }
+    
     TrainingSystem* ts = calloc(1, sizeof(TrainingSystem));
+    if (!ts) return NULL;
+    ts->vocab = vocab_create();
+    if (!ts->vocab) {
+        free(ts);
+        return NULL;
+    }
+    ts->prev_id = VOCAB_NONE;
+    ts->prev_prev_id = VOCAB_NONE;
     ts->learning_rate_gate = gate_create("THRESHOLD");
     return ts;
 }
 
+// Destroy training system with its patterns
+void destroy_training_system(TrainingSystem* ts) {
+    if (!ts) return;
+    for (int i = 0; i < HASH_SIZE; i++) {
+        Pattern* p = ts->patterns[i];
+        while (p) {
+            Pattern* next = p->collision_next;
+            free(p);
+            p = next;
+        }
+    }
+    if (ts->learning_rate_gate) gate_destroy(ts->learning_rate_gate);
+    vocab_destroy(ts->vocab);
+    free(ts);
+}
+
 // Learn pattern - O(1) insertion
 void learn_pattern_streaming(TrainingSystem* ts, const char* w1, const char* w2, const char* next) {
     uint32_t addr = compute_pattern_address(w1, w2);
@@ -84,7 +120,6 @@ void learn_pattern_streaming(TrainingSystem* ts, const char* w1, const char* w2,
     strcpy(new_p->word2, w2);
     strcpy(new_p->next, next);
     new_p->count = 1;
-    new_p->gate = gate_create("THRESHOLD");
     
     // Insert at head or in chain
     if (prev) {
@@ -96,77 +131,149 @@ void learn_pattern_streaming(TrainingSystem* ts, const char* w1, const char* w2,
     ts->total_patterns++;
 }
 
-// Process word from stream
-void process_word(TrainingSystem* ts, const char* word) {
+// Process word from stream, given by its vocabulary ID
+static void process_token(TrainingSystem* ts, uint32_t id) {
+    if (id == VOCAB_NONE) return;
+    
     // Learn trigram pattern
-    if (strlen(ts->prev_prev_word) > 0 && strlen(ts->prev_word) > 0) {
-        learn_pattern_streaming(ts, ts->prev_prev_word, ts->prev_word, word);
+    if (ts->prev_prev_id != VOCAB_NONE) {
+        learn_pattern_streaming(ts, vocab_word(ts->vocab, ts->prev_prev_id),
+                                vocab_word(ts->vocab, ts->prev_id), vocab_word(ts->vocab, id));
     }
     
     // Shift words
-    strcpy(ts->prev_prev_word, ts->prev_word);
-    strcpy(ts->prev_word, word);
+    ts->prev_prev_id = ts->prev_id;
+    ts->prev_id = id;
     ts->total_words++;
 }
 
-// Stream processing - handle any size input
-void train_from_stream(TrainingSystem* ts, FILE* stream) {
-    char word[MAX_WORD_LENGTH];
-    int word_pos = 0;
-    int ch;
-    
-    printf("Training from stream...\n");
-    clock_t start = clock();
+// Process word from stream
+void process_word(TrainingSystem* ts, const char* word) {
+    size_t length = strlen(word);
+    if (length > MAX_WORD_LENGTH - 1) length = MAX_WORD_LENGTH - 1;
+    process_token(ts, vocab_intern_lower(ts->vocab, word, length));
+}
+
+// Tokenize one block of a stream. Words are interned straight from the
+// block; only one that runs off its end is copied, into ts->word, and
+// finished by the next block or by stream_end. Characters past
+// MAX_WORD_LENGTH - 1 are dropped.
+static void stream_block(TrainingSystem* ts, const char* data, size_t length) {
+    const unsigned char* text = (const unsigned char*)data;
+    size_t i = 0;
+    ts->total_bytes += length;
+    
+    // Finish the word carried over from the previous block
+    if (ts->word_len > 0) {
+        for (; i < length && word_chars[text[i]]; i++) {
+            if (ts->word_len < MAX_WORD_LENGTH - 1) ts->word[ts->word_len++] = (char)word_chars[text[i]];
+        }
+        if (i == length) return;
+        process_token(ts, vocab_intern_lower(ts->vocab, ts->word, ts->word_len));
+        ts->word_len = 0;
+    }
     
-    while ((ch = fgetc(stream)) != EOF) {
-        ch = tolower(ch);
+    while (i < length) {
+        while (i < length && !word_chars[text[i]]) i++;
+        size_t start = i;
+        while (i < length && word_chars[text[i]]) i++;
         
-        if (isalnum(ch) || ch == '\'' || ch == '-') {
-            // Build word
-            if (word_pos < MAX_WORD_LENGTH - 1) {
-                word[word_pos++] = ch;
-            }
-        } else if (word_pos > 0) {
-            // End of word
-            word[word_pos] = '\0';
-            process_word(ts, word);
-            word_pos = 0;
-            
-            // Progress indicator
-            if (ts->total_words % 10000 == 0) {
-                printf("\rProcessed %d words, %d patterns", 
-                       ts->total_words, ts->total_patterns);
-                fflush(stdout);
-            }
+        size_t word_len = i - start;
+        if (word_len == 0) break;
+        if (word_len > MAX_WORD_LENGTH - 1) word_len = MAX_WORD_LENGTH - 1;
+        
+        if (i == length) {
+            for (size_t k = 0; k < word_len; k++) ts->word[k] = (char)word_chars[text[start + k]];
+            ts->word_len = (int)word_len;
+        } else {
+            process_token(ts, vocab_intern_lower(ts->vocab, data + start, word_len));
         }
     }
-    
-    // Process last word if any
-    if (word_pos > 0) {
-        word[word_pos] = '\0';
-        process_word(ts, word);
+}
+
+// Process last word if any
+static void stream_end(TrainingSystem* ts) {
+    if (ts->word_len > 0) {
+        process_token(ts, vocab_intern_lower(ts->vocab, ts->word, ts->word_len));
+        ts->word_len = 0;
     }
-    
-    clock_t end = clock();
-    double cpu_time = ((double)(end - start)) / CLOCKS_PER_SEC;
-    
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_progress(TrainingSystem* ts) {
+    printf("\rProcessed %zu words, %d patterns, %.1f MB", 
+           ts->total_words, ts->total_patterns, ts->total_bytes / (1024.0 * 1024.0));
+    fflush(stdout);
+}
+
+static void print_training_summary(TrainingSystem* ts, size_t words, size_t bytes, double seconds) {
+    if (seconds <= 0) seconds = 1e-9;
     printf("\n\nTraining complete:\n");
-    printf("- Words processed: %d\n", ts->total_words);
+    printf("- Words processed: %zu\n", words);
     printf("- Patterns learned: %d\n", ts->total_patterns);
-    printf("- Time: %.2f seconds\n", cpu_time);
-    printf("- Rate: %.0f words/second\n", ts->total_words / cpu_time);
+    printf("- Bytes read: %.2f MB\n", bytes / (1024.0 * 1024.0));
+    printf("- Time: %.2f seconds\n", seconds);
+    printf("- Rate: %.0f words/second\n", words / seconds);
+    printf("- Throughput: %.1f MB/second\n", bytes / (1024.0 * 1024.0) / seconds);
+}
+
+// Stream processing - handle any size input in STREAM_BUFFER_SIZE blocks
+void train_from_stream(TrainingSystem* ts, FILE* stream) {
+    char* buffer = malloc(STREAM_BUFFER_SIZE);
+    if (!buffer) return;
+    
+    printf("Training from stream...\n");
+    size_t words = ts->total_words, bytes = ts->total_bytes;
+    double start = now_seconds();
+    
+    size_t n;
+    while ((n = fread(buffer, 1, STREAM_BUFFER_SIZE, stream)) > 0) {
+        stream_block(ts, buffer, n);
+        print_progress(ts);
+    }
+    stream_end(ts);
+    
+    print_training_summary(ts, ts->total_words - words, ts->total_bytes - bytes, now_seconds() - start);
+    free(buffer);
 }
 
-// Train from file
+// Train from file, with read() straight into the block buffer
 void train_from_file(TrainingSystem* ts, const char* filename) {
-    FILE* f = fopen(filename, "r");
-    if (!f) {
+    int fd = strcmp(filename, "-") == 0 ? STDIN_FILENO : open(filename, O_RDONLY);
+    if (fd < 0) {
         printf("Cannot open file: %s\n", filename);
         return;
     }
+    char* buffer = malloc(STREAM_BUFFER_SIZE);
+    if (!buffer) {
+        if (fd != STDIN_FILENO) close(fd);
+        return;
+    }
+    
+    printf("Training from %s...\n", filename);
+    size_t words = ts->total_words, bytes = ts->total_bytes;
+    double start = now_seconds();
+    
+    ssize_t n;
+    while ((n = read(fd, buffer, STREAM_BUFFER_SIZE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            printf("\nRead error in %s\n", filename);
+            break;
+        }
+        stream_block(ts, buffer, (size_t)n);
+        print_progress(ts);
+    }
+    stream_end(ts);
     
-    train_from_stream(ts, f);
-    fclose(f);
+    print_training_summary(ts, ts->total_words - words, ts->total_bytes - bytes, now_seconds() - start);
+    free(buffer);
+    if (fd != STDIN_FILENO) close(fd);
 }
 
 // Train from string (for testing)
@@ -239,28 +346,42 @@ void show_stats(TrainingSystem* ts) {
     // Calculate memory usage
     size_t pattern_memory = ts->total_patterns * sizeof(Pattern);
     size_t table_memory = HASH_SIZE * sizeof(Pattern*);
-    size_t total_memory = pattern_memory + table_memory + sizeof(TrainingSystem);
+    size_t vocab_memory = vocab_memory_usage(ts->vocab);
+    size_t total_memory = pattern_memory + table_memory + vocab_memory + sizeof(TrainingSystem);
     
     printf("Memory usage:\n");
     printf("- Pattern storage: %.2f MB\n", pattern_memory / (1024.0 * 1024.0));
     printf("- Hash table: %.2f KB\n", table_memory / 1024.0);
+    printf("- Vocabulary: %.2f KB (%u words)\n", vocab_memory / 1024.0, vocab_size(ts->vocab));
     printf("- Total: %.2f MB\n", total_memory / (1024.0 * 1024.0));
     
-    // Calculate hash efficiency
+    // Calculate hash efficiency. histogram[n] counts chains of n patterns,
+    // with longer chains in the last row. Every continuation of a context
+    // shares its address, so chains also count contexts: patterns whose
+    // word pair is new to the chain, the collisions the hash controls.
     int used_buckets = 0;
     int max_chain = 0;
+    int contexts = 0;
+    int max_contexts = 0;
+    int histogram[CHAIN_HISTOGRAM_MAX + 2] = {0};
     
     for (int i = 0; i < HASH_SIZE; i++) {
-        if (ts->patterns[i]) {
-            used_buckets++;
-            int chain_len = 0;
-            Pattern* p = ts->patterns[i];
-            while (p) {
-                chain_len++;
-                p = p->collision_next;
+        int chain_len = 0;
+        int chain_contexts = 0;
+        for (Pattern* p = ts->patterns[i]; p; p = p->collision_next) {
+            Pattern* q = ts->patterns[i];
+            while (q != p && (strcmp(q->word1, p->word1) != 0 || strcmp(q->word2, p->word2) != 0)) {
+                q = q->collision_next;
             }
-            if (chain_len > max_chain) max_chain = chain_len;
+            if (q == p) chain_contexts++;
+            chain_len++;
         }
+        
+        if (chain_len > 0) used_buckets++;
+        if (chain_len > max_chain) max_chain = chain_len;
+        if (chain_contexts > max_contexts) max_contexts = chain_contexts;
+        contexts += chain_contexts;
+        histogram[chain_len > CHAIN_HISTOGRAM_MAX ? CHAIN_HISTOGRAM_MAX + 1 : chain_len]++;
     }
     
     printf("\nHash efficiency:\n");
@@ -268,10 +389,26 @@ void show_stats(TrainingSystem* ts) {
            used_buckets, HASH_SIZE, (used_buckets * 100.0) / HASH_SIZE);
     printf("- Max collision chain: %d\n", max_chain);
     printf("- Average chain length: %.2f\n", 
-           (float)ts->total_patterns / used_buckets);
+           used_buckets ? (float)ts->total_patterns / used_buckets : 0);
+    
+    // A uniform hash spreads contexts Poisson-like around the load factor,
+    // so the most crowded bucket stays small; a long tail means clustering
+    printf("- Contexts: %d (load factor %.2f), at most %d in one bucket\n",
+           contexts, (double)contexts / HASH_SIZE, max_contexts);
+    
+    printf("\nChain length histogram:\n");
+    for (int n = 0; n <= CHAIN_HISTOGRAM_MAX + 1; n++) {
+        if (histogram[n] == 0) continue;
+        printf("- %s%d: %d buckets (%.1f%%)\n", n > CHAIN_HISTOGRAM_MAX ? ">" : "",
+               n > CHAIN_HISTOGRAM_MAX ? CHAIN_HISTOGRAM_MAX : n, histogram[n], (histogram[n] * 100.0) / HASH_SIZE);
+    }
 }
 
-int main() {
+// The demo; benchmark_pattern_store measures this file's pattern table
+// through benchmark_trigram_store.c, which defines
+// TEXT_TRAINING_SYSTEM_NO_MAIN before including it
+#ifndef TEXT_TRAINING_SYSTEM_NO_MAIN
+int main(int argc, char* argv[]) {
     printf("gaia Text Training System\n");
     printf("=========================\n\n");
     
@@ -305,9 +442,14 @@ int main() {
     generate_text(ts, "logic gates", 10);
     generate_text(ts, "the system", 10);
     
-    // Demo 3: Train from file (if available)
+    // Demo 3: Train from files given on the command line ("-" for stdin)
     printf("\nDemo 3: File training\n");
-    printf("To train from file: train_from_file(ts, \"corpus.txt\")\n");
+    if (argc < 2) {
+        printf("To train from file: %s corpus.txt [more.txt ...]\n", argv[0]);
+    }
+    for (int i = 1; i < argc; i++) {
+        train_from_file(ts, argv[i]);
+    }
     
     // Show efficiency
     show_stats(ts);
@@ -317,22 +459,13 @@ int main() {
     printf("2. Streaming processing - handles any file size\n");
     printf("3. No in-memory dataset required\n");
     printf("4. Incremental learning as data arrives\n");
-    printf("5. Each pattern has associated gate\n");
+    printf("5. Patterns are bare counts, with no gate of their own\n");
     printf("6. Memory efficient - only stores unique patterns\n");
     
     // Cleanup
-    for (int i = 0; i < HASH_SIZE; i++) {
-        Pattern* p = ts->patterns[i];
-        while (p) {
-            Pattern* next = p->collision_next;
-            if (p->gate) gate_destroy(p->gate);
-            free(p);
-            p = next;
-        }
-    }
-    if (ts->learning_rate_gate) gate_destroy(ts->learning_rate_gate);
-    free(ts);
+    destroy_training_system(ts);
     
     gate_registry_cleanup();
     return 0;
-}
\ No newline at end of file
+}
+#endif // TEXT_TRAINING_SYSTEM_NO_MAIN
@@ -0,0 +1,111 @@
+#include "tokenizer.h"
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const char delimiters[] = TOKEN_DELIMITERS;
+#define NUM_DELIMITERS (sizeof(delimiters) - 1)
+
+// Byte -> 1 for TOKEN_DELIMITERS, filled in before main so readers on any
+// thread see it complete
+static unsigned char delimiter_table[256];
+
+__attribute__((constructor))
+static void build_delimiter_table(void) {
+    for (size_t i = 0; i < NUM_DELIMITERS; i++) {
+        delimiter_table[(unsigned char)delimiters[i]] = 1;
+    }
+}
+
+#if defined(__SSE2__)
+// Bitmask of the delimiters among the 16 bytes at p. The loop has a
+// constant trip count and unrolls into one compare per delimiter.
+static inline uint32_t delimiter_mask(const char* p) {
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    __m128i m = _mm_setzero_si128();
+    for (size_t i = 0; i < NUM_DELIMITERS; i++) {
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(delimiters[i])));
+    }
+    return (uint32_t)_mm_movemask_epi8(m);
+}
+#endif
+
+// First position at or after pos whose delimiter class is not skip
+static size_t scan(const char* text, size_t length, size_t pos, int skip) {
+#if defined(__SSE2__)
+    // Sixteen bytes at a time, finishing the tail with the table
+    while (pos + 16 <= length) {
+        uint32_t mask = delimiter_mask(text + pos);
+        if (skip) mask = ~mask & 0xFFFF;
+        if (mask) return pos + __builtin_ctz(mask);
+        pos += 16;
+    }
+#endif
+    while (pos < length && delimiter_table[(unsigned char)text[pos]] == skip) {
+        pos++;
+    }
+    return pos;
+}
+
+void token_stream_init(TokenStream* stream, const char* text, size_t length) {
+    stream->text = text;
+    stream->length = length;
+    stream->pos = 0;
+}
+
+int token_stream_next(TokenStream* stream, TokenSpan* span) {
+    size_t start = scan(stream->text, stream->length, stream->pos, 1);
+    if (start >= stream->length) {
+        stream->pos = stream->length;
+        return 0;
+    }
+    
+    size_t end = scan(stream->text, stream->length, start, 0);
+    span->start = start;
+    span->length = end - start;
+    stream->pos = end;
+    return 1;
+}
+
+int tokenize_spans(const char* text, size_t length, TokenSpan* spans, int max_spans) {
+    TokenStream stream;
+    token_stream_init(&stream, text, length);
+    
+    int count = 0;
+    while (count < max_spans && token_stream_next(&stream, &spans[count])) {
+        count++;
+    }
+    return count;
+}
+
+int tokenize_intern(Vocabulary* vocab, const char* text, size_t length, uint32_t* ids, int max_ids) {
+    TokenStream stream;
+    TokenSpan span;
+    token_stream_init(&stream, text, length);
+    
+    int count = 0;
+    while (count < max_ids && token_stream_next(&stream, &span)) {
+        ids[count++] = vocab_intern_lower(vocab, text + span.start, span.length);
+    }
+    return count;
+}
+
+int tokenize_lookup(const Vocabulary* vocab, const char* text, size_t length, uint32_t* ids, int max_ids) {
+    TokenStream stream;
+    TokenSpan span;
+    token_stream_init(&stream, text, length);
+    
+    int count = 0;
+    while (count < max_ids && token_stream_next(&stream, &span)) {
+        ids[count++] = vocab_lookup_lower(vocab, text + span.start, span.length);
+    }
+    return count;
+}
+
+void token_copy(char* dst, size_t size, const char* text, TokenSpan span) {
+    size_t length = span.length < size - 1 ? span.length : size - 1;
+    memcpy(dst, text + span.start, length);
+    dst[length] = '\0';
+}
@@ -0,0 +1,38 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "vocabulary.h"
+
+// Word delimiters shared by every chat generation
+#define TOKEN_DELIMITERS " \t\n\r.,!?;:"
+
+// A token as a byte range of the caller's text; nothing is copied
+typedef struct {
+    size_t start;
+    size_t length;
+} TokenSpan;
+
+// Cursor over text of any length, so long lines are never cut off
+typedef struct {
+    const char* text;
+    size_t length;
+    size_t pos;
+} TokenStream;
+
+void token_stream_init(TokenStream* stream, const char* text, size_t length);
+int token_stream_next(TokenStream* stream, TokenSpan* span);
+
+// Split text into at most max_spans tokens
+int tokenize_spans(const char* text, size_t length, TokenSpan* spans, int max_spans);
+
+// Split text straight into lowercase word IDs. tokenize_intern adds new
+// words; tokenize_lookup maps them to VOCAB_NONE.
+int tokenize_intern(Vocabulary* vocab, const char* text, size_t length, uint32_t* ids, int max_ids);
+int tokenize_lookup(const Vocabulary* vocab, const char* text, size_t length, uint32_t* ids, int max_ids);
+
+// Copy a token into a fixed buffer, truncating to size - 1 bytes
+void token_copy(char* dst, size_t size, const char* text, TokenSpan span);
+
+#endif // TOKENIZER_H
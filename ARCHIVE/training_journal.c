@@ -0,0 +1,121 @@
+#include "training_journal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Reads the header line; returns 1 and the generation if it is a journal
+static int read_header(FILE* file, uint32_t* generation) {
+    char magic[16];
+    unsigned int value;
+    if (fscanf(file, "%15s %u", magic, &value) != 2) return 0;
+    if (strcmp(magic, JOURNAL_MAGIC) != 0 || fgetc(file) != '\n') return 0;
+    *generation = value;
+    return 1;
+}
+
+static int write_header(FILE* file, uint32_t generation) {
+    if (fprintf(file, "%s %u\n", JOURNAL_MAGIC, generation) < 0) return 0;
+    return fflush(file) == 0;
+}
+
+// Length of the file up to and including its last newline
+static off_t complete_length(FILE* file) {
+    char buffer[4096];
+    off_t position = 0, complete = 0;
+    size_t got;
+    
+    rewind(file);
+    while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        for (size_t i = 0; i < got; i++) {
+            if (buffer[i] == '\n') complete = position + (off_t)i + 1;
+        }
+        position += (off_t)got;
+    }
+    return complete;
+}
+
+TrainingJournal* journal_open(const char* path, uint32_t generation) {
+    TrainingJournal* journal = calloc(1, sizeof(TrainingJournal));
+    if (!journal) return NULL;
+    
+    journal->path = strdup(path);
+    journal->generation = generation;
+    if (!journal->path) {
+        free(journal);
+        return NULL;
+    }
+    
+    // Keep an existing journal only if it extends this snapshot. A torn
+    // last line is cut off first, or the next line appended would be
+    // glued to it and replayed as one.
+    uint32_t existing;
+    FILE* file = fopen(path, "r");
+    int current = file && read_header(file, &existing) && existing == generation;
+    int intact = !current || truncate(path, complete_length(file)) == 0;
+    if (file) fclose(file);
+    
+    journal->file = intact ? fopen(path, current ? "a" : "w") : NULL;
+    if (!journal->file || (!current && !write_header(journal->file, generation))) {
+        journal_close(journal);
+        return NULL;
+    }
+    
+    return journal;
+}
+
+void journal_close(TrainingJournal* journal) {
+    if (!journal) return;
+    if (journal->file) fclose(journal->file);
+    free(journal->path);
+    free(journal);
+}
+
+int journal_append(TrainingJournal* journal, const char* line) {
+    if (!journal->file) return 0;
+    
+    size_t length = strcspn(line, "\n");
+    if (length >= JOURNAL_MAX_LINE) length = JOURNAL_MAX_LINE - 1;
+    
+    if (fwrite(line, 1, length, journal->file) != length || fputc('\n', journal->file) == EOF) return 0;
+    if (fflush(journal->file) != 0) return 0;
+    
+    journal->num_lines++;
+    return 1;
+}
+
+int journal_reset(TrainingJournal* journal, uint32_t generation) {
+    // Truncate through a fresh handle; the snapshot already holds every line
+    FILE* file = freopen(journal->path, "w", journal->file);
+    journal->file = file;
+    if (!file || !write_header(file, generation)) return 0;
+    
+    // Make the new header durable before more lines are appended
+    fsync(fileno(file));
+    journal->generation = generation;
+    journal->num_lines = 0;
+    return 1;
+}
+
+size_t journal_replay(const char* path, uint32_t generation, JournalVisitor visit, void* context) {
+    FILE* file = fopen(path, "r");
+    if (!file) return 0;
+    
+    uint32_t existing;
+    if (!read_header(file, &existing) || existing != generation) {
+        fclose(file);
+        return 0;
+    }
+    
+    char line[JOURNAL_MAX_LINE + 1];
+    size_t replayed = 0;
+    while (fgets(line, sizeof(line), file)) {
+        size_t length = strlen(line);
+        if (length == 0 || line[length - 1] != '\n') break;   // Torn write
+        line[length - 1] = '\0';
+        visit(line, context);
+        replayed++;
+    }
+    
+    fclose(file);
+    return replayed;
+}
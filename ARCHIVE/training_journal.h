@@ -0,0 +1,40 @@
+#ifndef TRAINING_JOURNAL_H
+#define TRAINING_JOURNAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Append-only log of training lines ingested since the last snapshot. The
+// first line names the snapshot generation the journal extends, so a
+// journal left behind by an interrupted compaction is never replayed twice.
+#define JOURNAL_MAGIC "GAIAJNL"
+#define JOURNAL_MAX_LINE 4096
+
+typedef struct {
+    FILE* file;
+    char* path;
+    uint32_t generation;
+    size_t num_lines;          // Lines appended since the journal was opened
+} TrainingJournal;
+
+// Called with each replayed line, without its newline
+typedef void (*JournalVisitor)(const char* line, void* context);
+
+// Opens path for appending. An existing journal for another generation is
+// stale and is started over; a torn last line in a current one is dropped.
+TrainingJournal* journal_open(const char* path, uint32_t generation);
+void journal_close(TrainingJournal* journal);
+
+// Appends one line and flushes it to the file
+int journal_append(TrainingJournal* journal, const char* line);
+
+// Empties the journal after its lines were folded into a new snapshot
+int journal_reset(TrainingJournal* journal, uint32_t generation);
+
+// Replays a journal written for generation. Returns the number of lines
+// replayed, 0 if the journal is missing or stale. A torn last line left by
+// a crash is skipped.
+size_t journal_replay(const char* path, uint32_t generation, JournalVisitor visit, void* context);
+
+#endif // TRAINING_JOURNAL_H
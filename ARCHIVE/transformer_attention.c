@@ -1,4 +1,5 @@
 #include "transformer_attention.h"
+#include "tokenizer.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -52,19 +53,16 @@ void init_transformer_weights(TransformerLayer* layer) {
 int tokenize_for_attention(const char* input, Token* tokens, int max_tokens) {
     if (!input || !tokens) return 0;
     
-    char temp[1024];
-    strncpy(temp, input, 1023);
-    temp[1023] = '\0';
+    // Stream over the whole input; only the kept words are copied
+    TokenStream stream;
+    TokenSpan span;
+    token_stream_init(&stream, input, strlen(input));
     
     int count = 0;
-    char* word = strtok(temp, " \t\n.,!?;:");
-    
-    while (word && count < max_tokens) {
-        strncpy(tokens[count].word, word, 49);
-        tokens[count].word[49] = '\0';
+    while (count < max_tokens && token_stream_next(&stream, &span)) {
+        token_copy(tokens[count].word, sizeof(tokens[count].word), input, span);
         tokens[count].position = count;
         count++;
-        word = strtok(NULL, " \t\n.,!?;:");
     }
     
     return count;
@@ -133,7 +131,7 @@ void softmax(float* scores, int length) {
 
 // Compute attention for a single head
 void compute_single_head_attention(AttentionContext* ctx, int head_idx) {
-    AttentionHead* head = &ctx->layer->heads[head_idx];
+    float (*scores)[MAX_SEQ_LENGTH] = ctx->attention_scores[head_idx];
     int num_tokens = ctx->num_tokens;
     
     // Temporary arrays for Q, K, V
@@ -167,11 +165,11 @@ void compute_single_head_attention(AttentionContext* ctx, int head_idx) {
             for (int k = 0; k < HEAD_DIM; k++) {
                 score += queries[i][k] * keys[j][k];
             }
-            head->attention_scores[i][j] = score * scale;
+            scores[i][j] = score * scale;
         }
         
         // Apply softmax to get attention weights
-        softmax(head->attention_scores[i], num_tokens);
+        softmax(scores[i], num_tokens);
     }
     
     // Apply attention to values
@@ -179,7 +177,7 @@ void compute_single_head_attention(AttentionContext* ctx, int head_idx) {
         for (int j = 0; j < HEAD_DIM; j++) {
             float sum = 0.0;
             for (int k = 0; k < num_tokens; k++) {
-                sum += head->attention_scores[i][k] * values[k][j];
+                sum += scores[i][k] * values[k][j];
             }
             ctx->output[i][head_start + j] = sum;
         }
@@ -312,7 +310,8 @@ float calculate_relevance(const char* query, const char* response) {
     int matches = 0;
     int total_words = 0;
     
-    char* word = strtok(query_lower, " \t\n.,!?;:");
+    char* save;
+    char* word = strtok_r(query_lower, " \t\n.,!?;:", &save);
     while (word) {
         if (strlen(word) > 2) { // Skip short words
             if (strstr(response_lower, word)) {
@@ -320,7 +319,7 @@ float calculate_relevance(const char* query, const char* response) {
             }
             total_words++;
         }
-        word = strtok(NULL, " \t\n.,!?;:");
+        word = strtok_r(NULL, " \t\n.,!?;:", &save);
     }
     
     return total_words > 0 ? (float)matches / total_words : 0.5;
@@ -530,7 +529,10 @@ int should_continue_refinement(RefinementContext* ctx) {
 }
 
 // Print attention matrix for visualization
-void print_attention_matrix(AttentionHead* head, Token* tokens, int num_tokens) {
+void print_attention_matrix(AttentionContext* ctx, int head_idx) {
+    AttentionHead* head = &ctx->layer->heads[head_idx];
+    Token* tokens = ctx->tokens;
+    int num_tokens = ctx->num_tokens;
     printf("\nAttention Matrix (Head %d - %s):\n", head->head_index,
            head->type == ATTN_PATTERN ? "PATTERN" :
            head->type == ATTN_SYNTAX ? "SYNTAX" :
@@ -547,7 +549,7 @@ void print_attention_matrix(AttentionHead* head, Token* tokens, int num_tokens)
     for (int i = 0; i < num_tokens && i < 10; i++) {
         printf("%-8.8s", tokens[i].word);
         for (int j = 0; j < num_tokens && j < 10; j++) {
-            float score = head->attention_scores[i][j];
+            float score = ctx->attention_scores[head_idx][i][j];
             if (score > 0.3) {
                 printf("\033[1;31m"); // Red for high attention
             } else if (score > 0.1) {
@@ -614,12 +616,10 @@ float get_attention_confidence(AttentionContext* ctx) {
     
     // Analyze attention patterns across all heads
     for (int h = 0; h < NUM_HEADS; h++) {
-        AttentionHead* head = &ctx->layer->heads[h];
-        
         // Count strong attention connections
         for (int i = 0; i < ctx->num_tokens; i++) {
             for (int j = 0; j < ctx->num_tokens; j++) {
-                if (head->attention_scores[i][j] > 0.3) {
+                if (ctx->attention_scores[h][i][j] > 0.3) {
                     num_strong_connections++;
                 }
             }
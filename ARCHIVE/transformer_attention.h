@@ -29,7 +29,6 @@ typedef struct {
 // Attention head
 typedef struct {
     int head_index;
-    float attention_scores[MAX_SEQ_LENGTH][MAX_SEQ_LENGTH];
     AttentionType type;
     float importance_weight;
 } AttentionHead;
@@ -86,11 +85,13 @@ typedef struct {
     int history_count;
 } RefinementContext;
 
-// Attention context for processing
+// Attention context for processing. Scores and output are kept here rather
+// than in the layer, so one layer can serve any number of contexts at once.
 typedef struct {
     Token* tokens;
     int num_tokens;
-    TransformerLayer* layer;
+    TransformerLayer* layer;     // Only read
+    float attention_scores[NUM_HEADS][MAX_SEQ_LENGTH][MAX_SEQ_LENGTH];
     float output[MAX_SEQ_LENGTH][HIDDEN_DIM];
 } AttentionContext;
 
@@ -133,7 +134,7 @@ char* apply_refinement_suggestions_v8(const char* response, ResponseAnalysis* an
 int should_continue_refinement(RefinementContext* ctx);
 
 // Visualization and debugging
-void print_attention_matrix(AttentionHead* head, Token* tokens, int num_tokens);
+void print_attention_matrix(AttentionContext* ctx, int head_idx);
 void visualize_attention_patterns(AttentionContext* ctx);
 char* explain_attention_focus(AttentionHead* head, Token* tokens, int num_tokens);
 
@@ -0,0 +1,232 @@
+#include "vocabulary.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VOCAB_INITIAL_WORDS 1024
+#define VOCAB_INITIAL_SLOTS 2048
+#define VOCAB_STRING_BLOCK_SIZE (16 * 1024)
+
+// DJB2 over the word's characters
+uint32_t vocab_hash(const char* word) {
+    uint32_t hash = 5381;
+    for (const unsigned char* p = (const unsigned char*)word; *p; p++) {
+        hash = ((hash << 5) + hash) + *p;
+    }
+    return hash;
+}
+
+Vocabulary* vocab_create(void) {
+    Vocabulary* vocab = calloc(1, sizeof(Vocabulary));
+    if (!vocab) return NULL;
+    
+    vocab->capacity = VOCAB_INITIAL_WORDS;
+    vocab->words = malloc(vocab->capacity * sizeof(char*));
+    vocab->hashes = malloc(vocab->capacity * sizeof(uint32_t));
+    vocab->num_slots = VOCAB_INITIAL_SLOTS;
+    vocab->slots = calloc(vocab->num_slots, sizeof(uint32_t));
+    vocab->strings = arena_create(VOCAB_STRING_BLOCK_SIZE);
+    
+    if (!vocab->words || !vocab->hashes || !vocab->slots || !vocab->strings) {
+        vocab_destroy(vocab);
+        return NULL;
+    }
+    
+    return vocab;
+}
+
+void vocab_destroy(Vocabulary* vocab) {
+    if (!vocab) return;
+    
+    arena_destroy(vocab->strings);
+    free(vocab->words);
+    free(vocab->hashes);
+    free(vocab->slots);
+    free(vocab);
+}
+
+// ASCII lowercase, as tolower in the C locale
+static inline unsigned char fold_lower(unsigned char c) {
+    return (unsigned char)(c - 'A') < 26 ? c + ('a' - 'A') : c;
+}
+
+// vocab_hash of the lowercase form of text[0..length)
+static uint32_t hash_lower(const char* text, size_t length) {
+    uint32_t hash = 5381;
+    for (size_t i = 0; i < length; i++) {
+        hash = ((hash << 5) + hash) + fold_lower((unsigned char)text[i]);
+    }
+    return hash;
+}
+
+// Like find_slot, for the lowercase form of an unterminated span
+static uint32_t find_slot_lower(const Vocabulary* vocab, const char* text, size_t length, uint32_t hash) {
+    uint32_t mask = vocab->num_slots - 1;
+    uint32_t pos = hash & mask;
+    
+    while (vocab->slots[pos]) {
+        uint32_t id = vocab->slots[pos] - 1;
+        if (vocab->hashes[id] == hash) {
+            const unsigned char* word = (const unsigned char*)vocab->words[id];
+            size_t i = 0;
+            while (i < length && word[i] == fold_lower((unsigned char)text[i])) i++;
+            if (i == length && word[i] == '\0') return pos;
+        }
+        pos = (pos + 1) & mask;
+    }
+    
+    return pos;
+}
+
+// Find the slot holding word, or the empty slot where it would go
+static uint32_t find_slot(const Vocabulary* vocab, const char* word, uint32_t hash) {
+    uint32_t mask = vocab->num_slots - 1;
+    uint32_t pos = hash & mask;
+    
+    while (vocab->slots[pos]) {
+        uint32_t id = vocab->slots[pos] - 1;
+        if (vocab->hashes[id] == hash && strcmp(vocab->words[id], word) == 0) {
+            return pos;
+        }
+        pos = (pos + 1) & mask;
+    }
+    
+    return pos;
+}
+
+// Double the slot index, keeping load below 50%
+static int grow_slots(Vocabulary* vocab) {
+    uint32_t new_num_slots = vocab->num_slots * 2;
+    uint32_t* new_slots = calloc(new_num_slots, sizeof(uint32_t));
+    if (!new_slots) return 0;
+    
+    uint32_t mask = new_num_slots - 1;
+    for (uint32_t id = 0; id < vocab->num_words; id++) {
+        uint32_t pos = vocab->hashes[id] & mask;
+        while (new_slots[pos]) {
+            pos = (pos + 1) & mask;
+        }
+        new_slots[pos] = id + 1;
+    }
+    
+    free(vocab->slots);
+    vocab->slots = new_slots;
+    vocab->num_slots = new_num_slots;
+    return 1;
+}
+
+// Room for one more ID
+static int reserve_id(Vocabulary* vocab) {
+    if (vocab->num_words < vocab->capacity) return 1;
+    
+    uint32_t new_capacity = vocab->capacity * 2;
+    char** new_words = realloc(vocab->words, new_capacity * sizeof(char*));
+    if (!new_words) return 0;
+    vocab->words = new_words;
+    
+    uint32_t* new_hashes = realloc(vocab->hashes, new_capacity * sizeof(uint32_t));
+    if (!new_hashes) return 0;
+    vocab->hashes = new_hashes;
+    
+    vocab->capacity = new_capacity;
+    return 1;
+}
+
+// Give a stored word the next ID at its empty slot
+static uint32_t add_word(Vocabulary* vocab, uint32_t pos, char* word, uint32_t hash) {
+    uint32_t id = vocab->num_words++;
+    vocab->words[id] = word;
+    vocab->hashes[id] = hash;
+    vocab->slots[pos] = id + 1;
+    
+    if (vocab->num_words * 2 > vocab->num_slots) {
+        if (!grow_slots(vocab)) {
+            printf("Warning: vocabulary index could not grow\n");
+        }
+    }
+    
+    return id;
+}
+
+static uint32_t intern_word(Vocabulary* vocab, const char* word, int copy_word) {
+    if (!vocab || !word) return VOCAB_NONE;
+    
+    uint32_t hash = vocab_hash(word);
+    uint32_t pos = find_slot(vocab, word, hash);
+    if (vocab->slots[pos]) {
+        return vocab->slots[pos] - 1;
+    }
+    
+    if (!reserve_id(vocab)) return VOCAB_NONE;
+    
+    char* copy = copy_word ? arena_strdup(vocab->strings, word) : (char*)word;
+    if (!copy) return VOCAB_NONE;
+    if (copy_word) vocab->string_bytes += strlen(copy) + 1;
+    
+    return add_word(vocab, pos, copy, hash);
+}
+
+uint32_t vocab_intern(Vocabulary* vocab, const char* word) {
+    return intern_word(vocab, word, 1);
+}
+
+// Intern a word whose storage outlives the vocabulary, such as a string in
+// a mapped model file, without copying it
+uint32_t vocab_intern_static(Vocabulary* vocab, const char* word) {
+    return intern_word(vocab, word, 0);
+}
+
+// Intern the lowercase form of text[0..length). The text is only copied
+// when the word is new, so tokens can be interned straight from the input.
+uint32_t vocab_intern_lower(Vocabulary* vocab, const char* text, size_t length) {
+    if (!vocab || !text) return VOCAB_NONE;
+    
+    uint32_t hash = hash_lower(text, length);
+    uint32_t pos = find_slot_lower(vocab, text, length, hash);
+    if (vocab->slots[pos]) {
+        return vocab->slots[pos] - 1;
+    }
+    
+    if (!reserve_id(vocab)) return VOCAB_NONE;
+    
+    char* copy = arena_alloc(vocab->strings, length + 1);
+    if (!copy) return VOCAB_NONE;
+    for (size_t i = 0; i < length; i++) {
+        copy[i] = (char)fold_lower((unsigned char)text[i]);
+    }
+    copy[length] = '\0';
+    vocab->string_bytes += length + 1;
+    
+    return add_word(vocab, pos, copy, hash);
+}
+
+uint32_t vocab_lookup_lower(const Vocabulary* vocab, const char* text, size_t length) {
+    if (!vocab || !text) return VOCAB_NONE;
+    
+    uint32_t pos = find_slot_lower(vocab, text, length, hash_lower(text, length));
+    return vocab->slots[pos] ? vocab->slots[pos] - 1 : VOCAB_NONE;
+}
+
+uint32_t vocab_lookup(const Vocabulary* vocab, const char* word) {
+    if (!vocab || !word) return VOCAB_NONE;
+    
+    uint32_t pos = find_slot(vocab, word, vocab_hash(word));
+    return vocab->slots[pos] ? vocab->slots[pos] - 1 : VOCAB_NONE;
+}
+
+const char* vocab_word(const Vocabulary* vocab, uint32_t id) {
+    if (!vocab || id >= vocab->num_words) return NULL;
+    return vocab->words[id];
+}
+
+uint32_t vocab_size(const Vocabulary* vocab) {
+    return vocab ? vocab->num_words : 0;
+}
+
+size_t vocab_memory_usage(const Vocabulary* vocab) {
+    if (!vocab) return 0;
+    return sizeof(Vocabulary) +
+           vocab->capacity * (sizeof(char*) + sizeof(uint32_t)) +
+           vocab->num_slots * sizeof(uint32_t) +
+           sizeof(Arena) + vocab->strings->bytes_reserved;
+}
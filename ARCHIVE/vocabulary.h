@@ -0,0 +1,47 @@
+#ifndef VOCABULARY_H
+#define VOCABULARY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "arena.h"
+
+// Returned by vocab_lookup for words that were never interned
+#define VOCAB_NONE UINT32_MAX
+
+// Word -> ID interning table. IDs are dense and assigned in first-seen order,
+// so they can index side arrays directly.
+typedef struct {
+    char** words;          // ID -> word
+    uint32_t* hashes;      // ID -> cached string hash
+    uint32_t num_words;
+    uint32_t capacity;     // Size of words/hashes arrays
+    
+    uint32_t* slots;       // Open-addressing index: ID + 1, 0 = empty
+    uint32_t num_slots;    // Always a power of two
+    
+    size_t string_bytes;   // Bytes held by interned strings
+    Arena* strings;        // Owns the interned strings
+} Vocabulary;
+
+// Lifecycle
+Vocabulary* vocab_create(void);
+void vocab_destroy(Vocabulary* vocab);
+
+// Interning
+uint32_t vocab_intern(Vocabulary* vocab, const char* word);
+uint32_t vocab_intern_static(Vocabulary* vocab, const char* word);
+uint32_t vocab_lookup(const Vocabulary* vocab, const char* word);
+const char* vocab_word(const Vocabulary* vocab, uint32_t id);
+
+// Interning of unterminated text, folded to ASCII lowercase
+uint32_t vocab_intern_lower(Vocabulary* vocab, const char* text, size_t length);
+uint32_t vocab_lookup_lower(const Vocabulary* vocab, const char* text, size_t length);
+
+// Hash used by the index, also by saved models
+uint32_t vocab_hash(const char* word);
+
+// Statistics
+uint32_t vocab_size(const Vocabulary* vocab);
+size_t vocab_memory_usage(const Vocabulary* vocab);
+
+#endif // VOCABULARY_H